@@ -30,147 +30,239 @@
 #include "pico/time.h"
 
 //
+#include "scoppy-adc-timing.h"
 #include "scoppy-common.h"
 #include "scoppy-message.h"
 #include "scoppy-outgoing.h"
-#include "scoppy-ring-buffer.h"
+#include "scoppy-stream.h"
 #include "scoppy.h"
 
 //
 #include "pico-scoppy-cont-sampling.h"
 #include "pico-scoppy-samples.h"
 #include "pico-scoppy-util.h"
+#include "scoppy-pio.h"
 
-static struct repeating_timer timer;
-static struct repeating_timer *active_timer = NULL;
+//
+// Continuous (roll) mode. The ADC runs freely in round robin mode, paced by its clock divider, and a single DMA channel
+// copies each conversion from the ADC FIFO into ring_arr. The DMA wraps the write address at the end of the ring so the
+// CPU isn't involved at all until get_samples() reads whatever has been written since the last call.
+// See scoppy-adc-timing.h
+//
+
+// The DMA can wrap the write address on a power of 2 boundary up to 2^15 bytes. At 2 x 25kS/s this holds over 300ms of
+// samples which is plenty given that get_samples() is called every 100ms.
+#define RING_BITS 14
+#define RING_SIZE (1u << RING_BITS)
+static uint8_t ring_arr[RING_SIZE] __attribute__((aligned(RING_SIZE)));
+
+// The DMA runs until the transfer count reaches zero so start it as high as possible. Long before then (about 70 minutes
+// at 500kS/s) we restart it.
+#define DMA_TRANSFER_COUNT 0xFFFFFFFFu
+#define DMA_RESTART_COUNT 0x80000000u
 
-static uint8_t ring_buf1_arr[4098];
-static struct scoppy_uint8_ring_buffer ring_buf1;
-static uint8_t ring_buf2_arr[4098];
-static struct scoppy_uint8_ring_buffer ring_buf2;
+static int dma_chan = -1;
+static bool dma_running = false;
+static struct scoppy_adc_ring_reader reader;
 
-static struct scoppy_uint8_ring_buffer *active_buffer = &ring_buf1;
-static struct scoppy_uint8_ring_buffer *dormant_buffer = &ring_buf2;
+// Decimated samples are copied here before being sent
+static uint8_t decimated_arr[SCOPPY_OUTGOING_MAX_SAMPLE_BYTES / 2];
 
-// Using a flag rather than a mutex/sem etc 'cos we're only running on the one
-// core. This will probably have to change if we move to multicore
-static volatile bool request_buffer_swap = false;
+//
+// Streaming mode (RUN_MODE_STREAM) uses the same DMA ring but get_samples() is called as often as possible and
+// scoppy_stream_send() keeps track of exactly how many samples were sent and dropped. See scoppy-stream.h
+//
+static struct scoppy_stream stream;
 
 void pico_scoppy_continuous_sampling_init() {
     DEBUG_PRINT("  pico_scoppy_continuous_sampling_init()\n");
 
-    // don't use the first and last bytes of the array. We can check these for
-    // illegal writes outside of the buffer
-    scoppy_uint8_ring_buffer_init(&ring_buf1, ring_buf1_arr + 1, sizeof(ring_buf1_arr) - 2);
-    scoppy_uint8_ring_buffer_init(&ring_buf2, ring_buf2_arr + 1, sizeof(ring_buf2_arr) - 2);
+    dma_chan = dma_claim_unused_channel(true);
+    DEBUG_PRINT("    cont dma_chan=%d\n", dma_chan);
 }
 
-void pico_scoppy_get_continuous_samples(struct scoppy_context *ctx) {
-    //DEBUG_PRINT("get_continuous_samples()\n");
+// The total number of bytes written by the DMA since it was started
+static inline uint32_t dma_write_count() { return DMA_TRANSFER_COUNT - dma_channel_hw_addr(dma_chan)->transfer_count; }
 
-    // We need access to the buffer that is currently being used.
-    // However the timer callback might be called anytime in this method so we
-    // let the callback swap the buffers
-    assert(active_timer != NULL);
-    request_buffer_swap = true;
+static uint64_t stream_time_us() { return time_us_64(); }
 
-    //
-    // Wait for the next timer callback to swap the buffers
-    // Once swapped, we read from the dormant_buffer (the previously active buffer)
-    //
+static void start_dma(bool is_logic_mode) {
+    dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
 
-    while (request_buffer_swap)
-        ;
+    // Reading from constant address, writing to incrementing byte addresses that wrap at the end of the ring
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_ring(&cfg, true, RING_BITS);
 
-    if (request_buffer_swap) {
-        assert(0);
-        request_buffer_swap = false;
-        return;
-    }
+    // Pace transfers based on availability of ADC (or PIO) samples
+    channel_config_set_dreq(&cfg, is_logic_mode ? scoppy_pio_get_dreq() : DREQ_ADC);
+
+    dma_channel_configure(dma_chan, &cfg, ring_arr, is_logic_mode ? scoppy_pio_get_dma_read_addr() : &adc_hw->fifo, DMA_TRANSFER_COUNT, true);
+    dma_running = true;
+}
 
-    struct scoppy_uint8_ring_buffer *buf = dormant_buffer;
-    //DEBUG_PRINT("  buffer(%lu): size=%lu\n", (unsigned long)buf->get_id(buf), (unsigned long)buf->size(buf));
+// Round robin starts from the currently selected input so make that the first enabled channel. Otherwise the
+// channels would be out of order.
+static void select_first_channel() { adc_select_input(__builtin_ctz(active_params->enabled_channels)); }
 
-    if (buf->size == 0) {
-        return;
+static void stop_dma() {
+    if (dma_running) {
+        dma_channel_abort(dma_chan);
+        dma_running = false;
     }
+}
+
+void pico_scoppy_get_continuous_samples(struct scoppy_context *ctx) {
+    // DEBUG_PRINT("get_continuous_samples()\n");
+    assert(dma_running);
 
     struct sampling_params *params = active_params;
 
-    //DEBUG_PRINT("  seq=%lu, discarded=%d\n", (unsigned long)params->seq, (int)buf->has_discarded_samples(buf));
-    bool is_new_wavepoint_record = params->seq++ == 0 || buf->discarded_samples;
-    buf->clear_discarded_flag(buf);
+    // Send everything that has been written up to now. Samples written while we are sending will be sent next time.
+    uint32_t write_count = dma_write_count();
+    for (;;) {
+        struct scoppy_uint8_span span0 = {NULL, 0}, span1 = {NULL, 0};
+        if (params->decimation == 1) {
+            // Send the samples straight from the ring
+            if (scoppy_adc_ring_reader_get_spans(&reader, write_count, SCOPPY_OUTGOING_MAX_SAMPLE_BYTES, &span0, &span1) == 0) {
+                break;
+            }
+        } else {
+            uint32_t len = scoppy_adc_ring_reader_read(&reader, write_count, decimated_arr, sizeof(decimated_arr));
+            if (len == 0) {
+                break;
+            }
+            span0.ptr = decimated_arr;
+            span0.len = len;
+        }
+
+        // Set if samples were overwritten before we could read (or send) them
+        bool discarded_samples = reader.discarded_samples;
+        reader.discarded_samples = false;
+
+        // DEBUG_PRINT("  seq=%lu, discarded=%d\n", (unsigned long)params->seq, (int)discarded_samples);
+        bool is_new_wavepoint_record = params->seq++ == 0 || discarded_samples;
+
+        struct scoppy_outgoing *msg = scoppy_new_outgoing_samples_msg(params->realSampleRatePerChannel, active_params->channels, is_new_wavepoint_record,
+                                                                       false /* last message in frame */, true /* cont mode */, false /* single shot */,
+                                                                       -1 /* trigger index - we didn't search for a trigger sample */, false /* is_logic_mode */);
+        struct scoppy_iovec segments[2] = {{span0.ptr, span0.len}, {span1.ptr, span1.len}};
+        scoppy_write_outgoing_samples_msg(ctx->write_serial_v, msg, active_params->samples_msg_version, NULL, segments, span1.len > 0 ? 2 : 1);
+        scoppy_release_outgoing(msg);
+
+        uint32_t sent_from_count = reader.read_count - (span0.len + span1.len);
+        if (params->decimation == 1 && scoppy_adc_ring_reader_was_overwritten(&reader, sent_from_count, dma_write_count())) {
+            // The DMA caught up with us while we were sending. Let the app know there's a discontinuity.
+            reader.discarded_samples = true;
+        }
+    }
+
+    write_count = dma_write_count();
+    if (write_count >= DMA_RESTART_COUNT) {
+        // Start again before the transfer count runs out
+        DEBUG_PRINT("  restarting cont dma\n");
+        adc_run(false);
+        while (!(adc_hw->cs & ADC_CS_READY_BITS)) {
+            // wait for the current conversion to finish
+        }
+        stop_dma();
+        adc_fifo_drain();
+        select_first_channel();
+        start_dma(false);
+        scoppy_adc_ring_reader_init(&reader, ring_arr, RING_SIZE, params->num_enabled_channels, params->decimation);
+        reader.discarded_samples = true;
+        adc_run(true);
+    }
+}
 
-    struct scoppy_outgoing *msg = scoppy_new_outgoing_samples_msg(
-        params->realSampleRatePerChannel, active_params->channels, 
-        is_new_wavepoint_record, false /* last message in frame */, true /* cont mode */, false /* single shot */,
-        -1 /* trigger index - we didn't search for a trigger sample */, false /* is_logic_mode */);
-    msg->payload_len += buf->read_all(buf, msg->payload + msg->payload_len);
-    scoppy_write_outgoing(ctx->write_serial, msg);
+void pico_scoppy_get_streamed_samples(struct scoppy_context *ctx) {
+    assert(dma_running);
+
+    stream.write_serial_v = ctx->write_serial_v;
+    stream.samples_msg_version = active_params->samples_msg_version;
+    // Logic samples rarely change so only sending the changes lets us stream at much higher sample rates
+    stream.edge_mode = active_params->is_logic_mode && active_params->logic_edges;
+    scoppy_stream_send(&stream);
+
+    if (dma_write_count() >= DMA_RESTART_COUNT) {
+        // Start again before the transfer count runs out. Whatever hasn't been sent is counted as dropped.
+        DEBUG_PRINT("  restarting stream dma\n");
+        bool is_logic_mode = active_params->is_logic_mode;
+        if (is_logic_mode) {
+            scoppy_pio_stop();
+        } else {
+            adc_run(false);
+            while (!(adc_hw->cs & ADC_CS_READY_BITS)) {
+                // wait for the current conversion to finish
+            }
+        }
+        scoppy_stream_update_stats(&stream);
+        stop_dma();
+        if (is_logic_mode) {
+            scoppy_pio_prestart(active_params);
+            start_dma(true);
+            scoppy_pio_start();
+        } else {
+            adc_fifo_drain();
+            select_first_channel();
+            start_dma(false);
+            adc_run(true);
+        }
+        scoppy_stream_restart(&stream);
+    }
 }
 
 void pico_scoppy_stop_continuous_sampling() {
     DEBUG_PRINT("  pico_scoppy_stop_continuous_sampling()\n");
-    if (active_timer != NULL) {
-        DEBUG_PRINT("    stopping adc read timer\n");
-        cancel_repeating_timer(active_timer);
-        active_timer = NULL;
+    if (dma_running) {
+        DEBUG_PRINT("    stopping cont dma\n");
+        stop_dma();
     }
 }
 
-static bool adc_read_timer_callback(repeating_timer_t *rt) {
-
-    if (active_params->enabled_channels & 0x00000001) {
-        adc_select_input(0);
-        active_buffer->put(active_buffer, (adc_read() >> 4) & 0x00FF);
-    }
+void pico_scoppy_start_continuous_sampling() {
+    DEBUG_PRINT("  pico_scoppy_start_continuous_sampling()\n");
 
-    if (active_params->enabled_channels & 0x00000002) {
-        adc_select_input(1);
-        active_buffer->put(active_buffer, (adc_read() >> 4) & 0x00FF);
+    bool is_stream_mode = active_params->run_mode == RUN_MODE_STREAM;
+    if (is_stream_mode) {
+        uint8_t bytes_per_sample_set = active_params->is_logic_mode ? 1 : active_params->num_enabled_channels;
+        stream.get_write_count = dma_write_count;
+        stream.get_time_us = stream_time_us;
+        scoppy_stream_init(&stream, ring_arr, RING_SIZE, bytes_per_sample_set, active_params->realSampleRatePerChannel, active_params->channels,
+                           active_params->is_logic_mode);
+    } else {
+        scoppy_adc_ring_reader_init(&reader, ring_arr, RING_SIZE, active_params->num_enabled_channels, active_params->decimation);
     }
 
-    if (request_buffer_swap) {
-        // The get_samples() code wants to read the buffer
-        struct scoppy_uint8_ring_buffer *tmp = dormant_buffer;
-        dormant_buffer = active_buffer;
-        active_buffer = tmp;
-
-        // The buffer should have been emptied by the last get_samples()
-        assert(active_buffer->is_empty(active_buffer));
-        assert(active_buffer->has_discarded_samples(false));
-
-        request_buffer_swap = false;
+    if (active_params->is_logic_mode) {
+        // Only possible in stream mode. The trigger is never armed so the pio just samples continuously.
+        assert(is_stream_mode);
+        scoppy_pio_prestart(active_params);
+        start_dma(true);
+        scoppy_pio_start();
+        DEBUG_PRINT("    started stream pio dma: clkdivint=%lu\n", (unsigned long)active_params->clkdivint);
+        return;
     }
 
-    // keep repeating
-    return true;
-}
-
-void pico_scoppy_start_continuous_sampling(struct scoppy_context *ctx) {
-    DEBUG_PRINT("  pico_scoppy_start_continuous_sampling()\n");
-
-    // Disable the adc fifo and interrupt. These aren't used during continuous mode.
-    adc_fifo_setup(
-        false, // Write each completed conversion to the sample FIFO
-        false, // Enable DMA data request (DREQ)
-        1,     // DREQ (and IRQ) asserted when at least 1 sample present
-        false, // We won't see the ERR bit because of 8 bit reads; disable.
-        true   // Shift each sample to 8 bits when pushing to FIFO
+    adc_fifo_setup(true,  // Write each completed conversion to the sample FIFO
+                   true,  // Enable DMA data request (DREQ)
+                   1,     // DREQ (and IRQ) asserted when at least 1 sample present
+                   false, // We won't see the ERR bit because of 8 bit reads; disable.
+                   true   // Shift each sample to 8 bits when pushing to FIFO
     );
 
-    // negative timeout means exact delay (rather than delay between callbacks)
-    int64_t delay_us = -1000000L / (signed long)active_params->realSampleRatePerChannel;
+    adc_set_clkdiv((float)active_params->clkdivint);
 
-    assert(active_timer == NULL);
-    active_timer = &timer;
-    if (!add_repeating_timer_us(delay_us, adc_read_timer_callback, NULL, active_timer)) {
-        ERROR_PRINT("Failed to add adc read timer\n");
-        active_timer = NULL;
+    // adc_set_round_robin(active_params->enabled_channels); // bug in param check code means we can't call this when PARAM_ASSERTIONS_ENABLE_ALL is defined
+    uint input_mask = active_params->enabled_channels;
+    invalid_params_if(ADC, (input_mask << ADC_CS_RROBIN_LSB) & ~ADC_CS_RROBIN_BITS);
+    hw_write_masked(&adc_hw->cs, input_mask << ADC_CS_RROBIN_LSB, ADC_CS_RROBIN_BITS);
+    select_first_channel();
 
-        // TODO: call fatal error handler?
-        return;
-    }
+    start_dma(false);
+    adc_run(true);
 
-    DEBUG_PRINT("    added adc read timer with delay of %ldus\n", (long)delay_us);
+    DEBUG_PRINT("    started cont dma: clkdivint=%lu, decimation=%lu\n", (unsigned long)active_params->clkdivint,
+                (unsigned long)active_params->decimation);
 }
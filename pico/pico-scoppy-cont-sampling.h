@@ -27,4 +27,5 @@
 void pico_scoppy_continuous_sampling_init();
 void pico_scoppy_start_continuous_sampling();
 void pico_scoppy_get_continuous_samples(struct scoppy_context *ctx);
+void pico_scoppy_get_streamed_samples(struct scoppy_context *ctx);
 void pico_scoppy_stop_continuous_sampling();
\ No newline at end of file
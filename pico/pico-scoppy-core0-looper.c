@@ -33,6 +33,7 @@
 #include "pico/time.h"
 
 //
+#include "scoppy-adc-timing.h"
 #include "scoppy-chunked-ring-buffer.h"
 #include "scoppy-common.h"
 #include "scoppy-message.h"
@@ -47,7 +48,7 @@
 #include "pico-scoppy-util.h"
 #include "pico-scoppy.h"
 
-static void calculate_clkdiv_and_real_sample_rate_for_adc(struct sampling_params *params) {
+static void calculate_clkdiv_and_real_sample_rate_for_adc(struct sampling_params *params, uint32_t max_decimation) {
     DEBUG_PRINT("  preferred SR: %lu\n", (unsigned long)params->preferredSampleRatePerChannelHz);
     // sleep_ms(50);
 
@@ -59,41 +60,15 @@ static void calculate_clkdiv_and_real_sample_rate_for_adc(struct sampling_params
     // continuously) or > 95 (take samples less frequently than 96 cycle
     // intervals). This is all timed by the 48 MHz ADC clock.
     //
-    // My notes:
-    // div values under 95 are clamped to 95
-    // div values greater than 2^16 are invalid
-    //
-    // sample rate = (48000000)/(div+1) = 500000/(div+1)
-    // (div + 1) = 500000/SR
-    // div = (48000000/SR) - 1
-    //
-    // div = 4999 = 100 S/s
-
-    // Todo: take into account the number of channels
-    uint8_t num_channels = params->num_enabled_channels;
-
-    // Deliberately using an int here to ensure that DIV.FRAC is zero. I think a non-zero frac would cause
-    // the period between samples to not be exactly the same
-    params->clkdivint = (48000000 / (params->preferredSampleRatePerChannelHz * num_channels)) - 1;
-
-    // Div.INT is only 2 bytes
-    if (params->clkdivint > 63999) {
-        params->clkdivint = 63999; // 750S/s
-    } else if (params->clkdivint <= 95) {
-        // Strange. A clkdivint of 95 gives a measured samplerate of 250kS/s (expected 500kS/s)
-        // A clkdivint of 0 gives a measured samplerate of 500kS/s.
-        // Further testing showed that values between 1 and 94 give unexpected results.
-        // All tested values above 96 give expected results.
-        params->clkdivint = 0;
-    }
+    // See scoppy_adc_timing_calculate() for the details
+    struct scoppy_adc_timing timing;
+    scoppy_adc_timing_calculate(&timing, params->preferredSampleRatePerChannelHz, params->num_enabled_channels, max_decimation);
 
-    if (params->clkdivint == 0) {
-        params->realSampleRatePerChannel = 500000 / num_channels;
-    } else {
-        params->realSampleRatePerChannel = (48000000 / (params->clkdivint + 1)) / num_channels;
-    }
+    params->clkdivint = timing.clkdivint;
+    params->decimation = timing.decimation;
+    params->realSampleRatePerChannel = timing.real_sample_rate_per_channel;
 
-    DEBUG_PRINT("  real SR: %lu\n", (unsigned long)params->realSampleRatePerChannel);
+    DEBUG_PRINT("  real SR: %lu, decimation=%lu\n", (unsigned long)params->realSampleRatePerChannel, (unsigned long)params->decimation);
     // sleep_ms(50);
 }
 
@@ -129,6 +104,7 @@ static void calculate_clkdiv_and_real_sample_rate_for_pio(struct sampling_params
     }
 
     params->realSampleRatePerChannel = sys_clk_freq / (params->clkdivint * pio_cycles_per_sample);
+    params->decimation = 1;
 
     DEBUG_PRINT("  real SR: %lu, pio clkdiv=%lu\n", params->realSampleRatePerChannel, params->clkdivint);
 }
@@ -137,7 +113,7 @@ static void calculate_clkdiv_and_real_sample_rate(struct sampling_params *params
     if (scoppy.app.is_logic_mode) {
         calculate_clkdiv_and_real_sample_rate_for_pio(params);
     } else {
-        calculate_clkdiv_and_real_sample_rate_for_adc(params);
+        calculate_clkdiv_and_real_sample_rate_for_adc(params, 1);
     }
 }
 
@@ -152,6 +128,9 @@ static bool update_sample_rate_params(struct sampling_params *params) {
     // For now assume 1 byte per sample
     int num_bytes = is_logic_mode ? (BYTES_TO_SEND_PER_CHANNEL * 2) : BYTES_TO_SEND_PER_CHANNEL;
 
+    // A segmented capture is made of normal sized frames even in single shot mode
+    bool is_single_shot_frame = scoppy.app.run_mode == RUN_MODE_SINGLE && scoppy.app.num_segments < 2;
+
     // Calculate the sample rate that will span twice the timebase.
     // N.B. The trace flickers a lot if the span is too close to the timebase
     uint64_t sr_per_channel = num_bytes * 1000000000000L / scoppy.app.timebasePs / (is_logic_mode ? 3 : 2);
@@ -161,7 +140,7 @@ static bool update_sample_rate_params(struct sampling_params *params) {
 
     if (scoppy.app.selectedSampleRate != 0) {
         // The user has selected a sample rate
-        if (scoppy.app.run_mode == RUN_MODE_SINGLE) {
+        if (is_single_shot_frame) {
             num_bytes = SINGLE_SHOT_TOTAL_BYTES_TO_SEND / total_bytes_per_sample;
         }
 
@@ -172,7 +151,7 @@ static bool update_sample_rate_params(struct sampling_params *params) {
         } else {
             cont_mode = scoppy.app.selectedSampleRate < 2000;
         }
-    } else if (scoppy.app.run_mode == RUN_MODE_SINGLE) {
+    } else if (is_single_shot_frame) {
         // the sample rate that would result in 5 times screen coverage
         num_bytes = SINGLE_SHOT_TOTAL_BYTES_TO_SEND / total_bytes_per_sample;
         sr_per_channel = num_bytes * 1000000000000L / scoppy.app.timebasePs / 5;
@@ -292,6 +271,12 @@ static bool aquisition_configuration_changed(struct scoppy_context *ctx) {
         scoppy_prepare_incoming(ctx->incoming);
     }
 
+    scoppy_expire_config_batch(ctx);
+    if (scoppy.app.config_batch_open) {
+        // Apply the whole batch at once when it's committed (with a single restart)
+        return false;
+    }
+
     if (!scoppy.channels_dirty && !scoppy.app.dirty) {
         // DEBUG_PRINT("  nothing changed\n");
 
@@ -332,8 +317,17 @@ static bool aquisition_configuration_changed(struct scoppy_context *ctx) {
         dormant_params->trigger_mode = scoppy.app.trigger_mode;
         dormant_params->trigger_channel = scoppy.app.trigger_channel;
         dormant_params->trigger_type = scoppy.app.trigger_type;
+        dormant_params->trigger_level = scoppy.app.trigger_level;
+        dormant_params->trigger_hysteresis = scoppy.app.trigger_hysteresis;
+        dormant_params->trigger_level2 = scoppy.app.trigger_level2;
+        dormant_params->trigger_options = scoppy.app.trigger_options;
+        dormant_params->trigger_time_min = scoppy.app.trigger_time_min;
+        dormant_params->trigger_time_max = scoppy.app.trigger_time_max;
         dormant_params->run_mode = scoppy.app.run_mode;
         dormant_params->is_logic_mode = scoppy.app.is_logic_mode;
+        dormant_params->samples_msg_version = scoppy.app.samples_msg_version;
+        dormant_params->logic_edges = scoppy.app.logic_edges;
+        dormant_params->num_segments = scoppy.app.num_segments;
 
         if (dormant_params->run_mode == RUN_MODE_STOP) {
             DEBUG_PRINT("    run_mode==STOP\n");
@@ -343,9 +337,14 @@ static bool aquisition_configuration_changed(struct scoppy_context *ctx) {
             DEBUG_PRINT("    zero enabled channels\n");
         } else {
             bool cont_mode = update_sample_rate_params(dormant_params);
-            if (cont_mode) {
+            if (dormant_params->run_mode == RUN_MODE_STREAM) {
+                // Samples are streamed straight from the DMA ring so there is no decimation
+                dormant_params->get_samples = pico_scoppy_get_streamed_samples;
+                calculate_clkdiv_and_real_sample_rate(dormant_params);
+            } else if (cont_mode) {
                 dormant_params->get_samples = pico_scoppy_get_continuous_samples;
-                dormant_params->realSampleRatePerChannel = dormant_params->preferredSampleRatePerChannelHz;
+                // Slow sample rates are decimated
+                calculate_clkdiv_and_real_sample_rate_for_adc(dormant_params, UINT32_MAX);
             } else {
                 dormant_params->get_samples = pico_scoppy_get_non_continuous_samples;
                 calculate_clkdiv_and_real_sample_rate(dormant_params);
@@ -376,8 +375,8 @@ static bool aquisition_configuration_changed(struct scoppy_context *ctx) {
         return true;
     }
 
-    // In continuous mode triggering is done in the app so don't restart sampling if the trigger mode changes
-    if (active_params->get_samples != pico_scoppy_get_continuous_samples) {
+    // In continuous (and stream) mode triggering is done in the app so don't restart sampling if the trigger mode changes
+    if (active_params->get_samples != pico_scoppy_get_continuous_samples && active_params->get_samples != pico_scoppy_get_streamed_samples) {
         if (dormant_params->trigger_mode != active_params->trigger_mode) {
             DEBUG_PRINT("    trigger mode changed\n");
             restart_sampling_required = true;
@@ -385,12 +384,6 @@ static bool aquisition_configuration_changed(struct scoppy_context *ctx) {
         }
     }
 
-    if (dormant_params->run_mode != active_params->run_mode) {
-        DEBUG_PRINT("    run mode changed\n");
-        restart_sampling_required = true;
-        return true;
-    }
-
     if (dormant_params->is_logic_mode != active_params->is_logic_mode) {
         DEBUG_PRINT("    is_logic_mode changed\n");
         restart_sampling_required = true;
@@ -415,14 +408,25 @@ static bool aquisition_configuration_changed(struct scoppy_context *ctx) {
         }
     }
 
-    if (dormant_params->min_num_pre_trigger_bytes != active_params->min_num_pre_trigger_bytes) {
-        DEBUG_PRINT("    min_num_pre_trigger_bytes changed\n");
+    // The segments are partitions of the ring buffer
+    if (dormant_params->num_segments != active_params->num_segments) {
+        DEBUG_PRINT("    num_segments changed\n");
+        restart_sampling_required = true;
+        return true;
+    }
+
+    // The frame size decides whether the dual buffers can be used
+    if (dormant_params->num_bytes_to_send != active_params->num_bytes_to_send) {
+        DEBUG_PRINT("    num_bytes_to_send changed\n");
         restart_sampling_required = true;
         return true;
     }
 
     if (restart_sampling_required) {
         DEBUG_PRINT(" aquisition params have not just changed but changed previously\n");
+    } else if (pico_scoppy_publish_live_params(dormant_params)) {
+        // eg. run mode, trigger level, pre-trigger percentage
+        DEBUG_PRINT(" live params changed - restart not required\n");
     } else {
         DEBUG_PRINT(" aquisition params have not changed - restart not required\n");
     }
@@ -457,9 +461,20 @@ void pico_scoppy_start_core0_loop(struct scoppy_context *ctx) {
             return;
         }
 
+        // Write the samples that core1 has queued for us
+        pico_scoppy_write_queued_frames(ctx);
+        // and scan some of the chunks if it's looking for a trigger
+        pico_scoppy_help_with_trigger_scan();
+
         // Multiple messages might have come in quick succession eg. change to horz timebase
         // We only really want the last so read all pending messages from the app
         consume_all_incoming_messages(ctx);
+
+        if (scoppy.app.telemetry_requested) {
+            scoppy.app.telemetry_requested = false;
+            pico_scoppy_send_telemetry(ctx, scoppy.app.telemetry_reset);
+        }
+
         if (aquisition_configuration_changed(ctx)) {
             restart_sampling_required = false;
 
@@ -475,7 +490,10 @@ void pico_scoppy_start_core0_loop(struct scoppy_context *ctx) {
             // tell the sampler that a restart is required
             multicore_fifo_push_blocking(MULTICORE_MSG_RESTART_REQUIRED);
 
-            // wait for sampling to stop
+            // wait for sampling to stop. core1 might be waiting for us to write its messages first.
+            while (!multicore_fifo_rvalid()) {
+                pico_scoppy_write_queued_frames(ctx);
+            }
             uint32_t msg = multicore_fifo_pop_blocking();
             assert(msg == MULTICORE_MSG_SAMPLING_STOPPED);
 
@@ -489,6 +507,9 @@ void pico_scoppy_start_core0_loop(struct scoppy_context *ctx) {
             CHECK_SAMPLING_PARAMS("core0-a", active_params);
             CHECK_SAMPLING_PARAMS("core0-d", dormant_params);
 
+            // So that the next change is compared against the params that the sampler is about to use
+            pico_scoppy_publish_live_params(active_params);
+
             // The sampler can start again
             multicore_fifo_push_blocking(MULTICORE_MSG_RESTART_SAMPLING);
 
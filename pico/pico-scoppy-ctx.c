@@ -61,6 +61,8 @@ static void ctx_sleep_ms(uint32_t msec) { sleep_ms(msec); }
 
 static void ctx_tight_loop(void) { sleep_ms(1); }
 
+static uint64_t ctx_time_us(void) { return time_us_64(); }
+
 static int ctx_read_serial(uint8_t *buf, int offset, int len) { return scoppy_usb_in_chars((char *)(buf + offset), len); }
 
 void ctx_fatal_error_handler(int error) {
@@ -96,14 +98,40 @@ static int ctx_write_serial(uint8_t *buf, int offset, int len) {
     return len;
 }
 
+static int ctx_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    const char *bufs[SCOPPY_OUTGOING_MAX_SEGMENTS + 1];
+    int lengths[SCOPPY_OUTGOING_MAX_SEGMENTS + 1];
+    assert(count <= SCOPPY_OUTGOING_MAX_SEGMENTS + 1);
+
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        bufs[i] = (const char *)iov[i].base;
+        lengths[i] = iov[i].len;
+        total += iov[i].len;
+    }
+
+    uint32_t start_us = time_us_32();
+    if (!scoppy_usb_out_chars_v(bufs, lengths, count)) {
+        // Failed due to rentrancy from the same core. wtf?
+        assert(false);
+        sleep_ms(2000);
+    }
+    scoppy_telemetry_add(&pico_scoppy_telemetry, SCOPPY_TELEMETRY_USB_WRITE, time_us_32() - start_us);
+
+    // see ctx_write_serial()
+    return total;
+}
+
 static void ctx_start_main_loop(struct scoppy_context *ctx) { pico_scoppy_start_core0_loop(ctx); }
 
 static struct scoppy_context ctx;
 struct scoppy_context *pico_scoppy_get_context() {
     ctx.read_serial = ctx_read_serial;
     ctx.write_serial = ctx_write_serial;
+    ctx.write_serial_v = ctx_write_serial_v;
     ctx.tight_loop = ctx_tight_loop;
     ctx.sleep_ms = ctx_sleep_ms;
+    ctx.time_us = ctx_time_us;
     ctx.debugf = debugf;
     ctx.errorf = errorf;
     ctx.start_main_loop = ctx_start_main_loop;
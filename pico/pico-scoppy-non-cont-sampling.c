@@ -37,6 +37,9 @@
 #include "scoppy-common.h"
 #include "scoppy-message.h"
 #include "scoppy-outgoing.h"
+#include "scoppy-rle.h"
+#include "scoppy-trigger-dispatch.h"
+#include "scoppy-trigger.h"
 #include "scoppy.h"
 
 #include "pico-scoppy-non-cont-sampling.h"
@@ -65,6 +68,39 @@
 // 1024 works at a sample rate of 20833333 in DEBUG mode. Fails at 125Ms/s
 #define MAX_CHUNK_SIZE 2048
 
+// When the frame is small enough the ring buffer array is split into 2 buffers. Instead of diverting the dma
+// transfers to the rubbish_buf while a frame is being sent, the dma handlers switch to the other buffer and
+// keep capturing. This means we don't have to wait for the pre-trigger samples to be re-aquired for every frame.
+// Single shot frames need the whole array so they still use the rubbish_buf.
+#define DUAL_BUFFER_ENABLED 1
+// The size of each of the 2 buffers. Must be a power of 2.
+#define DUAL_BUFFER_SIZE 32768
+
+// Deep single shot capture in logic mode. Rather than keeping the raw samples, the chunks are run length encoded (see
+// scoppy-rle.h) as soon as the dma has finished with them. Only the start of the ring buffer array is used for the raw
+// chunks. The rest holds the records. A sparse bus (eg. I2C or UART) gets a much longer frame from the same memory.
+#define RLE_CAPTURE_ENABLED 1
+// The part of the array used for the raw chunks and the biggest chunk in a deep capture. The compression must finish
+// with a chunk before the dma comes back around to it.
+#define RLE_RAW_BUFFER_SIZE 16384
+#define RLE_MAX_CHUNK_SIZE 1024
+// The longest a deep capture can be compared to a normal single shot frame (if the records don't run out first)
+#define RLE_MAX_DEPTH_FACTOR 100
+// ...and the longest we're prepared to wait for it to fill at slow sample rates
+#define RLE_MAX_CAPTURE_MS 2000
+
+// Core0 scans every other chunk for the trigger while core1 is looking for one (see scoppy-trigger-dispatch.h). It
+// does it between writing the frames and reading the messages from the app. Only for edge triggers without hysteresis.
+#define DUAL_CORE_TRIGGER_SCAN_ENABLED 1
+
+// Segmented capture (see scoppy_app.num_segments). The ring buffer array is split into a partition per segment. The
+// dma channels move on to the next partition as soon as a segment has its post trigger samples, the same way that they
+// switch buffers in dual buffer mode, and nothing is sent until the last segment has been captured.
+// Each partition only has to hold a normal frame so the chunks are kept small.
+#define SEGMENT_MAX_CHUNK_SIZE 1024
+// The room in each partition on top of the frame (for the reserved chunks and a few more)
+#define SEGMENT_SPARE_CHUNKS 6
+
 uint dma_chan1;
 uint dma_chan2;
 
@@ -82,9 +118,38 @@ uint dma_chan2;
 // unreserved chunks
 //
 #define RING_BUF_ARR_SIZE SINGLE_SHOT_TOTAL_BYTES_TO_SEND + (MAX_CHUNK_SIZE * 10)
-static uint8_t ring_buf1_arr[RING_BUF_ARR_SIZE];
+// The buffers start at RING_BUF_OFFSET (rather than straight after the overrun check byte) so that they are word aligned.
+// This lets the trigger scanner read 4 bytes at a time.
+#define RING_BUF_OFFSET 4
+static uint8_t ring_buf1_arr[RING_BUF_ARR_SIZE] __attribute__((aligned(4)));
 static struct scoppy_uint8_chunked_ring_buffer ring_buf1;
 
+// Only used in dual buffer mode. It uses the second half of ring_buf1_arr.
+static struct scoppy_uint8_chunked_ring_buffer ring_buf2;
+static bool dual_buffer_mode = false;
+static_assert(DUAL_BUFFER_SIZE * 2 <= RING_BUF_ARR_SIZE - (2 * RING_BUF_OFFSET), "");
+
+// Only used in deep capture mode. The records come after the raw chunks in ring_buf1_arr.
+#define RLE_NUM_RECORDS ((RING_BUF_ARR_SIZE - (2 * RING_BUF_OFFSET) - RLE_RAW_BUFFER_SIZE) / 4)
+static struct scoppy_rle_buffer rle_buf;
+static bool rle_capture_mode = false;
+static_assert((RLE_RAW_BUFFER_SIZE % 4) == 0, "the records must be word aligned");
+static_assert(RLE_RAW_BUFFER_SIZE >= 2 * SCOPPY_OUTGOING_MAX_SAMPLE_BYTES, "the raw chunk area is reused to expand the frame");
+
+// Only used in segmented mode. num_segments is 0 otherwise.
+static struct scoppy_uint8_chunked_ring_buffer segment_bufs[SCOPPY_MAX_SEGMENTS];
+static int num_segments = 0;
+// The segments captured so far. They're waiting to be sent.
+struct captured_segment {
+    struct scoppy_uint8_chunked_ring_buffer *buffer;
+    volatile uint8_t *copy_from;
+    int32_t copy_from_offset;
+    struct scoppy_segment_info info;
+    struct scoppy_samples_msg_info msg_info;
+};
+static struct captured_segment captured_segments[SCOPPY_MAX_SEGMENTS];
+static int num_captured_segments = 0;
+
 // NB. This should only need to be as big as the largest chunk. However, I found a buffer overrun outside of the
 // get samples function. I think that the interupt handler isn't getting called quickly enought to change the
 // write address. My guess is that the process of sending over USB is generating lots of interupts and delays
@@ -108,12 +173,26 @@ static int32_t max_trigger_chunks = -1;
 // samples_per_chunk will be 64
 static int samples_per_chunk = -1;
 
-static struct scoppy_uint8_chunked_ring_buffer *active_buffer = &ring_buf1;
+// The buffer the dma channels are writing to. In dual buffer mode this is changed by the dma handlers.
+static struct scoppy_uint8_chunked_ring_buffer *volatile active_buffer = &ring_buf1;
+
+// Dual buffer mode only. The buffer that the dma channels are not writing to. Either it is empty or it contains
+// a frame that is being sent to the app.
+static struct scoppy_uint8_chunked_ring_buffer *idle_buffer = NULL;
+
+// Dual buffer mode only. Set by get_samples() when it wants the dma channels to switch to another buffer. The next
+// dma handler to be called makes it the active buffer.
+static struct scoppy_uint8_chunked_ring_buffer *volatile pending_buffer = NULL;
 
 // Pointers to the memory location(s) that the dma channels can write to
 static uint8_t *reserved1 = NULL;
 static uint8_t *reserved2 = NULL;
 
+// The buffers that reserved1 and reserved2 belong to. After a buffer switch they will be different until both
+// handlers have been called.
+static struct scoppy_uint8_chunked_ring_buffer *volatile reserved1_buffer = NULL;
+static struct scoppy_uint8_chunked_ring_buffer *volatile reserved2_buffer = NULL;
+
 // Using a flag rather than a mutex/sem etc 'cos we're only running on the one
 // core. This will probably have to change if we move to multicore
 // Not sure if these actually have to be volatile
@@ -126,6 +205,9 @@ static volatile bool ch2_stopped = false;
 static volatile uint8_t *trigger_addr = NULL;
 static volatile bool hardware_triggered = false;
 
+// When the trigger sample was written (0 until the dma handler has worked it out). See record_trigger_time()
+static volatile uint64_t trigger_time_us = 0;
+
 #ifndef NDEBUG
 // For debugging
 static int in_dma_chan1_handler = 0;
@@ -136,9 +218,41 @@ static uint8_t first_ch2_reserved_byte_value = 0;
 #endif
 
 // queue of chunks to be checked for trigger
+#define TRIGGER_CHUNK_QUEUE_SIZE 100
 static queue_t trigger_chunk_queue;
 static volatile bool looking_for_software_trigger_point = false;
 
+// If the trigger scan can't keep up with the adc (eg. a fast external adc) the oldest chunks in the queue are skipped
+// so that a trigger is always found in recent samples - ie. samples that the dma channels haven't overwritten by the
+// time the post trigger samples have been captured. This is the most chunks that can wait in the queue.
+static uint32_t max_trigger_backlog = TRIGGER_CHUNK_QUEUE_SIZE - 1;
+// Set by the dma handlers if a chunk couldn't be added because the queue was full
+static volatile bool trigger_queue_overflowed = false;
+// The chunks the dma handlers couldn't add to the queue this frame
+static volatile uint32_t trigger_chunks_dropped = 0;
+// The chunks scanned and skipped this frame
+static uint32_t trigger_chunks_scanned = 0;
+static uint32_t trigger_chunks_unscanned = 0;
+// Sent with the samples messages of the current frame
+static struct scoppy_samples_msg_info frame_msg_info;
+
+// The chunks taken off the trigger_chunk_queue for core0 to help with. See DUAL_CORE_TRIGGER_SCAN_ENABLED.
+static struct scoppy_trigger_dispatch trigger_dispatch;
+
+// Deep capture mode only. The dma handlers add the chunks to the trigger_chunk_queue for compression while this is
+// set. If get_samples() falls too far behind the chunks would be overwritten before they are compressed so the
+// handlers set rle_overrun and stop adding them.
+static volatile bool rle_compressing = false;
+static volatile bool rle_overrun = false;
+static uint32_t rle_max_queued_chunks = 0;
+// The last chunk compressed
+static uint8_t *rle_last_chunk = NULL;
+// The trigger address and (once the chunk it's in has been compressed) the index of the trigger sample
+static volatile uint8_t *rle_trigger_addr = NULL;
+static int64_t rle_trigger_sample = -1;
+// Use the end of the compressed samples as the trigger if the trigger chunk hasn't been found by here (it should be!)
+static uint64_t rle_trigger_deadline = 0;
+
 #ifndef NDEBUG
 struct checkpoint {
     absolute_time_t timestamp;
@@ -250,18 +364,50 @@ static void print_debug_and_abort(const char *msg) {
 
 #endif // NDEBUG
 
-static inline void dma_handler_unreserve(uint8_t *reserved) {
+static inline void dma_handler_unreserve(struct scoppy_uint8_chunked_ring_buffer *buffer, uint8_t *reserved) {
     // tell the buffer we have finished writing the chunk
     // DEBUG_PRINT("DMA: reserved=%u %u\n", (unsigned)*reserved, (unsigned)*(reserved+1));
-    active_buffer->unreserve_chunk(active_buffer, reserved);
-    if (looking_for_software_trigger_point) {
-        if (!queue_try_add(&trigger_chunk_queue, &reserved)) {
-            // this should only happen if the queue is full
+    buffer->unreserve_chunk(buffer, reserved);
+    if (rle_compressing) {
+        if (rle_overrun) {
+            // The capture ends with the chunks that were compressed before the overrun
+        } else if (queue_get_level(&trigger_chunk_queue) >= rle_max_queued_chunks) {
+            rle_overrun = true;
+        } else if (!queue_try_add(&trigger_chunk_queue, &reserved)) {
             assert(false);
         }
+    } else if (looking_for_software_trigger_point) {
+        if (!queue_try_add(&trigger_chunk_queue, &reserved)) {
+            // The queue is full. The trigger scan will skip the chunks that are waiting and carry on from the newest.
+            trigger_queue_overflowed = true;
+            trigger_chunks_dropped++;
+        }
+    }
+}
+
+static inline void dma_handler_switch_buffer_if_pending() {
+    if (pending_buffer != NULL) {
+        // get_samples() has locked the frame in the active buffer. From now on both channels reserve
+        // chunks in the pending buffer. The other handler will switch when it is next called.
+        active_buffer = pending_buffer;
+        pending_buffer = NULL;
     }
 }
 
+// The number of nanoseconds that the dma takes to write a byte. See record_dma_irq_latency()
+static uint32_t dma_ns_per_byte = 0;
+
+// The other channel started when this channel finished its chunk (chain_to), which was the newest data in the buffer.
+// So everything after the trigger sample has been written at the sample rate since then and we can work back to when
+// the trigger sample was written without waiting for the scan to find it. num_post_trigger_bytes includes the trigger
+// sample so we go back to when its last byte was written.
+static inline void record_trigger_time(uint ch, uint32_t num_post_trigger_bytes) {
+    uint other_ch = ch == dma_chan1 ? dma_chan2 : dma_chan1;
+    uint64_t now_us = time_us_64();
+    uint32_t num_written = (uint32_t)chunk_size - dma_channel_hw_addr(other_ch)->transfer_count;
+    trigger_time_us = now_us - (uint64_t)(num_post_trigger_bytes - 1 + num_written) * dma_ns_per_byte / 1000;
+}
+
 static inline void dma_handler_on_reserved(uint ch, uint8_t *reserved) {
     if (waiting_for_pre_trigger_samples) {
         if (active_buffer->size(active_buffer) >= active_params->min_num_pre_trigger_bytes) {
@@ -277,7 +423,12 @@ static inline void dma_handler_on_reserved(uint ch, uint8_t *reserved) {
 
             int32_t trigger_index = active_buffer->index(active_buffer, (uint8_t *)trigger_addr);
             if (trigger_index >= 0) {
-                if ((active_buffer->size(active_buffer) - trigger_index) >= active_params->min_num_post_trigger_bytes) {
+                uint32_t num_post_trigger_bytes = active_buffer->size(active_buffer) - trigger_index;
+                if (trigger_time_us == 0) {
+                    record_trigger_time(ch, num_post_trigger_bytes);
+                }
+
+                if (num_post_trigger_bytes >= active_params->min_num_post_trigger_bytes) {
 #ifndef NDEBUG
                     add_checkpoint(&checkpoint_dma_handler, "DMA_HANDLER", trigger_addr, active_buffer);
 #endif
@@ -308,7 +459,16 @@ static inline void dma_handler_on_reserved(uint ch, uint8_t *reserved) {
     dma_channel_set_write_addr(ch, reserved, false);
 }
 
+// The other channel started when this channel finished its chunk (chain_to) so the bytes that it has written since
+// then tell us how long it took for this interrupt to be handled
+static inline void record_dma_irq_latency(uint other_ch) {
+    uint32_t num_written = (uint32_t)chunk_size - dma_channel_hw_addr(other_ch)->transfer_count;
+    scoppy_telemetry_add(&pico_scoppy_telemetry, SCOPPY_TELEMETRY_DMA_IRQ_LATENCY, num_written * dma_ns_per_byte);
+}
+
 static void dma_chan1_handler() {
+    record_dma_irq_latency(dma_chan2);
+
 #ifndef NDEBUG
     // check that a dma interrupt handler is not called during execution of this handler
     in_dma_chan1_handler++;
@@ -331,12 +491,15 @@ static void dma_chan1_handler() {
     } else {
 
         if (reserved1 != NULL) {
-            dma_handler_unreserve(reserved1);
+            // In dual buffer mode the chunk might belong to the buffer that we have just switched from
+            dma_handler_unreserve(reserved1_buffer, reserved1);
             assert(*(active_buffer->next_chunk_addr) == first_ch1_reserved_byte_value);
         } else {
             // reserved1 will be NULL if the buffer has recently been locked
         }
 
+        dma_handler_switch_buffer_if_pending();
+
         //
         // The other channel is now running (because of the chain_to)
         // We need to set the new write address for when this channel resumes
@@ -344,6 +507,7 @@ static void dma_chan1_handler() {
 
         // reserve space in the buffer that this channel can write to
         reserved1 = active_buffer->reserve_chunk(active_buffer);
+        reserved1_buffer = active_buffer;
 
 #ifndef NDEBUG
         // Save the value of the first byte of the next chunk that will be reserved by ch2
@@ -373,6 +537,8 @@ static void dma_chan1_handler() {
 }
 
 static void dma_chan2_handler() {
+    record_dma_irq_latency(dma_chan1);
+
 #ifndef NDEBUG
     in_dma_chan2_handler++;
     assert(in_dma_chan2_handler == 1);
@@ -394,12 +560,15 @@ static void dma_chan2_handler() {
     } else {
 
         if (reserved2 != NULL) {
-            dma_handler_unreserve(reserved2);
+            // In dual buffer mode the chunk might belong to the buffer that we have just switched from
+            dma_handler_unreserve(reserved2_buffer, reserved2);
             assert(*(active_buffer->next_chunk_addr) == first_ch2_reserved_byte_value);
         } else {
             // reserved2 will be NULL if the buffer has recently been locked
         }
 
+        dma_handler_switch_buffer_if_pending();
+
         //
         // The other channel is now running (because of the chain_to)
         // We need to set the new write address for when this channel resumes
@@ -407,6 +576,7 @@ static void dma_chan2_handler() {
 
         // reserve space in the buffer that this channel can write to
         reserved2 = active_buffer->reserve_chunk(active_buffer);
+        reserved2_buffer = active_buffer;
 
 #ifndef NDEBUG
         // Save the value of the first byte of the next chunk that will be reserved by ch2
@@ -451,6 +621,11 @@ int64_t total_pre_trigger_wait_time = 0;
 int64_t total_trigger_wait_time = 0;
 int64_t total_post_trigger_wait_time = 0;
 int64_t total_buf_copy_time = 0;
+// Cumulative time where a trigger could not be found. ie. the samples were written to the rubbish_buf, we were waiting
+// for the pre-trigger samples to be re-aquired or (in dual buffer mode) the samples were written to the other buffer
+// while a frame was being sent. Those samples are kept for the next frame's pre-trigger samples but they are never
+// searched for a trigger.
+int64_t total_dead_time = 0;
 
 int64_t total_get_samples_time = 0;
 uint32_t total_get_samples_invokations = 0;
@@ -459,26 +634,169 @@ uint8_t stats_num_channels = 0;
 uint stats_max_trigger_queue_size = 0;
 uint num_timeouts = 0;
 int stats_num_bytes_to_send = 0;
+// The number of chunks checked for a trigger
+uint32_t stats_trigger_chunks_checked = 0;
+// The number of chunks that weren't checked because the trigger scan fell behind
+uint32_t stats_trigger_chunks_unscanned = 0;
 #endif // STATS_ENABLED
 
-static uint8_t wait_for_software_trigger(struct scoppy_context *ctx, int trigger_channel_idx, uint8_t num_bytes_per_sample) {
-    uint8_t trigger_level = scoppy.app.trigger_level;
+// Throw away the oldest chunks in the trigger chunk queue if the trigger scan has fallen behind. num_in_flight is the
+// number of older chunks that have been taken off the queue but not scanned yet. Returns the number of chunks thrown
+// away.
+static uint32_t skip_trigger_backlog(uint32_t num_in_flight) {
+    uint32_t level = queue_get_level(&trigger_chunk_queue);
+    uint32_t keep;
+    if (trigger_queue_overflowed) {
+        // Chunks are missing from the queue so only the ones added after this can be scanned in order
+        trigger_queue_overflowed = false;
+        keep = 0;
+    } else if (level + num_in_flight > max_trigger_backlog) {
+        // Keep a few so we aren't back here straight away
+        keep = max_trigger_backlog / 4;
+    } else {
+        return 0;
+    }
 
-    // Note. We don't read trigger type from active_params because changing the trigger type in oscilloscope mode
-    // doesn't cause sampling to restart (and so active_params.trigger_type isn't updated)
-    uint8_t trigger_type = scoppy.app.trigger_type;
+    keep = keep > num_in_flight ? keep - num_in_flight : 0;
 
+    // Only the chunks that are already there. The dma handlers keep adding more.
+    uint32_t num_skipped = 0;
+    uint8_t *tmp;
+    while (num_skipped + keep < level && queue_try_remove(&trigger_chunk_queue, &tmp)) {
+        num_skipped++;
+    }
+    return num_skipped;
+}
+
+// Like the loop in wait_for_software_trigger() but the chunks are handed over to trigger_dispatch so that core0 can scan
+// some of them
+static uint8_t wait_for_software_trigger_dual_core(struct scoppy_trigger_scanner *scanner, int trigger_channel_idx, uint8_t num_bytes_per_sample) {
     uint8_t dbg_trigger_value = 99;
 
-    {
+    scoppy_trigger_dispatch_start(&trigger_dispatch, scanner, samples_per_chunk);
+
+    bool aquisition_params_changed = false;
+    int32_t trigger_chunks_skipped = 0;
+    bool restart_scan = true;
+    while (trigger_addr == NULL && (int32_t)scoppy_trigger_dispatch_num_completed(&trigger_dispatch) + trigger_chunks_skipped < max_trigger_chunks &&
+           !aquisition_params_changed) {
+        uint32_t num_skipped = skip_trigger_backlog(scoppy_trigger_dispatch_num_pending(&trigger_dispatch));
+        if (num_skipped > 0) {
+            trigger_chunks_unscanned += num_skipped;
+            trigger_chunks_skipped += num_skipped;
+            restart_scan = true;
+        }
+
+        // Hand over the queued chunks (in order). Only enough to keep both cores busy - the rest wait in the queue where
+        // skip_trigger_backlog() can see them.
+        uint8_t *chunk;
+        while (scoppy_trigger_dispatch_num_pending(&trigger_dispatch) < SCOPPY_TRIGGER_DISPATCH_LOOKAHEAD &&
+               queue_try_remove(&trigger_chunk_queue, &chunk)) {
+            uint32_t queue_level = queue_get_level(&trigger_chunk_queue) + 1;
+            if (queue_level > pico_scoppy_telemetry.max_trigger_queue_size) {
+                pico_scoppy_telemetry.max_trigger_queue_size = queue_level;
+            }
+#if STATS_ENABLED
+            if (queue_level > stats_max_trigger_queue_size) {
+                stats_max_trigger_queue_size = queue_level;
+            }
+#endif
+
+            scoppy_trigger_dispatch_publish(&trigger_dispatch, chunk, restart_scan);
+            restart_scan = false;
+        }
+
+        const uint8_t *trigger_chunk;
+        int32_t trigger_sample_idx;
+        if (scoppy_trigger_dispatch_work(&trigger_dispatch, &trigger_chunk, &trigger_sample_idx)) {
+            trigger_addr = (volatile uint8_t *)trigger_chunk + (trigger_sample_idx * num_bytes_per_sample) + trigger_channel_idx;
+            frame_msg_info.trigger_fraction = scoppy_trigger_crossing_fraction(
+                scanner, trigger_chunk, trigger_sample_idx, scoppy_trigger_dispatch_trigger_chunk_last_sample_value(&trigger_dispatch));
+
+#ifndef NDEBUG
+            add_checkpoint(&checkpoint1, "Found trigger", trigger_addr, active_buffer);
+            dbg_trigger_value = *trigger_addr;
+#endif
+        }
+
+        if (pico_scoppy_is_sampler_restart_required()) {
+            aquisition_params_changed = true;
+        }
+    }
+
+    // Core0 might be half way through a chunk
+    scoppy_trigger_dispatch_stop(&trigger_dispatch);
+
+    uint32_t num_completed = scoppy_trigger_dispatch_num_completed(&trigger_dispatch);
+    trigger_chunks_scanned += num_completed;
+#if STATS_ENABLED
+    stats_trigger_chunks_checked += num_completed;
+#endif
+
+    return dbg_trigger_value;
+}
+
+void pico_scoppy_help_with_trigger_scan() { scoppy_trigger_dispatch_help(&trigger_dispatch); }
+
+static uint8_t wait_for_software_trigger(struct scoppy_context *ctx, int trigger_channel_idx, uint8_t num_bytes_per_sample) {
+    // In oscilloscope mode these can change between frames without restarting sampling. See struct sampling_live_params.
+    uint8_t trigger_level = active_params->trigger_level;
+    uint8_t trigger_type = active_params->trigger_type;
+    uint8_t trigger_hysteresis = active_params->trigger_hysteresis;
+
+    uint8_t dbg_trigger_value = 99;
+
+    if (trigger_type > TRIGGER_TYPE_LAST) {
+#ifndef NDEBUG
+        // wtf
+        printf("unknown trigger type");
+        sleep_ms(2000);
+        assert(false);
+#endif
+    }
+
+    // Select the scan kernel for this frame
+    struct scoppy_trigger_scanner scanner;
+    scoppy_trigger_scanner_init(&scanner, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx >= 0 ? trigger_channel_idx : 0);
+    if (trigger_hysteresis > 0) {
+        scoppy_trigger_scanner_set_hysteresis(&scanner, trigger_hysteresis);
+    }
+    if (scoppy_trigger_fsm_is_fsm_type(trigger_type)) {
+        // pulse width, runt, window and slope triggers
+        struct scoppy_trigger_fsm_params fsm_params = {
+            .level2 = active_params->trigger_level2,
+            .options = active_params->trigger_options,
+            .time_min = active_params->trigger_time_min,
+            .time_max = active_params->trigger_time_max,
+        };
+        scoppy_trigger_scanner_set_fsm_params(&scanner, &fsm_params);
+    }
+
+    if (DUAL_CORE_TRIGGER_SCAN_ENABLED && trigger_channel_idx >= 0 && scoppy_trigger_dispatch_supports(&scanner)) {
+        dbg_trigger_value = wait_for_software_trigger_dual_core(&scanner, trigger_channel_idx, num_bytes_per_sample);
+    } else {
         bool aquisition_params_changed = false;
         int32_t trigger_chunks_processed = 0;
-        uint8_t last_sample_value = trigger_level;
+        // The next chunk doesn't follow on from the last one scanned
+        bool restart_scan = true;
         while (trigger_addr == NULL && trigger_chunks_processed < max_trigger_chunks && !aquisition_params_changed && trigger_channel_idx >= 0) {
             // if (aquisition_configuration_changed()) {
             //    return;
             //}
 
+            // If the trigger_chunk_queue is growing in size (which might happen with faster ADCs than the internal pico
+            // adc) skip to the newest chunks. The skipped chunks count towards the auto trigger timeout and the app is
+            // told how much of the signal wasn't scanned.
+            uint32_t num_skipped = skip_trigger_backlog(0);
+            if (num_skipped > 0) {
+                trigger_chunks_unscanned += num_skipped;
+                trigger_chunks_processed += num_skipped;
+                restart_scan = true;
+                if (trigger_chunks_processed >= max_trigger_chunks) {
+                    break;
+                }
+            }
+
 #if STATS_ENABLED
             uint queue_size = queue_get_level(&trigger_chunk_queue);
             if (queue_size > stats_max_trigger_queue_size) {
@@ -488,51 +806,37 @@ static uint8_t wait_for_software_trigger(struct scoppy_context *ctx, int trigger
 
             uint8_t *trig_check_addr;
             if (queue_try_remove(&trigger_chunk_queue, &trig_check_addr)) {
-                // check chunk for trigger sample making sure we check the byte that corresponds to the
-                // trigger channel
-                trig_check_addr += trigger_channel_idx;
-                if (trigger_chunks_processed == 0) {
-                    last_sample_value = *trig_check_addr;
+                // The chunks still waiting to be checked
+                uint32_t queue_level = queue_get_level(&trigger_chunk_queue) + 1;
+                if (queue_level > pico_scoppy_telemetry.max_trigger_queue_size) {
+                    pico_scoppy_telemetry.max_trigger_queue_size = queue_level;
                 }
 
-                for (int i = 0; i < samples_per_chunk; i++) {
-                    uint8_t current_sample_value = *trig_check_addr;
+                // check chunk for trigger sample. The scanner knows which byte corresponds to the trigger channel
+                if (restart_scan) {
+                    scoppy_trigger_scanner_restart(&scanner, trig_check_addr[trigger_channel_idx]);
+                    restart_scan = false;
+                }
 
-                    bool triggered = false;
-                    if (trigger_type == TRIGGER_TYPE_RISING_EDGE) {
-                        if (last_sample_value < trigger_level && current_sample_value >= trigger_level) {
-                            triggered = true;
-                        }
-                    } else if (trigger_type == TRIGGER_TYPE_FALLING_EDGE) {
-                        if (last_sample_value > trigger_level && current_sample_value <= trigger_level) {
-                            triggered = true;
-                        }
-                    } else {
-#ifndef NDEBUG
-                        // wtf
-                        printf("unknown trigger type");
-                        sleep_ms(2000);
-                        assert(false);
+                int32_t trigger_sample_idx = scanner.scan(&scanner, trig_check_addr, samples_per_chunk);
+#if STATS_ENABLED
+                stats_trigger_chunks_checked++;
 #endif
-                    }
-
-                    if (triggered) {
-                        trigger_addr = trig_check_addr;
+                if (trigger_sample_idx >= 0) {
+                    trigger_addr = trig_check_addr + (trigger_sample_idx * num_bytes_per_sample) + trigger_channel_idx;
+                    // The scanner still has the last sample of the previous chunk
+                    frame_msg_info.trigger_fraction =
+                        scoppy_trigger_crossing_fraction(&scanner, trig_check_addr, trigger_sample_idx, scanner.last_sample_value);
 
 #ifndef NDEBUG
-                        add_checkpoint(&checkpoint1, "Found trigger", trigger_addr, active_buffer);
-                        dbg_trigger_value = *trigger_addr;
-                        assert(dbg_trigger_value == current_sample_value);
+                    add_checkpoint(&checkpoint1, "Found trigger", trigger_addr, active_buffer);
+                    dbg_trigger_value = *trigger_addr;
 #endif
-                        // we will also break out of the while loop because trigger_addr is set
-                        break;
-                    } else {
-                        last_sample_value = current_sample_value;
-                        trig_check_addr += num_bytes_per_sample;
-                    }
+                    // we will break out of the while loop because trigger_addr is set
                 }
 
                 trigger_chunks_processed++;
+                trigger_chunks_scanned++;
             } else {
                 // Nothing in trigger chunk queue
             }
@@ -541,21 +845,21 @@ static uint8_t wait_for_software_trigger(struct scoppy_context *ctx, int trigger
                 aquisition_params_changed = true;
             }
 
-            //
-            // If the trigger_chunk_queue is growing in size (which might happen with faster ADCs than the internal pico adc)
-            // then we can cull the queue here (ie we wont check all the chunks). The app should then degrade gracefully :)
-            //
-            // eg
-            // if (qeueu.size > 3) {
-            //  foreach entry in queue: delete from queue, trigger_chunks_processed++
-            //}
-
             // every so often check for message from the app, esp in normal mode where we could
             // be stuck in this loop indefinitely
             // eg. timebase, triggerlevel etc changes
         }
     }
 
+#if STATS_ENABLED
+    stats_trigger_chunks_unscanned += trigger_chunks_unscanned + trigger_chunks_dropped;
+#endif
+
+    // The chunks the dma handlers dropped were never scanned either
+    uint32_t num_unscanned = trigger_chunks_unscanned + trigger_chunks_dropped;
+    uint32_t total = trigger_chunks_scanned + num_unscanned;
+    frame_msg_info.unscanned_permille = total > 0 ? (uint16_t)(((uint64_t)num_unscanned * 1000U) / total) : 0;
+
     return dbg_trigger_value;
 }
 
@@ -564,6 +868,51 @@ uint8_t *g_hw_trig_dma2_write_addr = 0;
 uint32_t g_hw_trig_dma1_trans_count = 0;
 uint32_t g_hw_trig_dma2_trans_count = 0;
 
+//
+// Deep capture (see RLE_CAPTURE_ENABLED)
+//
+
+// Compress the chunks that the dma handlers have finished with. Returns false if there weren't any.
+static bool rle_compress_queued_chunks() {
+    bool compressed = false;
+    uint8_t *chunk;
+    while (queue_try_remove(&trigger_chunk_queue, &chunk)) {
+        if (rle_trigger_addr != NULL && rle_trigger_sample < 0 && (uint8_t *)rle_trigger_addr >= chunk &&
+            (uint8_t *)rle_trigger_addr < chunk + chunk_size) {
+            rle_trigger_sample = rle_buf.end_sample + ((uint8_t *)rle_trigger_addr - chunk);
+        }
+
+        scoppy_rle_compress(&rle_buf, chunk, chunk_size);
+        rle_last_chunk = chunk;
+        compressed = true;
+    }
+
+    if (rle_trigger_addr != NULL && rle_trigger_sample < 0 && rle_buf.end_sample >= rle_trigger_deadline) {
+        DEBUG_PRINT("rle: trigger chunk not found\n");
+        rle_trigger_sample = rle_buf.end_sample;
+    }
+
+    return compressed;
+}
+
+// The trigger_addr is either in a chunk that the dma is still writing to or in the last chunk that it finished (see
+// wait_for_hardware_trigger()). We might have compressed that one already.
+static void rle_set_trigger(volatile uint8_t *addr) {
+    rle_trigger_sample = -1;
+    rle_trigger_deadline = rle_buf.end_sample + (uint64_t)(queue_get_level(&trigger_chunk_queue) + 4) * chunk_size;
+    if (rle_last_chunk != NULL && (uint8_t *)addr >= rle_last_chunk && (uint8_t *)addr < rle_last_chunk + chunk_size) {
+        rle_trigger_sample = rle_buf.end_sample - chunk_size + ((uint8_t *)addr - rle_last_chunk);
+    }
+    rle_trigger_addr = addr;
+}
+
+// Called while waiting for the dma. In a deep capture we have to keep compressing.
+static inline void poll_while_waiting() {
+    if (!rle_compressing || !rle_compress_queued_chunks()) {
+        tight_loop_contents();
+    }
+}
+
 static uint8_t wait_for_hardware_trigger(struct scoppy_context *ctx) {
     uint8_t trigger_mode = active_params->trigger_mode;
     if (trigger_mode == TRIGGER_MODE_NONE) {
@@ -593,7 +942,7 @@ static uint8_t wait_for_hardware_trigger(struct scoppy_context *ctx) {
             }
             last_time = now;
         } else {
-            tight_loop_contents();
+            poll_while_waiting();
         }
     }
 
@@ -657,6 +1006,268 @@ static uint8_t wait_for_hardware_trigger(struct scoppy_context *ctx) {
     return ret;
 }
 
+// A deep capture. Like a normal single shot frame but the samples are compressed as they arrive so there can be many
+// more of them. They are expanded again when they're sent so the app doesn't know the difference (apart from the
+// size of the frame).
+static void get_rle_samples(struct scoppy_context *ctx) {
+    assert(buffer_locked == false);
+
+    // Ensure the dma channels are writing to the buffer (a transfer to rubbish_buf might still be in progress)
+    while (ch1_stopped || ch2_stopped) {
+        tight_loop_contents();
+    }
+
+    uint64_t num_bytes_to_send = active_params->num_bytes_to_send;
+    uint64_t min_pre_trigger_samples = active_params->min_num_pre_trigger_bytes;
+
+    // The most samples we'll send. There's the same proportion of pre trigger samples as in a normal frame.
+    uint64_t max_samples = num_bytes_to_send * RLE_MAX_DEPTH_FACTOR;
+    uint64_t max_capture_samples = (uint64_t)active_params->realSampleRatePerChannel * RLE_MAX_CAPTURE_MS / 1000;
+    if (max_samples > max_capture_samples) {
+        max_samples = max_capture_samples;
+    }
+    if (max_samples < num_bytes_to_send) {
+        max_samples = num_bytes_to_send;
+    }
+    uint64_t max_pre_trigger_samples = max_samples * min_pre_trigger_samples / num_bytes_to_send;
+    uint64_t max_post_trigger_samples = max_samples - max_pre_trigger_samples;
+
+    // Start compressing
+    while (!queue_is_empty(&trigger_chunk_queue)) {
+        uint8_t *tmp;
+        queue_try_remove(&trigger_chunk_queue, &tmp);
+    }
+    scoppy_rle_clear(&rle_buf);
+    rle_last_chunk = NULL;
+    rle_trigger_addr = NULL;
+    rle_trigger_sample = -1;
+    rle_overrun = false;
+    rle_compressing = true;
+
+    // Aquire the same number of pretrigger samples as a normal frame. More will be compressed while we're waiting for
+    // the trigger.
+    while (rle_buf.end_sample < min_pre_trigger_samples && !rle_overrun) {
+        poll_while_waiting();
+    }
+
+    if (!rle_overrun) {
+        wait_for_hardware_trigger(ctx);
+        if (trigger_addr != NULL) {
+            rle_set_trigger(trigger_addr);
+        }
+    }
+
+    // Get the post trigger samples
+    while (!rle_overrun) {
+        rle_compress_queued_chunks();
+
+        if (trigger_addr == NULL) {
+            // Send the last max_samples samples
+            if (scoppy_rle_num_samples(&rle_buf) >= max_samples || scoppy_rle_is_full(&rle_buf)) {
+                break;
+            }
+        } else if (rle_trigger_sample >= 0) {
+            uint64_t num_pre = (uint64_t)rle_trigger_sample - rle_buf.first_sample;
+            uint64_t num_post = rle_buf.end_sample - (uint64_t)rle_trigger_sample;
+            if (num_post >= max_post_trigger_samples) {
+                break;
+            }
+
+            // The records have run out. Stop before the pre trigger samples get less than their share of the frame.
+            if (scoppy_rle_is_full(&rle_buf) && num_pre * num_bytes_to_send <= (num_pre + num_post) * min_pre_trigger_samples) {
+                break;
+            }
+        }
+    }
+
+    rle_compressing = false;
+
+    // Stop the dma channels writing to the raw chunks. We use them to expand the samples into.
+    buffer_locked = true;
+    while (!ch1_stopped || !ch2_stopped) {
+        tight_loop_contents();
+    }
+
+    // Anything left in the queue arrived after we stopped (or might have been overwritten if there was an overrun)
+    while (!queue_is_empty(&trigger_chunk_queue)) {
+        uint8_t *tmp;
+        queue_try_remove(&trigger_chunk_queue, &tmp);
+    }
+
+    if (rle_overrun) {
+        pico_scoppy_telemetry.num_rle_overruns++;
+        DEBUG_PRINT("rle: overrun after %lu samples\n", (unsigned long)rle_buf.end_sample);
+    }
+
+    // The part of the compressed samples that we'll send
+    uint64_t first_sample = rle_buf.first_sample;
+    uint64_t end_sample = rle_buf.end_sample;
+    int32_t trigger_idx = -1;
+    if (trigger_addr != NULL && rle_trigger_sample >= 0) {
+        // The trigger_addr lags behind the physical trigger point. See pico_scoppy_get_non_continuous_samples().
+        uint32_t lag_samples = active_params->realSampleRatePerChannel * 45 / 10000000;
+        if (lag_samples < 10) {
+            lag_samples = 10;
+        }
+        uint64_t trigger_sample = (uint64_t)rle_trigger_sample;
+        trigger_sample = trigger_sample > lag_samples ? trigger_sample - lag_samples : 0;
+
+        if (trigger_sample < first_sample) {
+            // the records ran out
+            trigger_sample = first_sample;
+        }
+        if (trigger_sample - first_sample > max_pre_trigger_samples) {
+            first_sample = trigger_sample - max_pre_trigger_samples;
+        }
+        if (end_sample - trigger_sample > max_post_trigger_samples) {
+            end_sample = trigger_sample + max_post_trigger_samples;
+        }
+        // Never negative. -1 and -2 mean there's no trigger.
+        trigger_idx = (int32_t)(trigger_sample - first_sample);
+    } else {
+        if (end_sample - first_sample > max_samples) {
+            first_sample = end_sample - max_samples;
+        }
+        if (active_params->trigger_mode != TRIGGER_MODE_NONE) {
+            // This indicates we looked for a trigger but didn't find one
+            trigger_idx = -2;
+        }
+    }
+
+#ifndef NDEBUG
+    printf("rle: sending %lu samples (%lu records), trigger_idx=%ld\n", (unsigned long)(end_sample - first_sample), (unsigned long)rle_buf.count,
+           (long)trigger_idx);
+#endif
+
+    // Expand the samples into the raw chunk area a message at a time. core0 writes each message while the next one is
+    // expanded so we alternate between 2 parts of the area.
+    struct scoppy_rle_reader reader;
+    scoppy_rle_reader_init(&reader, &rle_buf, first_sample);
+    uint8_t *expand_bufs[2] = {ring_buf1_arr + RING_BUF_OFFSET, ring_buf1_arr + RING_BUF_OFFSET + SCOPPY_OUTGOING_MAX_SAMPLE_BYTES};
+    int expand_buf_idx = 0;
+    bool is_new_wavepoint_record = true;
+    uint64_t remaining = end_sample - first_sample;
+    while (remaining > 0) {
+        uint32_t this_message_size = remaining < SCOPPY_OUTGOING_MAX_SAMPLE_BYTES ? (uint32_t)remaining : SCOPPY_OUTGOING_MAX_SAMPLE_BYTES;
+        remaining -= this_message_size;
+
+        uint8_t *dest = expand_bufs[expand_buf_idx];
+        expand_buf_idx ^= 1;
+        uint32_t num_read = scoppy_rle_read(&reader, dest, this_message_size);
+        assert(num_read == this_message_size);
+
+        struct scoppy_outgoing *msg = scoppy_new_outgoing_samples_msg(active_params->realSampleRatePerChannel, active_params->channels,
+                                                                      is_new_wavepoint_record, remaining == 0, false /* not cont mode */,
+                                                                      active_params->run_mode == RUN_MODE_SINGLE, trigger_idx, true /* logic mode */);
+        struct scoppy_iovec segment = {dest, num_read};
+        pico_scoppy_queue_samples_msg(msg, NULL, &segment, 1);
+
+        is_new_wavepoint_record = false;
+    }
+
+    // The last message points into the raw chunks
+    pico_scoppy_wait_for_queued_writes();
+
+    // Clean up in preparation for next invokation
+    ring_buf1.clear(&ring_buf1);
+
+#ifndef NDEBUG
+    first_ch1_reserved_byte_value = *(ring_buf1.next_chunk_addr);
+    first_ch2_reserved_byte_value = *(ring_buf1.next_chunk_addr);
+#endif
+
+    // Check for buffer overruns
+    assert(ring_buf1_arr[0] == 101);
+    assert(ring_buf1_arr[sizeof(ring_buf1_arr) - 1] == 102);
+    assert(rubbish_buf[0] == 103);
+    assert(rubbish_buf[RUBBISH_SIZE] == 104);
+
+    buffer_locked = false;
+}
+
+// Sends one frame as a series of samples messages. Returns the number of bytes sent.
+static uint32_t send_frame(struct scoppy_uint8_chunked_ring_buffer *buffer, volatile uint8_t *copy_from, int32_t copy_from_offset, int32_t trigger_idx,
+                           const struct scoppy_samples_msg_info *info, int total_bytes_per_sample, bool is_logic_mode) {
+    bool is_new_wavepoint_record = true;
+    uint32_t total_num_copied = 0;
+    int remaining = active_params->num_bytes_to_send;
+    while (remaining > 0) {
+
+        int this_message_size;
+        if (remaining <= SCOPPY_OUTGOING_MAX_SAMPLE_BYTES) {
+            this_message_size = remaining;
+        } else {
+            // The message data size must be an exact multiple of the number of channels - so that a sample can't span multiple
+            // messages. NB. for logic mode total_bytes_per_sample is always 1
+            this_message_size = (SCOPPY_OUTGOING_MAX_SAMPLE_BYTES / total_bytes_per_sample) * total_bytes_per_sample;
+        }
+
+#if DEBUG_SINGLE_SHOT
+        if (active_params->run_mode == RUN_MODE_SINGLE) {
+            printf("read_from(): copy_from=0x%lX, offset=%ld, size=%d\n", (unsigned long)copy_from, (long)copy_from_offset, (int)this_message_size);
+            // sleep_ms(1000); made no difference
+        }
+#endif
+
+        remaining -= this_message_size;
+        assert(remaining >= 0);
+        bool is_last_message = remaining <= 0;
+        struct scoppy_outgoing *msg =
+            scoppy_new_outgoing_samples_msg(active_params->realSampleRatePerChannel, active_params->channels, is_new_wavepoint_record, is_last_message,
+                                            false /* not cont mode */, active_params->run_mode == RUN_MODE_SINGLE, trigger_idx, is_logic_mode);
+
+        // Send the samples straight from the buffer rather than copying them into the message
+        struct scoppy_uint8_span span0, span1;
+        uint32_t num_copied = buffer->get_spans(buffer, (uint8_t *)copy_from, copy_from_offset, this_message_size, &span0, &span1);
+        struct scoppy_iovec segments[2] = {{span0.ptr, span0.len}, {span1.ptr, span1.len}};
+        int num_spans = span1.len > 0 ? 2 : 1;
+        total_num_copied += num_copied;
+
+        // add_checkpoint(&checkpoint4, "Copied", trigger_addr, frame_buffer);
+
+        // core0 writes the message while we prepare the next one
+        pico_scoppy_queue_samples_msg(msg, info, segments, num_spans);
+
+        copy_from_offset += this_message_size;
+        is_new_wavepoint_record = false;
+    }
+
+    assert(remaining == 0);
+    return total_num_copied;
+}
+
+// Sends the SEGMENT_INFO message followed by the frame from each segment. Returns the number of sample bytes sent.
+static uint32_t send_segments(struct scoppy_context *ctx, int total_bytes_per_sample, bool is_logic_mode) {
+    struct scoppy_segment_info infos[SCOPPY_MAX_SEGMENTS];
+    for (int i = 0; i < num_captured_segments; i++) {
+        infos[i] = captured_segments[i].info;
+    }
+
+    // The segment info must arrive before the samples so write it straight away. write_serial_v only returns once the
+    // records (which are held in the message) have been written.
+    struct scoppy_iovec records;
+    struct scoppy_outgoing *msg = scoppy_new_outgoing_segment_info_msg(active_params->realSampleRatePerChannel, infos, num_captured_segments, &records);
+    scoppy_write_outgoing_v(ctx->write_serial_v, msg, &records, 1);
+    scoppy_release_outgoing(msg);
+
+    uint32_t total_num_copied = 0;
+    for (int i = 0; i < num_captured_segments; i++) {
+        struct captured_segment *segment = &captured_segments[i];
+        total_num_copied += send_frame(segment->buffer, segment->copy_from, segment->copy_from_offset, segment->info.trigger_idx,
+                                       &segment->msg_info, total_bytes_per_sample, is_logic_mode);
+    }
+    return total_num_copied;
+}
+
+bool pico_scoppy_non_continuous_segments_pending() { return num_captured_segments > 0; }
+
+// Adds the time since phase_start_us to the phase's histogram and starts the next phase
+static inline void record_phase(int phase, uint32_t *phase_start_us) {
+    uint32_t now_us = time_us_32();
+    scoppy_telemetry_add(&pico_scoppy_telemetry, phase, now_us - *phase_start_us);
+    *phase_start_us = now_us;
+}
+
 void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
     // DEBUG_PRINT("pico_scoppy_get_non_continuous_samples(): dma_chan=%u\n", (unsigned)dma_chan);
 
@@ -669,6 +1280,13 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
     clear_checkpoints();
 #endif
 
+    if (rle_capture_mode) {
+        get_rle_samples(ctx);
+        return;
+    }
+
+    uint32_t phase_start_us = time_us_32();
+
 #if STATS_ENABLED
     total_get_samples_invokations++;
     absolute_time_t start_get_samples_checkpoint = get_absolute_time();
@@ -679,12 +1297,20 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 
     // Initialise variables and data structures shared between this method and the interrupt handlers
     trigger_addr = NULL;
+    trigger_time_us = 0;
 
-    // empty the trigger chunk queue
+    // empty the trigger chunk queue. It only has the chunks left over from the last frame's search - the dma handlers
+    // don't queue chunks while a frame is being sent (see total_dead_time)
     while (!queue_is_empty(&trigger_chunk_queue)) {
         uint8_t *tmp;
         queue_try_remove(&trigger_chunk_queue, &tmp); // yes -deliberately passing a pointer to the pointer
     }
+    trigger_queue_overflowed = false;
+    trigger_chunks_dropped = 0;
+    trigger_chunks_scanned = 0;
+    trigger_chunks_unscanned = 0;
+    frame_msg_info.unscanned_permille = 0;
+    frame_msg_info.trigger_fraction = 0;
 
     assert(buffer_locked == false);
     assert(waiting_for_pre_trigger_samples == false);
@@ -745,9 +1371,12 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 
     assert((active_buffer->size(active_buffer) % total_bytes_per_sample) == 0);
 
+    record_phase(SCOPPY_TELEMETRY_PRE_TRIGGER_WAIT, &phase_start_us);
+
 #if STATS_ENABLED
     absolute_time_t finished_pre_trigger_wait_checkpoint = get_absolute_time();
     total_pre_trigger_wait_time += absolute_time_diff_us(start_get_samples_checkpoint, finished_pre_trigger_wait_checkpoint);
+    total_dead_time += absolute_time_diff_us(start_get_samples_checkpoint, finished_pre_trigger_wait_checkpoint);
 #endif // STATS_ENABLED
 
     assert(queue_get_level(&trigger_chunk_queue) == 0);
@@ -784,10 +1413,16 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 
     looking_for_software_trigger_point = false;
 
+    // Segmented captures tell the app when each trigger happened. The dma handler works it out when it sees the
+    // trigger sample (see record_trigger_time()). Without a trigger it's when we stopped looking.
+    uint64_t segment_trigger_time_us = to_us_since_boot(get_absolute_time());
+
     // printf("Trigger chunks processed=%ld\n", trigger_chunks_processed);
 
     assert((active_buffer->size(active_buffer) % total_bytes_per_sample) == 0);
 
+    record_phase(SCOPPY_TELEMETRY_TRIGGER_WAIT, &phase_start_us);
+
 #if STATS_ENABLED
     absolute_time_t finished_trigger_wait_checkpoint = get_absolute_time();
     total_trigger_wait_time += absolute_time_diff_us(finished_pre_trigger_wait_checkpoint, finished_trigger_wait_checkpoint);
@@ -809,12 +1444,18 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
     }
     assert(waiting_for_post_trigger_samples == false);
 
+    if (trigger_time_us != 0) {
+        segment_trigger_time_us = trigger_time_us;
+    }
+
 #ifndef NDEBUG
     add_checkpoint(&checkpoint2, "Got post trigger samples", trigger_addr, active_buffer);
 #endif
 
     assert((active_buffer->size(active_buffer) % total_bytes_per_sample) == 0);
 
+    record_phase(SCOPPY_TELEMETRY_POST_TRIGGER_WAIT, &phase_start_us);
+
 #if STATS_ENABLED
     absolute_time_t finished_post_trigger_wait_checkpoint = get_absolute_time();
     total_post_trigger_wait_time += absolute_time_diff_us(finished_trigger_wait_checkpoint, finished_post_trigger_wait_checkpoint);
@@ -837,25 +1478,55 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
     // fairly frequently eg. less than 100ms (per dma channel) so that we can send at least 5 frames per second
     //
     assert(!ch1_stopped && !ch2_stopped && !buffer_locked);
-    buffer_locked = true;
+
+    // The buffer containing the frame we are about to send
+    struct scoppy_uint8_chunked_ring_buffer *frame_buffer = active_buffer;
+
+    if (dual_buffer_mode) {
+        // Switch the dma channels to the idle buffer. They keep writing to it while this frame is being sent.
+        assert(idle_buffer != NULL && idle_buffer->is_empty(idle_buffer));
+        pending_buffer = idle_buffer;
+
+        // Wait for both channels to stop writing to the frame buffer
+        while (reserved1_buffer == frame_buffer || reserved2_buffer == frame_buffer) {
+            tight_loop_contents();
+        }
+        assert(pending_buffer == NULL);
+
+        idle_buffer = frame_buffer;
+    } else if (num_segments > 0 && num_captured_segments + 1 < num_segments) {
+        // Keep this segment and move the dma channels on to the next partition (just like dual buffer mode)
+        struct scoppy_uint8_chunked_ring_buffer *next_buffer = &segment_bufs[num_captured_segments + 1];
+        assert(next_buffer->is_empty(next_buffer));
+        pending_buffer = next_buffer;
+
+        while (reserved1_buffer == frame_buffer || reserved2_buffer == frame_buffer) {
+            tight_loop_contents();
+        }
+        assert(pending_buffer == NULL);
+    } else {
+        buffer_locked = true;
 
 #if DEBUG_SINGLE_SHOT
-    if (active_params->run_mode == RUN_MODE_SINGLE) {
-        printf("-- SINGLE SHOT - waiting to lock buffer --\n");
-        active_buffer->dump(active_buffer);
-    }
+        if (active_params->run_mode == RUN_MODE_SINGLE) {
+            printf("-- SINGLE SHOT - waiting to lock buffer --\n");
+            active_buffer->dump(active_buffer);
+        }
 #endif
 
-    // Wait for the dma channels to stop writing to the buffer
-    while (!ch1_stopped || !ch2_stopped) {
-        tight_loop_contents();
+        // Wait for the dma channels to stop writing to the buffer
+        while (!ch1_stopped || !ch2_stopped) {
+            tight_loop_contents();
+        }
+        // printf("  both channels stopped\n");
     }
-    // printf("  both channels stopped\n");
 
 #ifndef NDEBUG
-    add_checkpoint(&checkpoint3, "Locked", trigger_addr, active_buffer);
+    add_checkpoint(&checkpoint3, "Locked", trigger_addr, frame_buffer);
 #endif
 
+    record_phase(SCOPPY_TELEMETRY_LOCKING, &phase_start_us);
+
 #if STATS_ENABLED
     absolute_time_t finished_locking_checkpoint = get_absolute_time();
     total_locking_time += absolute_time_diff_us(finished_post_trigger_wait_checkpoint, finished_locking_checkpoint);
@@ -868,23 +1539,23 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 #if DEBUG_SINGLE_SHOT
     if (active_params->run_mode == RUN_MODE_SINGLE) {
         printf("-- SINGLE SHOT - sending samples to app --\n");
-        active_buffer->dump(active_buffer);
+        frame_buffer->dump(frame_buffer);
     }
 #endif
 
     // We can now safely access the buffer
-    assert((active_buffer->size(active_buffer) % total_bytes_per_sample) == 0);
+    assert((frame_buffer->size(frame_buffer) % total_bytes_per_sample) == 0);
 
 #ifndef NDEBUG
     // save some attributes of the buffer so that we can check if it has been modified (it shouldn't be) while
     // we are processing it.
-    uint32_t saved_size = active_buffer->size(active_buffer);
-    uint8_t *saved_start_addr = active_buffer->start_addr;
+    uint32_t saved_size = frame_buffer->size(frame_buffer);
+    uint8_t *saved_start_addr = frame_buffer->start_addr;
 #endif
 
     // Check that we have enough bytes before the trigger_addr (this should always be the case)
     if (trigger_addr != NULL) {
-        int32_t trigger_byte_index = active_buffer->index(active_buffer, (uint8_t *)trigger_addr);
+        int32_t trigger_byte_index = frame_buffer->index(frame_buffer, (uint8_t *)trigger_addr);
         if (trigger_byte_index < active_params->min_num_pre_trigger_bytes) {
             // if (trigger_addr != NULL ) we previously had enough pre-trigger bytes but....
             // start_addr has progressed too far
@@ -915,9 +1586,9 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
         trigger_idx = active_params->min_num_pre_trigger_bytes / total_bytes_per_sample;
 
 #ifndef NDEBUG
-        if (active_buffer->end_addr >= active_buffer->start_addr) {
+        if (frame_buffer->end_addr >= frame_buffer->start_addr) {
             // Buffer has not wrapped
-            if (trigger_addr < active_buffer->start_addr || trigger_addr > active_buffer->end_addr) {
+            if (trigger_addr < frame_buffer->start_addr || trigger_addr > frame_buffer->end_addr) {
                 printf("invalid trigger_addr: outside unwrapped data\n");
                 print_debug();
                 sleep_ms(5000);
@@ -925,7 +1596,7 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
             }
         } else {
             // Buffer has wrapped
-            if (trigger_addr < active_buffer->start_addr && trigger_addr > active_buffer->end_addr) {
+            if (trigger_addr < frame_buffer->start_addr && trigger_addr > frame_buffer->end_addr) {
                 printf("invalid trigger_addr: outside wrapped data\n");
                 print_debug();
                 sleep_ms(5000);
@@ -954,9 +1625,9 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
             uint8_t test_value = active_params->trigger_type == TRIGGER_TYPE_FALLING_EDGE ? 255u : 0u;
 
             uint8_t trig_ch_mask = 1u << active_params->trigger_channel;
-            if (active_buffer->end_addr >= active_buffer->start_addr) {
+            if (frame_buffer->end_addr >= frame_buffer->start_addr) {
                 // buffer is unwrapped
-                for (test_edge_addr = trigger_addr; test_edge_addr >= active_buffer->start_addr; test_edge_addr--) {
+                for (test_edge_addr = trigger_addr; test_edge_addr >= frame_buffer->start_addr; test_edge_addr--) {
                     if (((*test_edge_addr) & trig_ch_mask) == test_value) {
                         edge_addr = test_edge_addr;
                         distance = trigger_addr - edge_addr;
@@ -965,9 +1636,9 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
                 }
             } else {
                 // buffer is wrapped
-                if (trigger_addr < active_buffer->end_addr) {
-                    assert(trigger_addr >= active_buffer->arr);
-                    for (test_edge_addr = trigger_addr; test_edge_addr >= active_buffer->arr; test_edge_addr--) {
+                if (trigger_addr < frame_buffer->end_addr) {
+                    assert(trigger_addr >= frame_buffer->arr);
+                    for (test_edge_addr = trigger_addr; test_edge_addr >= frame_buffer->arr; test_edge_addr--) {
                         if (((*test_edge_addr) & trig_ch_mask) == test_value) {
                             edge_addr = test_edge_addr;
                             distance = trigger_addr - edge_addr;
@@ -977,23 +1648,23 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 
                     if (edge_addr == NULL) {
                         // continue searching backwards from the end of the buffer
-                        for (test_edge_addr = active_buffer->arr_end; test_edge_addr >= active_buffer->start_addr; test_edge_addr--) {
+                        for (test_edge_addr = frame_buffer->arr_end; test_edge_addr >= frame_buffer->start_addr; test_edge_addr--) {
                             if (((*test_edge_addr) & trig_ch_mask) == test_value) {
                                 edge_addr = test_edge_addr;
-                                distance = (trigger_addr - active_buffer->arr) + (active_buffer->arr_end - edge_addr);
+                                distance = (trigger_addr - frame_buffer->arr) + (frame_buffer->arr_end - edge_addr);
                                 break;
                             }
                         }
                     }
                 } else {
-                    assert(trigger_addr >= active_buffer->start_addr);
-                    assert(trigger_addr <= active_buffer->arr_end);
+                    assert(trigger_addr >= frame_buffer->start_addr);
+                    assert(trigger_addr <= frame_buffer->arr_end);
 
                     // Trigger point is between start and arrayend
-                    for (test_edge_addr = active_buffer->arr_end; test_edge_addr >= active_buffer->start_addr; test_edge_addr--) {
+                    for (test_edge_addr = frame_buffer->arr_end; test_edge_addr >= frame_buffer->start_addr; test_edge_addr--) {
                         if (((*test_edge_addr) & trig_ch_mask) == test_value) {
                             edge_addr = test_edge_addr;
-                            distance = active_buffer->arr_end - edge_addr;
+                            distance = frame_buffer->arr_end - edge_addr;
                             break;
                         }
                     }
@@ -1043,9 +1714,10 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 #if STATS_ENABLED
         num_timeouts++;
 #endif
+        pico_scoppy_telemetry.num_timeouts++;
 
         // Copy the last n samples from the buffer
-        copy_from = active_buffer->end_addr;
+        copy_from = frame_buffer->end_addr;
         copy_from_offset = (active_params->num_bytes_to_send - 1) * -1;
 
         if (active_params->trigger_mode != TRIGGER_MODE_NONE) {
@@ -1057,60 +1729,47 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 #if DEBUG_SINGLE_SHOT
     if (active_params->run_mode == RUN_MODE_SINGLE) {
         printf("-- SINGLE SHOT --\n");
-        active_buffer->dump(active_buffer);
+        frame_buffer->dump(frame_buffer);
     }
 #endif
 
-    bool is_new_wavepoint_record = true;
-    uint32_t total_num_copied = 0;
-    int remaining = active_params->num_bytes_to_send;
-    while (remaining > 0) {
+    bool send_now = true;
+    if (num_segments > 0) {
+        // Keep the segment until all of them have been captured
+        struct captured_segment *segment = &captured_segments[num_captured_segments++];
+        segment->buffer = frame_buffer;
+        segment->copy_from = copy_from;
+        segment->copy_from_offset = copy_from_offset;
+        segment->info.trigger_time_us = segment_trigger_time_us;
+        segment->info.trigger_idx = trigger_idx;
+        segment->info.num_bytes = active_params->num_bytes_to_send;
+        segment->msg_info = frame_msg_info;
+
+        send_now = num_captured_segments == num_segments;
+    }
 
-        int this_message_size;
-        if (remaining <= SCOPPY_OUTGOING_MAX_SAMPLE_BYTES) {
-            this_message_size = remaining;
+    if (send_now) {
+        uint32_t total_num_copied;
+        uint32_t expected_num_copied;
+        if (num_segments > 0) {
+            total_num_copied = send_segments(ctx, total_bytes_per_sample, is_logic_mode);
+            expected_num_copied = (uint32_t)active_params->num_bytes_to_send * num_segments;
         } else {
-            // The message data size must be an exact multiple of the number of channels - so that a sample can't span multiple
-            // messages. NB. for logic mode total_bytes_per_sample is always 1
-            this_message_size = (SCOPPY_OUTGOING_MAX_SAMPLE_BYTES / total_bytes_per_sample) * total_bytes_per_sample;
+            total_num_copied = send_frame(frame_buffer, copy_from, copy_from_offset, trigger_idx, &frame_msg_info, total_bytes_per_sample, is_logic_mode);
+            expected_num_copied = active_params->num_bytes_to_send;
         }
 
-#if DEBUG_SINGLE_SHOT
-        if (active_params->run_mode == RUN_MODE_SINGLE) {
-            printf("read_from(): copy_from=0x%lX, offset=%ld, size=%d\n", (unsigned long)copy_from, (long)copy_from_offset, (int)this_message_size);
-            // sleep_ms(1000); made no difference
-        }
-#endif
-
-        remaining -= this_message_size;
-        assert(remaining >= 0);
-        bool is_last_message = remaining <= 0;
-        struct scoppy_outgoing *msg =
-            scoppy_new_outgoing_samples_msg(active_params->realSampleRatePerChannel, active_params->channels, is_new_wavepoint_record, is_last_message,
-                                            false /* not cont mode */, active_params->run_mode == RUN_MODE_SINGLE, trigger_idx, is_logic_mode);
-
-        uint8_t *dest_addr = msg->payload + msg->payload_len;
-        uint32_t num_copied = active_buffer->read_from(active_buffer, (uint8_t *)copy_from, copy_from_offset, dest_addr, this_message_size);
-        msg->payload_len += num_copied;
-        total_num_copied += num_copied;
-
-        // add_checkpoint(&checkpoint4, "Copied", trigger_addr, active_buffer);
-
-        scoppy_write_outgoing(ctx->write_serial, msg);
+        // The messages point into the frame buffer so wait for them to be written before it's cleared
+        pico_scoppy_wait_for_queued_writes();
 
-        copy_from_offset += this_message_size;
-        is_new_wavepoint_record = false;
-    }
-
-    assert(remaining == 0);
-
-    if (total_num_copied != active_params->num_bytes_to_send) {
-        printf("Error. num_copied=%lu, num_bytes_to_send=%d\n", (unsigned long)total_num_copied, active_params->num_bytes_to_send);
+        if (total_num_copied != expected_num_copied) {
+            printf("Error. num_copied=%lu, expected=%lu\n", (unsigned long)total_num_copied, (unsigned long)expected_num_copied);
 #ifndef NDEBUG
-        print_debug();
-        sleep_ms(1000);
-        abort();
+            print_debug();
+            sleep_ms(1000);
+            abort();
 #endif
+        }
     }
 
 #ifndef NDEBUG
@@ -1127,21 +1786,34 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
 
 #ifndef NDEBUG
     // check if the buffer has been illegally accessed while we were using it
-    assert(active_buffer->size(active_buffer) == saved_size);
-    assert(active_buffer->start_addr == saved_start_addr);
+    assert(frame_buffer->size(frame_buffer) == saved_size);
+    assert(frame_buffer->start_addr == saved_start_addr);
 #endif
 
     //
     // Clean up in preparation for next invokation of this method
     //
 
-    // empty the buffer in preparation for new sample data to be written to it
-    active_buffer->clear(active_buffer);
+    if (send_now) {
+        if (num_segments > 0) {
+            // The dma channels are stopped so it's safe to start again from the first partition
+            for (int i = 0; i < num_segments; i++) {
+                segment_bufs[i].clear(&segment_bufs[i]);
+            }
+            num_captured_segments = 0;
+            active_buffer = &segment_bufs[0];
+        } else {
+            // empty the buffer in preparation for new sample data to be written to it
+            frame_buffer->clear(frame_buffer);
+        }
+    }
 
 #ifndef NDEBUG
-    // Not sure which handler will be called next
-    first_ch1_reserved_byte_value = *(active_buffer->next_chunk_addr);
-    first_ch2_reserved_byte_value = *(active_buffer->next_chunk_addr);
+    if (!dual_buffer_mode && num_captured_segments == 0) {
+        // Not sure which handler will be called next
+        first_ch1_reserved_byte_value = *(active_buffer->next_chunk_addr);
+        first_ch2_reserved_byte_value = *(active_buffer->next_chunk_addr);
+    }
 #endif
 
     // Check for buffer overruns
@@ -1150,12 +1822,18 @@ void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx) {
     assert(rubbish_buf[0] == 103);
     assert(rubbish_buf[RUBBISH_SIZE] == 104);
 
-    // Resume normal dma transfers
+    // Resume normal dma transfers (in dual buffer mode they were never interrupted)
     buffer_locked = false;
 
+    record_phase(SCOPPY_TELEMETRY_BUFFER_COPY, &phase_start_us);
+    pico_scoppy_telemetry.num_frames++;
+
 #if STATS_ENABLED
     end_get_samples_checkpoint = get_absolute_time();
     total_buf_copy_time += absolute_time_diff_us(finished_locking_checkpoint, end_get_samples_checkpoint);
+    // The samples were written to the rubbish_buf (or to the other buffer in dual buffer mode) without being searched
+    // for a trigger
+    total_dead_time += absolute_time_diff_us(finished_post_trigger_wait_checkpoint, end_get_samples_checkpoint);
     total_get_samples_time += absolute_time_diff_us(start_get_samples_checkpoint, end_get_samples_checkpoint);
 #endif // STATS_ENABLED
 }
@@ -1223,7 +1901,10 @@ void pico_scoppy_start_non_continuous_sampling() {
         printf("  locking wait     : %ld us\n", (long int)(total_locking_time / total_get_samples_invokations));
         printf("  buf copy         : %ld us\n", (long int)(total_buf_copy_time / total_get_samples_invokations));
         printf(" external          : %ld us\n", (long int)(total_external_time / (total_get_samples_invokations - 1)));
+        printf(" dead time         : %ld us (dual_buffer_mode=%d)\n", (long int)(total_dead_time / total_get_samples_invokations), (int)dual_buffer_mode);
         printf(" max trig q size   : %u\n", (unsigned)stats_max_trigger_queue_size);
+        printf(" trig chunks checked: %lu\n", (unsigned long)stats_trigger_chunks_checked);
+        printf(" trig chunks unscanned: %lu\n", (unsigned long)stats_trigger_chunks_unscanned);
         printf(" %% timeouts       : %lu\n", (long unsigned)((num_timeouts * 100) / total_get_samples_invokations));
         printf("=========\n");
     }
@@ -1236,11 +1917,14 @@ void pico_scoppy_start_non_continuous_sampling() {
     total_trigger_wait_time = 0;
     total_post_trigger_wait_time = 0;
     total_buf_copy_time = 0;
+    total_dead_time = 0;
     total_get_samples_time = 0;
     total_get_samples_invokations = 0;
     stats_sample_rate = active_params->realSampleRatePerChannel;
     stats_num_channels = active_params->num_enabled_channels;
     stats_max_trigger_queue_size = 0;
+    stats_trigger_chunks_checked = 0;
+    stats_trigger_chunks_unscanned = 0;
     stats_num_bytes_to_send = active_params->num_bytes_to_send;
     num_timeouts = 0;
 #endif // STATS_ENABLED
@@ -1277,6 +1961,20 @@ void pico_scoppy_start_non_continuous_sampling() {
     //    abort();
     //#endif
 
+    num_segments = active_params->num_segments > 1 ? active_params->num_segments : 0;
+    num_captured_segments = 0;
+    if (num_segments > 0 && chunk_size > SEGMENT_MAX_CHUNK_SIZE) {
+        chunk_size = SEGMENT_MAX_CHUNK_SIZE;
+    }
+
+    // Deep single shot captures compress the logic samples as they arrive (see RLE_CAPTURE_ENABLED). The run mode is a
+    // live param but changing to or from single shot changes num_bytes_to_send so sampling is restarted anyway.
+    rle_capture_mode = RLE_CAPTURE_ENABLED && is_logic_mode && active_params->run_mode == RUN_MODE_SINGLE && num_segments == 0;
+    DEBUG_PRINT("    rle_capture_mode=%d\n", (int)rle_capture_mode);
+    if (rle_capture_mode && chunk_size > RLE_MAX_CHUNK_SIZE) {
+        chunk_size = RLE_MAX_CHUNK_SIZE;
+    }
+
     // For ease of processing the chunk size is a multiple of the number of channels. This prevents multichannel samples
     // spanning more than one chunk
     chunk_size = (chunk_size / total_bytes_per_sample) * total_bytes_per_sample;
@@ -1292,9 +1990,74 @@ void pico_scoppy_start_non_continuous_sampling() {
     assert((chunk_size % total_bytes_per_sample) == 0);
     // assert(chunk_size < active_params->min_num_post_trigger_bytes); // to ensure trigger_addr chunk becomes unreserved (pio triggering)
 
+    // Use as many segments as will fit in the array
+    uint32_t segment_size = 0;
+    while (num_segments > 1) {
+        segment_size = ((sizeof(ring_buf1_arr) - (2 * RING_BUF_OFFSET)) / num_segments) & ~3u;
+        if (segment_size >= (uint32_t)active_params->num_bytes_to_send + (chunk_size * SEGMENT_SPARE_CHUNKS)) {
+            break;
+        }
+        num_segments--;
+    }
+    if (num_segments < 2) {
+        num_segments = 0;
+    }
+    DEBUG_PRINT("    num_segments=%d (requested %u), segment_size=%lu\n", num_segments, (unsigned)active_params->num_segments, (unsigned long)segment_size);
+
+    // If a frame fits in a dual buffer we can use two buffers. The dma channels write to one while we send the
+    // other to the app. Single shot frames are too big so we fall back to locking the buffer.
+    // The dual buffers use the power of 2 ring buffer variant so the chunk size must be a power of 2 and still be a
+    // multiple of the sample size.
+    bool is_pow2_sample_size = (total_bytes_per_sample & (total_bytes_per_sample - 1)) == 0;
+    dual_buffer_mode = DUAL_BUFFER_ENABLED && !rle_capture_mode && num_segments == 0 && is_pow2_sample_size &&
+                       DUAL_BUFFER_SIZE >= (uint32_t)active_params->num_bytes_to_send + (MAX_CHUNK_SIZE * 10);
+    DEBUG_PRINT("    dual_buffer_mode=%d\n", (int)dual_buffer_mode);
+
+    if (dual_buffer_mode) {
+        // round down to a power of 2
+        int pow2_chunk_size = 1;
+        while (pow2_chunk_size * 2 <= chunk_size) {
+            pow2_chunk_size *= 2;
+        }
+        chunk_size = pow2_chunk_size;
+        DEBUG_PRINT("    pow2 chunk_size=%d\n", chunk_size);
+        assert((chunk_size % total_bytes_per_sample) == 0);
+    }
+
     samples_per_chunk = chunk_size / total_bytes_per_sample;
 
-    scoppy_uint8_chunked_ring_buffer_init(&ring_buf1, ring_buf1_arr + 1, sizeof(ring_buf1_arr) - 2, chunk_size);
+    // The telemetry is reset whenever sampling restarts so that it is for these settings
+    pico_scoppy_telemetry.sample_rate = active_params->realSampleRatePerChannel;
+    pico_scoppy_telemetry.chunk_size = chunk_size;
+    uint32_t bytes_per_sec = active_params->realSampleRatePerChannel * total_bytes_per_sample;
+    dma_ns_per_byte = bytes_per_sec > 0 ? 1000000000u / bytes_per_sec : 0;
+
+    if (dual_buffer_mode) {
+        scoppy_uint8_chunked_ring_buffer_init_pow2(&ring_buf1, ring_buf1_arr + RING_BUF_OFFSET, DUAL_BUFFER_SIZE, chunk_size);
+        scoppy_uint8_chunked_ring_buffer_init_pow2(&ring_buf2, ring_buf1_arr + RING_BUF_OFFSET + DUAL_BUFFER_SIZE, DUAL_BUFFER_SIZE, chunk_size);
+        ring_buf2.clear(&ring_buf2);
+        idle_buffer = &ring_buf2;
+    } else if (rle_capture_mode) {
+        scoppy_uint8_chunked_ring_buffer_init(&ring_buf1, ring_buf1_arr + RING_BUF_OFFSET, RLE_RAW_BUFFER_SIZE, chunk_size);
+        scoppy_rle_init(&rle_buf, (uint32_t *)(ring_buf1_arr + RING_BUF_OFFSET + RLE_RAW_BUFFER_SIZE), RLE_NUM_RECORDS);
+        // Leave room for the 2 reserved chunks and a bit more
+        rle_max_queued_chunks = ring_buf1.num_chunks - 4;
+        if (rle_max_queued_chunks > TRIGGER_CHUNK_QUEUE_SIZE - 1) {
+            rle_max_queued_chunks = TRIGGER_CHUNK_QUEUE_SIZE - 1;
+        }
+        idle_buffer = NULL;
+    } else if (num_segments > 0) {
+        for (int i = 0; i < num_segments; i++) {
+            scoppy_uint8_chunked_ring_buffer_init(&segment_bufs[i], ring_buf1_arr + RING_BUF_OFFSET + (i * segment_size), segment_size, chunk_size);
+        }
+        idle_buffer = NULL;
+    } else {
+        scoppy_uint8_chunked_ring_buffer_init(&ring_buf1, ring_buf1_arr + RING_BUF_OFFSET, sizeof(ring_buf1_arr) - (2 * RING_BUF_OFFSET), chunk_size);
+        idle_buffer = NULL;
+    }
+
+    active_buffer = num_segments > 0 ? &segment_bufs[0] : &ring_buf1;
+    pending_buffer = NULL;
 
     if (active_params->trigger_mode == TRIGGER_MODE_NONE) {
         max_trigger_chunks = -1;
@@ -1324,6 +2087,20 @@ void pico_scoppy_start_non_continuous_sampling() {
     }
     DEBUG_PRINT("    max_trigger_chunks=%ld\n", (long int)max_trigger_chunks);
 
+    // A trigger found in a chunk further back than this might have had its pre trigger samples overwritten by the
+    // time the post trigger samples have been captured. Allow for the whole frame and the reserved chunks.
+    {
+        int32_t frame_chunks = active_params->num_bytes_to_send / chunk_size + 1;
+        int32_t backlog = (int32_t)active_buffer->num_chunks - frame_chunks - 4;
+        if (backlog < 1) {
+            backlog = 1;
+        } else if (backlog > TRIGGER_CHUNK_QUEUE_SIZE - 1) {
+            backlog = TRIGGER_CHUNK_QUEUE_SIZE - 1;
+        }
+        max_trigger_backlog = (uint32_t)backlog;
+    }
+    DEBUG_PRINT("    max_trigger_backlog=%lu\n", (unsigned long)max_trigger_backlog);
+
     active_buffer->clear(active_buffer);
 
     init_dma_channel(dma_chan1, is_logic_mode);
@@ -1331,10 +2108,12 @@ void pico_scoppy_start_non_continuous_sampling() {
 
     // reserve space in the active buffer for the dma channels to write to
     reserved1 = active_buffer->reserve_chunk(active_buffer);
+    reserved1_buffer = active_buffer;
     dma_channel_set_write_addr(dma_chan1, reserved1, false);
     dma_channel_set_trans_count(dma_chan1, chunk_size, false);
 
     reserved2 = active_buffer->reserve_chunk(active_buffer);
+    reserved2_buffer = active_buffer;
     dma_channel_set_write_addr(dma_chan2, reserved2, false);
     dma_channel_set_trans_count(dma_chan2, chunk_size, false);
 
@@ -1432,7 +2211,8 @@ void pico_scoppy_non_continuous_sampling_init() {
     rubbish_buf[0] = 103;
     rubbish_buf[RUBBISH_SIZE] = 104;
 
-    queue_init(&trigger_chunk_queue, sizeof(uint8_t *), 100);
+    queue_init(&trigger_chunk_queue, sizeof(uint8_t *), TRIGGER_CHUNK_QUEUE_SIZE);
+    scoppy_trigger_dispatch_init(&trigger_dispatch);
 
     // Set up the DMA to start transferring data as soon as it appears in FIFO
     dma_chan1 = dma_claim_unused_channel(true);
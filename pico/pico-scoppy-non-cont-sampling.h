@@ -28,6 +28,10 @@ void pico_scoppy_non_continuous_sampling_init();
 void pico_scoppy_start_non_continuous_sampling();
 void pico_scoppy_get_non_continuous_samples(struct scoppy_context *ctx);
 void pico_scoppy_stop_non_continuous_sampling();
+// True while a segmented capture has captured some, but not all, of its segments
+bool pico_scoppy_non_continuous_segments_pending();
+// Called by core0 to scan some of the chunks while core1 is looking for a trigger. Returns straight away if it isn't.
+void pico_scoppy_help_with_trigger_scan();
 
 extern uint dma_chan1;
 extern uint dma_chan2;
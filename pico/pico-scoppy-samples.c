@@ -28,6 +28,7 @@
 #include "hardware/clocks.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 #include "pico/time.h"
@@ -35,9 +36,11 @@
 //
 #include "scoppy-chunked-ring-buffer.h"
 #include "scoppy-common.h"
+#include "scoppy-frame-queue.h"
 #include "scoppy-message.h"
 #include "scoppy-outgoing.h"
 #include "scoppy-ring-buffer.h"
+#include "scoppy-seqlock.h"
 #include "scoppy.h"
 
 #include "pico-scoppy-cont-sampling.h"
@@ -56,6 +59,190 @@ static struct sampling_params params1, params2;
 struct sampling_params *active_params = &params1;
 struct sampling_params *dormant_params = &params2;
 
+// Messages from the sampler (core1) waiting to be written to USB by core0. The samples aren't copied so core1 must
+// wait for a frame to be written before it reuses the buffer.
+#define FRAME_QUEUE_SIZE 16
+static struct scoppy_frame_desc frame_queue_descs[FRAME_QUEUE_SIZE];
+static struct scoppy_frame_queue frame_queue;
+
+// core1's copy of the context. Its writes go through the frame queue.
+static struct scoppy_context sampler_ctx;
+
+int pico_scoppy_queue_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    if (iov[0].len > SCOPPY_FRAME_QUEUE_MAX_HEADER_SIZE) {
+        // It would never fit so don't wait for room. Anything big must be written as a segment.
+        assert(false);
+        return -1;
+    }
+
+    while (!scoppy_frame_queue_push_v(&frame_queue, iov, count)) {
+        // wait for core0 to make some room
+        tight_loop_contents();
+    }
+
+    // Like ctx_write_serial_v() we assume that all the bytes will be written
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].len;
+    }
+    return total;
+}
+
+// A queued samples message can point into itself (eg. delta encoded samples) so core1 keeps the last one until it has
+// been written. Only the one so that there is always a message in the pool for core0.
+static struct scoppy_outgoing *pending_samples_msg = NULL;
+static uint32_t pending_samples_ticket;
+
+static void wait_for_ticket(uint32_t ticket) {
+    while (!scoppy_frame_queue_is_written(&frame_queue, ticket)) {
+        tight_loop_contents();
+    }
+}
+
+static void release_pending_samples_msg() {
+    if (pending_samples_msg != NULL) {
+        wait_for_ticket(pending_samples_ticket);
+        scoppy_release_outgoing(pending_samples_msg);
+        pending_samples_msg = NULL;
+    }
+}
+
+void pico_scoppy_queue_samples_msg(struct scoppy_outgoing *msg, const struct scoppy_samples_msg_info *info, const struct scoppy_iovec *segments,
+                                   int num_segments) {
+    scoppy_write_outgoing_samples_msg(pico_scoppy_queue_write_serial_v, msg, active_params->samples_msg_version, info, segments, num_segments);
+    uint32_t ticket = scoppy_frame_queue_get_ticket(&frame_queue);
+
+    // core0 writes this one while we prepare the next
+    release_pending_samples_msg();
+    pending_samples_msg = msg;
+    pending_samples_ticket = ticket;
+}
+
+void pico_scoppy_wait_for_queued_writes() {
+    wait_for_ticket(scoppy_frame_queue_get_ticket(&frame_queue));
+    release_pending_samples_msg();
+}
+
+// The default for core1. Returns once the message has been written so the caller can reuse the memory straight away.
+static int sampler_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    int ret = pico_scoppy_queue_write_serial_v(iov, count);
+    pico_scoppy_wait_for_queued_writes();
+    return ret;
+}
+
+void pico_scoppy_write_queued_frames(struct scoppy_context *ctx) { scoppy_frame_queue_write(&frame_queue, ctx->write_serial_v, FRAME_QUEUE_SIZE); }
+
+// Both cores take messages from the outgoing pool (the sync message on core0 and the samples on core1)
+static spin_lock_t *outgoing_pool_spin_lock;
+static uint32_t outgoing_pool_saved_irq;
+
+static void lock_outgoing_pool() {
+    uint32_t saved_irq = spin_lock_blocking(outgoing_pool_spin_lock);
+    outgoing_pool_saved_irq = saved_irq;
+}
+
+static void unlock_outgoing_pool() { spin_unlock(outgoing_pool_spin_lock, outgoing_pool_saved_irq); }
+
+// Written by core0 and read by core1. See struct sampling_live_params.
+static struct scoppy_seqlock live_params_lock;
+static struct sampling_live_params shared_live_params;
+// The last ones published by core0 (only accessed by core0)
+static struct sampling_live_params published_live_params;
+// The generation of the live params in active_params (only accessed by core1)
+static uint32_t applied_live_params_generation;
+
+static void get_live_params(const struct sampling_params *params, struct sampling_live_params *live) {
+    // zero the padding so that we can memcmp
+    memset(live, 0, sizeof(*live));
+    live->trigger_type = params->trigger_type;
+    live->trigger_level = params->trigger_level;
+    live->trigger_hysteresis = params->trigger_hysteresis;
+    live->trigger_level2 = params->trigger_level2;
+    live->trigger_options = params->trigger_options;
+    live->trigger_time_min = params->trigger_time_min;
+    live->trigger_time_max = params->trigger_time_max;
+    live->run_mode = params->run_mode;
+    live->samples_msg_version = params->samples_msg_version;
+    live->logic_edges = params->logic_edges;
+    live->min_num_pre_trigger_bytes = params->min_num_pre_trigger_bytes;
+    live->min_num_post_trigger_bytes = params->min_num_post_trigger_bytes;
+}
+
+bool pico_scoppy_publish_live_params(const struct sampling_params *params) {
+    struct sampling_live_params live;
+    get_live_params(params, &live);
+    if (memcmp(&live, &published_live_params, sizeof(live)) == 0) {
+        return false;
+    }
+
+    published_live_params = live;
+    scoppy_seqlock_write(&live_params_lock, &shared_live_params, &live, sizeof(live));
+    return true;
+}
+
+struct scoppy_telemetry pico_scoppy_telemetry;
+// Set by core0. Only core1 resets its own counts.
+static volatile bool telemetry_reset_requested = false;
+
+// Called by core1. The dma interrupt handlers record their latency so they mustn't run while it's being cleared.
+static void clear_sampler_telemetry() {
+    uint32_t saved_irq_status = save_and_disable_interrupts();
+    for (int i = 0; i < SCOPPY_TELEMETRY_NUM_HISTOGRAMS; i++) {
+        if (i != SCOPPY_TELEMETRY_USB_WRITE) {
+            scoppy_histogram_clear(&pico_scoppy_telemetry.histograms[i]);
+        }
+    }
+    pico_scoppy_telemetry.num_frames = 0;
+    pico_scoppy_telemetry.num_timeouts = 0;
+    pico_scoppy_telemetry.max_trigger_queue_size = 0;
+    restore_interrupts(saved_irq_status);
+}
+
+void pico_scoppy_send_telemetry(struct scoppy_context *ctx, bool reset) {
+    // Too big for the stack
+    static struct scoppy_telemetry snapshot;
+    scoppy_telemetry_copy(&snapshot, &pico_scoppy_telemetry);
+
+    struct scoppy_outgoing *msg = scoppy_new_outgoing_telemetry_msg(&snapshot);
+    scoppy_write_outgoing_v(ctx->write_serial_v, msg, NULL, 0);
+    scoppy_release_outgoing(msg);
+
+    if (reset) {
+        scoppy_histogram_clear(&pico_scoppy_telemetry.histograms[SCOPPY_TELEMETRY_USB_WRITE]);
+        telemetry_reset_requested = true;
+    }
+}
+
+// Called by core1 between frames
+static void apply_live_params() {
+    if (scoppy_seqlock_get_generation(&live_params_lock) == applied_live_params_generation) {
+        return;
+    }
+
+    struct sampling_live_params live;
+    applied_live_params_generation = scoppy_seqlock_read(&live_params_lock, &live, &shared_live_params, sizeof(live));
+
+    // The dma interrupt handlers use the pre/post trigger sizes so don't let them see a half updated active_params
+    uint32_t saved_irq_status = save_and_disable_interrupts();
+    if (!active_params->is_logic_mode) {
+        active_params->trigger_type = live.trigger_type;
+    }
+    active_params->trigger_level = live.trigger_level;
+    active_params->trigger_hysteresis = live.trigger_hysteresis;
+    active_params->trigger_level2 = live.trigger_level2;
+    active_params->trigger_options = live.trigger_options;
+    active_params->trigger_time_min = live.trigger_time_min;
+    active_params->trigger_time_max = live.trigger_time_max;
+    active_params->run_mode = live.run_mode;
+    active_params->samples_msg_version = live.samples_msg_version;
+    active_params->logic_edges = live.logic_edges;
+    active_params->min_num_pre_trigger_bytes = live.min_num_pre_trigger_bytes;
+    active_params->min_num_post_trigger_bytes = live.min_num_post_trigger_bytes;
+    restore_interrupts(saved_irq_status);
+
+    DEBUG_PRINT(" core1: applied live params gen=%lu\n", (unsigned long)applied_live_params_generation);
+}
+
 void pico_scoppy_init_samplers() {
 
     // Init GPIO for analogue use: hi-Z, no pulls, disable digital input buffer.
@@ -64,6 +251,12 @@ void pico_scoppy_init_samplers() {
 
     adc_init();
 
+    scoppy_frame_queue_init(&frame_queue, frame_queue_descs, FRAME_QUEUE_SIZE);
+    scoppy_seqlock_init(&live_params_lock);
+
+    outgoing_pool_spin_lock = spin_lock_init(spin_lock_claim_unused(true));
+    scoppy_set_outgoing_pool_lock(lock_outgoing_pool, unlock_outgoing_pool);
+
     pico_scoppy_continuous_sampling_init();
     pico_scoppy_non_continuous_sampling_init();
 }
@@ -95,6 +288,9 @@ static void restart_sampling() {
 
     stop_sampling();
 
+    // The telemetry is for the current settings
+    clear_sampler_telemetry();
+
     // Activate the new sampling params
     struct sampling_params *tmp = active_params;
     active_params = dormant_params;
@@ -105,7 +301,7 @@ static void restart_sampling() {
 
     if (active_params->get_samples == pico_scoppy_get_non_continuous_samples) {
         pico_scoppy_start_non_continuous_sampling();
-    } else if (active_params->get_samples == pico_scoppy_get_continuous_samples) {
+    } else if (active_params->get_samples == pico_scoppy_get_continuous_samples || active_params->get_samples == pico_scoppy_get_streamed_samples) {
         pico_scoppy_start_continuous_sampling();
     } else {
         // sampling has stopped eg. no channels are configured
@@ -144,7 +340,11 @@ void pico_scoppy_sampling_loop() {
     DEBUG_PRINT("Entered sampling_loop() - core1\n");
 
     // core0 will provide the context pointer
-    struct scoppy_context *ctx = (struct scoppy_context *)multicore_fifo_pop_blocking();
+    sampler_ctx = *(struct scoppy_context *)multicore_fifo_pop_blocking();
+    // Only core0 writes to USB
+    sampler_ctx.write_serial = NULL;
+    sampler_ctx.write_serial_v = sampler_write_serial_v;
+    struct scoppy_context *ctx = &sampler_ctx;
 
     // Determines the maximum number of frames per second
     //(or in continuous mode the frequency at which we send more samples to the app)
@@ -188,7 +388,8 @@ void pico_scoppy_sampling_loop() {
         bool delay = true;
         while (delay) {
             absolute_time_t now = get_absolute_time();
-            if (absolute_time_diff_us(last_get_samples_time, now) < min_delay_time_us) {
+            // In stream mode we send samples as fast as the link allows
+            if (active_params->run_mode != RUN_MODE_STREAM && absolute_time_diff_us(last_get_samples_time, now) < min_delay_time_us) {
                 // Delay some more
                 sleep_us(1000);
             } else {
@@ -205,12 +406,20 @@ void pico_scoppy_sampling_loop() {
             }
         }
 
+        // Pick up changes to eg. the trigger level at the frame boundary
+        apply_live_params();
+
+        if (telemetry_reset_requested) {
+            telemetry_reset_requested = false;
+            clear_sampler_telemetry();
+        }
+
         last_get_samples_time = get_absolute_time();
         CHECK_SAMPLING_PARAMS("core1-a-2", active_params);
         active_params->get_samples(ctx);
         CHECK_SAMPLING_PARAMS("core1-a-3", active_params);
 
-        if (active_params->run_mode == RUN_MODE_SINGLE) {
+        if (active_params->run_mode == RUN_MODE_SINGLE && !pico_scoppy_non_continuous_segments_pending()) {
             // HACK. Both cores might be readin/writing to this at the same time
             scoppy.app.run_mode = RUN_MODE_STOP;
             scoppy.app.dirty = true;
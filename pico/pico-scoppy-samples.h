@@ -21,6 +21,8 @@
 #pragma once
 
 #include "scoppy.h"
+#include "scoppy-message.h"
+#include "scoppy-telemetry.h"
 
 // This must be an even number
 // Also using powers of 2 because some FFT algorithms require this
@@ -41,6 +43,9 @@ struct sampling_params {
     uint32_t preferredSampleRatePerChannelHz;
     uint32_t realSampleRatePerChannel;
     uint32_t clkdivint;
+    // In continuous mode, only 1 in every 'decimation' samples is kept (for sample rates that are too slow for the adc
+    // clock divider). Always 1 otherwise.
+    uint32_t decimation;
 
     // The total number of bytes for all channels (not bytes per channel!)
     int num_bytes_to_send;
@@ -60,6 +65,13 @@ struct sampling_params {
     uint8_t trigger_mode; // off/normal/single
     uint8_t trigger_channel; // channel id in scope mode, a mask of channels in logic mode
     uint8_t trigger_type; // eg. rising edge, falling edge
+    uint8_t trigger_level;
+    uint8_t trigger_hysteresis;
+    // See scoppy-trigger-fsm.h
+    uint8_t trigger_level2;
+    uint8_t trigger_options;
+    uint32_t trigger_time_min;
+    uint32_t trigger_time_max;
 
     // run mode - we need to know what run mode was used to get the last
     // samples eg. single shot mode can last a while so the scoppy.app.run_mode might have changed in the meantime
@@ -68,6 +80,15 @@ struct sampling_params {
     // logic or scope
     bool is_logic_mode;
 
+    // The newest version of the samples message that the app can read
+    uint8_t samples_msg_version;
+
+    // Stream logic samples as edges. See scoppy-edges.h
+    bool logic_edges;
+
+    // The number of frames in a segmented capture (see scoppy_app.num_segments). 0 or 1 for normal captures.
+    uint8_t num_segments;
+
     void (*get_samples)(struct scoppy_context *ctx);
 
     // for debugging
@@ -77,11 +98,48 @@ struct sampling_params {
 extern struct sampling_params *active_params;
 extern struct sampling_params *dormant_params;
 
+// The sampling params that can change without restarting sampling. core0 publishes them and core1 copies them into
+// active_params before it starts on the next frame. Changes to anything else in sampling_params need a restart.
+struct sampling_live_params {
+    uint8_t trigger_type; // only in oscilloscope mode. In logic mode it selects the pio program.
+    uint8_t trigger_level;
+    uint8_t trigger_hysteresis;
+    uint8_t trigger_level2;
+    uint8_t trigger_options;
+    uint32_t trigger_time_min;
+    uint32_t trigger_time_max;
+    uint8_t run_mode;
+    uint8_t samples_msg_version;
+    bool logic_edges;
+    int min_num_pre_trigger_bytes;
+    int min_num_post_trigger_bytes;
+};
+
 void pico_scoppy_init_samplers();
 void pico_scoppy_sampling_loop();
 bool pico_scoppy_is_sampler_restart_required();
 void pico_scoppy_get_null_samples(struct scoppy_context *ctx);
 
+// core1 doesn't write to USB. It queues messages for core0 to write. See scoppy-frame-queue.h
+int pico_scoppy_queue_write_serial_v(const struct scoppy_iovec *iov, int count);
+// Wait for everything queued so far to be written (and release the last samples message)
+void pico_scoppy_wait_for_queued_writes();
+// Queue a samples message (see scoppy_write_outgoing_samples_msg()). The message is released once it has been written
+// so the caller must not release it.
+void pico_scoppy_queue_samples_msg(struct scoppy_outgoing *msg, const struct scoppy_samples_msg_info *info, const struct scoppy_iovec *segments,
+                                   int num_segments);
+// Called by core0
+void pico_scoppy_write_queued_frames(struct scoppy_context *ctx);
+
+// Called by core0. Returns true if the live params had changed.
+bool pico_scoppy_publish_live_params(const struct sampling_params *params);
+
+// core1 updates everything except the USB write times which core0 updates. See scoppy-telemetry.h
+extern struct scoppy_telemetry pico_scoppy_telemetry;
+// Called by core0 when the app asks for the telemetry. If reset is true the counts start again from zero (core1 resets
+// its counts before its next frame).
+void pico_scoppy_send_telemetry(struct scoppy_context *ctx, bool reset);
+
 inline void pico_scoppy_check_params(const char *label, struct sampling_params *params) {
     if (params->get_samples == 0) {
         printf("%s - sampling_params get_samples is null\n", label);
@@ -46,6 +46,8 @@
  */
 bool scoppy_usb_init();
 bool scoppy_usb_out_chars(const char *buf, int length);
+// Write several buffers as if they were one
+bool scoppy_usb_out_chars_v(const char *const bufs[], const int lengths[], int count);
 int scoppy_usb_in_chars(char *buf, int length);
 
 #endif
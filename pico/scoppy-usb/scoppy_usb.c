@@ -30,13 +30,10 @@ static int64_t timer_task(__unused alarm_id_t id, __unused void *user_data) {
     return SCOPPY_USB_TASK_INTERVAL_US;
 }
 
-bool scoppy_usb_out_chars(const char *buf, int length) {
-    static uint64_t last_avail_time;
-    uint32_t owner;
-    if (!mutex_try_enter(&scoppy_usb_mutex, &owner)) {
-        if (owner == get_core_num()) return false; // would deadlock otherwise
-        mutex_enter_blocking(&scoppy_usb_mutex);
-    }
+static uint64_t last_avail_time;
+
+// Must be called with the mutex held
+static void out_chars_locked(const char *buf, int length) {
     if (tud_cdc_connected()) {
         for (int i = 0; i < length;) {
             int n = length - i;
@@ -61,6 +58,30 @@ bool scoppy_usb_out_chars(const char *buf, int length) {
         // reset our timeout
         last_avail_time = 0;
     }
+}
+
+bool scoppy_usb_out_chars(const char *buf, int length) {
+    uint32_t owner;
+    if (!mutex_try_enter(&scoppy_usb_mutex, &owner)) {
+        if (owner == get_core_num()) return false; // would deadlock otherwise
+        mutex_enter_blocking(&scoppy_usb_mutex);
+    }
+    out_chars_locked(buf, length);
+    mutex_exit(&scoppy_usb_mutex);
+
+    return true;
+}
+
+bool scoppy_usb_out_chars_v(const char *const bufs[], const int lengths[], int count) {
+    uint32_t owner;
+    if (!mutex_try_enter(&scoppy_usb_mutex, &owner)) {
+        if (owner == get_core_num()) return false; // would deadlock otherwise
+        mutex_enter_blocking(&scoppy_usb_mutex);
+    }
+    // hold the mutex for all the buffers so that nothing else can be written in between
+    for (int i = 0; i < count; i++) {
+        out_chars_locked(bufs[i], lengths[i]);
+    }
     mutex_exit(&scoppy_usb_mutex);
 
     return true;
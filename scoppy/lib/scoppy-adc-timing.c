@@ -0,0 +1,165 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-adc-timing.h"
+#include "scoppy.h"
+
+void scoppy_adc_timing_calculate(struct scoppy_adc_timing *timing, uint32_t preferred_sample_rate_per_channel, uint8_t num_channels,
+                                 uint32_t max_decimation) {
+    assert(num_channels > 0);
+    assert(max_decimation > 0);
+
+    if (preferred_sample_rate_per_channel == 0) {
+        preferred_sample_rate_per_channel = 1;
+    }
+
+    // The total number of cycles between samples of the same channel. Deliberately using ints so that DIV.FRAC is zero.
+    // A non-zero frac would cause the period between samples to not be exactly the same.
+    uint32_t cycles_per_conversion = SCOPPY_ADC_CLOCK_HZ / (preferred_sample_rate_per_channel * num_channels);
+    uint32_t decimation = 1;
+
+    if (cycles_per_conversion > SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION && max_decimation > 1) {
+        // Too slow for the ADC divider. Look for the smallest decimation that divides the cycles exactly. If there isn't
+        // one (within a reasonable range) then use the smallest decimation and accept that the rate won't be exact.
+        uint32_t total_cycles = cycles_per_conversion;
+        uint32_t min_decimation = (total_cycles + SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION - 1) / SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION;
+        if (min_decimation > max_decimation) {
+            min_decimation = max_decimation;
+        }
+
+        decimation = min_decimation;
+        for (uint32_t d = min_decimation; d <= max_decimation && d <= min_decimation * 2; d++) {
+            if (total_cycles % d == 0 && total_cycles / d >= SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION) {
+                decimation = d;
+                break;
+            }
+        }
+
+        cycles_per_conversion = total_cycles / decimation;
+    }
+
+    if (cycles_per_conversion > SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION) {
+        cycles_per_conversion = SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION;
+    } else if (cycles_per_conversion <= SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION) {
+        // A clkdivint of 95 gives a measured samplerate of 250kS/s (expected 500kS/s) and values between 1 and 94 give
+        // unexpected results. A clkdivint of 0 gives 500kS/s.
+        cycles_per_conversion = SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION;
+    }
+
+    timing->clkdivint = cycles_per_conversion == SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION ? 0 : cycles_per_conversion - 1;
+    timing->decimation = decimation;
+    timing->cycles_per_sample = cycles_per_conversion * num_channels * decimation;
+    timing->real_sample_rate_per_channel = SCOPPY_ADC_CLOCK_HZ / timing->cycles_per_sample;
+}
+
+void scoppy_adc_ring_reader_init(struct scoppy_adc_ring_reader *reader, const uint8_t *arr, uint32_t size, uint8_t num_channels,
+                                 uint32_t decimation) {
+    assert(size > 0 && (size & (size - 1)) == 0);
+    assert(num_channels > 0 && num_channels < size);
+    assert(decimation > 0);
+
+    reader->arr = arr;
+    reader->size = size;
+    reader->num_channels = num_channels;
+    reader->decimation = decimation;
+    reader->read_count = 0;
+    reader->phase = 0;
+    reader->discarded_samples = false;
+}
+
+// The number of whole sample sets that can be read. If the DMA has lapped the reader then skip ahead so that we read
+// the newest samples and leave half of the ring for the DMA to write to while we are reading.
+static uint32_t available_sample_sets(struct scoppy_adc_ring_reader *reader, uint32_t write_count) {
+    uint32_t available = write_count - reader->read_count;
+    if (available > reader->size) {
+        uint32_t skip = available - reader->size / 2;
+        skip -= skip % reader->num_channels;
+        reader->read_count += skip;
+        reader->phase = 0;
+        reader->discarded_samples = true;
+        available -= skip;
+    }
+    return available / reader->num_channels;
+}
+
+uint32_t scoppy_adc_ring_reader_read(struct scoppy_adc_ring_reader *reader, uint32_t write_count, uint8_t *dest, uint32_t dest_size) {
+    uint32_t num_sets = available_sample_sets(reader, write_count);
+    uint32_t mask = reader->size - 1;
+    uint32_t num_channels = reader->num_channels;
+    uint32_t copied = 0;
+
+    uint32_t set = 0;
+    while (set < num_sets) {
+        if (reader->phase > 0) {
+            // skip as many sets as we can in one go
+            uint32_t n = num_sets - set < reader->phase ? num_sets - set : reader->phase;
+            reader->phase -= n;
+            set += n;
+            continue;
+        }
+
+        if (copied + num_channels > dest_size) {
+            // leave the rest for the next read
+            break;
+        }
+
+        uint32_t idx = reader->read_count + set * num_channels;
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            dest[copied++] = reader->arr[(idx + ch) & mask];
+        }
+        reader->phase = reader->decimation - 1;
+        set++;
+    }
+
+    reader->read_count += set * num_channels;
+    return copied;
+}
+
+uint32_t scoppy_adc_ring_reader_get_spans(struct scoppy_adc_ring_reader *reader, uint32_t write_count, uint32_t max_len,
+                                          struct scoppy_uint8_span *span0, struct scoppy_uint8_span *span1) {
+    assert(reader->decimation == 1);
+
+    uint32_t len = available_sample_sets(reader, write_count) * reader->num_channels;
+    if (len > max_len) {
+        len = max_len - (max_len % reader->num_channels);
+    }
+
+    uint32_t start = reader->read_count & (reader->size - 1);
+    uint32_t len0 = reader->size - start;
+    if (len0 > len) {
+        len0 = len;
+    }
+
+    span0->ptr = (uint8_t *)reader->arr + start;
+    span0->len = len0;
+    span1->ptr = (uint8_t *)reader->arr;
+    span1->len = len - len0;
+
+    reader->read_count += len;
+    return len;
+}
+
+bool scoppy_adc_ring_reader_was_overwritten(struct scoppy_adc_ring_reader *reader, uint32_t from_count, uint32_t write_count) {
+    return write_count - from_count > reader->size;
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+#include "scoppy-chunked-ring-buffer.h"
+
+//
+// The parts of DMA driven continuous sampling that don't need the hardware.
+//
+// In continuous (roll) mode the ADC runs freely in round robin mode and a single DMA channel copies each conversion
+// from the ADC FIFO into a ring (using the DMA write address ring wrapping). The ADC clock divider paces the samples
+// so the spacing is exact and the CPU isn't involved until the samples are read.
+//
+// The ADC divider can't go slower than about 730 conversions/sec so slower rates are achieved by only keeping 1 in
+// every 'decimation' sample sets (a sample set is one sample from each enabled channel).
+//
+
+// The ADC is clocked at 48MHz and a conversion takes 96 cycles
+#define SCOPPY_ADC_CLOCK_HZ 48000000u
+#define SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION 96u
+// Div.INT is only 2 bytes
+#define SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION 64000u
+
+struct scoppy_adc_timing {
+    // The value to pass to adc_set_clkdiv(). 0 means full speed.
+    uint32_t clkdivint;
+
+    // Keep 1 in every 'decimation' sample sets
+    uint32_t decimation;
+
+    // The number of ADC clock cycles between the samples of a channel (ie. between sample sets)
+    uint32_t cycles_per_sample;
+
+    uint32_t real_sample_rate_per_channel;
+};
+
+// Calculate the clock divider (and decimation) for the sample rate. The decimation will be no more than max_decimation
+// so use 1 if the samples can't be decimated. In which case the result is the same as the original calculation in
+// calculate_clkdiv_and_real_sample_rate_for_adc().
+void scoppy_adc_timing_calculate(struct scoppy_adc_timing *timing, uint32_t preferred_sample_rate_per_channel, uint8_t num_channels,
+                                 uint32_t max_decimation);
+
+//
+// Reads the samples that the DMA has written to the ring. The DMA write position is passed in as a count of the total
+// number of bytes written since the DMA was started (ie. initial transfer count - current transfer count). The read
+// position is also a count so the ring itself doesn't need to know anything about the DMA.
+//
+struct scoppy_adc_ring_reader {
+    const uint8_t *arr;
+
+    // must be a power of 2
+    uint32_t size;
+
+    // The number of bytes in a sample set
+    uint32_t num_channels;
+
+    uint32_t decimation;
+
+    // The total number of bytes read (or skipped). Always a multiple of num_channels.
+    uint32_t read_count;
+
+    // The number of sample sets to skip before the next one is kept
+    uint32_t phase;
+
+    // Set if unread samples were overwritten by the DMA
+    bool discarded_samples;
+};
+
+void scoppy_adc_ring_reader_init(struct scoppy_adc_ring_reader *reader, const uint8_t *arr, uint32_t size, uint8_t num_channels,
+                                 uint32_t decimation);
+
+// Copy the (decimated) sample sets written since the last read into dest. Only whole sample sets are copied. Returns
+// the number of bytes copied.
+uint32_t scoppy_adc_ring_reader_read(struct scoppy_adc_ring_reader *reader, uint32_t write_count, uint8_t *dest, uint32_t dest_size);
+
+// Like scoppy_adc_ring_reader_read() but doesn't copy. Instead the sample sets are described by (at most) 2 spans.
+// Only available when decimation is 1.
+uint32_t scoppy_adc_ring_reader_get_spans(struct scoppy_adc_ring_reader *reader, uint32_t write_count, uint32_t max_len,
+                                          struct scoppy_uint8_span *span0, struct scoppy_uint8_span *span1);
+
+// Returns true if the DMA has overwritten any of the bytes from from_count onwards. eg. spans that were sent after
+// being returned by scoppy_adc_ring_reader_get_spans().
+bool scoppy_adc_ring_reader_was_overwritten(struct scoppy_adc_ring_reader *reader, uint32_t from_count, uint32_t write_count);
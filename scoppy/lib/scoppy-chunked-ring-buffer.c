@@ -217,13 +217,16 @@ static void scoppy_uint8_chunked_ring_buffer_unreserve_chunk(struct scoppy_uint8
     CHECK(ring);
 }
 
-// Read all data from a particular address in the buffer. The address maybe modified by an offset
-uint32_t scoppy_uint8_chunked_ring_buffer_read_from(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *src_addr, int32_t src_offset, uint8_t *dest, uint32_t max_bytes_to_copy) {
-    ASSERT(max_bytes_to_copy >= 0);
+// Resolve an address and offset into (at most) 2 contiguous spans of valid data
+uint32_t scoppy_uint8_chunked_ring_buffer_get_spans(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *src_addr, int32_t src_offset,
+                                                    uint32_t max_len, struct scoppy_uint8_span *span0, struct scoppy_uint8_span *span1) {
+    span0->ptr = NULL;
+    span0->len = 0;
+    span1->ptr = NULL;
+    span1->len = 0;
 
     if (ring->end_addr == NULL) {
         // buffer is empty
-        //ASSERT(ring->start_addr == NULL);
         return 0;
     }
 
@@ -236,148 +239,58 @@ uint32_t scoppy_uint8_chunked_ring_buffer_read_from(struct scoppy_uint8_chunked_
         return 0;
     }
 
-    if (ring->end_addr >= ring->start_addr) {
-        //
-        // Not wrapped
-        //
-
-        // arr <= start_addr <= end_addr <= arr_end
-        // valid data is from start_addr to end_addr
-
-        if (src_addr < ring->start_addr || src_addr > ring->end_addr) {
-            ASSERT(!"invalid src_addr param: outside non-wrapped data");
-            return 0;
-        }
+    // Work with the distance from start_addr rather than addresses so that we don't need to worry about wrapping
+    int32_t idx = ring->index(ring, src_addr);
+    if (idx < 0) {
+        ASSERT(!"invalid src_addr param: outside valid data");
+        return 0;
+    }
 
-        // Ajusting for the offset is easy here because we don't need to worry about wrapping
-        src_addr += src_offset;
+    idx += src_offset;
+    uint32_t data_size = ring->size(ring);
+    if (idx < 0 || (uint32_t)idx >= data_size) {
+        ASSERT(!"invalid src_offset param: outside valid data");
+        return 0;
+    }
 
-        if (src_addr < ring->start_addr || src_addr > ring->end_addr) {
-            ASSERT(!"invalid src_offset param: outside non-wrapped data");
-            return 0;
-        }
+    uint32_t len = MIN(data_size - idx, max_len);
+    if (len == 0) {
+        return 0;
+    }
 
-        int data_size = (ring->end_addr - src_addr) + 1;
-        int num_to_copy = MIN(data_size, max_bytes_to_copy);
+    // The number of bytes from start_addr to the end of the array. If the buffer hasn't wrapped this will be
+    // at least data_size
+    uint32_t len_to_arr_end = (ring->arr_end - ring->start_addr) + 1;
 
-        //printf("copying from: 0x%lX\n", (unsigned long)src_addr);
-        memcpy(dest, src_addr, num_to_copy);
-        return num_to_copy;
+    if ((uint32_t)idx >= len_to_arr_end) {
+        // src_addr (after the offset) is between arr and end_addr
+        span0->ptr = ring->arr + (idx - len_to_arr_end);
+        span0->len = len;
     } else {
-        //
-        // Wrapped
-        //
-
-        // arr <= end_addr < start_addr <= arr_end
-        // valid data is from start_addr to arr_end and then arr to end_addr
-
-        if (src_addr < ring->start_addr && src_addr > ring->end_addr) {
-            ASSERT(!"invalid src_addr param: outside wrapped data");
-            return 0;
+        span0->ptr = ring->start_addr + idx;
+        span0->len = MIN(len, len_to_arr_end - idx);
+        if (span0->len < len) {
+            span1->ptr = ring->arr;
+            span1->len = len - span0->len;
         }
+    }
 
-        // Apply the offset
-        if (src_offset > 0) {
-            if (src_addr <= ring->end_addr) {
-                ASSERT(src_addr >= ring->arr && src_addr <= ring->end_addr);
-
-                // easy. src_addr won't wrap after applying the (+ve) offset - but we need to check it isn't past
-                // the end of valid data
-                src_addr += src_offset;
-                if (src_addr > ring->end_addr) {
-                    ASSERT(!"invalid src_offset param: past wrapped data (1)");
-                    return 0;
-                }
-            } else {
-                ASSERT(src_addr >= ring->start_addr && src_addr <= ring->arr_end);
-
-                int bytes_to_end_of_buffer = ring->arr_end - src_addr;
-                if (src_offset <= bytes_to_end_of_buffer) {
-                    src_addr += src_offset;
-                    ASSERT(src_addr <= ring->arr_end);
-                } else {
-                    src_offset -= bytes_to_end_of_buffer;
-                    ASSERT(src_offset > 0);
-
-                    // if src_offset is now 1, src_addr should equal ring->addr (this why the -1 is in the next statement)
-                    src_addr = ring->arr + src_offset - 1;
-                    if (src_addr > ring->end_addr) {
-                        ASSERT(!"invalid src_offset param: past wrapped data (2)");
-                        return 0;
-                    }
-                }
-            }
-        } else if (src_offset < 0) {
-            if (src_addr >= ring->start_addr) {
-                ASSERT(src_addr >= ring->start_addr && src_addr <= ring->arr_end);
-
-                // easy. src_addr won't wrap after applying the (-ve) offset
-                src_addr += src_offset;
-                if (src_addr < ring->start_addr) {
-                    ASSERT(!"invalid src_offset param: before wrapped data (1)");
-                    return 0;
-                }
-            } else {
-                ASSERT(src_addr >= ring->arr && src_addr <= ring->end_addr);
-                int bytes_to_start_of_buffer = ring->arr - src_addr; // NB. this will be -ve
-
-                if (src_offset >= bytes_to_start_of_buffer) {
-                    // eg. src_offset == -1 and bytes_to_start_of_buffer = -2
-                    // src_addr won't wrap after applying the offset
-                    src_addr += src_offset;
-                    ASSERT(src_addr >= ring->arr);
-                } else {
-                    // eg -10 = -10 - -2 = -8
-                    src_offset -= bytes_to_start_of_buffer;
-                    ASSERT(src_offset < 0);
-
-                    // if src_offset is now -1, src_addr should equal ring->arr_end - 0
-                    // if src_offset is now -2, src_addr should equal ring->arr_end - 1
-                    // if src_offset is now -3, src_addr should equal ring->arr_end - 2
-                    // etc
-                    src_addr = ring->arr_end + src_offset + 1;
-                    if (src_addr < ring->start_addr) {
-                        ASSERT(!"invalid src_offset param: before wrapped data (2)");
-                        return 0;
-                    }
-                }
-            }
-        } else {
-            // src_offset is 0
-        }
-
-        // same test as further above. If this fails then its a programming error in this function
-        if (src_addr < ring->start_addr && src_addr > ring->end_addr) {
-            ASSERT(!"invalid src_addr param: outside wrapped data (2)");
-            return 0;
-        }
-
-        if (src_addr >= ring->arr && src_addr <= ring->end_addr) {
-            int data_size = (ring->end_addr - src_addr) + 1;
-            int num_to_copy = MIN(data_size, max_bytes_to_copy);
-            memcpy(dest, src_addr, num_to_copy);
-            return num_to_copy;
-        } else {
-            ASSERT(src_addr >= ring->start_addr && src_addr <= ring->arr_end);
-
-            int data_size = (ring->arr_end - src_addr) + 1;
-            int first_copy_size = MIN(data_size, max_bytes_to_copy);
-            memcpy(dest, src_addr, first_copy_size);
+    return len;
+}
 
-            data_size = (ring->end_addr - ring->arr) + 1;
-            int second_copy_size = MIN(data_size, max_bytes_to_copy - first_copy_size);
-            if (second_copy_size > 0) {
-                memcpy(dest + first_copy_size, ring->arr, second_copy_size);
-            } else {
-                second_copy_size = 0;
-            }
+// Read all data from a particular address in the buffer. The address maybe modified by an offset
+uint32_t scoppy_uint8_chunked_ring_buffer_read_from(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *src_addr, int32_t src_offset, uint8_t *dest, uint32_t max_bytes_to_copy) {
+    struct scoppy_uint8_span span0, span1;
+    uint32_t len = scoppy_uint8_chunked_ring_buffer_get_spans(ring, src_addr, src_offset, max_bytes_to_copy, &span0, &span1);
 
-            return first_copy_size + second_copy_size;
-        }
+    if (span0.len > 0) {
+        memcpy(dest, span0.ptr, span0.len);
+    }
+    if (span1.len > 0) {
+        memcpy(dest + span0.len, span1.ptr, span1.len);
     }
 
-    ASSERT("WTF?");
-    return 0;
+    return len;
 }
 
 int16_t scoppy_uint8_chunked_ring_buffer_read_byte(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *src_addr, int32_t src_offset) {
@@ -452,6 +365,12 @@ void scoppy_uint8_chunked_ring_buffer_copy(struct scoppy_uint8_chunked_ring_buff
     // End of data that can be read (inclusive) - NULL means the buffer is empty
     to->end_addr = ring->end_addr;
 
+    // power of two variant
+    to->mask = ring->mask;
+    to->start_idx = ring->start_idx;
+    to->end_idx = ring->end_idx;
+    to->next_chunk_idx = ring->next_chunk_idx;
+
     to->dump = ring->dump;
 
     to->get_id = ring->get_id;
@@ -482,6 +401,9 @@ void scoppy_uint8_chunked_ring_buffer_copy(struct scoppy_uint8_chunked_ring_buff
     // Read all the data from the buffer
     to->read_all = ring->read_all;
 
+    // Like read_from() but without copying
+    to->get_spans = ring->get_spans;
+
     // Read all data from a particular address in the buffer. The address maybe modified by an offset
     to->read_from = ring->read_from;
 
@@ -507,6 +429,12 @@ void scoppy_uint8_chunked_ring_buffer_init(struct scoppy_uint8_chunked_ring_buff
     ring->end_addr = NULL;   // empty buffer
     ring->next_chunk_addr = arr;
 
+    // not used by this variant
+    ring->mask = 0;
+    ring->start_idx = 0;
+    ring->end_idx = 0;
+    ring->next_chunk_idx = 0;
+
 #ifndef NDEBUG
     ring->dump = dump_struct;
 #endif
@@ -522,6 +450,7 @@ void scoppy_uint8_chunked_ring_buffer_init(struct scoppy_uint8_chunked_ring_buff
 
     // ring->put = scoppy_uint8_chunked_ring_buffer_put;
     // ring->get = scoppy_uint8_chunked_ring_buffer_get;
+    ring->get_spans = scoppy_uint8_chunked_ring_buffer_get_spans;
     ring->read_from = scoppy_uint8_chunked_ring_buffer_read_from;
     ring->read_all = scoppy_uint8_chunked_ring_buffer_read_all;
     ring->read_byte = scoppy_uint8_chunked_ring_buffer_read_byte;
@@ -530,3 +459,101 @@ void scoppy_uint8_chunked_ring_buffer_init(struct scoppy_uint8_chunked_ring_buff
 
     CHECK(ring);
 }
+
+//
+// Power of two variant
+//
+
+// 1 if x isn't 0, otherwise 0. Without a branch (the M0+ has no conditional instructions so a compare that produces a
+// value can turn into one).
+static inline uint32_t pow2_is_nonzero(uint32_t x) { return (x | (0u - x)) >> 31; }
+
+// Set the addresses from the indexes. The addresses are NULL when the buffer is empty.
+static inline void scoppy_uint8_chunked_ring_buffer_pow2_sync(struct scoppy_uint8_chunked_ring_buffer *ring) {
+    uintptr_t keep = 0u - (uintptr_t)pow2_is_nonzero(ring->end_idx - ring->start_idx);
+    ring->start_addr = (uint8_t *)((uintptr_t)(ring->arr + (ring->start_idx & ring->mask)) & keep);
+    ring->end_addr = (uint8_t *)((uintptr_t)(ring->arr + ((ring->end_idx - 1) & ring->mask)) & keep);
+    ring->next_chunk_addr = ring->arr + (ring->next_chunk_idx & ring->mask);
+}
+
+static uint32_t scoppy_uint8_chunked_ring_buffer_pow2_size(struct scoppy_uint8_chunked_ring_buffer *ring) {
+    return ring->end_idx - ring->start_idx;
+}
+
+static int32_t scoppy_uint8_chunked_ring_buffer_pow2_index(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *addr) {
+    // deliberately allowing NULL to be supplied as the addr
+    if (addr == NULL) {
+        return -1;
+    }
+
+    if (addr < ring->arr || addr > ring->arr_end) {
+        ASSERT(!"out of bounds");
+        return -1;
+    }
+
+    // If addr is outside valid data then idx will be >= size (including when the buffer is empty)
+    uint32_t idx = ((uint32_t)(addr - ring->arr) - ring->start_idx) & ring->mask;
+    return idx < (ring->end_idx - ring->start_idx) ? (int32_t)idx : -1;
+}
+
+static void scoppy_uint8_chunked_ring_buffer_pow2_clear(struct scoppy_uint8_chunked_ring_buffer *ring) {
+    ring->start_idx = 0;
+    ring->end_idx = 0;
+    ring->next_chunk_idx = 0;
+    scoppy_uint8_chunked_ring_buffer_pow2_sync(ring);
+    CHECK(ring);
+}
+
+static bool scoppy_uint8_chunked_ring_buffer_pow2_is_empty(struct scoppy_uint8_chunked_ring_buffer *ring) {
+    return ring->start_idx == ring->end_idx;
+}
+
+static uint8_t *scoppy_uint8_chunked_ring_buffer_pow2_reserve_chunk(struct scoppy_uint8_chunked_ring_buffer *ring) {
+    uint32_t this_chunk_idx = ring->next_chunk_idx;
+    ring->next_chunk_idx += ring->chunk_size;
+
+    // If the buffer isn't empty and this is the chunk at start_idx then it will be overwritten by the caller so bump
+    // start_idx. If that was the only chunk then the buffer is now empty.
+    uint32_t bump = pow2_is_nonzero(ring->end_idx - ring->start_idx) & (pow2_is_nonzero(this_chunk_idx - ring->start_idx - ring->arr_size) ^ 1u);
+    ring->start_idx += ring->chunk_size & (0u - bump);
+
+    scoppy_uint8_chunked_ring_buffer_pow2_sync(ring);
+    CHECK(ring);
+    return ring->arr + (this_chunk_idx & ring->mask);
+}
+
+static void scoppy_uint8_chunked_ring_buffer_pow2_unreserve_chunk(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *chunk_addr) {
+    // Chunks are unreserved in the same order that they were reserved
+    ASSERT(chunk_addr == ring->arr + (ring->end_idx & ring->mask));
+
+    // NB. If the buffer was empty then start_idx == end_idx so start_idx is already pointing to this chunk
+    ring->end_idx += ring->chunk_size;
+
+    scoppy_uint8_chunked_ring_buffer_pow2_sync(ring);
+    CHECK(ring);
+}
+
+void scoppy_uint8_chunked_ring_buffer_init_pow2(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *arr, uint32_t arr_size, uint32_t chunk_size) {
+    assert(arr_size > 0 && (arr_size & (arr_size - 1)) == 0);
+    assert(chunk_size > 0 && (chunk_size & (chunk_size - 1)) == 0);
+    assert(chunk_size <= arr_size);
+
+    scoppy_uint8_chunked_ring_buffer_init(ring, arr, arr_size, chunk_size);
+    ASSERT(ring->arr_end == arr + arr_size - 1);
+
+    ring->mask = arr_size - 1;
+    ring->start_idx = 0;
+    ring->end_idx = 0;
+    ring->next_chunk_idx = 0;
+
+    ring->size = scoppy_uint8_chunked_ring_buffer_pow2_size;
+    ring->index = scoppy_uint8_chunked_ring_buffer_pow2_index;
+    ring->clear = scoppy_uint8_chunked_ring_buffer_pow2_clear;
+    ring->is_empty = scoppy_uint8_chunked_ring_buffer_pow2_is_empty;
+    ring->reserve_chunk = scoppy_uint8_chunked_ring_buffer_pow2_reserve_chunk;
+    ring->unreserve_chunk = scoppy_uint8_chunked_ring_buffer_pow2_unreserve_chunk;
+
+    // get_spans(), read_from() etc. work with the addresses so they are shared with the other variant
+
+    CHECK(ring);
+}
@@ -36,6 +36,12 @@
 // check more thoroughly that the caller is doing the right thing (eg only unreserving reserved chunks)
 //
 
+// A contiguous region of a ring buffer
+struct scoppy_uint8_span {
+    uint8_t *ptr;
+    uint32_t len;
+};
+
 struct scoppy_uint8_chunked_ring_buffer {
 
     // An id we can use when debugging so we know which buffer we are dealing with
@@ -61,6 +67,17 @@ struct scoppy_uint8_chunked_ring_buffer {
     // End of data that can be read (inclusive) - NULL means the buffer is empty
     uint8_t *end_addr;
 
+    // Only used by the power of two variant (see scoppy_uint8_chunked_ring_buffer_init_pow2()). These are free
+    // running byte indexes that are masked to get the array index. The address fields above are kept in sync.
+    uint32_t mask;
+    // first byte of valid data
+    uint32_t start_idx;
+    // one past the last byte of valid data (start_idx == end_idx means the buffer is empty). This is also where
+    // the next chunk to be unreserved starts.
+    uint32_t end_idx;
+    // the next chunk that can be reserved
+    uint32_t next_chunk_idx;
+
     void (*dump)(struct scoppy_uint8_chunked_ring_buffer *ring);
 
     uint32_t (*get_id)(struct scoppy_uint8_chunked_ring_buffer *ring);
@@ -94,6 +111,11 @@ struct scoppy_uint8_chunked_ring_buffer {
     // Read all the data from the buffer
     uint32_t (*read_all)(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *dest, uint32_t dest_size);
 
+    // Like read_from() but doesn't copy. Instead the data is described by (at most) 2 spans. span1 is only used if the
+    // data wraps (otherwise its len is 0). Returns the total length of the spans
+    uint32_t (*get_spans)(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *src_addr, int32_t src_offset, uint32_t max_len,
+                          struct scoppy_uint8_span *span0, struct scoppy_uint8_span *span1);
+
     // Read all data from a particular address in the buffer. The address maybe modified by an offset
     uint32_t (*read_from)(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *src_addr, int32_t src_offset, uint8_t *dest, uint32_t max_bytes_to_copy);
     
@@ -109,4 +131,9 @@ struct scoppy_uint8_chunked_ring_buffer {
 //void scoppy_uint8_chunked_ring_buffer_set_idx_max(uint32_t new_max_capacity);
 //#endif
 
-void scoppy_uint8_chunked_ring_buffer_init(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *arr, uint32_t arr_size, uint32_t chunk_size);
\ No newline at end of file
+void scoppy_uint8_chunked_ring_buffer_init(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *arr, uint32_t arr_size, uint32_t chunk_size);
+
+// A variant where arr_size and chunk_size must both be a power of 2. size(), reserve_chunk() and unreserve_chunk() are
+// branch free and index() only branches on a NULL or out of bounds address so it is cheaper to call them from interrupt
+// handlers. Otherwise it behaves exactly the same as the buffer above.
+void scoppy_uint8_chunked_ring_buffer_init_pow2(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *arr, uint32_t arr_size, uint32_t chunk_size);
\ No newline at end of file
@@ -25,6 +25,7 @@
 
 //
 #include "scoppy-incoming.h"
+#include "scoppy-outgoing.h"
 
 struct scoppy_context {
 
@@ -40,8 +41,12 @@ struct scoppy_context {
 
     int (*read_serial)(uint8_t *, int, int);
     int (*write_serial)(uint8_t *, int, int);
+    // Write the segments in order. Returns the total number of bytes written
+    int (*write_serial_v)(const struct scoppy_iovec *, int);
     void (*tight_loop)(void);
     void (*sleep_ms)(uint32_t);
+    // Microseconds since boot. Can be NULL in which case config batches only expire after too many messages.
+    uint64_t (*time_us)(void);
     int (*debugf)( const char *format, ... );
     int (*errorf)( const char *format, ... );
     void (*start_main_loop)(struct scoppy_context *ctx);
@@ -0,0 +1,115 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+//
+#include "scoppy-delta-codec.h"
+#include "scoppy.h"
+
+// Nibbles are shifted in at the bottom and bytes are taken off the top
+struct nibble_writer {
+    uint32_t acc;
+    uint32_t num_bits;
+    uint8_t *out;
+};
+
+static inline void put_nibbles(struct nibble_writer *w, uint32_t value, uint32_t num_nibbles) {
+    w->acc = (w->acc << (num_nibbles * 4)) | value;
+    w->num_bits += num_nibbles * 4;
+    while (w->num_bits >= 8) {
+        w->num_bits -= 8;
+        *w->out++ = (uint8_t)(w->acc >> w->num_bits);
+    }
+}
+
+static inline void put_run(struct nibble_writer *w, uint32_t run) {
+    if (run >= SCOPPY_DELTA_MIN_RUN) {
+        put_nibbles(w, (SCOPPY_DELTA_RUN << 4) | (run - SCOPPY_DELTA_MIN_RUN), 2);
+    } else if (run == 1) {
+        put_nibbles(w, 0, 1);
+    }
+}
+
+static inline uint8_t zigzag(uint8_t sample, uint8_t prev) {
+    uint8_t delta = (uint8_t)(sample - prev);
+    // (delta << 1) ^ (delta >> 7) for an int8_t
+    return (uint8_t)((delta << 1) ^ (uint8_t)(0 - (delta >> 7)));
+}
+
+uint32_t scoppy_delta_encode(const struct scoppy_iovec *segments, int num_segments, uint8_t num_channels, uint8_t *dest, uint32_t dest_size) {
+    assert(num_channels > 0 && num_channels <= MAX_CHANNELS);
+
+    uint8_t prev[MAX_CHANNELS];
+    for (int i = 0; i < num_channels; i++) {
+        prev[i] = SCOPPY_DELTA_INITIAL_VALUE;
+    }
+    uint8_t ch = 0;
+
+    struct nibble_writer w = {0, 0, dest};
+    uint8_t *const out_end = dest + dest_size;
+
+    // zero differences that haven't been written yet
+    uint32_t run = 0;
+
+    for (int s = 0; s < num_segments; s++) {
+        const uint8_t *in = segments[s].base;
+        const uint8_t *const in_end = in + segments[s].len;
+        while (in < in_end) {
+            uint8_t sample = *in++;
+            uint8_t zz = zigzag(sample, prev[ch]);
+            prev[ch] = sample;
+            if (++ch == num_channels) {
+                ch = 0;
+            }
+
+            if (zz == 0 && ++run < SCOPPY_DELTA_MAX_RUN) {
+                continue;
+            }
+
+            // A run and a sample never take more than 3 bytes (even with a nibble left over from the last one)
+            if (out_end - w.out < 3) {
+                return 0;
+            }
+
+            // If zz is 0 here then it's the last sample of a full run
+            put_run(&w, run);
+            run = 0;
+            if (zz != 0) {
+                if (zz < SCOPPY_DELTA_RUN) {
+                    put_nibbles(&w, zz, 1);
+                } else {
+                    put_nibbles(&w, (SCOPPY_DELTA_ESCAPE << 8) | zz, 3);
+                }
+            }
+        }
+    }
+
+    // the last run and padding
+    if (out_end - w.out < 2) {
+        return 0;
+    }
+    put_run(&w, run);
+    if (w.num_bits > 0) {
+        put_nibbles(&w, 0, 1);
+    }
+
+    return (uint32_t)(w.out - dest);
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+//
+#include "scoppy-outgoing.h"
+
+//
+// Delta encoding for analog samples (the v2 samples message). Slow moving or periodic signals change by only a few
+// ADC counts from one sample to the next so most samples fit in a nibble.
+//
+// Each sample is replaced by the difference from the previous sample of the same channel (the samples of each
+// channel are interleaved ie. ch0, ch1, ch0, ch1...). The first sample of each channel is compared with
+// SCOPPY_DELTA_INITIAL_VALUE. The difference is taken modulo 256 and zig-zag encoded so that small positive and
+// negative differences are both small numbers: 0, -1, 1, -2, 2... -> 0, 1, 2, 3, 4...
+//
+// The zig-zag values are packed into nibbles, high nibble first:
+//   0x0-0xD: the zig-zag value
+//   0xE:     a run of zero differences - the next nibble is the length of the run less SCOPPY_DELTA_MIN_RUN
+//   0xF:     escape - the zig-zag value follows in the next two nibbles (high then low)
+// So a sample takes half a byte if it's within +/-6 of the last one (on the same channel) and a flat signal takes
+// even less. The last byte is padded with a zero nibble if necessary. The number of samples is sent separately.
+//
+#define SCOPPY_DELTA_INITIAL_VALUE 0x80
+#define SCOPPY_DELTA_RUN 0x0E
+#define SCOPPY_DELTA_ESCAPE 0x0F
+#define SCOPPY_DELTA_MIN_RUN 2
+#define SCOPPY_DELTA_MAX_RUN (SCOPPY_DELTA_MIN_RUN + 15)
+
+// Encode the samples in the segments (eg. both parts of a wrapped ring buffer) as if they were one array. Returns the
+// number of bytes written to dest or 0 if the encoded samples don't fit in dest_size bytes.
+uint32_t scoppy_delta_encode(const struct scoppy_iovec *segments, int num_segments, uint8_t num_channels, uint8_t *dest, uint32_t dest_size);
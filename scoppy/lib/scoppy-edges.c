@@ -0,0 +1,86 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+//
+#include "scoppy-edges.h"
+
+void scoppy_edge_encoder_init(struct scoppy_edge_encoder *enc, uint8_t initial_state, uint8_t *dest, uint32_t dest_size) {
+    enc->state = initial_state;
+    enc->num_samples = 0;
+    enc->last_edge_idx = 0;
+    enc->dest = dest;
+    enc->out = dest;
+    enc->out_end = dest + dest_size;
+}
+
+// p must be word aligned. memcpy rather than a cast keeps the compiler happy about aliasing but is still a single load.
+static inline uint32_t load_word(const uint8_t *p) {
+    uint32_t word;
+    memcpy(&word, __builtin_assume_aligned(p, 4), 4);
+    return word;
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+uint32_t scoppy_edge_encode(struct scoppy_edge_encoder *enc, const uint8_t *samples, uint32_t len) {
+    const uint8_t *p = samples;
+    const uint8_t *const end = samples + len;
+    uint8_t state = enc->state;
+    uint32_t same_word = state * 0x01010101u;
+
+    while (p < end) {
+        // Skip over a word at a time while nothing changes (which is most of the time)
+        if (((uintptr_t)p & 3) == 0) {
+            while (end - p >= 4 && load_word(p) == same_word) {
+                p += 4;
+            }
+            if (p == end) {
+                break;
+            }
+        }
+
+        if (*p != state) {
+            if (enc->out_end - enc->out < SCOPPY_EDGE_MAX_RECORD_SIZE) {
+                break;
+            }
+            uint32_t idx = enc->num_samples + (uint32_t)(p - samples);
+            enc->out = put_varint(enc->out, idx - enc->last_edge_idx);
+            *enc->out++ = *p;
+            enc->last_edge_idx = idx;
+            state = *p;
+            same_word = state * 0x01010101u;
+        }
+        p++;
+    }
+
+    uint32_t num_encoded = (uint32_t)(p - samples);
+    enc->num_samples += num_encoded;
+    enc->state = state;
+    return num_encoded;
+}
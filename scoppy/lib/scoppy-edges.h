@@ -0,0 +1,55 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+//
+// Edge encoding for logic samples. Most logic samples are the same as the one before so rather than sending every
+// sample we only send the changes. Each change is a record:
+//   - the number of samples since the last change (or since the first sample) as a varint ie. 7 bits per byte, least
+//     significant first, with the top bit set on every byte except the last
+//   - the new pin state (1 byte)
+// The state of the first sample is sent separately (see scoppy_new_outgoing_logic_edges_msg()).
+//
+
+// A record is never bigger than this (a 32 bit varint and the state)
+#define SCOPPY_EDGE_MAX_RECORD_SIZE 6
+
+struct scoppy_edge_encoder {
+    uint8_t state;
+
+    // The number of samples encoded so far and the index of the sample where the state last changed
+    uint32_t num_samples;
+    uint32_t last_edge_idx;
+
+    uint8_t *dest;
+    uint8_t *out;
+    uint8_t *out_end;
+};
+
+void scoppy_edge_encoder_init(struct scoppy_edge_encoder *enc, uint8_t initial_state, uint8_t *dest, uint32_t dest_size);
+
+// Encode samples until there is no room for another record. Call again with the next samples (eg. the second part of
+// a wrapped ring buffer). Returns the number of samples encoded.
+uint32_t scoppy_edge_encode(struct scoppy_edge_encoder *enc, const uint8_t *samples, uint32_t len);
+
+static inline uint32_t scoppy_edge_encoder_get_len(const struct scoppy_edge_encoder *enc) { return (uint32_t)(enc->out - enc->dest); }
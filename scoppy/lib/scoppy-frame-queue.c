@@ -0,0 +1,101 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-frame-queue.h"
+
+static inline uint32_t load_acquire(uint32_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+
+static inline void store_release(uint32_t *p, uint32_t value) { __atomic_store_n(p, value, __ATOMIC_RELEASE); }
+
+void scoppy_frame_queue_init(struct scoppy_frame_queue *queue, struct scoppy_frame_desc *descs, uint32_t size) {
+    assert(size > 0 && (size & (size - 1)) == 0);
+    queue->descs = descs;
+    queue->size = size;
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+bool scoppy_frame_queue_push_v(struct scoppy_frame_queue *queue, const struct scoppy_iovec *iov, int count) {
+    if (count < 1 || count > SCOPPY_OUTGOING_MAX_SEGMENTS + 1 || iov[0].len > SCOPPY_FRAME_QUEUE_MAX_HEADER_SIZE) {
+        assert(false);
+        return false;
+    }
+
+    // Only we write head
+    uint32_t head = queue->head;
+    if (head - load_acquire(&queue->tail) >= queue->size) {
+        // full
+        return false;
+    }
+
+    struct scoppy_frame_desc *desc = &queue->descs[head & (queue->size - 1)];
+    memcpy(desc->header, iov[0].base, iov[0].len);
+    desc->header_len = iov[0].len;
+    for (int i = 1; i < count; i++) {
+        desc->segments[i - 1] = iov[i];
+    }
+    desc->num_segments = count - 1;
+
+    // Publish the descriptor
+    store_release(&queue->head, head + 1);
+    return true;
+}
+
+uint32_t scoppy_frame_queue_get_ticket(struct scoppy_frame_queue *queue) { return queue->head; }
+
+bool scoppy_frame_queue_is_written(struct scoppy_frame_queue *queue, uint32_t ticket) {
+    return (int32_t)(load_acquire(&queue->tail) - ticket) >= 0;
+}
+
+struct scoppy_frame_desc *scoppy_frame_queue_peek(struct scoppy_frame_queue *queue) {
+    // Only we write tail
+    uint32_t tail = queue->tail;
+    if (load_acquire(&queue->head) == tail) {
+        return NULL;
+    }
+    return &queue->descs[tail & (queue->size - 1)];
+}
+
+void scoppy_frame_queue_pop(struct scoppy_frame_queue *queue) {
+    assert(queue->head != queue->tail);
+    // Hand the descriptor (and the memory that its segments point to) back to the producer
+    store_release(&queue->tail, queue->tail + 1);
+}
+
+uint32_t scoppy_frame_queue_write(struct scoppy_frame_queue *queue, int (*write_serial_v)(const struct scoppy_iovec *, int), uint32_t max_msgs) {
+    uint32_t num_written = 0;
+    struct scoppy_frame_desc *desc;
+    while (num_written < max_msgs && (desc = scoppy_frame_queue_peek(queue)) != NULL) {
+        struct scoppy_iovec iov[SCOPPY_OUTGOING_MAX_SEGMENTS + 1];
+        iov[0].base = desc->header;
+        iov[0].len = desc->header_len;
+        for (uint32_t i = 0; i < desc->num_segments; i++) {
+            iov[i + 1] = desc->segments[i];
+        }
+        write_serial_v(iov, desc->num_segments + 1);
+        scoppy_frame_queue_pop(queue);
+        num_written++;
+    }
+    return num_written;
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+#include "scoppy-outgoing.h"
+
+//
+// A lock-free single-producer/single-consumer queue of outgoing messages. The sampling core (core1) pushes messages and
+// core0 pops them and writes them to the serial port, so only core0 ever touches the USB stack.
+//
+// A message is held as its header (copied into the descriptor) followed by up to SCOPPY_OUTGOING_MAX_SEGMENTS
+// segments that are NOT copied. eg. the samples are sent straight from the ring buffer. The producer must not reuse the
+// memory that the segments point to until the consumer has written the message - see scoppy_frame_queue_is_written().
+//
+// head is only written by the producer and tail only by the consumer. Each is published with release semantics and
+// read with acquire semantics so a descriptor is always completely written before the other side can see it.
+//
+
+// The header of a samples message is about 24 bytes. Leave room for small messages that are sent without segments.
+#define SCOPPY_FRAME_QUEUE_MAX_HEADER_SIZE 64
+
+struct scoppy_frame_desc {
+    uint8_t header[SCOPPY_FRAME_QUEUE_MAX_HEADER_SIZE];
+    uint32_t header_len;
+
+    struct scoppy_iovec segments[SCOPPY_OUTGOING_MAX_SEGMENTS];
+    uint32_t num_segments;
+};
+
+struct scoppy_frame_queue {
+    struct scoppy_frame_desc *descs;
+
+    // must be a power of 2
+    uint32_t size;
+
+    // The number of descriptors pushed and popped since the queue was initialised. They wrap at 2^32.
+    uint32_t head;
+    uint32_t tail;
+};
+
+void scoppy_frame_queue_init(struct scoppy_frame_queue *queue, struct scoppy_frame_desc *descs, uint32_t size);
+
+//
+// Producer
+//
+
+// Push a message in the form passed to write_serial_v() ie. iov[0] is the header (which is copied) and the rest are
+// the segments. Returns false if the queue is full (or the message is too big to be queued).
+bool scoppy_frame_queue_push_v(struct scoppy_frame_queue *queue, const struct scoppy_iovec *iov, int count);
+
+// A ticket for everything pushed so far. Pass it to scoppy_frame_queue_is_written().
+uint32_t scoppy_frame_queue_get_ticket(struct scoppy_frame_queue *queue);
+
+// True once every message pushed before the ticket was taken has been written
+bool scoppy_frame_queue_is_written(struct scoppy_frame_queue *queue, uint32_t ticket);
+
+//
+// Consumer
+//
+
+// The oldest message or NULL if the queue is empty. It stays in the queue until scoppy_frame_queue_pop() is called.
+struct scoppy_frame_desc *scoppy_frame_queue_peek(struct scoppy_frame_queue *queue);
+void scoppy_frame_queue_pop(struct scoppy_frame_queue *queue);
+
+// Write (and pop) up to max_msgs messages. Returns the number written.
+uint32_t scoppy_frame_queue_write(struct scoppy_frame_queue *queue, int (*write_serial_v)(const struct scoppy_iovec *, int), uint32_t max_msgs);
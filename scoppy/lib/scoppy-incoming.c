@@ -20,6 +20,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 // my stuff
 #include "scoppy-incoming.h"
@@ -45,6 +46,13 @@ void scoppy_init_incoming(struct scoppy_incoming *data) {
 
     data->post = SCOPPY_INCOMING_POST;
     data->post_payload = SCOPPY_INCOMING_POST;
+
+    data->staging.write_count = 0;
+    data->staging.read_count = 0;
+    data->staging.num_read_calls = 0;
+    data->staging.num_framing_errors = 0;
+
+    scoppy_prepare_incoming(data);
 }
 
 #ifndef NDEBUG
@@ -92,156 +100,134 @@ void scoppy_prepare_incoming(struct scoppy_incoming *data) {
     data->payload_ok = false;
 }
 
-int scoppy_read_incoming(int (*read_serial)(uint8_t *, int, int), struct scoppy_incoming *data) {
-    CHECK_INCOMING(data);
-    uint8_t tmpBuf[1];
-    if (!data->found_start_byte) {
-        // keep reading a byte at a time until we find the 'start of message' byte
-        int count;
-        while ((count = read_serial(tmpBuf, 0, 1)) > 0) {
-            if (tmpBuf[0] == scoppy_start_of_message_byte) {
-                data->found_start_byte = true;
-                data->bytes_read += count;
-                break;
-            } else {
-                data->bytes_skipped += count;
-            }
-        }
-
-        if (!data->found_start_byte) {
-            CHECK_INCOMING(data);
-            return SCOPPY_INCOMING_INCOMPLETE;
-        }
-    }
+#define STAGING_MASK (SCOPPY_INCOMING_STAGING_SIZE - 1)
 
-    if (data->msg_size == 0) {
-        // https://hackaday.com/2020/08/04/dont-let-endianness-flip-you-around/
-        // uint32_t be=(b[0]<<24)|(b[1]<<16)|(b[2]<<8)|b[3];
-
-        assert(data->bytes_read == 1 || data->bytes_read == 2);
-        if (data->bytes_read == 1) {
-            // NB. We're just storing it temporarily in data->payload
-
-            int count = read_serial(data->payload, 0, 1);
-            assert(count <= 1);
-            if (count < 1) {
-                CHECK_INCOMING(data);
-                return SCOPPY_INCOMING_INCOMPLETE;
-            }
-            data->bytes_read++;
-        }
+static inline uint32_t staged_len(struct scoppy_incoming_staging *staging) { return staging->write_count - staging->read_count; }
 
-        assert(data->bytes_read == 2);
+// The i'th unread byte
+static inline uint8_t staged_byte(struct scoppy_incoming_staging *staging, uint32_t i) {
+    return staging->buf[(staging->read_count + i) & STAGING_MASK];
+}
 
-        // We already have one byte of the msg size...get the next
-        int count = read_serial(data->payload, 1, 1);
-        assert(count <= 1);
-        if (count < 1) {
-            CHECK_INCOMING(data);
-            return SCOPPY_INCOMING_INCOMPLETE;
+// Read whatever the serial port has (up to the free space in the staging buffer)
+static void fill_staging(int (*read_serial)(uint8_t *, int, int), struct scoppy_incoming_staging *staging) {
+    // At most two reads. One up to the end of the buffer and one from the start.
+    for (int i = 0; i < 2; i++) {
+        uint32_t free_space = SCOPPY_INCOMING_STAGING_SIZE - staged_len(staging);
+        uint32_t write_idx = staging->write_count & STAGING_MASK;
+        uint32_t len = SCOPPY_INCOMING_STAGING_SIZE - write_idx;
+        if (len > free_space) {
+            len = free_space;
         }
-        data->bytes_read++;
-
-        // We have the start byte and the 2 message size bytes
-        assert(data->bytes_read == 3);
-        data->msg_size = (data->payload[0] << 8) | data->payload[1];
-
-        if (data->msg_size < 5 || data->msg_size > SCOPPY_INCOMING_MAX_PAYLOAD_SIZE) {
-            last_error = "Invalid message size";
-            return SCOPPY_INCOMING_ERROR;
+        if (len == 0) {
+            return;
         }
-    }
 
-    if (data->msg_type == 0) {
-        int count = read_serial(&data->msg_type, 0, 1);
-        if (count < 1) {
-            CHECK_INCOMING(data);
-            return SCOPPY_INCOMING_INCOMPLETE;
+        staging->num_read_calls++;
+        int count = read_serial(staging->buf, write_idx, len);
+        if (count <= 0) {
+            return;
         }
-        data->bytes_read += count;
-
-        if (data->msg_type == 0) {
-            last_error = "Invalid message type";
-            return SCOPPY_INCOMING_ERROR;
+        staging->write_count += count;
+        if (count < len) {
+            // That's all there is for now
+            return;
         }
     }
+}
 
-    if (data->msg_type_plus_5 == 0) {
-        int count = read_serial(&data->msg_type_plus_5, 0, 1);
-        if (count < 1) {
-            CHECK_INCOMING(data);
-            return SCOPPY_INCOMING_INCOMPLETE;
-        }
-        data->bytes_read += count;
+static int framing_error(struct scoppy_incoming_staging *staging, char *error) {
+    last_error = error;
+    staging->num_framing_errors++;
+    // Skip the start byte (only). The next call will look for a start byte in the bytes that follow it.
+    staging->read_count++;
+    return SCOPPY_INCOMING_ERROR;
+}
 
-        if (data->msg_type_plus_5 != data->msg_type + 5) {
-            last_error = "Invalid message type checksum";
-            scoppy_debug_incoming(data);
-            return SCOPPY_INCOMING_ERROR;
-        }
+// Frame a message from the staging buffer
+static int read_staged_message(struct scoppy_incoming_staging *staging, struct scoppy_incoming *data) {
+    // Skip to the 'start of message' byte
+    uint32_t len = staged_len(staging);
+    while (len > 0 && staged_byte(staging, 0) != scoppy_start_of_message_byte) {
+        staging->read_count++;
+        data->bytes_skipped++;
+        len--;
     }
 
-    if (data->msg_version == 0) {
-        int count = read_serial(&data->msg_version, 0, 1);
-        if (count < 1) {
-            CHECK_INCOMING(data);
-            return SCOPPY_INCOMING_INCOMPLETE;
-        }
-        data->bytes_read += count;
+    if (len < 3) {
+        return SCOPPY_INCOMING_INCOMPLETE;
+    }
 
-        if (data->msg_version < 1) {
-            last_error = "Invalid message version";
-            scoppy_debug_incoming(data);
-            return SCOPPY_INCOMING_ERROR;
-        }
+    // The size includes the 'start of message' and 'end of message' bytes
+    int16_t msg_size = (staged_byte(staging, 1) << 8) | staged_byte(staging, 2);
+    if (msg_size < 7 || msg_size > SCOPPY_INCOMING_MAX_PAYLOAD_SIZE) {
+        return framing_error(staging, "Invalid message size");
     }
 
-    // Read enough chars to fill the buffer but no more
-    int remaining = data->msg_size - data->bytes_read;
-    if (remaining < 0 || remaining > SCOPPY_INCOMING_MAX_PAYLOAD_SIZE) {
-        // msg size is wrong?
-        last_error = "Wrong message size";
-        return SCOPPY_INCOMING_ERROR;
-    } else if (remaining > 0) {
-        int count = read_serial(data->payload, data->payload_len, remaining);
-        data->bytes_read += count;
-        data->payload_len += count;
-        if (data->bytes_read < data->msg_size) {
-            CHECK_INCOMING(data);
-            return SCOPPY_INCOMING_INCOMPLETE;
-        }
+    if (len < 6) {
+        return SCOPPY_INCOMING_INCOMPLETE;
+    }
 
-        // for testing
-        //return SCOPPY_INCOMING_INCOMPLETE;
+    uint8_t msg_type = staged_byte(staging, 3);
+    if (msg_type == 0) {
+        return framing_error(staging, "Invalid message type");
     }
 
-    assert(data->bytes_read == data->msg_size);
+    if (staged_byte(staging, 4) != (uint8_t)(msg_type + 5)) {
+        return framing_error(staging, "Invalid message type checksum");
+    }
 
-    if (!data->found_end_byte) {
+    uint8_t msg_version = staged_byte(staging, 5);
+    if (msg_version < 1) {
+        return framing_error(staging, "Invalid message version");
+    }
 
-        //
-        // The buffer now has all the message data plus the 'end of message' byte
-        //
+    if (len < msg_size) {
+        return SCOPPY_INCOMING_INCOMPLETE;
+    }
 
-        // There should be at least one byte ie. the 'end of message' byte
-        if (data->payload_len < 1) {
-            last_error = "payload_len too small";
-            return SCOPPY_INCOMING_ERROR;
-        }
+    if (staged_byte(staging, msg_size - 1) != scoppy_end_of_message_byte) {
+        return framing_error(staging, "EOM byte not found.");
+    }
 
-        if (data->payload[data->payload_len - 1] != scoppy_end_of_message_byte) {
-            //printf("last byte of message=%X\n", (unsigned int)data->payload[data->payload_len - 1]);
-            last_error = "EOM byte not found.";
-            return SCOPPY_INCOMING_ERROR;
-        }
+    // Copy the payload (not including the 'end of message' byte) in up to 2 parts
+    int16_t payload_len = msg_size - 7;
+    uint32_t payload_idx = (staging->read_count + 6) & STAGING_MASK;
+    uint32_t len1 = SCOPPY_INCOMING_STAGING_SIZE - payload_idx;
+    if (len1 > payload_len) {
+        len1 = payload_len;
+    }
+    memcpy(data->payload, staging->buf + payload_idx, len1);
+    memcpy(data->payload + len1, staging->buf, payload_len - len1);
+    staging->read_count += msg_size;
+
+    data->found_start_byte = true;
+    data->found_end_byte = true;
+    data->bytes_read = msg_size;
+    data->msg_size = msg_size;
+    data->msg_type = msg_type;
+    data->msg_type_plus_5 = msg_type + 5;
+    data->msg_version = msg_version;
+    data->payload_len = payload_len;
+    return SCOPPY_INCOMING_COMPLETE;
+}
 
-        // Don't include the 'end of message' byte in the payload length
-        data->found_end_byte = 1;
-        data->payload_len -= 1;
+int scoppy_read_incoming(int (*read_serial)(uint8_t *, int, int), struct scoppy_incoming *data) {
+    CHECK_INCOMING(data);
+    if (data->found_end_byte) {
+        // scoppy_prepare_incoming() hasn't been called since the last message was read
+        return SCOPPY_INCOMING_COMPLETE;
+    }
+
+    // Only read from the serial port if we don't already have a complete message
+    int ret = read_staged_message(&data->staging, data);
+    if (ret == SCOPPY_INCOMING_INCOMPLETE) {
+        fill_staging(read_serial, &data->staging);
+        ret = read_staged_message(&data->staging, data);
     }
 
     CHECK_INCOMING(data);
-    return SCOPPY_INCOMING_COMPLETE;
+    return ret;
 }
 
 void scoppy_debug_incoming(struct scoppy_incoming *data) {
@@ -34,6 +34,26 @@
 extern const uint8_t scoppy_start_of_message_byte;
 extern const uint8_t scoppy_end_of_message_byte;
 
+// Must be a power of 2 and big enough for a complete message
+#define SCOPPY_INCOMING_STAGING_SIZE 1024
+
+//
+// Bytes read from the serial port that haven't been framed yet. scoppy_read_incoming() reads as much as it can in one
+// go (rather than a byte at a time) and then frames the messages from memory. So several messages that arrive together
+// only cost one or two calls to read_serial.
+//
+struct scoppy_incoming_staging {
+    uint8_t buf[SCOPPY_INCOMING_STAGING_SIZE];
+
+    // The number of bytes written to and read from buf. They wrap at 2^32.
+    uint32_t write_count;
+    uint32_t read_count;
+
+    // for debugging/testing
+    uint32_t num_read_calls;
+    uint32_t num_framing_errors;
+};
+
 struct scoppy_incoming {
     uint32_t pre;
 
@@ -69,12 +89,18 @@ struct scoppy_incoming {
     // Flag to indicate if the message payload was parsed successfully
     bool payload_ok;
 
+    // Not reset by scoppy_prepare_incoming()
+    struct scoppy_incoming_staging staging;
+
     uint32_t post;
 };
 
 void scoppy_init_incoming(struct scoppy_incoming *data);
 void scoppy_prepare_incoming(struct scoppy_incoming *);
 
+// Returns SCOPPY_INCOMING_COMPLETE if a message was read. Call scoppy_prepare_incoming() before reading the next one.
+// Returns SCOPPY_INCOMING_ERROR if there was a framing error. Only the start byte of the bad message is discarded so
+// the next call will look for a message in the bytes that followed it.
 int scoppy_read_incoming(int (*read_serial)(uint8_t *, int, int), struct scoppy_incoming *data);
 void scoppy_debug_incoming(struct scoppy_incoming *data);
 char* scoppy_incoming_error();
@@ -23,9 +23,12 @@
 #include <assert.h>
 //
 #include "scoppy-common.h"
+#include "scoppy-delta-codec.h"
+#include "scoppy-edges.h"
 #include "scoppy-message.h"
 #include "scoppy-outgoing.h"
 #include "scoppy-stdio.h"
+#include "scoppy-trigger-fsm.h"
 #include "scoppy-util/number.h"
 #include "scoppy.h"
 
@@ -109,6 +112,208 @@ struct scoppy_outgoing *scoppy_new_outgoing_samples_msg(uint32_t realSampleRateH
     return msg;
 }
 
+int scoppy_write_outgoing_samples_msg(int (*write_serial_v)(const struct scoppy_iovec *, int), struct scoppy_outgoing *msg, uint8_t version,
+                                      const struct scoppy_samples_msg_info *info, const struct scoppy_iovec *segments, int num_segments) {
+    if (version < 2) {
+        return scoppy_write_outgoing_v(write_serial_v, msg, segments, num_segments);
+    }
+
+    uint32_t num_samples = 0;
+    for (int i = 0; i < num_segments; i++) {
+        num_samples += segments[i].len;
+    }
+    assert(num_samples <= UINT16_MAX);
+
+    msg->msg_version = version;
+    uint8_t flags = msg->payload[0];
+    uint8_t num_data_channels = msg->payload[1];
+    int encoding_offset = msg->payload_len;
+    msg->payload[msg->payload_len++] = SCOPPY_SAMPLES_ENCODING_RAW;
+    scoppy_uint16_to_2_network_bytes(msg->payload + msg->payload_len, (uint16_t)num_samples);
+    msg->payload_len += 2;
+
+    if (version >= 3) {
+        scoppy_uint16_to_2_network_bytes(msg->payload + msg->payload_len, info != NULL ? info->unscanned_permille : 0);
+        msg->payload_len += 2;
+    }
+
+    if (version >= 4) {
+        scoppy_uint16_to_2_network_bytes(msg->payload + msg->payload_len, info != NULL ? info->trigger_fraction : 0);
+        msg->payload_len += 2;
+    }
+
+    // Logic samples are bit patterns and don't get any smaller
+    bool is_logic_mode = (flags & 0x10) != 0;
+    if (!is_logic_mode && num_samples > 0) {
+        // Only worth it if it's smaller than the samples
+        uint8_t *encoded = msg->payload + msg->payload_len;
+        uint32_t max_encoded_len = SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE - msg->payload_len;
+        if (max_encoded_len > num_samples - 1) {
+            max_encoded_len = num_samples - 1;
+        }
+
+        uint32_t encoded_len = scoppy_delta_encode(segments, num_segments, num_data_channels, encoded, max_encoded_len);
+        if (encoded_len > 0) {
+            msg->payload[encoding_offset] = SCOPPY_SAMPLES_ENCODING_DELTA;
+            struct scoppy_iovec encoded_segment = {encoded, encoded_len};
+            return scoppy_write_outgoing_v(write_serial_v, msg, &encoded_segment, 1);
+        }
+    }
+
+    return scoppy_write_outgoing_v(write_serial_v, msg, segments, num_segments);
+}
+
+struct scoppy_outgoing *scoppy_new_outgoing_logic_edges_msg(uint32_t sample_rate, bool new_record, uint64_t start_idx, const struct scoppy_iovec *segments,
+                                                            int num_segments, uint32_t *num_encoded, struct scoppy_iovec *edges) {
+    struct scoppy_outgoing *msg = scoppy_new_outgoing(SCOPPY_OUTGOING_MSG_TYPE_LOGIC_EDGES, 1);
+
+    // Like the samples message: set if these samples don't follow on from the previous message
+    msg->payload[msg->payload_len++] = new_record ? 0x01 : 0x00;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, sample_rate);
+    msg->payload_len += 4;
+
+    scoppy_uint64_to_8_network_bytes(msg->payload + msg->payload_len, start_idx);
+    msg->payload_len += 8;
+
+    // The number of samples is filled in once we know how many fit
+    int num_samples_offset = msg->payload_len;
+    msg->payload_len += 4;
+
+    // The state of the first sample
+    assert(num_segments > 0 && segments[0].len > 0);
+    uint8_t initial_state = segments[0].base[0];
+    msg->payload[msg->payload_len++] = initial_state;
+
+    struct scoppy_edge_encoder enc;
+    scoppy_edge_encoder_init(&enc, initial_state, msg->payload + msg->payload_len, SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE - msg->payload_len);
+    uint32_t num_samples = 0;
+    for (int i = 0; i < num_segments; i++) {
+        uint32_t n = scoppy_edge_encode(&enc, segments[i].base, segments[i].len);
+        num_samples += n;
+        if (n < segments[i].len) {
+            // full
+            break;
+        }
+    }
+    // The edges aren't part of the payload held in the message. See scoppy_write_outgoing_samples_msg().
+    edges->base = msg->payload + msg->payload_len;
+    edges->len = scoppy_edge_encoder_get_len(&enc);
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + num_samples_offset, num_samples);
+    *num_encoded = num_samples;
+    return msg;
+}
+
+struct scoppy_outgoing *scoppy_new_outgoing_segment_info_msg(uint32_t sample_rate, const struct scoppy_segment_info *segments, int num_segments,
+                                                             struct scoppy_iovec *records) {
+    assert(num_segments > 0 && num_segments <= SCOPPY_MAX_SEGMENTS);
+    struct scoppy_outgoing *msg = scoppy_new_outgoing(SCOPPY_OUTGOING_MSG_TYPE_SEGMENT_INFO, 1);
+
+    msg->payload[msg->payload_len++] = (uint8_t)num_segments;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, sample_rate);
+    msg->payload_len += 4;
+
+    // 16 bytes each. Up to SCOPPY_MAX_SEGMENTS of them is too much for the header. See scoppy_write_outgoing_samples_msg().
+    uint8_t *record = msg->payload + msg->payload_len;
+    records->base = record;
+    for (int i = 0; i < num_segments; i++) {
+        scoppy_uint64_to_8_network_bytes(record, segments[i].trigger_time_us);
+        record += 8;
+
+        scoppy_int32_to_4_network_bytes(record, segments[i].trigger_idx);
+        record += 4;
+
+        scoppy_uint32_to_4_network_bytes(record, segments[i].num_bytes);
+        record += 4;
+    }
+    records->len = record - records->base;
+
+    return msg;
+}
+
+// Sent periodically in streaming mode. The counts are cumulative since the stream started.
+struct scoppy_outgoing *scoppy_new_outgoing_stream_stats_msg(const struct scoppy_stream_stats *stats, uint8_t bytes_per_sample_set) {
+    struct scoppy_outgoing *msg = scoppy_new_outgoing(SCOPPY_OUTGOING_MSG_TYPE_STREAM_STATS, 1);
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, stats->sample_rate_per_channel);
+    msg->payload_len += 4;
+
+    // elapsed time in ms
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, (uint32_t)((stats->now_us - stats->start_us) / 1000));
+    msg->payload_len += 4;
+
+    scoppy_uint64_to_8_network_bytes(msg->payload + msg->payload_len, stats->num_captured);
+    msg->payload_len += 8;
+
+    scoppy_uint64_to_8_network_bytes(msg->payload + msg->payload_len, stats->num_sent);
+    msg->payload_len += 8;
+
+    scoppy_uint64_to_8_network_bytes(msg->payload + msg->payload_len, stats->num_dropped);
+    msg->payload_len += 8;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, stats->num_drop_events);
+    msg->payload_len += 4;
+
+    // Throughput versus sample rate
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, scoppy_stream_stats_delivered_rate(stats));
+    msg->payload_len += 4;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, scoppy_stream_stats_link_bytes_per_sec(stats));
+    msg->payload_len += 4;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, scoppy_stream_stats_max_lossless_rate(stats, bytes_per_sample_set));
+    msg->payload_len += 4;
+
+    return msg;
+}
+
+// The histograms are sent in the order of the SCOPPY_TELEMETRY_* ids. Each one is the count, the max and then the
+// bucket counts.
+struct scoppy_outgoing *scoppy_new_outgoing_telemetry_msg(const struct scoppy_telemetry *telemetry) {
+    struct scoppy_outgoing *msg = scoppy_new_outgoing(SCOPPY_OUTGOING_MSG_TYPE_TELEMETRY, 1);
+
+    msg->payload[msg->payload_len++] = SCOPPY_TELEMETRY_NUM_HISTOGRAMS;
+    msg->payload[msg->payload_len++] = SCOPPY_HISTOGRAM_NUM_BUCKETS;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, telemetry->sample_rate);
+    msg->payload_len += 4;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, telemetry->chunk_size);
+    msg->payload_len += 4;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, telemetry->num_frames);
+    msg->payload_len += 4;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, telemetry->num_timeouts);
+    msg->payload_len += 4;
+
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, telemetry->max_trigger_queue_size);
+    msg->payload_len += 4;
+
+    for (int i = 0; i < SCOPPY_TELEMETRY_NUM_HISTOGRAMS; i++) {
+        const struct scoppy_histogram *hist = &telemetry->histograms[i];
+
+        scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, hist->count);
+        msg->payload_len += 4;
+
+        scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, hist->max);
+        msg->payload_len += 4;
+
+        for (int b = 0; b < SCOPPY_HISTOGRAM_NUM_BUCKETS; b++) {
+            scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, hist->buckets[b]);
+            msg->payload_len += 4;
+        }
+    }
+
+    // Added after the histograms so that the offsets of everything else stay the same
+    scoppy_uint32_to_4_network_bytes(msg->payload + msg->payload_len, telemetry->num_rle_overruns);
+    msg->payload_len += 4;
+
+    return msg;
+}
+
 static void update_channel_from_config_byte(struct scoppy_context *ctx, int channel_id, uint8_t config_byte) {
     if (channel_id >= ARRAY_SIZE(scoppy.channels) || channel_id < 0) {
         CTX_DEBUG_PRINT(ctx, "  Invalid channel id: %d\n", channel_id);
@@ -125,6 +330,23 @@ static void update_channel_from_config_byte(struct scoppy_context *ctx, int chan
     CTX_LOG_PRINT(ctx, "    CHID %d -> %s\n", channel_id, (enabled ? "ON" : "OFF"));
 }
 
+static uint8_t trigger_level_from_network_bytes(struct scoppy_context *ctx, const uint8_t *buf) {
+    int16_t trigger_level = scoppy_int16_from_2_network_bytes(buf);
+    if (trigger_level < 0) {
+        CTX_ERROR_PRINT(ctx, "  invalid trigger level: %d\n", (int)trigger_level);
+        trigger_level = 0;
+    }
+
+    if (trigger_level > 255) {
+        CTX_ERROR_PRINT(ctx, "  invalid trigger level: %d\n", (int)trigger_level);
+        trigger_level = 255;
+        // The trigger can end up at the wrong level if the voltage level changes so don't make this a
+        // fatal error (anymore)
+        // ctx->fatal_error_handler(SCOPPY_FATAL_ERROR_BAD_APP_PARAMS);
+    }
+    return (uint8_t)trigger_level;
+}
+
 static int process_trigger_params(struct scoppy_context *ctx, int i) {
     struct scoppy_incoming *incoming = ctx->incoming;
     scoppy.app.trigger_mode = scoppy_uint8_from_1_network_byte(incoming->payload + i) & 0x00FF;
@@ -144,7 +366,9 @@ static int process_trigger_params(struct scoppy_context *ctx, int i) {
     i += 1;
 
     scoppy.app.trigger_type = scoppy_uint8_from_1_network_byte(incoming->payload + i) & 0x00FF;
-    if (scoppy.app.trigger_type > TRIGGER_TYPE_LAST) {
+    // The logic analyser only has edge triggers
+    uint8_t last_trigger_type = scoppy.app.is_logic_mode ? TRIGGER_TYPE_FALLING_EDGE : TRIGGER_TYPE_LAST;
+    if (scoppy.app.trigger_type > last_trigger_type) {
         CTX_ERROR_PRINT(ctx, "  invalid trigger type: %d\n", (int)scoppy.app.trigger_type);
         // ctx->fatal_error_handler(SCOPPY_FATAL_ERROR_BAD_APP_PARAMS);
         scoppy.app.trigger_type = TRIGGER_TYPE_RISING_EDGE;
@@ -152,24 +376,44 @@ static int process_trigger_params(struct scoppy_context *ctx, int i) {
     i += 1;
 
     // The app sends an int16 but we only use uint8
-    int16_t trigger_level = scoppy_int16_from_2_network_bytes(incoming->payload + i);
-    if (trigger_level < 0) {
-        CTX_ERROR_PRINT(ctx, "  invalid trigger level: %d\n", (int)trigger_level);
-        trigger_level = 0;
+    scoppy.app.trigger_level = trigger_level_from_network_bytes(ctx, incoming->payload + i);
+    i += 2;
+
+    // Newer apps send the hysteresis (in adc units) after the level. Older apps don't so there isn't any.
+    if (incoming->payload_len > i) {
+        scoppy.app.trigger_hysteresis = scoppy_uint8_from_1_network_byte(incoming->payload + i);
+        i += 1;
+    } else {
+        scoppy.app.trigger_hysteresis = 0;
     }
 
-    if (trigger_level > 255) {
-        CTX_ERROR_PRINT(ctx, "  invalid trigger level: %d\n", (int)trigger_level);
-        trigger_level = 255;
-        // The trigger can end up at the wrong level if the voltage level changes so don't make this a
-        // fatal error (anymore)
-        // ctx->fatal_error_handler(SCOPPY_FATAL_ERROR_BAD_APP_PARAMS);
+    // Followed by the settings for pulse width, runt, window and slope triggers (see scoppy-trigger-fsm.h)
+    if (incoming->payload_len >= i + 11) {
+        scoppy.app.trigger_level2 = trigger_level_from_network_bytes(ctx, incoming->payload + i);
+        i += 2;
+        scoppy.app.trigger_options = scoppy_uint8_from_1_network_byte(incoming->payload + i);
+        i += 1;
+        uint8_t condition = (scoppy.app.trigger_options & SCOPPY_TRIGGER_OPTION_CONDITION_MASK) >> SCOPPY_TRIGGER_OPTION_CONDITION_SHIFT;
+        if (condition > SCOPPY_TRIGGER_CONDITION_LAST) {
+            CTX_ERROR_PRINT(ctx, "  invalid trigger condition: %d\n", (int)condition);
+            scoppy.app.trigger_options &= ~SCOPPY_TRIGGER_OPTION_CONDITION_MASK;
+        }
+        scoppy.app.trigger_time_min = scoppy_uint32_from_4_network_bytes(incoming->payload + i);
+        i += 4;
+        scoppy.app.trigger_time_max = scoppy_uint32_from_4_network_bytes(incoming->payload + i);
+        i += 4;
+    } else {
+        scoppy.app.trigger_level2 = scoppy.app.trigger_level;
+        scoppy.app.trigger_options = 0;
+        scoppy.app.trigger_time_min = 0;
+        scoppy.app.trigger_time_max = 0;
     }
-    scoppy.app.trigger_level = trigger_level;
-    i += 2;
 
-    CTX_LOG_PRINT(ctx, "  Trigger. mode=%u, ch=%u, type=%u, level=%u\n", (unsigned)scoppy.app.trigger_mode, (unsigned)scoppy.app.trigger_channel,
-                  (unsigned)scoppy.app.trigger_type, (unsigned)scoppy.app.trigger_level);
+    CTX_LOG_PRINT(ctx, "  Trigger. mode=%u, ch=%u, type=%u, level=%u, hyst=%u\n", (unsigned)scoppy.app.trigger_mode,
+                  (unsigned)scoppy.app.trigger_channel, (unsigned)scoppy.app.trigger_type, (unsigned)scoppy.app.trigger_level,
+                  (unsigned)scoppy.app.trigger_hysteresis);
+    CTX_LOG_PRINT(ctx, "    level2=%u, options=%x, time_min=%lu, time_max=%lu\n", (unsigned)scoppy.app.trigger_level2, (unsigned)scoppy.app.trigger_options,
+                  (unsigned long)scoppy.app.trigger_time_min, (unsigned long)scoppy.app.trigger_time_max);
 
     return i;
 }
@@ -213,6 +457,23 @@ static void process_sync_response_message(struct scoppy_context *ctx) {
         scoppy.app.resync_required = true;
     }
 
+    // Bits 4-6 are the newest samples message version that the app can read. Older apps leave them as zero.
+    uint8_t samples_msg_version = (flags >> 4) & 0x7;
+    if (samples_msg_version < 1) {
+        samples_msg_version = 1;
+    } else if (samples_msg_version > SCOPPY_SAMPLES_MSG_MAX_VERSION) {
+        samples_msg_version = SCOPPY_SAMPLES_MSG_MAX_VERSION;
+    }
+    scoppy.app.samples_msg_version = samples_msg_version;
+    CTX_DEBUG_PRINT(ctx, "  samples_msg_version=%u\n", (unsigned)samples_msg_version);
+
+    // Bit 7 asks for logic samples to be streamed as edges (SCOPPY_OUTGOING_MSG_TYPE_LOGIC_EDGES)
+    scoppy.app.logic_edges = (flags & 0x80) != 0;
+    CTX_DEBUG_PRINT(ctx, "  logic_edges=%d\n", (int)scoppy.app.logic_edges);
+
+    // Normal captures until the app asks for segments (SCOPPY_INCOMING_MSG_TYPE_SEGMENTED_CAPTURE)
+    scoppy.app.num_segments = 0;
+
     // Next 4 bytes ununsed
     i += 4;
 
@@ -365,10 +626,84 @@ static void process_sig_gen_message(struct scoppy_context *ctx) {
     ctx->sig_gen(func, gpio, freq, duty);
 }
 
+static void process_segmented_capture_message(struct scoppy_context *ctx) {
+    CTX_DEBUG_PRINT(ctx, "Processing segmented capture message\n");
+    struct scoppy_incoming *incoming = ctx->incoming;
+
+    if (incoming->payload_len < 1) {
+        CTX_DEBUG_PRINT(ctx, "  Payload too small: ignore this message\n");
+        return;
+    }
+
+    uint8_t num_segments = scoppy_uint8_from_1_network_byte(incoming->payload);
+    if (num_segments > SCOPPY_MAX_SEGMENTS) {
+        CTX_ERROR_PRINT(ctx, "  too many segments: %u\n", (unsigned)num_segments);
+        num_segments = SCOPPY_MAX_SEGMENTS;
+    }
+    CTX_LOG_PRINT(ctx, "  num_segments=%u\n", (unsigned)num_segments);
+
+    scoppy.app.num_segments = num_segments;
+    scoppy.app.dirty = true;
+
+    incoming->payload_ok = true;
+}
+
+static void process_telemetry_request_message(struct scoppy_context *ctx) {
+    CTX_DEBUG_PRINT(ctx, "Processing telemetry request message\n");
+    struct scoppy_incoming *incoming = ctx->incoming;
+
+    // Bit 0 of the optional flags byte asks for the counts to be reset once they have been sent
+    uint8_t flags = incoming->payload_len > 0 ? scoppy_uint8_from_1_network_byte(incoming->payload) : 0;
+
+    // Nothing has changed that needs sampling to restart so this doesn't make the app settings dirty
+    scoppy.app.telemetry_requested = true;
+    scoppy.app.telemetry_reset = (flags & 0x01) != 0;
+
+    incoming->payload_ok = true;
+}
+
+static void process_config_begin_message(struct scoppy_context *ctx) {
+    CTX_DEBUG_PRINT(ctx, "Processing config begin message\n");
+    scoppy.app.config_batch_open = true;
+    scoppy.app.config_batch_num_msgs = 0;
+    scoppy.app.config_batch_begin_us = ctx->time_us != NULL ? ctx->time_us() : 0;
+    ctx->incoming->payload_ok = true;
+}
+
+static void process_config_commit_message(struct scoppy_context *ctx) {
+    CTX_DEBUG_PRINT(ctx, "Processing config commit message\n");
+    scoppy.app.config_batch_open = false;
+    ctx->incoming->payload_ok = true;
+}
+
+bool scoppy_expire_config_batch(struct scoppy_context *ctx) {
+    if (!scoppy.app.config_batch_open || ctx->time_us == NULL) {
+        return false;
+    }
+
+    if (ctx->time_us() - scoppy.app.config_batch_begin_us < SCOPPY_CONFIG_BATCH_TIMEOUT_US) {
+        return false;
+    }
+
+    // The commit must have been lost and the app has gone quiet
+    CTX_ERROR_PRINT(ctx, "config batch timed out\n");
+    scoppy.app.config_batch_open = false;
+    return true;
+}
+
 static void process_complete_incoming_message(struct scoppy_context *ctx) {
     // CTX_DEBUG_PRINT(ctx, "process_complete_incoming_message\n");
     struct scoppy_incoming *incoming = ctx->incoming;
+
+    if (scoppy.app.config_batch_open && ++scoppy.app.config_batch_num_msgs > SCOPPY_MAX_CONFIG_BATCH_MSGS) {
+        // The commit must have been lost. Don't hold up the changes any longer.
+        CTX_ERROR_PRINT(ctx, "config batch not committed\n");
+        scoppy.app.config_batch_open = false;
+    }
+
     if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE) {
+        // Start again from scratch
+        scoppy.app.config_batch_open = false;
         process_sync_response_message(ctx);
     } else if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_HORZ_SCALE_CHANGED) {
         process_horz_scale_changed_message(ctx);
@@ -382,6 +717,14 @@ static void process_complete_incoming_message(struct scoppy_context *ctx) {
         process_pre_trigger_samples_message(ctx);
     } else if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_SIG_GEN) {
         process_sig_gen_message(ctx);
+    } else if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_SEGMENTED_CAPTURE) {
+        process_segmented_capture_message(ctx);
+    } else if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_TELEMETRY_REQUEST) {
+        process_telemetry_request_message(ctx);
+    } else if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_CONFIG_BEGIN) {
+        process_config_begin_message(ctx);
+    } else if (incoming->msg_type == SCOPPY_INCOMING_MSG_TYPE_CONFIG_COMMIT) {
+        process_config_commit_message(ctx);
     } else {
         CTX_LOG_PRINT(ctx, "Unknown message type %d - ignore\n", incoming->msg_type);
     }
@@ -27,12 +27,33 @@
 #include "scoppy-context.h"
 #include "scoppy-incoming.h"
 #include "scoppy-outgoing.h"
+#include "scoppy-stream.h"
+#include "scoppy-telemetry.h"
 
 #define SCOPPY_OUTGOING_MSG_TYPE_SYNC 60
 #define SCOPPY_OUTGOING_MSG_TYPE_SAMPLES 61
+// Logic samples as the changes in the pin states. See scoppy-edges.h
+#define SCOPPY_OUTGOING_MSG_TYPE_LOGIC_EDGES 62
+#define SCOPPY_OUTGOING_MSG_TYPE_STREAM_STATS 63
+// Sent before the frames of a segmented capture. See scoppy_new_outgoing_segment_info_msg()
+#define SCOPPY_OUTGOING_MSG_TYPE_SEGMENT_INFO 64
+// The reply to TELEMETRY_REQUEST. See scoppy_new_outgoing_telemetry_msg()
+#define SCOPPY_OUTGOING_MSG_TYPE_TELEMETRY 65
 
 #define SCOPPY_OUTGOING_MAX_SAMPLE_BYTES (SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE - 50)
 
+// The newest version of the samples message that we can send. The app tells us the newest one that it can read in the
+// sync response (scoppy_app.samples_msg_version).
+//   v1: the samples follow the header
+//   v2: adds the encoding (1 byte) and the number of samples (2 bytes) to the end of the header
+//   v3: adds the unscanned trigger chunks (2 bytes, see scoppy_samples_msg_info) after the v2 fields
+//   v4: adds the fractional trigger position (2 bytes, see scoppy_samples_msg_info) after the v3 fields
+#define SCOPPY_SAMPLES_MSG_MAX_VERSION 4
+
+// v2 sample encodings
+#define SCOPPY_SAMPLES_ENCODING_RAW 0
+#define SCOPPY_SAMPLES_ENCODING_DELTA 1 // see scoppy-delta-codec.h
+
 #define SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE 80
 #define SCOPPY_INCOMING_MSG_TYPE_HORZ_SCALE_CHANGED 81
 #define SCOPPY_INCOMING_MSG_TYPE_CHANNELS_CHANGED 82
@@ -41,8 +62,66 @@
 #define SCOPPY_INCOMING_MSG_TYPE_SELECTED_SAMPLE_RATE 85
 // 86 is the end of message byte
 #define SCOPPY_INCOMING_MSG_TYPE_PRE_TRIGGER_SAMPLES 87
+// The config messages between these are applied together. See scoppy_app.config_batch_open
+#define SCOPPY_INCOMING_MSG_TYPE_CONFIG_BEGIN 88
+#define SCOPPY_INCOMING_MSG_TYPE_CONFIG_COMMIT 89
+// The number of segments (see scoppy_app.num_segments)
+#define SCOPPY_INCOMING_MSG_TYPE_SEGMENTED_CAPTURE 90
+// Asks for a TELEMETRY message (see scoppy_app.telemetry_requested)
+#define SCOPPY_INCOMING_MSG_TYPE_TELEMETRY_REQUEST 91
+
+// One frame of a segmented capture
+struct scoppy_segment_info {
+    // When the trigger was found (microseconds since boot)
+    uint64_t trigger_time_us;
+    // As in the samples message. -1 if there's no trigger, -2 if we looked for one but didn't find it.
+    int32_t trigger_idx;
+    // The number of sample bytes in the frame (all channels)
+    uint32_t num_bytes;
+};
 
 struct scoppy_outgoing *scoppy_new_outgoing_sync_msg(struct scoppy_context *ctx);
 struct scoppy_outgoing *scoppy_new_outgoing_samples_msg(uint32_t realSampleRateHz, struct scoppy_channel *channels, bool new_wavepoint_record, bool is_last_message_in_frame, bool is_continuous_mode, bool is_single_shot, int32_t trigger_idx, bool is_logic_mode);
 
+// The samples message header fields that were added after v2. Older versions don't send them.
+struct scoppy_samples_msg_info {
+    // v3: the proportion (in 1/1000ths) of the chunks in the frame that were never checked for a trigger because the
+    // trigger scan couldn't keep up with the adc. 0 if there was no trigger scan.
+    uint16_t unscanned_permille;
+    // v4: where the signal actually crossed the trigger level, as a fraction of a sample period (in 1/65536ths) before
+    // the trigger sample. Lets the app line up successive frames more precisely than one sample. 0 if there's no
+    // trigger or it isn't a software edge trigger.
+    uint16_t trigger_fraction;
+};
+
+// Write a message created by scoppy_new_outgoing_samples_msg() followed by the samples in the segments. If version is
+// 2 or more the analog samples are delta encoded into the message when that makes it smaller. The encoded samples
+// are written from the message as a separate segment so that the header can still be queued on its own (see
+// scoppy_frame_queue_push_v()) but the message must then not be released until it has been written. info can be
+// NULL in which case its fields are sent as 0.
+int scoppy_write_outgoing_samples_msg(int (*write_serial_v)(const struct scoppy_iovec *, int), struct scoppy_outgoing *msg, uint8_t version,
+                                      const struct scoppy_samples_msg_info *info, const struct scoppy_iovec *segments, int num_segments);
+
+// Encode the logic samples in the segments as edges until the message is full. start_idx is the index of the first
+// sample since the stream was started. Sets num_encoded to the number of samples that the message covers (at least 1).
+// Like the delta encoded samples, the edges are held in the message after the payload and edges is set to them. Write
+// them as a segment (see scoppy_write_outgoing_v()) so that the header can still be queued on its own and don't
+// release the message until they have been written.
+struct scoppy_outgoing *scoppy_new_outgoing_logic_edges_msg(uint32_t sample_rate, bool new_record, uint64_t start_idx, const struct scoppy_iovec *segments,
+                                                            int num_segments, uint32_t *num_encoded, struct scoppy_iovec *edges);
+
+// The segments are then sent as normal frames (samples messages) in the same order. The per segment records are held
+// in the message after the payload and records is set to them. Like the logic edges, write them as a segment and
+// don't release the message until they have been written.
+struct scoppy_outgoing *scoppy_new_outgoing_segment_info_msg(uint32_t sample_rate, const struct scoppy_segment_info *segments, int num_segments,
+                                                             struct scoppy_iovec *records);
+
+struct scoppy_outgoing *scoppy_new_outgoing_stream_stats_msg(const struct scoppy_stream_stats *stats, uint8_t bytes_per_sample_set);
+
+struct scoppy_outgoing *scoppy_new_outgoing_telemetry_msg(const struct scoppy_telemetry *telemetry);
+
 int scoppy_read_and_process_incoming_message(struct scoppy_context *ctx, int num_tries, int32_t sleep_between_tries_ms);
+
+// Close the config batch if it has been open for SCOPPY_CONFIG_BATCH_TIMEOUT_US (ie. the commit was lost and no more
+// messages have come in to close it). Call it regularly. Returns true if the batch was closed.
+bool scoppy_expire_config_batch(struct scoppy_context *ctx);
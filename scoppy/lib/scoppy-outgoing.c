@@ -26,35 +26,56 @@
 #include "scoppy-util/number.h"
 #include "scoppy.h"
 
-static struct scoppy_outgoing msg_instance;
+static struct scoppy_outgoing pool[SCOPPY_OUTGOING_POOL_SIZE];
 static char *last_error = "???";
 
+// Protect the pool when it's used from both cores. See scoppy_set_outgoing_pool_lock().
+static void no_lock(void) {}
+static void (*pool_lock)(void) = no_lock;
+static void (*pool_unlock)(void) = no_lock;
+
 #define SCOPPY_OUTGOING_PRE 0x5555 // 0101
 #define SCOPPY_OUTGOING_POST 0xAAAA // 1010
 
 void scoppy_init_outgoing() {
-    msg_instance.pre = SCOPPY_OUTGOING_PRE;
-    msg_instance.pre_data = SCOPPY_OUTGOING_PRE;
+    for (int i = 0; i < SCOPPY_OUTGOING_POOL_SIZE; i++) {
+        struct scoppy_outgoing *msg = &pool[i];
+        msg->pre = SCOPPY_OUTGOING_PRE;
+        msg->pre_data = SCOPPY_OUTGOING_PRE;
+
+        msg->post = SCOPPY_OUTGOING_POST;
+        msg->post_data = SCOPPY_OUTGOING_POST;
+
+        msg->in_use = false;
+    }
+}
 
-    msg_instance.post = SCOPPY_OUTGOING_POST;
-    msg_instance.post_data = SCOPPY_OUTGOING_POST;
+void scoppy_set_outgoing_pool_lock(void (*lock)(void), void (*unlock)(void)) {
+    pool_lock = lock != NULL ? lock : no_lock;
+    pool_unlock = unlock != NULL ? unlock : no_lock;
 }
 
 #ifndef NDEBUG
-static void check_outgoing() {
+static void check_outgoing(struct scoppy_outgoing *msg_instance) {
     char *msg = NULL;
-    if (msg_instance.pre != SCOPPY_OUTGOING_PRE) {
+    if (msg_instance < pool || msg_instance >= pool + SCOPPY_OUTGOING_POOL_SIZE) {
+        msg = "scoppy_outgoing - not from the pool";
+    }
+    else if (msg_instance->pre != SCOPPY_OUTGOING_PRE) {
         msg = "scoppy_outgoing - pre clobbered";
     }
-    else if (msg_instance.pre_data != SCOPPY_OUTGOING_PRE) {
+    else if (msg_instance->pre_data != SCOPPY_OUTGOING_PRE) {
         msg = "scoppy_outgoing - pre data clobbered";
     }
-    else    if (msg_instance.post != SCOPPY_OUTGOING_POST) {
+    else    if (msg_instance->post != SCOPPY_OUTGOING_POST) {
         msg = "scoppy_outgoing - post clobbered";
     }
-    else if (msg_instance.post_data != SCOPPY_OUTGOING_POST) {
+    else if (msg_instance->post_data != SCOPPY_OUTGOING_POST) {
         msg = "scoppy_outgoing - post data clobbered";
     }
+    else if (!msg_instance->in_use) {
+        msg = "scoppy_outgoing - used after release";
+    }
 
     if (msg != NULL) {
         printf("%s\n", msg);
@@ -67,30 +88,64 @@ static void check_outgoing() {
         assert(j == 0);
     }
 }
-    #define CHECK_OUTGOING() check_outgoing()
+    #define CHECK_OUTGOING(msg) check_outgoing(msg)
 #else
-#define CHECK_OUTGOING()
+#define CHECK_OUTGOING(msg)
 #endif
 
+struct scoppy_outgoing *scoppy_try_new_outgoing(uint8_t msg_type, uint8_t msg_version) {
+    struct scoppy_outgoing *msg = NULL;
+
+    pool_lock();
+    for (int i = 0; i < SCOPPY_OUTGOING_POOL_SIZE; i++) {
+        if (!pool[i].in_use) {
+            msg = &pool[i];
+            msg->in_use = true;
+            break;
+        }
+    }
+    pool_unlock();
+
+    if (msg == NULL) {
+        last_error = "outgoing pool exhausted";
+        return NULL;
+    }
+
+    CHECK_OUTGOING(msg);
+    msg->msg_type = msg_type;
+    msg->msg_version = msg_version;
+    msg->payload_len = 0;
+    msg->msg_size = -1;
+    msg->payload = &msg->data[6];
+    return msg;
+}
+
 struct scoppy_outgoing *scoppy_new_outgoing(uint8_t msg_type, uint8_t msg_version) {
-    CHECK_OUTGOING();
-    msg_instance.msg_type = msg_type;
-    msg_instance.msg_version = msg_version;
-    msg_instance.payload_len = 0;
-    msg_instance.msg_size = -1;
-    msg_instance.payload = &msg_instance.data[6];
-    return &msg_instance;
+    struct scoppy_outgoing *msg;
+    while ((msg = scoppy_try_new_outgoing(msg_type, msg_version)) == NULL) {
+        // Wait for the other core to release one. There are enough for each core to have one in use so if we get
+        // here on a single core then a message wasn't released.
+    }
+    return msg;
 }
 
-void scoppy_prepare_outgoing(struct scoppy_outgoing *msg) {
-    CHECK_OUTGOING();
+void scoppy_release_outgoing(struct scoppy_outgoing *msg) {
+    CHECK_OUTGOING(msg);
+    pool_lock();
+    msg->in_use = false;
+    pool_unlock();
+}
+
+static void prepare_outgoing(struct scoppy_outgoing *msg, uint32_t external_payload_len) {
+    CHECK_OUTGOING(msg);
 
     msg->msg_size = 1 +               // start byte
                     2 +               // message_size
                     1 +               // message type
                     1 +               // message type + 5
                     1 +               // message version
-                    msg->payload_len; //
+                    msg->payload_len + //
+                    external_payload_len; // see scoppy_write_outgoing_v()
     //                1;                 // end of message byte
 
     msg->data[0] = scoppy_start_of_message_byte;
@@ -101,14 +156,55 @@ void scoppy_prepare_outgoing(struct scoppy_outgoing *msg) {
     msg->data[4] = msg->msg_type + 5;
     msg->data[5] = msg->msg_version;
 
-    CHECK_OUTGOING();
+    CHECK_OUTGOING(msg);
+}
+
+void scoppy_prepare_outgoing(struct scoppy_outgoing *msg) {
+    prepare_outgoing(msg, 0);
 }
 
 int scoppy_write_outgoing(int (*write_serial)(uint8_t *, int, int), struct scoppy_outgoing *msg) {
-    CHECK_OUTGOING();
+    CHECK_OUTGOING(msg);
     scoppy_prepare_outgoing(msg);
     int ret = write_serial(msg->data, 0, msg->msg_size);
-    CHECK_OUTGOING();
+    CHECK_OUTGOING(msg);
+    return ret;
+}
+
+int scoppy_write_outgoing_v(int (*write_serial_v)(const struct scoppy_iovec *, int), struct scoppy_outgoing *msg,
+                            const struct scoppy_iovec *segments, int num_segments) {
+    CHECK_OUTGOING(msg);
+
+    if (num_segments < 0 || num_segments > SCOPPY_OUTGOING_MAX_SEGMENTS) {
+        last_error = "too many segments";
+        assert(false);
+        return -1;
+    }
+
+    uint32_t external_payload_len = 0;
+    for (int i = 0; i < num_segments; i++) {
+        external_payload_len += segments[i].len;
+    }
+
+    // The app doesn't know how the message was written so the usual payload limit still applies
+    if (msg->payload_len + external_payload_len > SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE) {
+        last_error = "payload too big";
+        assert(false);
+        return -1;
+    }
+
+    prepare_outgoing(msg, external_payload_len);
+
+    // The first segment is the message header and the payload held in the message
+    struct scoppy_iovec iov[SCOPPY_OUTGOING_MAX_SEGMENTS + 1];
+    iov[0].base = msg->data;
+    iov[0].len = msg->msg_size - external_payload_len;
+    for (int i = 0; i < num_segments; i++) {
+        iov[i + 1] = segments[i];
+    }
+
+    int ret = write_serial_v(iov, num_segments + 1);
+    CHECK_OUTGOING(msg);
     return ret;
 }
 
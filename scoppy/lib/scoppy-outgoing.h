@@ -31,6 +31,21 @@
 
 #define SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE 4096
 
+// The maximum number of external payload segments that can be written with scoppy_write_outgoing_v()
+#define SCOPPY_OUTGOING_MAX_SEGMENTS 4
+
+// Outgoing messages come from a small pool so that a message can be built on one core while another is being written
+// on the other (or the previous one is still being written).
+#ifndef SCOPPY_OUTGOING_POOL_SIZE
+#define SCOPPY_OUTGOING_POOL_SIZE 3
+#endif
+
+// A contiguous region of memory to be written to the serial port
+struct scoppy_iovec {
+    const uint8_t *base;
+    uint32_t len;
+};
+
 struct scoppy_outgoing {
     // for debugging
     uint32_t pre;
@@ -43,7 +58,7 @@ struct scoppy_outgoing {
     uint32_t pre_data;
 
     // The raw message data including the payload, the start and end bytes, message size and message type
-    uint8_t data[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 5];
+    uint8_t data[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 6];
 
     // for debugging
     uint32_t post_data;
@@ -57,15 +72,33 @@ struct scoppy_outgoing {
     // The size of the complete message
     uint16_t msg_size;
 
+    // Set while the message is acquired from the pool
+    bool in_use;
+
     // for debugging
     uint32_t post;
 };
 
 void scoppy_init_outgoing();
+
+// Use these to protect the pool if messages are acquired/released on more than one core. The default (or NULL) is no
+// locking.
+void scoppy_set_outgoing_pool_lock(void (*lock)(void), void (*unlock)(void));
+
+// Acquire a message from the pool. Waits for one to be released if they are all in use.
 struct scoppy_outgoing *scoppy_new_outgoing(uint8_t msg_type, uint8_t msg_version);
+// Returns NULL if they are all in use
+struct scoppy_outgoing *scoppy_try_new_outgoing(uint8_t msg_type, uint8_t msg_version);
+// Return the message to the pool once it has been written
+void scoppy_release_outgoing(struct scoppy_outgoing *msg);
 
 void scoppy_prepare_outgoing(struct scoppy_outgoing *msg);
 int scoppy_write_outgoing(int (*write_serial)(uint8_t *, int, int), struct scoppy_outgoing *msg);
+
+// Write the message followed by the given segments without copying them into the message. The segments form the
+// end of the payload and are included in the message size.
+int scoppy_write_outgoing_v(int (*write_serial_v)(const struct scoppy_iovec *, int), struct scoppy_outgoing *msg,
+                            const struct scoppy_iovec *segments, int num_segments);
 void scoppy_debug_outgoing(struct scoppy_outgoing *data);
 char* scoppy_outgoing_error();
 
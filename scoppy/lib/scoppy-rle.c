@@ -0,0 +1,202 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-rle.h"
+
+void scoppy_rle_init(struct scoppy_rle_buffer *rle, uint32_t *records, uint32_t capacity) {
+    assert(capacity > 0);
+    rle->records = records;
+    rle->capacity = capacity;
+    scoppy_rle_clear(rle);
+}
+
+void scoppy_rle_clear(struct scoppy_rle_buffer *rle) {
+    rle->head = 0;
+    rle->count = 0;
+    rle->first_sample = 0;
+    rle->end_sample = 0;
+    rle->state = 0;
+    rle->run = 0;
+}
+
+static inline bool is_literal(uint32_t record) { return (record & SCOPPY_RLE_LITERAL_FLAG) != 0; }
+
+static inline uint32_t num_literals(uint32_t record) { return (record >> 24) & 0x03; }
+
+static inline uint32_t record_len(uint32_t record) { return is_literal(record) ? num_literals(record) : ((record >> 8) & (SCOPPY_RLE_MAX_RUN - 1)) + 1; }
+
+// The array index of the nth record from the oldest
+static inline uint32_t record_idx(const struct scoppy_rle_buffer *rle, uint32_t n) {
+    uint32_t idx = rle->head + n;
+    return idx >= rle->capacity ? idx - rle->capacity : idx;
+}
+
+static void push_record(struct scoppy_rle_buffer *rle, uint32_t record) {
+    if (rle->count == rle->capacity) {
+        // drop the oldest
+        rle->first_sample += record_len(rle->records[rle->head]);
+        rle->head = record_idx(rle, 1);
+        rle->count--;
+    }
+    rle->records[record_idx(rle, rle->count)] = record;
+    rle->count++;
+}
+
+static void add_literal(struct scoppy_rle_buffer *rle, uint8_t state) {
+    if (rle->count > 0) {
+        uint32_t *last = &rle->records[record_idx(rle, rle->count - 1)];
+        uint32_t n = num_literals(*last);
+        if (is_literal(*last) && n < SCOPPY_RLE_MAX_LITERALS) {
+            *last = (*last & ~(0x03u << 24)) | ((n + 1) << 24) | ((uint32_t)state << (8 * n));
+            return;
+        }
+    }
+    push_record(rle, SCOPPY_RLE_LITERAL_FLAG | (1u << 24) | state);
+}
+
+static void add_run(struct scoppy_rle_buffer *rle, uint8_t state, uint32_t run) {
+    while (run > 0) {
+        if (run < 3) {
+            // A literal record is never worse than a run record and usually holds more than one sample
+            add_literal(rle, state);
+            run--;
+        } else {
+            uint32_t n = run > SCOPPY_RLE_MAX_RUN ? SCOPPY_RLE_MAX_RUN : run;
+            push_record(rle, ((n - 1) << 8) | state);
+            run -= n;
+        }
+    }
+}
+
+// p must be word aligned. See scoppy-edges.c
+static inline uint32_t load_word(const uint8_t *p) {
+    uint32_t word;
+    memcpy(&word, __builtin_assume_aligned(p, 4), 4);
+    return word;
+}
+
+void scoppy_rle_compress(struct scoppy_rle_buffer *rle, const uint8_t *samples, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    const uint8_t *p = samples;
+    const uint8_t *const end = samples + len;
+    uint8_t state = rle->run == 0 ? *p : rle->state;
+    uint32_t same_word = state * 0x01010101u;
+
+    // The samples from run_start belong to the current run as well as the rle->run samples before them
+    const uint8_t *run_start = p;
+    uint32_t run = rle->run;
+
+    while (p < end) {
+        // Skip over a word at a time while nothing changes (which is most of the time)
+        if (((uintptr_t)p & 3) == 0) {
+            while (end - p >= 4 && load_word(p) == same_word) {
+                p += 4;
+            }
+            if (p == end) {
+                break;
+            }
+        }
+
+        if (*p != state) {
+            add_run(rle, state, run + (uint32_t)(p - run_start));
+            run = 0;
+            run_start = p;
+            state = *p;
+            same_word = state * 0x01010101u;
+        }
+        p++;
+    }
+
+    run += (uint32_t)(end - run_start);
+
+    // Don't let the current run overflow when nothing changes for a long time
+    while (run > SCOPPY_RLE_MAX_RUN) {
+        add_run(rle, state, SCOPPY_RLE_MAX_RUN);
+        run -= SCOPPY_RLE_MAX_RUN;
+    }
+
+    rle->state = state;
+    rle->run = run;
+    rle->end_sample += len;
+}
+
+void scoppy_rle_reader_init(struct scoppy_rle_reader *reader, const struct scoppy_rle_buffer *rle, uint64_t sample_idx) {
+    assert(sample_idx >= rle->first_sample && sample_idx <= rle->end_sample);
+    reader->rle = rle;
+    reader->record = 0;
+
+    uint64_t skip = sample_idx - rle->first_sample;
+    while (reader->record < rle->count) {
+        uint32_t len = record_len(rle->records[record_idx(rle, reader->record)]);
+        if (skip < len) {
+            break;
+        }
+        skip -= len;
+        reader->record++;
+    }
+    assert(reader->record < rle->count || skip <= rle->run);
+    reader->used = (uint32_t)skip;
+}
+
+uint32_t scoppy_rle_read(struct scoppy_rle_reader *reader, uint8_t *dest, uint32_t len) {
+    const struct scoppy_rle_buffer *rle = reader->rle;
+    uint32_t n = 0;
+
+    while (n < len) {
+        uint32_t record;
+        if (reader->record < rle->count) {
+            record = rle->records[record_idx(rle, reader->record)];
+        } else if (reader->used < rle->run) {
+            // the current run
+            record = ((rle->run - 1) << 8) | rle->state;
+        } else {
+            break;
+        }
+
+        uint32_t remaining = record_len(record) - reader->used;
+        if (is_literal(record)) {
+            while (remaining > 0 && n < len) {
+                dest[n++] = (uint8_t)(record >> (8 * reader->used));
+                reader->used++;
+                remaining--;
+            }
+        } else {
+            uint32_t m = remaining < len - n ? remaining : len - n;
+            memset(dest + n, (uint8_t)record, m);
+            n += m;
+            reader->used += m;
+            remaining -= m;
+        }
+
+        if (remaining == 0 && reader->record < rle->count) {
+            reader->record++;
+            reader->used = 0;
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Run length encoded logic samples. Used for deep single shot captures: the samples are compressed a chunk at a time
+// as the dma transfers complete so a sparse bus (eg. I2C or UART) fits many more samples into the same memory than
+// the raw ring buffer.
+//
+// The records are 32 bits. There are 2 kinds:
+//   - a run: bit 31 clear, the run length - 1 in bits 8-30 and the pin state in bits 0-7
+//   - literals: bit 31 set, the number of samples (1-3) in bits 24-25 and the pin states in bits 0-7, 8-15 and 16-23
+// Runs of 1 or 2 samples are packed into literals so that a busy signal costs at most 4 bytes per 3 samples.
+//
+// The records are kept in a ring. When it is full the oldest record is dropped to make room for a new one. The
+// current run is not added to the ring until the state changes.
+//
+
+#define SCOPPY_RLE_LITERAL_FLAG 0x80000000u
+#define SCOPPY_RLE_MAX_LITERALS 3
+#define SCOPPY_RLE_MAX_RUN (1u << 23)
+
+struct scoppy_rle_buffer {
+    uint32_t *records;
+    uint32_t capacity;
+
+    // The oldest record and the number of records
+    uint32_t head;
+    uint32_t count;
+
+    // The index of the first sample in the oldest record and of the sample after the last one compressed. Indexes
+    // count from the first sample compressed since the buffer was cleared.
+    uint64_t first_sample;
+    uint64_t end_sample;
+
+    // The current run. run is 0 when nothing has been compressed.
+    uint8_t state;
+    uint32_t run;
+};
+
+void scoppy_rle_init(struct scoppy_rle_buffer *rle, uint32_t *records, uint32_t capacity);
+void scoppy_rle_clear(struct scoppy_rle_buffer *rle);
+
+// Compress the samples (eg. a chunk that the dma has just written) onto the end of the buffer
+void scoppy_rle_compress(struct scoppy_rle_buffer *rle, const uint8_t *samples, uint32_t len);
+
+static inline bool scoppy_rle_is_full(const struct scoppy_rle_buffer *rle) { return rle->count == rle->capacity; }
+
+// The number of samples that the buffer currently holds
+static inline uint64_t scoppy_rle_num_samples(const struct scoppy_rle_buffer *rle) { return rle->end_sample - rle->first_sample; }
+
+// Reads the samples back out of the buffer. The buffer must not be compressed to while it is being read.
+struct scoppy_rle_reader {
+    const struct scoppy_rle_buffer *rle;
+
+    // The number of records from the oldest one and the number of samples of that record that have been read. When
+    // record == rle->count we are reading the current run.
+    uint32_t record;
+    uint32_t used;
+};
+
+// Start reading at sample_idx which must be between rle->first_sample and rle->end_sample
+void scoppy_rle_reader_init(struct scoppy_rle_reader *reader, const struct scoppy_rle_buffer *rle, uint64_t sample_idx);
+
+// Expand the next samples into dest. Returns the number of samples read which is less than len at the end of the buffer.
+uint32_t scoppy_rle_read(struct scoppy_rle_reader *reader, uint8_t *dest, uint32_t len);
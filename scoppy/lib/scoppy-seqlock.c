@@ -0,0 +1,68 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+//
+#include "scoppy-seqlock.h"
+
+// The shared data is copied a byte at a time with relaxed atomics. It's small and they compile to plain loads and
+// stores, but it means that a reader racing with the writer isn't undefined behaviour.
+static void copy_relaxed(uint8_t *dest, const uint8_t *src, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        __atomic_store_n(dest + i, __atomic_load_n(src + i, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+}
+
+void scoppy_seqlock_init(struct scoppy_seqlock *lock) { lock->seq = 0; }
+
+void scoppy_seqlock_write(struct scoppy_seqlock *lock, void *dest, const void *src, size_t size) {
+    // Only we write seq
+    uint32_t seq = lock->seq;
+    assert((seq & 1) == 0);
+
+    __atomic_store_n(&lock->seq, seq + 1, __ATOMIC_RELAXED);
+    // The odd sequence number must be visible before any of the data changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    copy_relaxed(dest, src, size);
+
+    __atomic_store_n(&lock->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint32_t scoppy_seqlock_read(struct scoppy_seqlock *lock, void *dest, const void *src, size_t size) {
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            // being written
+            continue;
+        }
+
+        copy_relaxed(dest, src, size);
+
+        // The data must be read before we check the sequence number again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&lock->seq, __ATOMIC_RELAXED) == seq) {
+            return seq / 2;
+        }
+    }
+}
+
+uint32_t scoppy_seqlock_get_generation(struct scoppy_seqlock *lock) { return __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE) / 2; }
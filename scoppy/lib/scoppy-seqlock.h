@@ -0,0 +1,48 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// A sequence lock for publishing a small struct from one core to another without stopping the reader. The writer
+// makes the sequence number odd while it updates the data and even again when it's done. A reader copies the data
+// and tries again if the sequence number was odd or changed while it was copying.
+//
+// There must only be one writer. Readers never block the writer.
+//
+struct scoppy_seqlock {
+    uint32_t seq;
+};
+
+void scoppy_seqlock_init(struct scoppy_seqlock *lock);
+
+// Copy size bytes from src to the shared data at dest
+void scoppy_seqlock_write(struct scoppy_seqlock *lock, void *dest, const void *src, size_t size);
+
+// Copy a consistent snapshot of the shared data at src to dest. Returns its generation ie. the number of times that
+// it has been written since the lock was initialised.
+uint32_t scoppy_seqlock_read(struct scoppy_seqlock *lock, void *dest, const void *src, size_t size);
+
+// The generation of the shared data. Cheaper than reading it if the caller only wants to know if it has changed.
+uint32_t scoppy_seqlock_get_generation(struct scoppy_seqlock *lock);
@@ -0,0 +1,240 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-message.h"
+#include "scoppy-stream.h"
+#include "scoppy.h"
+
+#define STREAM_DEFAULT_STATS_INTERVAL_US 1000000u
+
+void scoppy_stream_init(struct scoppy_stream *stream, const uint8_t *ring_arr, uint32_t ring_size, uint8_t bytes_per_sample_set,
+                        uint32_t sample_rate_per_channel, struct scoppy_channel *channels, bool is_logic_mode) {
+    // get_write_count, get_time_us and write_serial_v must be set by the caller
+    scoppy_adc_ring_reader_init(&stream->reader, ring_arr, ring_size, bytes_per_sample_set, 1);
+
+    memset(&stream->stats, 0, sizeof(stream->stats));
+    stream->stats.sample_rate_per_channel = sample_rate_per_channel;
+    if (stream->get_time_us != NULL) {
+        stream->stats.start_us = stream->stats.now_us = stream->get_time_us();
+    }
+
+    stream->num_captured_bytes = 0;
+    stream->last_write_count = 0;
+
+    stream->channels = channels;
+    stream->is_logic_mode = is_logic_mode;
+    stream->seq = 0;
+    stream->samples_msg_version = 1;
+    stream->edge_mode = false;
+    stream->stats_interval_us = STREAM_DEFAULT_STATS_INTERVAL_US;
+    stream->last_stats_us = stream->stats.start_us;
+}
+
+void scoppy_stream_update_stats(struct scoppy_stream *stream) {
+    // The write count wraps at 2^32 so only add on the difference
+    uint32_t write_count = stream->get_write_count();
+    stream->num_captured_bytes += write_count - stream->last_write_count;
+    stream->last_write_count = write_count;
+    stream->stats.num_captured = stream->num_captured_bytes / stream->reader.num_channels;
+    stream->stats.now_us = stream->get_time_us();
+}
+
+static void add_dropped(struct scoppy_stream *stream, uint32_t num_sets) {
+    if (num_sets > 0) {
+        stream->stats.num_dropped += num_sets;
+        stream->stats.num_drop_events++;
+        // Tell the app that the samples in the next message don't follow on from the last
+        stream->reader.discarded_samples = true;
+    }
+}
+
+void scoppy_stream_restart(struct scoppy_stream *stream) {
+    struct scoppy_adc_ring_reader *reader = &stream->reader;
+    uint32_t num_channels = reader->num_channels;
+
+    // Everything that wasn't sent is lost. So is a partial sample set (the DMA starts again with the first channel).
+    add_dropped(stream, (stream->last_write_count - reader->read_count) / num_channels);
+    stream->num_captured_bytes -= stream->num_captured_bytes % num_channels;
+    stream->stats.num_captured = stream->num_captured_bytes / num_channels;
+
+    scoppy_adc_ring_reader_init(reader, reader->arr, reader->size, num_channels, 1);
+    stream->last_write_count = 0;
+
+    // The samples won't follow on from the last ones even if none were dropped
+    reader->discarded_samples = true;
+}
+
+static int timed_write(struct scoppy_stream *stream, struct scoppy_outgoing *msg, const struct scoppy_iovec *segments, int num_segments) {
+    uint64_t start_us = stream->get_time_us();
+    int ret;
+    if (msg->msg_type == SCOPPY_OUTGOING_MSG_TYPE_SAMPLES) {
+        ret = scoppy_write_outgoing_samples_msg(stream->write_serial_v, msg, stream->samples_msg_version, NULL, segments, num_segments);
+    } else {
+        ret = scoppy_write_outgoing_v(stream->write_serial_v, msg, segments, num_segments);
+    }
+    stream->stats.write_time_us += stream->get_time_us() - start_us;
+    stream->stats.num_bytes_sent += msg->msg_size;
+    scoppy_release_outgoing(msg);
+    return ret;
+}
+
+static void send_stats(struct scoppy_stream *stream) {
+    scoppy_stream_update_stats(stream);
+    struct scoppy_outgoing *msg = scoppy_new_outgoing_stream_stats_msg(&stream->stats, (uint8_t)stream->reader.num_channels);
+    timed_write(stream, msg, NULL, 0);
+    stream->last_stats_us = stream->stats.now_us;
+}
+
+// The index of the sample set at the given read count since the stream was started (ie. across DMA restarts)
+static uint64_t get_sample_idx(struct scoppy_stream *stream, uint32_t read_count) {
+    return (stream->num_captured_bytes - stream->last_write_count + read_count) / stream->reader.num_channels;
+}
+
+// Edges are encoded into the message so unlike the samples they can't be overwritten while they are being sent. Any
+// that were overwritten while they were being encoded are dropped.
+static uint32_t send_edges(struct scoppy_stream *stream, uint32_t write_count) {
+    struct scoppy_adc_ring_reader *reader = &stream->reader;
+    assert(reader->num_channels == 1);
+    uint32_t total_sent = 0;
+
+    for (;;) {
+        uint32_t read_count = reader->read_count;
+        struct scoppy_uint8_span span0, span1;
+        uint32_t len = scoppy_adc_ring_reader_get_spans(reader, write_count, UINT32_MAX, &span0, &span1);
+        add_dropped(stream, reader->read_count - read_count - len);
+        if (len == 0) {
+            break;
+        }
+
+        uint32_t from_count = reader->read_count - len;
+        uint32_t num_encoded;
+        struct scoppy_iovec edges;
+        struct scoppy_iovec segments[2] = {{span0.ptr, span0.len}, {span1.ptr, span1.len}};
+        struct scoppy_outgoing *msg =
+            scoppy_new_outgoing_logic_edges_msg(stream->stats.sample_rate_per_channel, stream->seq++ == 0 || reader->discarded_samples,
+                                                get_sample_idx(stream, from_count), segments, span1.len > 0 ? 2 : 1, &num_encoded, &edges);
+
+        // The rest go in the next message
+        reader->read_count = from_count + num_encoded;
+
+        if (scoppy_adc_ring_reader_was_overwritten(reader, from_count, stream->get_write_count())) {
+            scoppy_release_outgoing(msg);
+            add_dropped(stream, num_encoded);
+            continue;
+        }
+
+        reader->discarded_samples = false;
+        timed_write(stream, msg, &edges, 1);
+        stream->stats.num_sent += num_encoded;
+        total_sent += num_encoded;
+    }
+
+    return total_sent;
+}
+
+static uint32_t send_samples(struct scoppy_stream *stream, uint32_t write_count) {
+    struct scoppy_adc_ring_reader *reader = &stream->reader;
+    uint32_t num_channels = reader->num_channels;
+    uint32_t total_sent = 0;
+
+    for (;;) {
+        uint32_t read_count = reader->read_count;
+        bool discarded_samples = reader->discarded_samples;
+
+        struct scoppy_uint8_span span0, span1;
+        uint32_t len = scoppy_adc_ring_reader_get_spans(reader, write_count, SCOPPY_OUTGOING_MAX_SAMPLE_BYTES, &span0, &span1);
+
+        // The reader skips samples that the DMA has already overwritten
+        uint32_t skipped = reader->read_count - read_count - len;
+        reader->discarded_samples = discarded_samples;
+        add_dropped(stream, skipped / num_channels);
+
+        if (len == 0) {
+            break;
+        }
+
+        bool is_new_wavepoint_record = stream->seq++ == 0 || reader->discarded_samples;
+        reader->discarded_samples = false;
+
+        struct scoppy_outgoing *msg = scoppy_new_outgoing_samples_msg(stream->stats.sample_rate_per_channel, stream->channels, is_new_wavepoint_record,
+                                                                       false /* last message in frame */, true /* cont mode */, false /* single shot */,
+                                                                       -1 /* trigger index */, stream->is_logic_mode);
+        struct scoppy_iovec segments[2] = {{span0.ptr, span0.len}, {span1.ptr, span1.len}};
+        timed_write(stream, msg, segments, span1.len > 0 ? 2 : 1);
+
+        uint32_t num_sets = len / num_channels;
+        uint32_t sent_from_count = reader->read_count - len;
+        uint32_t write_count_after = stream->get_write_count();
+        if (scoppy_adc_ring_reader_was_overwritten(reader, sent_from_count, write_count_after)) {
+            // The DMA caught up with us while we were sending. We don't know exactly which of the samples the app got
+            // before they were overwritten so assume none of the overwritten ones.
+            uint32_t overwritten = write_count_after - sent_from_count - reader->size;
+            uint32_t overwritten_sets = (overwritten + num_channels - 1) / num_channels;
+            if (overwritten_sets > num_sets) {
+                overwritten_sets = num_sets;
+            }
+            add_dropped(stream, overwritten_sets);
+            num_sets -= overwritten_sets;
+        }
+
+        stream->stats.num_sent += num_sets;
+        total_sent += num_sets;
+    }
+
+    return total_sent;
+}
+
+uint32_t scoppy_stream_send(struct scoppy_stream *stream) {
+    uint32_t write_count = stream->get_write_count();
+    uint32_t total_sent = stream->edge_mode ? send_edges(stream, write_count) : send_samples(stream, write_count);
+
+    if (stream->get_time_us() - stream->last_stats_us >= stream->stats_interval_us) {
+        send_stats(stream);
+    }
+
+    return total_sent;
+}
+
+uint32_t scoppy_stream_stats_delivered_rate(const struct scoppy_stream_stats *stats) {
+    uint64_t elapsed_us = stats->now_us - stats->start_us;
+    if (elapsed_us == 0) {
+        return 0;
+    }
+    return (uint32_t)((stats->num_sent * 1000000u) / elapsed_us);
+}
+
+uint32_t scoppy_stream_stats_link_bytes_per_sec(const struct scoppy_stream_stats *stats) {
+    if (stats->write_time_us == 0) {
+        return 0;
+    }
+    return (uint32_t)((stats->num_bytes_sent * 1000000u) / stats->write_time_us);
+}
+
+uint32_t scoppy_stream_stats_max_lossless_rate(const struct scoppy_stream_stats *stats, uint8_t bytes_per_sample_set) {
+    // A full SAMPLES message carries SCOPPY_OUTGOING_MAX_SAMPLE_BYTES of samples but the link also has to carry the
+    // header and the STREAM_STATS messages. 50 bytes is a generous allowance for that.
+    uint64_t link = scoppy_stream_stats_link_bytes_per_sec(stats);
+    uint64_t sample_bytes_per_sec = link * SCOPPY_OUTGOING_MAX_SAMPLE_BYTES / (SCOPPY_OUTGOING_MAX_SAMPLE_BYTES + 50);
+    return (uint32_t)(sample_bytes_per_sec / bytes_per_sample_set);
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+#include "scoppy-adc-timing.h"
+#include "scoppy-outgoing.h"
+#include "scoppy.h"
+
+//
+// Streaming mode (RUN_MODE_STREAM). Like continuous mode, the samples are written to a ring by the DMA, but they are
+// sent to the app as fast as the serial link allows rather than every 100ms. If the link can't keep up then the DMA
+// overwrites unsent samples. Every sample is accounted for so the app can tell exactly how many were dropped and can
+// choose the highest sample rate that the link sustains without losing any.
+//
+// All the counts are in sample sets (one sample from each channel) since the stream was started.
+//
+struct scoppy_stream_stats {
+    uint32_t sample_rate_per_channel;
+
+    uint64_t start_us;
+    uint64_t now_us;
+
+    // written to the ring by the DMA
+    uint64_t num_captured;
+    // sent to the app intact
+    uint64_t num_sent;
+    // overwritten by the DMA before they could be sent (or while they were being sent)
+    uint64_t num_dropped;
+    // the number of times that samples were dropped ie. the number of gaps in the stream
+    uint32_t num_drop_events;
+
+    // The total number of bytes written including the message overhead
+    uint64_t num_bytes_sent;
+    // Time spent writing to the serial port. num_bytes_sent / write_time_us is the throughput of the link.
+    uint64_t write_time_us;
+};
+
+struct scoppy_stream {
+    struct scoppy_adc_ring_reader reader;
+    struct scoppy_stream_stats stats;
+
+    // The number of bytes that the DMA has written to the ring since it was started
+    uint32_t (*get_write_count)(void);
+    uint64_t (*get_time_us)(void);
+    // Must not return until the message has been written. The message is released straight after and the edges are
+    // held in it (see scoppy_new_outgoing_logic_edges_msg()).
+    int (*write_serial_v)(const struct scoppy_iovec *, int);
+
+    // Used to keep num_captured up to date
+    uint64_t num_captured_bytes;
+    uint32_t last_write_count;
+
+    // Used for the samples messages
+    struct scoppy_channel *channels;
+    bool is_logic_mode;
+    uint32_t seq;
+    // 1 unless the caller changes it. See SCOPPY_SAMPLES_MSG_MAX_VERSION.
+    uint8_t samples_msg_version;
+    // Send logic samples as LOGIC_EDGES messages rather than SAMPLES messages. false unless the caller changes it.
+    bool edge_mode;
+
+    // How often to send a STREAM_STATS message
+    uint32_t stats_interval_us;
+    uint64_t last_stats_us;
+};
+
+void scoppy_stream_init(struct scoppy_stream *stream, const uint8_t *ring_arr, uint32_t ring_size, uint8_t bytes_per_sample_set,
+                        uint32_t sample_rate_per_channel, struct scoppy_channel *channels, bool is_logic_mode);
+
+// Send everything that the DMA has written since the last call (as one or more SAMPLES or LOGIC_EDGES messages). Samples that are
+// written while we are sending are left for the next call. Also sends a STREAM_STATS message every stats_interval_us.
+// Returns the number of sample sets sent.
+uint32_t scoppy_stream_send(struct scoppy_stream *stream);
+
+// Bring num_captured up to date
+void scoppy_stream_update_stats(struct scoppy_stream *stream);
+
+// Call this after the DMA has been restarted (ie. the write count has gone back to 0). scoppy_stream_update_stats()
+// must have been called just before the DMA was stopped. Unsent samples are counted as dropped.
+void scoppy_stream_restart(struct scoppy_stream *stream);
+
+// The rate (per channel) at which samples have actually been delivered to the app
+uint32_t scoppy_stream_stats_delivered_rate(const struct scoppy_stream_stats *stats);
+
+// The throughput of the serial link measured while it was busy (bytes/sec)
+uint32_t scoppy_stream_stats_link_bytes_per_sec(const struct scoppy_stream_stats *stats);
+
+// An estimate of the highest sample rate (per channel) that the link can sustain without dropping samples. It takes
+// into account the message overhead.
+uint32_t scoppy_stream_stats_max_lossless_rate(const struct scoppy_stream_stats *stats, uint8_t bytes_per_sample_set);
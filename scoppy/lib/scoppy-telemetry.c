@@ -0,0 +1,44 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+//
+#include "scoppy-telemetry.h"
+
+void scoppy_histogram_clear(struct scoppy_histogram *hist) { memset(hist, 0, sizeof(*hist)); }
+
+void scoppy_telemetry_clear(struct scoppy_telemetry *telemetry) {
+    uint32_t sample_rate = telemetry->sample_rate;
+    uint32_t chunk_size = telemetry->chunk_size;
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->sample_rate = sample_rate;
+    telemetry->chunk_size = chunk_size;
+}
+
+void scoppy_telemetry_copy(struct scoppy_telemetry *dest, const struct scoppy_telemetry *src) {
+    // The struct is all uint32_t
+    const uint32_t *from = (const uint32_t *)src;
+    uint32_t *to = (uint32_t *)dest;
+    for (size_t i = 0; i < sizeof(*src) / sizeof(uint32_t); i++) {
+        to[i] = __atomic_load_n(from + i, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+//
+// Always-on timing telemetry. Each histogram counts values (usually microseconds) in power of two buckets so adding a
+// value is only a few instructions, cheap enough for the dma interrupt handlers. The app (or a host tool) asks for a
+// copy with the TELEMETRY_REQUEST message and gets it back in a TELEMETRY message.
+//
+
+// Bucket 0 counts zeros. Bucket n counts values from 2^(n-1) up to (2^n)-1. The last bucket also counts everything
+// bigger than that - about 8 seconds when the values are microseconds.
+#define SCOPPY_HISTOGRAM_NUM_BUCKETS 24
+
+struct scoppy_histogram {
+    uint32_t buckets[SCOPPY_HISTOGRAM_NUM_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+};
+
+// The acquisition phases of a non-continuous frame (microseconds)
+#define SCOPPY_TELEMETRY_PRE_TRIGGER_WAIT 0
+#define SCOPPY_TELEMETRY_TRIGGER_WAIT 1
+#define SCOPPY_TELEMETRY_POST_TRIGGER_WAIT 2
+#define SCOPPY_TELEMETRY_LOCKING 3
+#define SCOPPY_TELEMETRY_BUFFER_COPY 4
+// How long after a dma channel finished a chunk its interrupt handler ran (nanoseconds)
+#define SCOPPY_TELEMETRY_DMA_IRQ_LATENCY 5
+// How long each write to USB took (microseconds)
+#define SCOPPY_TELEMETRY_USB_WRITE 6
+#define SCOPPY_TELEMETRY_NUM_HISTOGRAMS 7
+
+struct scoppy_telemetry {
+    struct scoppy_histogram histograms[SCOPPY_TELEMETRY_NUM_HISTOGRAMS];
+
+    uint32_t num_frames;
+    // Frames sent without finding a trigger
+    uint32_t num_timeouts;
+    // The most chunks waiting in the trigger chunk queue
+    uint32_t max_trigger_queue_size;
+    // Deep captures that were cut short because the compression couldn't keep up with the adc
+    uint32_t num_rle_overruns;
+
+    // The settings that the timings were measured with
+    uint32_t sample_rate;
+    uint32_t chunk_size;
+};
+
+void scoppy_histogram_clear(struct scoppy_histogram *hist);
+
+static inline int scoppy_histogram_bucket(uint32_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    int bucket = 32 - __builtin_clz(value);
+    return bucket < SCOPPY_HISTOGRAM_NUM_BUCKETS ? bucket : SCOPPY_HISTOGRAM_NUM_BUCKETS - 1;
+}
+
+// There must only be one writer for each histogram. Another core can read it with scoppy_telemetry_copy().
+static inline void scoppy_histogram_add(struct scoppy_histogram *hist, uint32_t value) {
+    hist->buckets[scoppy_histogram_bucket(value)]++;
+    hist->count++;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+void scoppy_telemetry_clear(struct scoppy_telemetry *telemetry);
+
+static inline void scoppy_telemetry_add(struct scoppy_telemetry *telemetry, int which, uint32_t value) {
+    scoppy_histogram_add(&telemetry->histograms[which], value);
+}
+
+// Copy telemetry that is being updated on the other core. Every counter is copied as a whole word so none of them
+// can be torn, but counters updated during the copy might be from either side of the update.
+void scoppy_telemetry_copy(struct scoppy_telemetry *dest, const struct scoppy_telemetry *src);
@@ -0,0 +1,204 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-trigger-dispatch.h"
+
+// The words shared between the cores are read and written with atomics. They compile to plain loads and stores (with
+// barriers where they're needed) so there's nothing here that the cortex-m0+ can't do.
+
+static inline struct scoppy_trigger_dispatch_chunk *chunk_for_seq(struct scoppy_trigger_dispatch *dispatch, uint32_t seq) {
+    return &dispatch->chunks[seq & (SCOPPY_TRIGGER_DISPATCH_SIZE - 1)];
+}
+
+// Returns true if we (who) have the chunk. Our claim must be visible to the other core before we look at its claim.
+static bool try_claim(struct scoppy_trigger_dispatch_chunk *chunk, int who, uint32_t seq) {
+    __atomic_store_n(&chunk->claims[who], seq + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&chunk->claims[1 - who], __ATOMIC_ACQUIRE) != seq + 1;
+}
+
+static void scan_chunk(struct scoppy_trigger_scanner *scanner, uint32_t num_samples, struct scoppy_trigger_dispatch_chunk *chunk, uint32_t seq) {
+    scanner->last_sample_value = chunk->last_sample_value;
+    chunk->trigger_sample_idx = scanner->scan(scanner, chunk->addr, num_samples);
+    __atomic_store_n(&chunk->done, seq + 1, __ATOMIC_RELEASE);
+}
+
+void scoppy_trigger_dispatch_init(struct scoppy_trigger_dispatch *dispatch) { memset(dispatch, 0, sizeof(*dispatch)); }
+
+bool scoppy_trigger_dispatch_supports(const struct scoppy_trigger_scanner *scanner) {
+    return (scanner->trigger_type == TRIGGER_TYPE_RISING_EDGE || scanner->trigger_type == TRIGGER_TYPE_FALLING_EDGE) && scanner->trigger_hysteresis == 0;
+}
+
+void scoppy_trigger_dispatch_start(struct scoppy_trigger_dispatch *dispatch, const struct scoppy_trigger_scanner *scanner, uint32_t num_samples) {
+    assert(!dispatch->active);
+    assert(!__atomic_load_n(&dispatch->helping, __ATOMIC_ACQUIRE));
+    assert(scoppy_trigger_dispatch_supports(scanner));
+
+    dispatch->scanner = *scanner;
+    dispatch->owner_scanner = dispatch->scanner;
+    dispatch->num_samples = num_samples;
+
+    // The helper isn't looking so the claims from the last search can be cleared
+    for (int i = 0; i < SCOPPY_TRIGGER_DISPATCH_SIZE; i++) {
+        struct scoppy_trigger_dispatch_chunk *chunk = &dispatch->chunks[i];
+        chunk->claims[SCOPPY_TRIGGER_DISPATCH_OWNER] = 0;
+        chunk->claims[SCOPPY_TRIGGER_DISPATCH_HELPER] = 0;
+        chunk->done = 0;
+    }
+    dispatch->num_published = 0;
+    dispatch->next_result = 0;
+    dispatch->next_lookahead = 0;
+    dispatch->last_addr = NULL;
+    dispatch->num_helper_chunks_scanned = 0;
+    dispatch->frame++;
+
+    __atomic_store_n(&dispatch->active, true, __ATOMIC_RELEASE);
+}
+
+void scoppy_trigger_dispatch_publish(struct scoppy_trigger_dispatch *dispatch, const uint8_t *addr, bool restart) {
+    assert(!scoppy_trigger_dispatch_is_full(dispatch));
+
+    uint32_t seq = dispatch->num_published;
+    struct scoppy_trigger_dispatch_chunk *chunk = chunk_for_seq(dispatch, seq);
+    const struct scoppy_trigger_scanner *scanner = &dispatch->scanner;
+
+    // Nobody is looking at the chunk that used this slot. Its result has been collected and if the helper tries to
+    // claim it now it will see our claim on it or, once we claim the new chunk, the new seq.
+    chunk->addr = addr;
+    if (restart || dispatch->last_addr == NULL) {
+        chunk->last_sample_value = addr[scanner->trigger_channel_idx];
+    } else {
+        chunk->last_sample_value = dispatch->last_addr[(dispatch->num_samples - 1) * scanner->num_bytes_per_sample + scanner->trigger_channel_idx];
+    }
+    dispatch->last_addr = addr;
+    __atomic_store_n(&chunk->seq, seq, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&dispatch->num_published, seq + 1, __ATOMIC_RELEASE);
+}
+
+bool scoppy_trigger_dispatch_work(struct scoppy_trigger_dispatch *dispatch, const uint8_t **trigger_chunk, int32_t *trigger_sample_idx) {
+    uint32_t num_published = dispatch->num_published;
+    bool scanned = false;
+
+    for (;;) {
+        // Collect the results that are ready, in order
+        while (dispatch->next_result < num_published) {
+            uint32_t seq = dispatch->next_result;
+            struct scoppy_trigger_dispatch_chunk *chunk = chunk_for_seq(dispatch, seq);
+            if (__atomic_load_n(&chunk->done, __ATOMIC_ACQUIRE) != seq + 1) {
+                break;
+            }
+
+            __atomic_store_n(&dispatch->next_result, seq + 1, __ATOMIC_RELAXED);
+            if (chunk->trigger_sample_idx >= 0) {
+                *trigger_chunk = chunk->addr;
+                *trigger_sample_idx = chunk->trigger_sample_idx;
+                return true;
+            }
+        }
+
+        if (scanned || dispatch->next_result == num_published) {
+            return false;
+        }
+        scanned = true;
+
+        // Scan one of our (even numbered) chunks if there is one not too far ahead and leave the odd numbered ones for
+        // the helper. Otherwise scan the oldest one ourselves unless the helper has it.
+        uint32_t seq = dispatch->next_lookahead > dispatch->next_result ? dispatch->next_lookahead : dispatch->next_result;
+        seq += seq & 1;
+        uint32_t end = dispatch->next_result + SCOPPY_TRIGGER_DISPATCH_LOOKAHEAD;
+        if (end > num_published) {
+            end = num_published;
+        }
+        while (seq < end && __atomic_load_n(&chunk_for_seq(dispatch, seq)->done, __ATOMIC_ACQUIRE) == seq + 1) {
+            seq += 2;
+        }
+        if (seq >= end) {
+            seq = dispatch->next_result;
+        }
+        dispatch->next_lookahead = seq + 1;
+
+        struct scoppy_trigger_dispatch_chunk *chunk = chunk_for_seq(dispatch, seq);
+        if (try_claim(chunk, SCOPPY_TRIGGER_DISPATCH_OWNER, seq)) {
+            scan_chunk(&dispatch->owner_scanner, dispatch->num_samples, chunk, seq);
+        }
+    }
+}
+
+void scoppy_trigger_dispatch_stop(struct scoppy_trigger_dispatch *dispatch) {
+    __atomic_store_n(&dispatch->active, false, __ATOMIC_RELAXED);
+    // The helper either sees that we've stopped or we see that it's helping
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&dispatch->helping, __ATOMIC_ACQUIRE)) {
+        // it's in the middle of a chunk
+    }
+}
+
+uint32_t scoppy_trigger_dispatch_help(struct scoppy_trigger_dispatch *dispatch) {
+    __atomic_store_n(&dispatch->helping, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&dispatch->active, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&dispatch->helping, false, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    if (dispatch->helper_frame != dispatch->frame) {
+        dispatch->helper_frame = dispatch->frame;
+        dispatch->helper_next = 1;
+    }
+
+    struct scoppy_trigger_scanner scanner = dispatch->scanner;
+
+    // Only the chunks that are there now so we don't keep the other jobs waiting
+    uint32_t num_published = __atomic_load_n(&dispatch->num_published, __ATOMIC_ACQUIRE);
+
+    // Don't bother with the chunks that the owner has already finished with
+    uint32_t seq = __atomic_load_n(&dispatch->next_result, __ATOMIC_RELAXED) | 1;
+    if (seq < dispatch->helper_next) {
+        seq = dispatch->helper_next;
+    }
+
+    uint32_t num_scanned = 0;
+    for (; seq < num_published && __atomic_load_n(&dispatch->active, __ATOMIC_RELAXED); seq += 2) {
+        struct scoppy_trigger_dispatch_chunk *chunk = chunk_for_seq(dispatch, seq);
+        if (!try_claim(chunk, SCOPPY_TRIGGER_DISPATCH_HELPER, seq)) {
+            // The owner got there first
+            __atomic_store_n(&chunk->claims[SCOPPY_TRIGGER_DISPATCH_HELPER], 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_load_n(&chunk->seq, __ATOMIC_ACQUIRE) != seq) {
+            // The owner finished with it and has reused the slot for a newer chunk
+            continue;
+        }
+
+        scan_chunk(&scanner, dispatch->num_samples, chunk, seq);
+        num_scanned++;
+    }
+
+    dispatch->helper_next = seq;
+    dispatch->num_helper_chunks_scanned += num_scanned;
+
+    __atomic_store_n(&dispatch->helping, false, __ATOMIC_RELEASE);
+    return num_scanned;
+}
@@ -0,0 +1,145 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+#include "scoppy-trigger.h"
+
+//
+// Shares the search for a trigger between two cores. The owner (core1, which runs the sampler) takes the chunks off
+// the trigger chunk queue and publishes them, in order, as descriptors in a small ring. The helper (core0, between
+// its other jobs) scans the odd numbered chunks and the owner scans the rest. The owner collects the results in order
+// so the trigger is always the first one in the signal no matter which core found it.
+//
+// Each chunk is scanned on its own. The owner copies the value of the last sample of the previous chunk into the
+// descriptor so edges between chunks are still found but nothing else can be carried over. That rules out hysteresis
+// and the state machine triggers - see scoppy_trigger_dispatch_supports().
+//
+// A core claims a chunk by writing the chunk's sequence number + 1 to its own claim word and then checking the other
+// core's claim word. It only needs loads, stores and barriers (the RP2040's cortex-m0+ has no compare-and-swap). If
+// both cores try at the same time at least one of them sees the other's claim. The owner never withdraws a claim so
+// if neither gets it the helper gives up and the owner gets it next time. If the helper never turns up the owner
+// scans every chunk itself.
+//
+
+// Must be a power of 2
+#define SCOPPY_TRIGGER_DISPATCH_SIZE 16
+// How far ahead of the oldest unfinished chunk the owner will scan its own chunks before it takes the oldest one from
+// the helper. Keeps the wasted work down if the helper is busy with something else.
+#define SCOPPY_TRIGGER_DISPATCH_LOOKAHEAD 4
+
+#define SCOPPY_TRIGGER_DISPATCH_OWNER 0
+#define SCOPPY_TRIGGER_DISPATCH_HELPER 1
+
+struct scoppy_trigger_dispatch_chunk {
+    // The number of the chunk since scoppy_trigger_dispatch_start()
+    uint32_t seq;
+    const uint8_t *addr;
+    // The value of the trigger channel in the sample before the chunk
+    uint8_t last_sample_value;
+
+    // seq + 1 if claimed by the owner/helper
+    uint32_t claims[2];
+    // seq + 1 once it has been scanned
+    uint32_t done;
+    // The result of the scan. See scoppy_trigger_scanner.scan.
+    int32_t trigger_sample_idx;
+};
+
+struct scoppy_trigger_dispatch {
+    // Set by scoppy_trigger_dispatch_start() and not changed while the search is active
+    struct scoppy_trigger_scanner scanner;
+    uint32_t num_samples;
+    uint32_t frame;
+    bool active;
+
+    struct scoppy_trigger_dispatch_chunk chunks[SCOPPY_TRIGGER_DISPATCH_SIZE];
+    uint32_t num_published;
+
+    // Only used by the owner
+    struct scoppy_trigger_scanner owner_scanner;
+    // The next chunk whose result is needed. The helper reads it to skip the chunks that are already finished with.
+    uint32_t next_result;
+    // Where to start looking for the next of our chunks to scan ahead of next_result
+    uint32_t next_lookahead;
+    const uint8_t *last_addr;
+
+    // Only written by the helper
+    bool helping;
+    uint32_t helper_frame;
+    uint32_t helper_next;
+
+    // The number of chunks the helper scanned. The owner can read it after scoppy_trigger_dispatch_stop().
+    uint32_t num_helper_chunks_scanned;
+};
+
+void scoppy_trigger_dispatch_init(struct scoppy_trigger_dispatch *dispatch);
+
+// True if chunks scanned with this scanner don't depend on anything from the previous chunk but its last sample
+bool scoppy_trigger_dispatch_supports(const struct scoppy_trigger_scanner *scanner);
+
+//
+// Owner
+//
+
+// Start a new search. The scanner must be supported (see above). The helper must not be in scoppy_trigger_dispatch_help()
+// which is guaranteed if the previous search was stopped with scoppy_trigger_dispatch_stop().
+void scoppy_trigger_dispatch_start(struct scoppy_trigger_dispatch *dispatch, const struct scoppy_trigger_scanner *scanner, uint32_t num_samples);
+
+// The chunks that have been published but whose results haven't been collected
+static inline uint32_t scoppy_trigger_dispatch_num_pending(const struct scoppy_trigger_dispatch *dispatch) {
+    return dispatch->num_published - dispatch->next_result;
+}
+
+static inline bool scoppy_trigger_dispatch_is_full(const struct scoppy_trigger_dispatch *dispatch) {
+    return scoppy_trigger_dispatch_num_pending(dispatch) >= SCOPPY_TRIGGER_DISPATCH_SIZE;
+}
+
+// Add the next chunk. restart is true if it doesn't follow on from the previous chunk (see
+// scoppy_trigger_scanner_restart()). The first chunk always restarts.
+void scoppy_trigger_dispatch_publish(struct scoppy_trigger_dispatch *dispatch, const uint8_t *addr, bool restart);
+
+// Scan (at most) one chunk and collect whatever results are ready. Returns true once the trigger has been found in
+// which case trigger_chunk and trigger_sample_idx are set.
+bool scoppy_trigger_dispatch_work(struct scoppy_trigger_dispatch *dispatch, const uint8_t **trigger_chunk, int32_t *trigger_sample_idx);
+
+// The number of chunks whose results have been collected. The trigger (if found) is in the last one.
+static inline uint32_t scoppy_trigger_dispatch_num_completed(const struct scoppy_trigger_dispatch *dispatch) { return dispatch->next_result; }
+
+// The value of the trigger channel in the sample before the chunk that the trigger was found in (see
+// scoppy_trigger_crossing_fraction()). Only valid after scoppy_trigger_dispatch_work() has returned true.
+static inline uint8_t scoppy_trigger_dispatch_trigger_chunk_last_sample_value(const struct scoppy_trigger_dispatch *dispatch) {
+    return dispatch->chunks[(dispatch->next_result - 1) & (SCOPPY_TRIGGER_DISPATCH_SIZE - 1)].last_sample_value;
+}
+
+// Stop the search and wait for the helper to finish the chunk it's scanning (if any)
+void scoppy_trigger_dispatch_stop(struct scoppy_trigger_dispatch *dispatch);
+
+//
+// Helper
+//
+
+// Scan the odd numbered chunks that have been published and not claimed by the owner. Returns the number scanned.
+// Returns straight away if there isn't an active search.
+uint32_t scoppy_trigger_dispatch_help(struct scoppy_trigger_dispatch *dispatch);
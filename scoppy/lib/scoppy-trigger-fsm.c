@@ -0,0 +1,230 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+//
+#include "scoppy-trigger-fsm.h"
+
+// The state that is carried over from one chunk to the next. The scan functions work on a copy in local variables and
+// save it when they return.
+struct fsm_state {
+    uint8_t last;
+    bool active;
+    bool reached;
+    uint32_t start_idx;
+};
+
+static inline struct fsm_state load_state(const struct scoppy_trigger_fsm *fsm) {
+    struct fsm_state state = {
+        .last = fsm->last_sample_value, .active = fsm->active, .reached = fsm->reached_other_level, .start_idx = fsm->start_idx};
+    return state;
+}
+
+// num_scanned includes the trigger sample (if there is one) so that scanning can carry on from the next sample
+static inline void save_state(struct scoppy_trigger_fsm *fsm, const struct fsm_state *state, uint32_t num_scanned) {
+    fsm->last_sample_value = state->last;
+    fsm->active = state->active;
+    fsm->reached_other_level = state->reached;
+    fsm->start_idx = state->start_idx;
+    fsm->sample_idx += num_scanned;
+}
+
+static inline bool condition_met(const struct scoppy_trigger_fsm *fsm, uint32_t duration) {
+    switch (fsm->condition) {
+    case SCOPPY_TRIGGER_CONDITION_LESS:
+        return duration < fsm->time_max;
+    case SCOPPY_TRIGGER_CONDITION_IN_RANGE:
+        return duration >= fsm->time_min && duration <= fsm->time_max;
+    default:
+        return duration > fsm->time_min;
+    }
+}
+
+static int32_t scan_pulse_width(struct scoppy_trigger_fsm *fsm, const uint8_t *addr, uint32_t num_samples, uint32_t stride) {
+    struct fsm_state s = load_state(fsm);
+    const uint8_t level = fsm->lower_level;
+    const bool negative = fsm->negative;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint8_t value = *addr;
+        if (!s.active) {
+            if (negative ? (s.last > level && value <= level) : (s.last < level && value >= level)) {
+                s.active = true;
+                s.start_idx = fsm->sample_idx + i;
+            }
+        } else if (negative ? value > level : value < level) {
+            s.active = false;
+            fsm->last_duration = fsm->sample_idx + i - s.start_idx;
+            if (condition_met(fsm, fsm->last_duration)) {
+                s.last = value;
+                save_state(fsm, &s, i + 1);
+                return i;
+            }
+        }
+        s.last = value;
+        addr += stride;
+    }
+
+    save_state(fsm, &s, num_samples);
+    return -1;
+}
+
+static int32_t scan_runt(struct scoppy_trigger_fsm *fsm, const uint8_t *addr, uint32_t num_samples, uint32_t stride) {
+    struct fsm_state s = load_state(fsm);
+    const uint8_t lower = fsm->lower_level;
+    const uint8_t upper = fsm->upper_level;
+    const bool negative = fsm->negative;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint8_t value = *addr;
+        if (!s.active) {
+            if (negative ? (s.last > upper && value <= upper) : (s.last < lower && value >= lower)) {
+                s.active = true;
+                s.reached = false;
+                s.start_idx = fsm->sample_idx + i;
+            }
+        }
+
+        if (s.active) {
+            if (negative ? value <= lower : value >= upper) {
+                // a full pulse rather than a runt
+                s.reached = true;
+            } else if (negative ? value > upper : value < lower) {
+                s.active = false;
+                fsm->last_duration = fsm->sample_idx + i - s.start_idx;
+                if (!s.reached && condition_met(fsm, fsm->last_duration)) {
+                    s.last = value;
+                    save_state(fsm, &s, i + 1);
+                    return i;
+                }
+            }
+        }
+        s.last = value;
+        addr += stride;
+    }
+
+    save_state(fsm, &s, num_samples);
+    return -1;
+}
+
+static int32_t scan_window(struct scoppy_trigger_fsm *fsm, const uint8_t *addr, uint32_t num_samples, uint32_t stride) {
+    struct fsm_state s = load_state(fsm);
+    const uint8_t lower = fsm->lower_level;
+    const uint8_t upper = fsm->upper_level;
+    // trigger when inside() changes to this
+    const bool trigger_inside = !fsm->window_exit;
+
+    bool was_inside = s.last >= lower && s.last <= upper;
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint8_t value = *addr;
+        bool inside = value >= lower && value <= upper;
+        if (inside != was_inside && inside == trigger_inside) {
+            s.last = value;
+            save_state(fsm, &s, i + 1);
+            return i;
+        }
+        was_inside = inside;
+        s.last = value;
+        addr += stride;
+    }
+
+    save_state(fsm, &s, num_samples);
+    return -1;
+}
+
+static int32_t scan_slope(struct scoppy_trigger_fsm *fsm, const uint8_t *addr, uint32_t num_samples, uint32_t stride) {
+    struct fsm_state s = load_state(fsm);
+    const bool falling = fsm->negative;
+    // The level that starts the slope and the one that ends it
+    const uint8_t start_level = falling ? fsm->upper_level : fsm->lower_level;
+    const uint8_t end_level = falling ? fsm->lower_level : fsm->upper_level;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint8_t value = *addr;
+        if (!s.active) {
+            if (falling ? (s.last > start_level && value <= start_level) : (s.last < start_level && value >= start_level)) {
+                s.active = true;
+                s.start_idx = fsm->sample_idx + i;
+            }
+        } else if (falling ? value > start_level : value < start_level) {
+            // went back the way it came
+            s.active = false;
+        }
+
+        // A fast edge can cross both levels in one sample
+        if (s.active && (falling ? value <= end_level : value >= end_level)) {
+            s.active = false;
+            fsm->last_duration = fsm->sample_idx + i - s.start_idx;
+            if (condition_met(fsm, fsm->last_duration)) {
+                s.last = value;
+                save_state(fsm, &s, i + 1);
+                return i;
+            }
+        }
+        s.last = value;
+        addr += stride;
+    }
+
+    save_state(fsm, &s, num_samples);
+    return -1;
+}
+
+void scoppy_trigger_fsm_init(struct scoppy_trigger_fsm *fsm, uint8_t trigger_type, uint8_t trigger_level, const struct scoppy_trigger_fsm_params *params) {
+    uint8_t level2 = params != NULL ? params->level2 : trigger_level;
+    uint8_t options = params != NULL ? params->options : 0;
+
+    fsm->trigger_type = trigger_type;
+    if (trigger_type == TRIGGER_TYPE_PULSE_WIDTH) {
+        level2 = trigger_level;
+    }
+    fsm->lower_level = trigger_level < level2 ? trigger_level : level2;
+    fsm->upper_level = trigger_level < level2 ? level2 : trigger_level;
+    fsm->negative = (options & SCOPPY_TRIGGER_OPTION_NEGATIVE) != 0;
+    fsm->window_exit = (options & SCOPPY_TRIGGER_OPTION_WINDOW_EXIT) != 0;
+    fsm->condition = (options & SCOPPY_TRIGGER_OPTION_CONDITION_MASK) >> SCOPPY_TRIGGER_OPTION_CONDITION_SHIFT;
+    fsm->time_min = params != NULL ? params->time_min : 0;
+    fsm->time_max = params != NULL ? params->time_max : 0;
+
+    fsm->last_sample_value = trigger_level;
+    fsm->active = false;
+    fsm->reached_other_level = false;
+    fsm->start_idx = 0;
+    fsm->sample_idx = 0;
+    fsm->last_duration = 0;
+}
+
+int32_t scoppy_trigger_fsm_scan(struct scoppy_trigger_fsm *fsm, const uint8_t *addr, uint32_t num_samples, uint32_t stride) {
+    assert(stride > 0);
+
+    switch (fsm->trigger_type) {
+    case TRIGGER_TYPE_PULSE_WIDTH:
+        return scan_pulse_width(fsm, addr, num_samples, stride);
+    case TRIGGER_TYPE_RUNT:
+        return scan_runt(fsm, addr, num_samples, stride);
+    case TRIGGER_TYPE_WINDOW:
+        return scan_window(fsm, addr, num_samples, stride);
+    case TRIGGER_TYPE_SLOPE:
+        return scan_slope(fsm, addr, num_samples, stride);
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+#include "scoppy.h"
+
+//
+// A streaming state machine for the trigger types that need more than the previous sample (pulse width, runt, window
+// and slope). Chunks are scanned one after the other and the state (eg. when the current pulse started) is carried
+// over from one chunk to the next.
+//
+// Durations are in samples (per channel) and are measured from the sample that starts the pulse/edge to the sample
+// that ends it. The trigger point is the sample that ends it.
+//
+// Pulse width - a positive pulse starts when the signal crosses the level going up and ends when it goes back below
+//   the level. A negative pulse is the other way round. Triggers if the width meets the condition.
+// Runt - a positive runt goes above the lower level and falls back below it without reaching the upper level.
+//   A negative runt goes below the upper level and back above it without reaching the lower level. Triggers if the
+//   width meets the condition.
+// Window - triggers when the signal goes into the window (lower level <= sample <= upper level) or comes out of it
+//   (SCOPPY_TRIGGER_OPTION_WINDOW_EXIT). The condition isn't used.
+// Slope - a rising edge starts when the signal crosses the lower level going up and ends when it crosses the upper
+//   level. It is abandoned if the signal goes back below the lower level first. A falling edge is the other way round.
+//   Triggers if the time between the levels meets the condition.
+//
+
+// Bits of the trigger options sent by the app
+// A negative pulse or runt or a falling slope
+#define SCOPPY_TRIGGER_OPTION_NEGATIVE 0x01
+#define SCOPPY_TRIGGER_OPTION_WINDOW_EXIT 0x02
+// Bits 2-3 are the condition
+#define SCOPPY_TRIGGER_OPTION_CONDITION_SHIFT 2
+#define SCOPPY_TRIGGER_OPTION_CONDITION_MASK 0x0C
+
+// duration > time_min
+#define SCOPPY_TRIGGER_CONDITION_GREATER 0
+// duration < time_max
+#define SCOPPY_TRIGGER_CONDITION_LESS 1
+// time_min <= duration <= time_max
+#define SCOPPY_TRIGGER_CONDITION_IN_RANGE 2
+#define SCOPPY_TRIGGER_CONDITION_LAST 2
+
+// The settings for the state machine in addition to the trigger type and level
+struct scoppy_trigger_fsm_params {
+    // The other level for runt, window and slope triggers. It doesn't matter which of the 2 levels is higher.
+    uint8_t level2;
+    uint8_t options;
+    uint32_t time_min;
+    uint32_t time_max;
+};
+
+struct scoppy_trigger_fsm {
+    uint8_t trigger_type;
+    // For pulse width triggers both are the trigger level
+    uint8_t lower_level;
+    uint8_t upper_level;
+    bool negative;
+    bool window_exit;
+    uint8_t condition;
+    uint32_t time_min;
+    uint32_t time_max;
+
+    // The value of the previous sample. Like scoppy_trigger_scanner.last_sample_value it should be set to the value of
+    // the first sample before scanning the first chunk.
+    uint8_t last_sample_value;
+
+    // True while in a pulse (or between the levels of a slope)
+    bool active;
+    // True if a pulse reached the upper (positive) or lower (negative) level. For runt triggers.
+    bool reached_other_level;
+    // The index of the sample that started the current pulse/slope
+    uint32_t start_idx;
+    // The index of the next sample to be scanned (counting from the start of the first chunk)
+    uint32_t sample_idx;
+    // The duration of the last pulse/slope that ended (whether or not it met the condition). For debugging and tests.
+    uint32_t last_duration;
+};
+
+static inline bool scoppy_trigger_fsm_is_fsm_type(uint8_t trigger_type) {
+    return trigger_type >= TRIGGER_TYPE_PULSE_WIDTH && trigger_type <= TRIGGER_TYPE_SLOPE;
+}
+
+// params can be NULL in which case level2 is the same as trigger_level and the condition is duration > 0
+void scoppy_trigger_fsm_init(struct scoppy_trigger_fsm *fsm, uint8_t trigger_type, uint8_t trigger_level, const struct scoppy_trigger_fsm_params *params);
+
+// Scan num_samples samples starting at addr. stride is the number of bytes between samples. Returns the index of the
+// trigger sample or -1 if there isn't one. After a trigger the state is as if the trigger sample was the last one
+// scanned so scanning can carry on from the next sample.
+int32_t scoppy_trigger_fsm_scan(struct scoppy_trigger_fsm *fsm, const uint8_t *addr, uint32_t num_samples, uint32_t stride);
@@ -0,0 +1,448 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+//
+#include "scoppy-trigger.h"
+#include "scoppy.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the word at a time kernels assume a little endian cpu"
+#endif
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+//
+// Generic kernel. Handles any trigger type, sample size and channel index.
+//
+static int32_t scan_generic(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples) {
+    const uint8_t *addr = chunk + scanner->trigger_channel_idx;
+    uint8_t trigger_level = scanner->trigger_level;
+    uint8_t last_sample_value = scanner->last_sample_value;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint8_t current_sample_value = *addr;
+
+        bool triggered = false;
+        if (scanner->trigger_type == TRIGGER_TYPE_RISING_EDGE) {
+            if (last_sample_value < trigger_level && current_sample_value >= trigger_level) {
+                triggered = true;
+            }
+        } else if (scanner->trigger_type == TRIGGER_TYPE_FALLING_EDGE) {
+            if (last_sample_value > trigger_level && current_sample_value <= trigger_level) {
+                triggered = true;
+            }
+        }
+
+        if (triggered) {
+            return i;
+        }
+
+        last_sample_value = current_sample_value;
+        addr += scanner->num_bytes_per_sample;
+    }
+
+    scanner->last_sample_value = last_sample_value;
+    return -1;
+}
+
+// The state machine kernel. The state machine has its own copy of the previous sample value.
+static int32_t scan_fsm(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples) {
+    scanner->fsm.last_sample_value = scanner->last_sample_value;
+    int32_t trigger_sample_idx = scoppy_trigger_fsm_scan(&scanner->fsm, chunk + scanner->trigger_channel_idx, num_samples, scanner->num_bytes_per_sample);
+    if (trigger_sample_idx < 0) {
+        scanner->last_sample_value = scanner->fsm.last_sample_value;
+    }
+    return trigger_sample_idx;
+}
+
+// For a rising edge a sample arms the trigger if it is < arm_level and fires it if it is >= level. For a falling edge it
+// arms the trigger if it is > arm_level and fires it if it is <= level. arm_level is never on the other side of level so
+// a sample can't do both.
+static ALWAYS_INLINE bool sample_arms(uint8_t value, bool rising, uint8_t arm_level) {
+    return rising ? value < arm_level : value > arm_level;
+}
+
+static ALWAYS_INLINE bool sample_fires(uint8_t value, bool rising, uint8_t level) {
+    return rising ? value >= level : value <= level;
+}
+
+static int32_t scan_generic_hysteresis(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples) {
+    bool rising = scanner->trigger_type == TRIGGER_TYPE_RISING_EDGE;
+    if (!rising && scanner->trigger_type != TRIGGER_TYPE_FALLING_EDGE) {
+        return -1;
+    }
+
+    const uint8_t *addr = chunk + scanner->trigger_channel_idx;
+    uint8_t trigger_level = scanner->trigger_level;
+    uint8_t arm_level = scanner->arm_level;
+    bool armed = scanner->armed || sample_arms(scanner->last_sample_value, rising, arm_level);
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint8_t current_sample_value = *addr;
+
+        if (armed && sample_fires(current_sample_value, rising, trigger_level)) {
+            scanner->armed = false;
+            return i;
+        }
+
+        armed = armed || sample_arms(current_sample_value, rising, arm_level);
+        addr += scanner->num_bytes_per_sample;
+    }
+
+    if (num_samples > 0) {
+        scanner->last_sample_value = *(addr - scanner->num_bytes_per_sample);
+    }
+    scanner->armed = armed;
+    return -1;
+}
+
+//
+// Word at a time kernels
+//
+// Each sample is turned into a 1 bit 'state'. For a rising edge the state is (sample >= level) and we look for a
+// 0 -> 1 transition. For a falling edge the state is (sample > level) ie. (sample >= level + 1) and we look for a
+// 1 -> 0 transition.
+//
+// 4 bytes are loaded at once and the state of each byte is calculated in parallel (SWAR). With 2 bytes per sample
+// only every second byte belongs to the trigger channel so the other bytes are masked out.
+//
+
+#define BYTES_HIGH_BITS 0x80808080u
+
+// Set bit 0 of each byte in the result if the corresponding byte of x is >= the corresponding byte of y (unsigned)
+static ALWAYS_INLINE uint32_t bytes_ge(uint32_t x, uint32_t y) {
+    // high bit of each byte is set if the low 7 bits of x >= low 7 bits of y (no borrows between bytes)
+    uint32_t t = ((x | BYTES_HIGH_BITS) - (y & ~BYTES_HIGH_BITS)) & BYTES_HIGH_BITS;
+    // now take the high bits into account
+    uint32_t ge = ((x & ~y) | (~(x ^ y) & t)) & BYTES_HIGH_BITS;
+    return ge >> 7;
+}
+
+static ALWAYS_INLINE uint32_t load_word(const uint8_t *addr) {
+    uint32_t word;
+    // addr is always word aligned here so this will be a single load
+    memcpy(&word, __builtin_assume_aligned(addr, 4), sizeof(word));
+    return word;
+}
+
+static ALWAYS_INLINE int32_t scan_words(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples, const bool rising,
+                                        const uint32_t bytes_per_sample, const uint32_t channel_idx) {
+    if (num_samples == 0) {
+        return -1;
+    }
+
+    uint8_t threshold;
+    if (rising) {
+        threshold = scanner->trigger_level;
+    } else {
+        if (scanner->trigger_level == 255) {
+            // a sample can't be > 255 so we will never trigger
+            scanner->last_sample_value = chunk[(num_samples - 1) * bytes_per_sample + channel_idx];
+            return -1;
+        }
+        threshold = scanner->trigger_level + 1;
+    }
+
+    const uint32_t samples_per_word = 4 / bytes_per_sample;
+    // bit 0 of the trigger channel bytes
+    const uint32_t lane_mask = bytes_per_sample == 1 ? 0x01010101u : (channel_idx == 0 ? 0x00010001u : 0x01000100u);
+    // the bit (in the word) of the trigger channel byte of the first and last samples
+    const uint32_t first_lane_bit = channel_idx * 8;
+    const uint32_t last_lane_bit = (4 - bytes_per_sample + channel_idx) * 8;
+
+    const uint32_t threshold_word = threshold * 0x01010101u;
+    uint32_t prev_state = scanner->last_sample_value >= threshold;
+    const uint8_t *addr = chunk;
+    uint32_t i = 0;
+
+    // byte at a time until we are word aligned
+    while (i < num_samples && ((uintptr_t)addr & 3) != 0) {
+        uint32_t state = addr[channel_idx] >= threshold;
+        if (rising ? (state & ~prev_state) : (prev_state & ~state)) {
+            return i;
+        }
+        prev_state = state;
+        addr += bytes_per_sample;
+        i++;
+    }
+
+    for (; i + samples_per_word <= num_samples; i += samples_per_word) {
+        uint32_t state = bytes_ge(load_word(addr), threshold_word) & lane_mask;
+        // the state of the previous sample for each sample in the word
+        uint32_t prev = ((state << (8 * bytes_per_sample)) | (prev_state << first_lane_bit)) & lane_mask;
+        uint32_t edges = rising ? (state & ~prev) : (prev & ~state);
+        if (edges != 0) {
+            return i + (__builtin_ctz(edges) / 8) / bytes_per_sample;
+        }
+        prev_state = (state >> last_lane_bit) & 1;
+        addr += 4;
+    }
+
+    // whatever is left over
+    for (; i < num_samples; i++) {
+        uint32_t state = addr[channel_idx] >= threshold;
+        if (rising ? (state & ~prev_state) : (prev_state & ~state)) {
+            return i;
+        }
+        prev_state = state;
+        addr += bytes_per_sample;
+    }
+
+    // the last sample we looked at
+    scanner->last_sample_value = *(addr - bytes_per_sample + channel_idx);
+    return -1;
+}
+
+// With hysteresis each word gives a mask of the samples that arm the trigger and a mask of the samples that fire it.
+// Once armed only the fire mask is needed so a signal that is waiting to cross the level costs the same as without
+// hysteresis.
+static ALWAYS_INLINE int32_t scan_words_hysteresis(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples,
+                                                   const bool rising, const uint32_t bytes_per_sample, const uint32_t channel_idx) {
+    if (num_samples == 0) {
+        return -1;
+    }
+
+    uint8_t level = scanner->trigger_level;
+    uint8_t arm_level = scanner->arm_level;
+    bool armed = scanner->armed || sample_arms(scanner->last_sample_value, rising, arm_level);
+
+    if (!rising && arm_level == 255) {
+        // a sample can't be > 255 so we will never arm
+        scanner->last_sample_value = chunk[(num_samples - 1) * bytes_per_sample + channel_idx];
+        return -1;
+    }
+
+    const uint32_t samples_per_word = 4 / bytes_per_sample;
+    const uint32_t lane_mask = bytes_per_sample == 1 ? 0x01010101u : (channel_idx == 0 ? 0x00010001u : 0x01000100u);
+
+    // the masks are built from sample >= threshold
+    const uint32_t arm_word = (rising ? arm_level : arm_level + 1u) * 0x01010101u;
+    // level can only be 255 for a falling edge if arm_level is too
+    const uint32_t fire_word = (rising ? level : level + 1u) * 0x01010101u;
+
+    const uint8_t *addr = chunk;
+    uint32_t i = 0;
+
+    while (i < num_samples && ((uintptr_t)addr & 3) != 0) {
+        uint8_t value = addr[channel_idx];
+        if (armed && sample_fires(value, rising, level)) {
+            scanner->armed = false;
+            return i;
+        }
+        armed = armed || sample_arms(value, rising, arm_level);
+        addr += bytes_per_sample;
+        i++;
+    }
+
+    for (; i + samples_per_word <= num_samples; i += samples_per_word) {
+        uint32_t word = load_word(addr);
+        uint32_t fires;
+        if (armed) {
+            fires = (rising ? bytes_ge(word, fire_word) : ~bytes_ge(word, fire_word)) & lane_mask;
+        } else {
+            uint32_t arms = (rising ? ~bytes_ge(word, arm_word) : bytes_ge(word, arm_word)) & lane_mask;
+            if (arms == 0) {
+                addr += 4;
+                continue;
+            }
+            // only the samples after the first one that arms the trigger can fire it
+            fires = (rising ? bytes_ge(word, fire_word) : ~bytes_ge(word, fire_word)) & lane_mask & (~0u << __builtin_ctz(arms));
+            armed = true;
+        }
+        if (fires != 0) {
+            scanner->armed = false;
+            return i + (__builtin_ctz(fires) / 8) / bytes_per_sample;
+        }
+        addr += 4;
+    }
+
+    for (; i < num_samples; i++) {
+        uint8_t value = addr[channel_idx];
+        if (armed && sample_fires(value, rising, level)) {
+            scanner->armed = false;
+            return i;
+        }
+        armed = armed || sample_arms(value, rising, arm_level);
+        addr += bytes_per_sample;
+    }
+
+    scanner->last_sample_value = *(addr - bytes_per_sample + channel_idx);
+    scanner->armed = armed;
+    return -1;
+}
+
+#define SCOPPY_TRIGGER_KERNEL(name, rising, bytes_per_sample, channel_idx)                                               \
+    static int32_t name(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples) {         \
+        return scan_words(scanner, chunk, num_samples, rising, bytes_per_sample, channel_idx);                       \
+    }
+
+#define SCOPPY_TRIGGER_HYSTERESIS_KERNEL(name, rising, bytes_per_sample, channel_idx)                                    \
+    static int32_t name(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples) {         \
+        return scan_words_hysteresis(scanner, chunk, num_samples, rising, bytes_per_sample, channel_idx);            \
+    }
+
+SCOPPY_TRIGGER_KERNEL(scan_rising_1ch, true, 1, 0)
+SCOPPY_TRIGGER_KERNEL(scan_falling_1ch, false, 1, 0)
+SCOPPY_TRIGGER_KERNEL(scan_rising_2ch_idx0, true, 2, 0)
+SCOPPY_TRIGGER_KERNEL(scan_falling_2ch_idx0, false, 2, 0)
+SCOPPY_TRIGGER_KERNEL(scan_rising_2ch_idx1, true, 2, 1)
+SCOPPY_TRIGGER_KERNEL(scan_falling_2ch_idx1, false, 2, 1)
+
+SCOPPY_TRIGGER_HYSTERESIS_KERNEL(scan_rising_1ch_hyst, true, 1, 0)
+SCOPPY_TRIGGER_HYSTERESIS_KERNEL(scan_falling_1ch_hyst, false, 1, 0)
+SCOPPY_TRIGGER_HYSTERESIS_KERNEL(scan_rising_2ch_idx0_hyst, true, 2, 0)
+SCOPPY_TRIGGER_HYSTERESIS_KERNEL(scan_falling_2ch_idx0_hyst, false, 2, 0)
+SCOPPY_TRIGGER_HYSTERESIS_KERNEL(scan_rising_2ch_idx1_hyst, true, 2, 1)
+SCOPPY_TRIGGER_HYSTERESIS_KERNEL(scan_falling_2ch_idx1_hyst, false, 2, 1)
+
+static void init_fields(struct scoppy_trigger_scanner *scanner, uint8_t trigger_type, uint8_t trigger_level, uint8_t num_bytes_per_sample,
+                        uint8_t trigger_channel_idx) {
+    assert(num_bytes_per_sample > 0);
+    assert(trigger_channel_idx < num_bytes_per_sample);
+
+    scanner->trigger_type = trigger_type;
+    scanner->trigger_level = trigger_level;
+    scanner->num_bytes_per_sample = num_bytes_per_sample;
+    scanner->trigger_channel_idx = trigger_channel_idx;
+    scanner->last_sample_value = trigger_level;
+    scanner->trigger_hysteresis = 0;
+    scanner->arm_level = trigger_level;
+    scanner->armed = false;
+}
+
+void scoppy_trigger_scanner_init_generic(struct scoppy_trigger_scanner *scanner, uint8_t trigger_type, uint8_t trigger_level,
+                                         uint8_t num_bytes_per_sample, uint8_t trigger_channel_idx) {
+    init_fields(scanner, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx);
+    scoppy_trigger_fsm_init(&scanner->fsm, trigger_type, trigger_level, NULL);
+    if (scoppy_trigger_fsm_is_fsm_type(trigger_type)) {
+        // there is only one kernel for these
+        scanner->kernel_name = "fsm";
+        scanner->scan = scan_fsm;
+    } else {
+        scanner->kernel_name = "generic";
+        scanner->scan = scan_generic;
+    }
+}
+
+void scoppy_trigger_scanner_set_fsm_params(struct scoppy_trigger_scanner *scanner, const struct scoppy_trigger_fsm_params *params) {
+    scoppy_trigger_fsm_init(&scanner->fsm, scanner->trigger_type, scanner->trigger_level, params);
+}
+
+void scoppy_trigger_scanner_restart(struct scoppy_trigger_scanner *scanner, uint8_t first_sample_value) {
+    scanner->last_sample_value = first_sample_value;
+    scanner->armed = false;
+    scanner->fsm.active = false;
+    scanner->fsm.reached_other_level = false;
+}
+
+// Select the specialised kernel for the trigger type, sample size and hysteresis (if there is one)
+static void select_kernel(struct scoppy_trigger_scanner *scanner) {
+    bool rising = scanner->trigger_type == TRIGGER_TYPE_RISING_EDGE;
+    if (!rising && scanner->trigger_type != TRIGGER_TYPE_FALLING_EDGE) {
+        return;
+    }
+
+    bool hyst = scanner->trigger_hysteresis > 0;
+    if (scanner->num_bytes_per_sample == 1) {
+        if (hyst) {
+            scanner->kernel_name = rising ? "rising_1ch_hyst" : "falling_1ch_hyst";
+            scanner->scan = rising ? scan_rising_1ch_hyst : scan_falling_1ch_hyst;
+        } else {
+            scanner->kernel_name = rising ? "rising_1ch" : "falling_1ch";
+            scanner->scan = rising ? scan_rising_1ch : scan_falling_1ch;
+        }
+    } else if (scanner->num_bytes_per_sample == 2 && scanner->trigger_channel_idx == 0) {
+        if (hyst) {
+            scanner->kernel_name = rising ? "rising_2ch_idx0_hyst" : "falling_2ch_idx0_hyst";
+            scanner->scan = rising ? scan_rising_2ch_idx0_hyst : scan_falling_2ch_idx0_hyst;
+        } else {
+            scanner->kernel_name = rising ? "rising_2ch_idx0" : "falling_2ch_idx0";
+            scanner->scan = rising ? scan_rising_2ch_idx0 : scan_falling_2ch_idx0;
+        }
+    } else if (scanner->num_bytes_per_sample == 2 && scanner->trigger_channel_idx == 1) {
+        if (hyst) {
+            scanner->kernel_name = rising ? "rising_2ch_idx1_hyst" : "falling_2ch_idx1_hyst";
+            scanner->scan = rising ? scan_rising_2ch_idx1_hyst : scan_falling_2ch_idx1_hyst;
+        } else {
+            scanner->kernel_name = rising ? "rising_2ch_idx1" : "falling_2ch_idx1";
+            scanner->scan = rising ? scan_rising_2ch_idx1 : scan_falling_2ch_idx1;
+        }
+    }
+}
+
+void scoppy_trigger_scanner_init(struct scoppy_trigger_scanner *scanner, uint8_t trigger_type, uint8_t trigger_level, uint8_t num_bytes_per_sample,
+                                 uint8_t trigger_channel_idx) {
+    scoppy_trigger_scanner_init_generic(scanner, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx);
+    select_kernel(scanner);
+}
+
+void scoppy_trigger_scanner_set_hysteresis(struct scoppy_trigger_scanner *scanner, uint8_t hysteresis) {
+    uint8_t level = scanner->trigger_level;
+    scanner->trigger_hysteresis = hysteresis;
+    scanner->armed = false;
+
+    // Keep the arm level inside 0-255. If the band doesn't fit the trigger arms at the lowest (highest) value that
+    // can still cross the level.
+    if (scanner->trigger_type == TRIGGER_TYPE_FALLING_EDGE) {
+        scanner->arm_level = level == 255 ? 255 : (hysteresis >= 255 - level ? 254 : level + hysteresis);
+    } else {
+        scanner->arm_level = level == 0 ? 0 : (hysteresis >= level ? 1 : level - hysteresis);
+    }
+
+    bool generic = scanner->scan == scan_generic || scanner->scan == scan_generic_hysteresis;
+    if (generic) {
+        scanner->scan = hysteresis > 0 ? scan_generic_hysteresis : scan_generic;
+        scanner->kernel_name = hysteresis > 0 ? "generic_hyst" : "generic";
+    } else {
+        select_kernel(scanner);
+    }
+}
+
+uint16_t scoppy_trigger_crossing_fraction(const struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, int32_t trigger_sample_idx,
+                                          uint8_t last_sample_value) {
+    assert(trigger_sample_idx >= 0);
+    const uint8_t *addr = chunk + trigger_sample_idx * scanner->num_bytes_per_sample + scanner->trigger_channel_idx;
+    uint32_t current = *addr;
+    uint32_t last = trigger_sample_idx > 0 ? *(addr - scanner->num_bytes_per_sample) : last_sample_value;
+    uint32_t level = scanner->trigger_level;
+
+    // How far past the level the trigger sample is and how big the step from the last sample was
+    uint32_t past, step;
+    if (scanner->trigger_type == TRIGGER_TYPE_RISING_EDGE && last < level && current >= level) {
+        past = current - level;
+        step = current - last;
+    } else if (scanner->trigger_type == TRIGGER_TYPE_FALLING_EDGE && last > level && current <= level) {
+        past = level - current;
+        step = last - current;
+    } else {
+        return 0;
+    }
+
+    // past < step so this is always < 65536
+    return (uint16_t)(((past << 16) + step / 2) / step);
+}
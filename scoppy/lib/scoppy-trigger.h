@@ -0,0 +1,102 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+#include "scoppy-chunked-ring-buffer.h"
+#include "scoppy-trigger-fsm.h"
+
+//
+// Software trigger detection. A scanner is set up once per frame and then used to scan each chunk of samples
+// as it becomes available.
+//
+// For the common cases (rising/falling edge with 1 or 2 bytes per sample) the scanner uses a kernel that is
+// specialised at compile time and tests 4 bytes at a time. Everything else uses a generic (byte at a time) kernel.
+//
+// With hysteresis the scanner only arms once the signal has been below level - hysteresis (rising edge) or above
+// level + hysteresis (falling edge) and then triggers on the next crossing of the level. Noise that is smaller than
+// the hysteresis can't trigger it.
+//
+// Pulse width, runt, window and slope triggers use the state machine in scoppy-trigger-fsm.h. Hysteresis isn't used
+// for them.
+//
+
+struct scoppy_trigger_scanner {
+    uint8_t trigger_type;
+    uint8_t trigger_level;
+    uint8_t num_bytes_per_sample;
+
+    // The index of the trigger channel byte within a (possibly multichannel) sample
+    uint8_t trigger_channel_idx;
+
+    // The value of the previous sample. This is carried over from one chunk to the next. It should be set to the
+    // value of the first sample before scanning the first chunk.
+    uint8_t last_sample_value;
+
+    // For the trigger types that need a state machine. See scoppy_trigger_scanner_set_fsm_params().
+    struct scoppy_trigger_fsm fsm;
+
+    // 0 for none. See scoppy_trigger_scanner_set_hysteresis().
+    uint8_t trigger_hysteresis;
+    // The level the signal has to go below (rising edge) or above (falling edge) to arm the trigger
+    uint8_t arm_level;
+    // Only used with hysteresis. Carried over from one chunk to the next.
+    bool armed;
+
+    // The name of the selected kernel (for debugging and benchmarks)
+    const char *kernel_name;
+
+    // Scan num_samples samples from the start of a chunk. Returns the index of the trigger sample (not byte) or -1 if
+    // there isn't one.
+    int32_t (*scan)(struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, uint32_t num_samples);
+};
+
+void scoppy_trigger_scanner_init(struct scoppy_trigger_scanner *scanner, uint8_t trigger_type, uint8_t trigger_level, uint8_t num_bytes_per_sample,
+                                 uint8_t trigger_channel_idx);
+
+// Same as scoppy_trigger_scanner_init() but always uses the generic kernel. For testing.
+void scoppy_trigger_scanner_init_generic(struct scoppy_trigger_scanner *scanner, uint8_t trigger_type, uint8_t trigger_level,
+                                         uint8_t num_bytes_per_sample, uint8_t trigger_channel_idx);
+
+// Use a hysteresis band (in adc units) to ignore noise around the trigger level. Keeps the kind of kernel (specialised
+// or generic) that the scanner was initialised with. Call it before scanning the first chunk.
+void scoppy_trigger_scanner_set_hysteresis(struct scoppy_trigger_scanner *scanner, uint8_t hysteresis);
+
+// Set the extra settings for pulse width, runt, window and slope triggers. Without them the other level is the same as
+// the trigger level and the condition is duration > 0. Call it before scanning the first chunk.
+void scoppy_trigger_scanner_set_fsm_params(struct scoppy_trigger_scanner *scanner, const struct scoppy_trigger_fsm_params *params);
+
+// Start scanning again from a chunk that doesn't follow on from the last one scanned (eg. the first chunk of a frame or
+// the first chunk after some were skipped). first_sample_value is the value of the first sample in the chunk. Forgets
+// everything carried over from the previous chunk (the last sample, hysteresis arming and any pulse in progress) so a
+// gap between chunks can't look like an edge.
+void scoppy_trigger_scanner_restart(struct scoppy_trigger_scanner *scanner, uint8_t first_sample_value);
+
+// Where the trigger channel crossed the trigger level, found by linear interpolation between the trigger sample and the
+// one before it. The result is how far before the trigger sample the crossing was, in 1/65536ths of a sample period
+// (so 0 means exactly on the trigger sample). last_sample_value is the trigger channel in the sample before the chunk
+// (the scanner's last_sample_value is still that straight after the scan that found the trigger). 0 for triggers
+// other than rising/falling edges.
+uint16_t scoppy_trigger_crossing_fraction(const struct scoppy_trigger_scanner *scanner, const uint8_t *chunk, int32_t trigger_sample_idx,
+                                          uint8_t last_sample_value);
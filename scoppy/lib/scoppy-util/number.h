@@ -31,6 +31,7 @@ int16_t scoppy_int16_from_2_network_bytes(const void *buf);
 uint16_t scoppy_uint16_from_2_network_bytes(const void *buf);
 uint8_t scoppy_uint8_from_1_network_byte(const void *buf);
 
+void scoppy_uint64_to_8_network_bytes(void *buf, uint64_t value);
 void scoppy_uint32_to_4_network_bytes(void *buf, uint32_t value);
 void scoppy_int32_to_4_network_bytes(void *buf, int32_t value);
 void scoppy_uint16_to_2_network_bytes(void *buf, uint16_t value);
\ No newline at end of file
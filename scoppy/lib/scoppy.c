@@ -47,10 +47,10 @@ static enum scoppy_state unsynced_state_handler(struct scoppy_context *ctx) {
     for (;;) {
         ctx->set_status_led(true);
 
-        // always create a 'new' message in case the buffer of the old was reused (there is only one instance of the msg object)
         CTX_DEBUG_PRINT(ctx, "Sending sync message\n");
         struct scoppy_outgoing *outgoing = scoppy_new_outgoing_sync_msg(ctx);
         scoppy_write_outgoing(ctx->write_serial, outgoing);
+        scoppy_release_outgoing(outgoing);
         // todo check for errors
 
         // Give the host time to get back to us and then try multiple times to get the response
@@ -113,7 +113,15 @@ static void init_scoppy() {
     scoppy.app.timebasePs = 1000000000; // 100 ms
     scoppy.app.preTriggerSamples = 50; // ie. 50%
     scoppy.app.is_logic_mode = false;
+    scoppy.app.samples_msg_version = 1;
+    scoppy.app.logic_edges = false;
+    scoppy.app.num_segments = 0;
     scoppy.app.resync_required = false;
+    scoppy.app.config_batch_open = false;
+    scoppy.app.config_batch_num_msgs = 0;
+    scoppy.app.config_batch_begin_us = 0;
+    scoppy.app.telemetry_requested = false;
+    scoppy.app.telemetry_reset = false;
 }
 
 int scoppy_get_num_enabled_channels() {
@@ -133,7 +141,8 @@ void scoppy_main(struct scoppy_context *ctx) {
 
     init_scoppy();
 
-    struct scoppy_incoming incoming;
+    // Static because it includes the staging buffer (too big for the core0 stack)
+    static struct scoppy_incoming incoming;
     scoppy_init_incoming(&incoming); // once off initialisation
     scoppy_prepare_incoming(&incoming);
     ctx->incoming = &incoming;
@@ -34,6 +34,11 @@
 #define RUN_MODE_RUN 0
 #define RUN_MODE_STOP 1
 #define RUN_MODE_SINGLE 2
+// Send samples continuously at the full sample rate. See scoppy-stream.h
+#define RUN_MODE_STREAM 3
+
+// The most frames that a segmented capture can hold. See scoppy_app.num_segments
+#define SCOPPY_MAX_SEGMENTS 16
 
 #define TRIGGER_MODE_NONE 0
 #define TRIGGER_MODE_AUTO 1
@@ -42,7 +47,12 @@
 
 #define TRIGGER_TYPE_RISING_EDGE 0
 #define TRIGGER_TYPE_FALLING_EDGE 1
-#define TRIGGER_TYPE_LAST 1
+// Oscilloscope mode only. See scoppy-trigger-fsm.h
+#define TRIGGER_TYPE_PULSE_WIDTH 2
+#define TRIGGER_TYPE_RUNT 3
+#define TRIGGER_TYPE_WINDOW 4
+#define TRIGGER_TYPE_SLOPE 5
+#define TRIGGER_TYPE_LAST 5
 
 extern const uint8_t scoppy_start_of_message_byte;
 extern const uint8_t scoppy_end_of_message_byte;
@@ -58,6 +68,16 @@ struct scoppy_app {
 
     uint8_t run_mode;
 
+    // The newest version of the samples message that the app can read (1 for older apps)
+    uint8_t samples_msg_version;
+
+    // In logic mode, stream the changes in the pin states rather than every sample
+    bool logic_edges;
+
+    // Capture this many trigger aligned frames back to back and then send them all together. Catches bursts of events
+    // that are too close together for a frame to be sent in between. 0 or 1 for normal captures.
+    uint8_t num_segments;
+
     // The timeperiod for the screen in picoseconds
     uint64_t timebasePs;
 
@@ -78,14 +98,41 @@ struct scoppy_app {
     // bits for channels not set in trigger_channels should be ignored
     uint8_t trigger_level;
 
+    // Only in oscilloscope mode. The trigger arms when the signal goes this far below (rising edge) or above (falling
+    // edge) trigger_level. 0 for none.
+    uint8_t trigger_hysteresis;
+
+    // Only for pulse width, runt, window and slope triggers. See scoppy-trigger-fsm.h
+    uint8_t trigger_level2;
+    uint8_t trigger_options;
+    uint32_t trigger_time_min;
+    uint32_t trigger_time_max;
+
     // true if the app settings have changed.
     bool dirty;
 
     // true if a resync is required
     // usually only if the app mode has changed
     bool resync_required;
+
+    // true between CONFIG_BEGIN and CONFIG_COMMIT messages. Changes aren't applied until the batch is committed so that
+    // a burst of changes (eg. when scrolling the timebase) causes a single restart.
+    bool config_batch_open;
+    // The number of messages received since CONFIG_BEGIN. If the app doesn't send CONFIG_COMMIT the batch is closed
+    // after SCOPPY_MAX_CONFIG_BATCH_MSGS messages or SCOPPY_CONFIG_BATCH_TIMEOUT_US after it began (see
+    // scoppy_expire_config_batch()), whichever is first.
+    uint8_t config_batch_num_msgs;
+    uint64_t config_batch_begin_us;
+
+    // The app wants a TELEMETRY message (and maybe for the counts to be reset after it's sent). Cleared once it has
+    // been sent.
+    bool telemetry_requested;
+    bool telemetry_reset;
 };
 
+#define SCOPPY_MAX_CONFIG_BATCH_MSGS 32
+#define SCOPPY_CONFIG_BATCH_TIMEOUT_US 250000
+
 #define MAX_CHANNELS 8
 
 // The current settings for the scope
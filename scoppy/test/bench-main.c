@@ -0,0 +1,64 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//
+// Benchmarks for the host. These are not tests - they just print timings.
+//
+// cmake -DCMAKE_BUILD_TYPE=Release ..
+//
+// scoppy-libs-bench [results.csv]
+// The results are also written to the file as CSV (see scoppy_bench_report()). Use - for stdout.
+//
+
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-outgoing.h"
+
+FILE *scoppy_bench_results = NULL;
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        scoppy_bench_results = strcmp(argv[1], "-") == 0 ? stdout : fopen(argv[1], "w");
+        if (scoppy_bench_results == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+        fprintf(scoppy_bench_results, "suite,name,ns_per_op,mb_per_sec\n");
+    }
+
+    scoppy_init_outgoing();
+
+    run_scoppy_outgoing_bench();
+    run_scoppy_chunked_ring_buffer_bench();
+    run_scoppy_trigger_bench();
+    run_scoppy_delta_codec_bench();
+    run_scoppy_rle_bench();
+    run_scoppy_ring_buffer_bench();
+    run_scoppy_incoming_bench();
+    run_scoppy_number_bench();
+
+    if (scoppy_bench_results != NULL && scoppy_bench_results != stdout) {
+        fclose(scoppy_bench_results);
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "delta-decoder.h"
+#include "scoppy-delta-codec.h"
+#include "scoppy.h"
+
+// The next nibble (high nibble first) or -1 if there are no more
+static int next_nibble(const uint8_t *src, uint32_t src_len, uint32_t *nibble_idx) {
+    uint32_t byte_idx = *nibble_idx / 2;
+    if (byte_idx >= src_len) {
+        return -1;
+    }
+    int nibble = (*nibble_idx & 1) ? (src[byte_idx] & 0x0F) : (src[byte_idx] >> 4);
+    (*nibble_idx)++;
+    return nibble;
+}
+
+int delta_decode(const uint8_t *src, uint32_t src_len, uint8_t num_channels, uint8_t *dest, uint32_t num_samples) {
+    uint8_t prev[MAX_CHANNELS];
+    for (int i = 0; i < num_channels; i++) {
+        prev[i] = SCOPPY_DELTA_INITIAL_VALUE;
+    }
+
+    uint32_t nibble_idx = 0;
+    // the number of zero differences left in the current run
+    int run = 0;
+    for (uint32_t i = 0; i < num_samples; i++) {
+        int zz;
+        if (run > 0) {
+            run--;
+            zz = 0;
+        } else {
+            zz = next_nibble(src, src_len, &nibble_idx);
+        }
+
+        if (zz == SCOPPY_DELTA_RUN) {
+            int len = next_nibble(src, src_len, &nibble_idx);
+            if (len < 0) {
+                return -1;
+            }
+            run = len + SCOPPY_DELTA_MIN_RUN - 1;
+            zz = 0;
+        } else if (zz == SCOPPY_DELTA_ESCAPE) {
+            int hi = next_nibble(src, src_len, &nibble_idx);
+            int lo = next_nibble(src, src_len, &nibble_idx);
+            if (hi < 0 || lo < 0) {
+                return -1;
+            }
+            zz = (hi << 4) | lo;
+        }
+        if (zz < 0) {
+            return -1;
+        }
+
+        // undo the zig-zag
+        int delta = (zz & 1) ? -((zz + 1) / 2) : zz / 2;
+        uint8_t ch = i % num_channels;
+        prev[ch] = (uint8_t)(prev[ch] + delta);
+        dest[i] = prev[ch];
+    }
+
+    if (run > 0) {
+        // the run goes past the end of the samples
+        return -1;
+    }
+
+    return (int)((nibble_idx + 1) / 2);
+}
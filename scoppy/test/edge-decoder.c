@@ -0,0 +1,56 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+//
+#include "edge-decoder.h"
+
+int edge_decode(const uint8_t *records, uint32_t len, uint8_t initial_state, uint8_t *dest, uint32_t num_samples) {
+    uint8_t state = initial_state;
+    uint32_t idx = 0;
+    uint32_t i = 0;
+    while (i < len) {
+        uint32_t delta = 0;
+        int shift = 0;
+        for (;;) {
+            if (i >= len || shift > 28) {
+                return -1;
+            }
+            uint8_t b = records[i++];
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            shift += 7;
+            if ((b & 0x80) == 0) {
+                break;
+            }
+        }
+        if (i >= len || delta == 0 || delta > num_samples - idx) {
+            return -1;
+        }
+
+        // The old state lasts until the change
+        memset(dest + idx, state, delta);
+        idx += delta;
+        state = records[i++];
+    }
+
+    memset(dest + idx, state, num_samples - idx);
+    return 0;
+}
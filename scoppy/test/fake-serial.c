@@ -29,7 +29,10 @@ static int max_read_count = 9999;
 static int serial_data_idx = 0;
 static int serial_data_len = 0;
 static uint8_t *serial_data = NULL;
+static int num_read_calls = 0;
 int fake_serial_read(uint8_t *buf, int offset, int count) {
+    num_read_calls++;
+
     int remaining = serial_data_len - serial_data_idx;
     if (remaining <= 0) {
         return 0;
@@ -39,9 +42,9 @@ int fake_serial_read(uint8_t *buf, int offset, int count) {
         count = remaining;
     }
 
-    // to test one byte at a time
-    if (count > 20) {
-        count = 1;
+    // eg. to test one byte at a time
+    if (count > max_read_count) {
+        count = max_read_count;
     }
 
     memcpy((void *)(buf + offset), (void *)(serial_data + serial_data_idx), count);
@@ -58,8 +61,58 @@ void fake_serial_set_data(uint8_t *data, int len) {
     serial_data = data;
     serial_data_idx = 0;
     serial_data_len = len;
+    num_read_calls = 0;
+}
+
+int fake_serial_get_num_read_calls() {
+    return num_read_calls;
+}
+
+static uint8_t *write_buf = NULL;
+static int write_buf_size = 0;
+static int write_count = 0;
+
+void fake_serial_set_write_buffer(uint8_t *buf, int size) {
+    write_buf = buf;
+    write_buf_size = size;
+    write_count = 0;
+}
+
+int fake_serial_get_write_count() {
+    return write_count;
+}
+
+static uint32_t write_bytes_per_sec = 0;
+static uint64_t write_time_ns = 0;
+
+void fake_serial_set_write_throttle(uint32_t bytes_per_sec) {
+    write_bytes_per_sec = bytes_per_sec;
+    write_time_ns = 0;
+}
+
+uint64_t fake_serial_get_write_time_ns() {
+    return write_time_ns;
 }
 
 int fake_serial_write(uint8_t *buf, int offset, int count) {
-    return 0;
+    if (write_buf != NULL) {
+        int space = write_buf_size - write_count;
+        int num_to_copy = count < space ? count : space;
+        if (num_to_copy > 0) {
+            memcpy(write_buf + write_count, buf + offset, num_to_copy);
+        }
+    }
+    write_count += count;
+    if (write_bytes_per_sec != 0) {
+        write_time_ns += ((uint64_t)count * 1000000000u) / write_bytes_per_sec;
+    }
+    return count;
+}
+
+int fake_serial_write_v(const struct scoppy_iovec *iov, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += fake_serial_write((uint8_t *)iov[i].base, 0, iov[i].len);
+    }
+    return total;
 }
\ No newline at end of file
@@ -23,10 +23,28 @@
 
 #include <stdint.h>
 
+//
+#include "scoppy-outgoing.h"
+
 int fake_serial_read(uint8_t *buf, int offset, int count);
 void fake_serial_set_max_read_count(int count);
+// Also resets the number of read calls
 void fake_serial_set_data(uint8_t *data, int len);
+// The number of times fake_serial_read() has been called since the data was set
+int fake_serial_get_num_read_calls();
 
 int fake_serial_write(uint8_t *buf, int offset, int count);
+int fake_serial_write_v(const struct scoppy_iovec *iov, int count);
+
+// Capture written data in the given buffer. Data that doesn't fit is discarded. Pass NULL to stop capturing.
+void fake_serial_set_write_buffer(uint8_t *buf, int size);
+// The number of bytes written since the write buffer was set
+int fake_serial_get_write_count();
+
+// Simulate a link with limited throughput. Writing n bytes takes n / bytes_per_sec seconds of simulated time. 0 means
+// unlimited. Resets the simulated time.
+void fake_serial_set_write_throttle(uint32_t bytes_per_sec);
+// The simulated time spent writing
+uint64_t fake_serial_get_write_time_ns();
 
 #endif // __SCOPPY_FAKE_SERIAL_H__
\ No newline at end of file
@@ -0,0 +1,36 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+//
+#include "logic-signal.h"
+
+void make_logic_signal(uint8_t *samples, uint32_t len, uint32_t mean_run) {
+    uint8_t state = (uint8_t)rand();
+    uint32_t i = 0;
+    while (i < len) {
+        uint32_t run = 1 + rand() % (2 * mean_run);
+        for (uint32_t j = 0; j < run && i < len; j++) {
+            samples[i++] = state;
+        }
+        state ^= (uint8_t)(1u << (rand() % 8));
+    }
+}
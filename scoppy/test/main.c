@@ -31,11 +31,22 @@
 #include "simul.h"
 #include "scoppy-util/md5.h"
 #include "scoppy.h"
+#include "scoppy-adc-timing-test.h"
+#include "scoppy-stream-test.h"
+#include "scoppy-frame-queue-test.h"
+#include "scoppy-seqlock-test.h"
+#include "scoppy-delta-codec-test.h"
+#include "scoppy-edges-test.h"
+#include "scoppy-rle-test.h"
+#include "scoppy-telemetry-test.h"
 #include "scoppy-incoming-test.h"
 #include "scoppy-message-test.h"
 #include "scoppy-outgoing-test.h"
 #include "scoppy-chunked-ring-buffer-test.h"
 #include "scoppy-ring-buffer-test.h"
+#include "scoppy-trigger-test.h"
+#include "scoppy-trigger-fsm-test.h"
+#include "scoppy-trigger-dispatch-test.h"
 
 int main() {
     run_scoppy_incoming_test();
@@ -43,6 +54,17 @@ int main() {
     run_scoppy_message_test();
     run_scoppy_ring_buffer_tests();
     run_scoppy_chunked_ring_buffer_tests();
+    run_scoppy_trigger_tests();
+    run_scoppy_trigger_fsm_tests();
+    run_scoppy_trigger_dispatch_tests();
+    run_scoppy_adc_timing_tests();
+    run_scoppy_stream_tests();
+    run_scoppy_frame_queue_tests();
+    run_scoppy_seqlock_tests();
+    run_scoppy_delta_codec_tests();
+    run_scoppy_edges_tests();
+    run_scoppy_rle_tests();
+    run_scoppy_telemetry_tests();
 
     //run_scoppy_simulation();
 
@@ -0,0 +1,158 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-adc-timing-test.h"
+#include "scoppy-adc-timing.h"
+#include "scoppy-test.h"
+#include "scoppy.h"
+
+static void adc_timing_calculate_test() {
+    TPRINTF("adc_timing_calculate_test...");
+
+    struct scoppy_adc_timing timing;
+
+    // full speed
+    scoppy_adc_timing_calculate(&timing, 500000, 1, 1);
+    TASSERT(timing.clkdivint == 0 && timing.decimation == 1 && timing.real_sample_rate_per_channel == 500000);
+    scoppy_adc_timing_calculate(&timing, 400000, 2, 100);
+    TASSERT(timing.clkdivint == 0 && timing.real_sample_rate_per_channel == 250000);
+
+    // exact divisions
+    scoppy_adc_timing_calculate(&timing, 10000, 2, 100);
+    TASSERT(timing.clkdivint == 2399 && timing.decimation == 1 && timing.real_sample_rate_per_channel == 10000);
+    TASSERT(timing.cycles_per_sample == 4800);
+
+    // same as the original calculation when we can't decimate
+    for (uint32_t sr = 1; sr < 600000; sr = sr * 3 / 2 + 1) {
+        for (uint8_t num_channels = 1; num_channels <= 2; num_channels++) {
+            scoppy_adc_timing_calculate(&timing, sr, num_channels, 1);
+            uint32_t clkdivint = (48000000 / (sr * num_channels)) - 1;
+            if (clkdivint > 63999) {
+                clkdivint = 63999;
+            } else if (clkdivint <= 95) {
+                clkdivint = 0;
+            }
+            uint32_t real_sr = clkdivint == 0 ? 500000 / num_channels : (48000000 / (clkdivint + 1)) / num_channels;
+            TASSERT(timing.decimation == 1);
+            TASSERT(timing.clkdivint == clkdivint);
+            TASSERT(timing.real_sample_rate_per_channel == real_sr);
+        }
+    }
+
+    // slow rates are decimated and still exact
+    scoppy_adc_timing_calculate(&timing, 5, 2, 1000);
+    TASSERT(timing.decimation > 1);
+    TASSERT(timing.clkdivint + 1 <= SCOPPY_ADC_MAX_CYCLES_PER_CONVERSION);
+    TASSERT(timing.real_sample_rate_per_channel == 5);
+    TASSERT(timing.cycles_per_sample == 48000000 / 5);
+
+    scoppy_adc_timing_calculate(&timing, 100, 1, 1000);
+    TASSERT(timing.real_sample_rate_per_channel == 100 && timing.decimation > 1);
+
+    printf("OK\n");
+}
+
+//
+// Simulate the ADC and DMA. Conversion n happens at cycle n * cycles_per_conversion and is for channel n % num_channels.
+// The sample value encodes the sample set number (and the channel) so we can check that the reader keeps exactly 1 in
+// every 'decimation' sample sets with nothing missing or out of order.
+//
+static uint8_t sim_value(uint32_t set, uint32_t ch) { return (uint8_t)(ch == 0 ? set : ~set); }
+
+static void adc_ring_reader_sim_test() {
+    TPRINTF("adc_ring_reader_sim_test...");
+
+    static uint8_t ring[256];
+    static uint8_t dest[1024];
+    srand(2468);
+
+    for (int iteration = 0; iteration < 500; iteration++) {
+        uint32_t sample_rate = 1 + rand() % 20000;
+        uint8_t num_channels = 1 + rand() % 2;
+        bool use_spans = rand() % 3 == 0;
+
+        struct scoppy_adc_timing timing;
+        scoppy_adc_timing_calculate(&timing, sample_rate, num_channels, use_spans ? 1 : 100000);
+        uint32_t cycles_per_conversion = timing.clkdivint == 0 ? SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION : timing.clkdivint + 1;
+        TASSERT(cycles_per_conversion * num_channels * timing.decimation == timing.cycles_per_sample);
+
+        uint32_t ring_size = 1u << (4 + rand() % 5); // 16 to 256
+        struct scoppy_adc_ring_reader reader;
+        scoppy_adc_ring_reader_init(&reader, ring, ring_size, num_channels, timing.decimation);
+
+        // the dma writes conversion n to ring[n & mask]. Start just before the counts wrap.
+        uint32_t start_count = rand() % 2 ? 0 : UINT32_MAX - 100 - (UINT32_MAX - 100) % num_channels;
+        uint32_t write_count = start_count;
+        reader.read_count = start_count;
+
+        int64_t last_set = -1;
+        for (int read = 0; read < 50; read++) {
+            // run the adc for a while (sometimes long enough to overrun the ring)
+            uint32_t num_conversions = rand() % (rand() % 10 == 0 ? ring_size * 3 : ring_size);
+            for (uint32_t i = 0; i < num_conversions; i++) {
+                uint32_t n = write_count - start_count;
+                ring[write_count & (ring_size - 1)] = sim_value(n / num_channels, n % num_channels);
+                write_count++;
+            }
+
+            uint32_t len;
+            bool discarded_before = reader.discarded_samples;
+            if (use_spans) {
+                struct scoppy_uint8_span span0, span1;
+                len = scoppy_adc_ring_reader_get_spans(&reader, write_count, 1 + rand() % sizeof(dest), &span0, &span1);
+                TASSERT(span0.len + span1.len == len);
+                memcpy(dest, span0.ptr, span0.len);
+                memcpy(dest + span0.len, span1.ptr, span1.len);
+            } else {
+                len = scoppy_adc_ring_reader_read(&reader, write_count, dest, rand() % sizeof(dest));
+            }
+            TASSERT(len % num_channels == 0);
+
+            if (reader.discarded_samples && !discarded_before) {
+                // a gap is expected
+                last_set = -1;
+            }
+
+            for (uint32_t i = 0; i < len; i += num_channels) {
+                uint8_t set = dest[i];
+                for (uint32_t ch = 1; ch < num_channels; ch++) {
+                    TASSERT(dest[i + ch] == sim_value(set, ch));
+                }
+                if (last_set >= 0) {
+                    TASSERT(set == (uint8_t)(last_set + timing.decimation));
+                }
+                last_set = set;
+            }
+            reader.discarded_samples = false;
+        }
+    }
+
+    printf("OK\n");
+}
+
+void run_scoppy_adc_timing_tests() {
+    TPRINTF("run_scoppy_adc_timing_tests...\n");
+    adc_timing_calculate_test();
+    adc_ring_reader_sim_test();
+}
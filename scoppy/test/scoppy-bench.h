@@ -0,0 +1,72 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Monotonic time in nanoseconds
+static inline uint64_t scoppy_bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// CPU cycles (time stamp counter) where available, otherwise nanoseconds
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SCOPPY_BENCH_CYCLES_UNIT "cycles"
+static inline uint64_t scoppy_bench_cycles() {
+    return __rdtsc();
+}
+#else
+#define SCOPPY_BENCH_CYCLES_UNIT "ns"
+static inline uint64_t scoppy_bench_cycles() {
+    return scoppy_bench_now_ns();
+}
+#endif
+
+static inline double scoppy_bench_mb_per_sec(uint64_t num_bytes, uint64_t elapsed_ns) {
+    return elapsed_ns == 0 ? 0.0 : ((double)num_bytes / (1024.0 * 1024.0)) / ((double)elapsed_ns / 1e9);
+}
+
+// Where the machine readable results go (NULL for none). See main() in bench-main.c
+extern FILE *scoppy_bench_results;
+
+// Record a result for scripts as a line of CSV: suite,name,ns_per_op,mb_per_sec
+// Use 0 for num_bytes if the operation doesn't move any data (mb_per_sec is then 0).
+static inline void scoppy_bench_report(const char *suite, const char *name, uint64_t num_ops, uint64_t num_bytes, uint64_t elapsed_ns) {
+    if (scoppy_bench_results == NULL) {
+        return;
+    }
+    double ns_per_op = num_ops == 0 ? 0.0 : (double)elapsed_ns / (double)num_ops;
+    fprintf(scoppy_bench_results, "%s,%s,%.2f,%.2f\n", suite, name, ns_per_op, scoppy_bench_mb_per_sec(num_bytes, elapsed_ns));
+}
+
+void run_scoppy_outgoing_bench();
+void run_scoppy_chunked_ring_buffer_bench();
+void run_scoppy_trigger_bench();
+void run_scoppy_delta_codec_bench();
+void run_scoppy_rle_bench();
+void run_scoppy_ring_buffer_bench();
+void run_scoppy_incoming_bench();
+void run_scoppy_number_bench();
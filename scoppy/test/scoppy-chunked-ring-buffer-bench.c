@@ -0,0 +1,143 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-chunked-ring-buffer.h"
+
+//
+// Compares get_spans() with read_from() for reads at random positions in a wrapped buffer
+//
+
+#define BENCH_RING_SIZE (64 * 1024)
+#define BENCH_CHUNK_SIZE 512
+#define BENCH_READ_SIZE 4000
+#define BENCH_NUM_POSITIONS 1024
+#define BENCH_ITERATIONS 200000
+
+static uint8_t ring_arr[BENCH_RING_SIZE];
+static struct scoppy_uint8_chunked_ring_buffer ring;
+static uint8_t dest[BENCH_READ_SIZE];
+
+static uint8_t *src_addrs[BENCH_NUM_POSITIONS];
+static int32_t src_offsets[BENCH_NUM_POSITIONS];
+
+static volatile uint32_t sink = 0;
+
+static void fill_ring() {
+    scoppy_uint8_chunked_ring_buffer_init(&ring, ring_arr, sizeof(ring_arr), BENCH_CHUNK_SIZE);
+    ring.clear(&ring);
+
+    uint32_t num_chunks = (sizeof(ring_arr) / BENCH_CHUNK_SIZE) + 21;
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        uint8_t *chunk = ring.reserve_chunk(&ring);
+        memset(chunk, (uint8_t)i, BENCH_CHUNK_SIZE);
+        ring.unreserve_chunk(&ring, chunk);
+    }
+    assert(ring.end_addr < ring.start_addr);
+
+    // (end_addr, -ve offset) like the non-continuous send loop
+    uint32_t size = ring.size(&ring);
+    srand(99);
+    for (int i = 0; i < BENCH_NUM_POSITIONS; i++) {
+        src_addrs[i] = ring.end_addr;
+        src_offsets[i] = -(int32_t)(BENCH_READ_SIZE + rand() % (size - BENCH_READ_SIZE));
+    }
+}
+
+static void bench_read_from() {
+    uint64_t start = scoppy_bench_now_ns();
+    uint64_t total = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        int j = i % BENCH_NUM_POSITIONS;
+        total += ring.read_from(&ring, src_addrs[j], src_offsets[j], dest, BENCH_READ_SIZE);
+        sink += dest[0];
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+    printf("  read_from : %8.1f ns/op %8.1f MB/s\n", (double)elapsed / BENCH_ITERATIONS, scoppy_bench_mb_per_sec(total, elapsed));
+    scoppy_bench_report("chunked-ring-buffer", "read_from", BENCH_ITERATIONS, total, elapsed);
+}
+
+static void bench_get_spans() {
+    uint64_t start = scoppy_bench_now_ns();
+    uint64_t total = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        int j = i % BENCH_NUM_POSITIONS;
+        struct scoppy_uint8_span span0, span1;
+        total += ring.get_spans(&ring, src_addrs[j], src_offsets[j], BENCH_READ_SIZE, &span0, &span1);
+        sink += *span0.ptr;
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+    printf("  get_spans : %8.1f ns/op %8.1f MB/s\n", (double)elapsed / BENCH_ITERATIONS, scoppy_bench_mb_per_sec(total, elapsed));
+    scoppy_bench_report("chunked-ring-buffer", "get_spans", BENCH_ITERATIONS, total, elapsed);
+}
+
+// What the dma handlers do for each chunk: unreserve, reserve then size() and index() (dma_handler_on_reserved())
+static void bench_dma_handler(const char *name, bool pow2) {
+    static uint8_t arr[32768];
+    struct scoppy_uint8_chunked_ring_buffer buf;
+    if (pow2) {
+        scoppy_uint8_chunked_ring_buffer_init_pow2(&buf, arr, sizeof(arr), BENCH_CHUNK_SIZE);
+    } else {
+        scoppy_uint8_chunked_ring_buffer_init(&buf, arr, sizeof(arr), BENCH_CHUNK_SIZE);
+    }
+    buf.clear(&buf);
+
+    uint8_t *reserved1 = buf.reserve_chunk(&buf);
+    uint8_t *reserved2 = buf.reserve_chunk(&buf);
+    uint8_t *trigger_addr = arr + 1000;
+    uint32_t total = 0;
+
+    uint64_t start_ns = scoppy_bench_now_ns();
+    uint64_t start = scoppy_bench_cycles();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        buf.unreserve_chunk(&buf, reserved1);
+        reserved1 = reserved2;
+        reserved2 = buf.reserve_chunk(&buf);
+        total += buf.size(&buf);
+        total += buf.index(&buf, trigger_addr);
+    }
+    uint64_t elapsed = scoppy_bench_cycles() - start;
+    uint64_t elapsed_ns = scoppy_bench_now_ns() - start_ns;
+    sink += total;
+
+    printf("  %-10s: %8.1f %s/chunk\n", name, (double)elapsed / BENCH_ITERATIONS, SCOPPY_BENCH_CYCLES_UNIT);
+
+    // The dma writes the chunks (not us) so there is no MB/s
+    char result_name[32];
+    snprintf(result_name, sizeof(result_name), "dma_handler_%s", name);
+    scoppy_bench_report("chunked-ring-buffer", result_name, BENCH_ITERATIONS, 0, elapsed_ns);
+}
+
+void run_scoppy_chunked_ring_buffer_bench() {
+    printf("scoppy-chunked-ring-buffer-bench: read size=%d bytes\n", BENCH_READ_SIZE);
+    fill_ring();
+
+    bench_read_from();
+    bench_get_spans();
+
+    printf("scoppy-chunked-ring-buffer-bench: dma handler\n");
+    bench_dma_handler("normal", false);
+    bench_dma_handler("pow2", true);
+}
@@ -19,6 +19,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 //
@@ -566,6 +567,196 @@ static void testx() {
     }
 }
 
+// Copy the valid data into dest by walking the buffer one byte at a time. This is the reference that
+// get_spans() and read_from() are checked against.
+static uint32_t chunked_ring_buffer_model(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *dest) {
+    if (ring->end_addr == NULL) {
+        return 0;
+    }
+
+    uint32_t n = 0;
+    uint8_t *addr = ring->start_addr;
+    for (;;) {
+        dest[n++] = *addr;
+        if (addr == ring->end_addr) {
+            break;
+        }
+        addr = (addr == ring->arr_end) ? ring->arr : addr + 1;
+    }
+    return n;
+}
+
+static void chunked_ring_buffer_spans_random_test() {
+    TPRINTF("chunked_ring_buffer_spans_random_test...");
+
+    static uint8_t arr[2000];
+    static uint8_t model[2000];
+    static uint8_t dest[2000];
+    uint8_t next_value = 0;
+
+    srand(1234);
+
+    for (int iteration = 0; iteration < 2000; iteration++) {
+        // random chunk size and array size (the array doesn't have to be a multiple of the chunk size)
+        uint32_t chunk_size = 1 + rand() % 50;
+        uint32_t arr_size = chunk_size * (3 + rand() % 20) + rand() % chunk_size;
+        TASSERT(arr_size <= sizeof(arr));
+
+        struct scoppy_uint8_chunked_ring_buffer ring;
+        scoppy_uint8_chunked_ring_buffer_init(&ring, arr, arr_size, chunk_size);
+
+        // fill the buffer with a random number of chunks so that the wrap position is random. As in the dma handlers,
+        // there are 2 reserved chunks at any one time
+        uint8_t *reserved1 = ring.reserve_chunk(&ring);
+        uint8_t *reserved2 = ring.reserve_chunk(&ring);
+        int num_chunks = 1 + rand() % (3 * ring.num_chunks);
+        for (int i = 0; i < num_chunks; i++) {
+            memset(reserved1, next_value++, chunk_size);
+            ring.unreserve_chunk(&ring, reserved1);
+            reserved1 = reserved2;
+            reserved2 = ring.reserve_chunk(&ring);
+        }
+
+        uint32_t size = chunked_ring_buffer_model(&ring, model);
+        TASSERT(size == ring.size(&ring));
+        TASSERT(size > 0);
+
+        for (int j = 0; j < 20; j++) {
+            // a random src address within the valid data and a random offset that keeps it within the valid data
+            int32_t src_idx = rand() % size;
+            int32_t offset = (rand() % size) - src_idx;
+            uint32_t max_len = rand() % (size + 10);
+
+            uint8_t *src_addr = ring.start_addr + src_idx;
+            if (src_addr > ring.arr_end) {
+                src_addr = ring.arr + (src_addr - ring.arr_end - 1);
+            }
+            TASSERT(ring.index(&ring, src_addr) == src_idx);
+
+            uint32_t expected_len = size - (src_idx + offset);
+            if (expected_len > max_len) {
+                expected_len = max_len;
+            }
+
+            struct scoppy_uint8_span span0, span1;
+            uint32_t len = ring.get_spans(&ring, src_addr, offset, max_len, &span0, &span1);
+            TASSERT(len == expected_len);
+            TASSERT(span0.len + span1.len == len);
+            if (span1.len > 0) {
+                // only wraps if span0 goes to the end of the array
+                TASSERT(span0.ptr + span0.len == ring.arr_end + 1);
+                TASSERT(span1.ptr == ring.arr);
+            }
+            TASSERT(span0.len == 0 || (span0.ptr >= ring.arr && span0.ptr + span0.len <= ring.arr_end + 1));
+            TASSERT(span0.len == 0 || memcmp(span0.ptr, model + src_idx + offset, span0.len) == 0);
+            TASSERT(span1.len == 0 || memcmp(span1.ptr, model + src_idx + offset + span0.len, span1.len) == 0);
+
+            uint32_t num_copied = ring.read_from(&ring, src_addr, offset, dest, max_len);
+            TASSERT(num_copied == expected_len);
+            TASSERT(memcmp(dest, model + src_idx + offset, num_copied) == 0);
+        }
+    }
+
+    printf("OK\n");
+}
+
+// offset of addr from the start of the array or -1 for NULL
+static long chunked_ring_buffer_offset(struct scoppy_uint8_chunked_ring_buffer *ring, uint8_t *addr) {
+    return addr == NULL ? -1 : (long)(addr - ring->arr);
+}
+
+static void chunked_ring_buffer_compare(struct scoppy_uint8_chunked_ring_buffer *ring, struct scoppy_uint8_chunked_ring_buffer *pow2) {
+    TASSERT(chunked_ring_buffer_offset(ring, ring->start_addr) == chunked_ring_buffer_offset(pow2, pow2->start_addr));
+    TASSERT(chunked_ring_buffer_offset(ring, ring->end_addr) == chunked_ring_buffer_offset(pow2, pow2->end_addr));
+    TASSERT(chunked_ring_buffer_offset(ring, ring->next_chunk_addr) == chunked_ring_buffer_offset(pow2, pow2->next_chunk_addr));
+    TASSERT(ring->size(ring) == pow2->size(pow2));
+    TASSERT(ring->is_empty(ring) == pow2->is_empty(pow2));
+
+    for (uint32_t i = 0; i < ring->arr_size; i++) {
+        TASSERT(ring->index(ring, ring->arr + i) == pow2->index(pow2, pow2->arr + i));
+    }
+    TASSERT(pow2->index(pow2, NULL) == -1);
+
+    if (!ring->is_empty(ring)) {
+        uint32_t size = ring->size(ring);
+        int32_t offset = rand() % size;
+        struct scoppy_uint8_span span0, span1, pow2_span0, pow2_span1;
+        uint32_t len = ring->get_spans(ring, ring->start_addr, offset, size, &span0, &span1);
+        uint32_t pow2_len = pow2->get_spans(pow2, pow2->start_addr, offset, size, &pow2_span0, &pow2_span1);
+        TASSERT(len == pow2_len);
+        TASSERT(chunked_ring_buffer_offset(ring, span0.ptr) == chunked_ring_buffer_offset(pow2, pow2_span0.ptr));
+        TASSERT(span0.len == pow2_span0.len);
+        TASSERT(chunked_ring_buffer_offset(ring, span1.ptr) == chunked_ring_buffer_offset(pow2, pow2_span1.ptr));
+        TASSERT(span1.len == pow2_span1.len);
+        TASSERT(span0.len == 0 || memcmp(span0.ptr, pow2_span0.ptr, span0.len) == 0);
+        TASSERT(span1.len == 0 || memcmp(span1.ptr, pow2_span1.ptr, span1.len) == 0);
+    }
+}
+
+// The power of 2 variant must behave exactly the same as the normal buffer
+static void chunked_ring_buffer_pow2_random_test() {
+    TPRINTF("chunked_ring_buffer_pow2_random_test...");
+
+    static uint8_t arr[1024];
+    static uint8_t pow2_arr[1024];
+
+    srand(4321);
+
+    for (int iteration = 0; iteration < 300; iteration++) {
+        uint32_t arr_size = 1u << (4 + rand() % 7);       // 16 to 1024
+        uint32_t chunk_size = arr_size >> (2 + rand() % 3); // at least 4 chunks
+
+        struct scoppy_uint8_chunked_ring_buffer ring, pow2;
+        scoppy_uint8_chunked_ring_buffer_init(&ring, arr, arr_size, chunk_size);
+        scoppy_uint8_chunked_ring_buffer_init_pow2(&pow2, pow2_arr, arr_size, chunk_size);
+        chunked_ring_buffer_compare(&ring, &pow2);
+
+        // like the dma handlers, there are at most 2 reserved chunks
+        uint8_t *reserved[2], *pow2_reserved[2];
+        int num_reserved = 0;
+        uint8_t value = 0;
+
+        for (int op = 0; op < 200; op++) {
+            int r = rand() % 100;
+            if (r < 45 && num_reserved < 2) {
+                reserved[num_reserved] = ring.reserve_chunk(&ring);
+                pow2_reserved[num_reserved] = pow2.reserve_chunk(&pow2);
+                num_reserved++;
+            } else if (r < 95 && num_reserved > 0) {
+                memset(reserved[0], value, chunk_size);
+                memset(pow2_reserved[0], value, chunk_size);
+                value++;
+                ring.unreserve_chunk(&ring, reserved[0]);
+                pow2.unreserve_chunk(&pow2, pow2_reserved[0]);
+                reserved[0] = reserved[1];
+                pow2_reserved[0] = pow2_reserved[1];
+                num_reserved--;
+            } else if (num_reserved == 0) {
+                ring.clear(&ring);
+                pow2.clear(&pow2);
+            }
+            chunked_ring_buffer_compare(&ring, &pow2);
+        }
+    }
+
+    // The free running indexes must survive wrapping around 2^32
+    {
+        struct scoppy_uint8_chunked_ring_buffer ring, pow2;
+        scoppy_uint8_chunked_ring_buffer_init(&ring, arr, 64, 8);
+        scoppy_uint8_chunked_ring_buffer_init_pow2(&pow2, pow2_arr, 64, 8);
+        pow2.start_idx = pow2.end_idx = pow2.next_chunk_idx = UINT32_MAX - 63; // same array position as 0
+        for (int i = 0; i < 100; i++) {
+            uint8_t *chunk = ring.reserve_chunk(&ring);
+            uint8_t *pow2_chunk = pow2.reserve_chunk(&pow2);
+            ring.unreserve_chunk(&ring, chunk);
+            pow2.unreserve_chunk(&pow2, pow2_chunk);
+            chunked_ring_buffer_compare(&ring, &pow2);
+        }
+    }
+
+    printf("OK\n");
+}
+
 void run_scoppy_chunked_ring_buffer_tests() {
     TPRINTF("run_scoppy_chunked_ring_buffer_tests...\n");
     //chunked_ring_buffer_basic_test();
@@ -573,5 +764,7 @@ void run_scoppy_chunked_ring_buffer_tests() {
     //chunked_ring_buffer_dma_test();
     //chunked_ring_buffer_read_from_non_wrapped_test();
     //chunked_ring_buffer_read_from_wrapped_test();
+    chunked_ring_buffer_spans_random_test();
+    chunked_ring_buffer_pow2_random_test();
     testx();
 }
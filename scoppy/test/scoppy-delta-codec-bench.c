@@ -0,0 +1,117 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-delta-codec.h"
+#include "scoppy-message.h"
+
+//
+// Compression ratio and encode speed of the delta encoding (v2 samples message) for typical signals. The signals are
+// made to look like what the ADC records ie. 8 bit samples with a little noise.
+//
+
+#define BENCH_FRAME_SIZE (100 * 1000)
+#define BENCH_ITERATIONS 200
+
+static uint8_t frame[BENCH_FRAME_SIZE];
+static uint8_t encoded[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE];
+
+static int noise(int lsb) { return lsb == 0 ? 0 : (rand() % (2 * lsb + 1)) - lsb; }
+
+static uint8_t clamp(double v) { return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v); }
+
+// samples_per_cycle is per channel. The second channel (if any) is at twice the frequency.
+static void make_sine(uint8_t num_channels, double samples_per_cycle, int noise_lsb) {
+    for (int i = 0; i < BENCH_FRAME_SIZE; i++) {
+        int ch = i % num_channels;
+        double phase = 2 * M_PI * (i / num_channels) * (ch + 1) / samples_per_cycle;
+        frame[i] = clamp(128 + 100 * sin(phase) + noise(noise_lsb));
+    }
+}
+
+static void make_square(uint8_t num_channels, double samples_per_cycle, int noise_lsb) {
+    for (int i = 0; i < BENCH_FRAME_SIZE; i++) {
+        int ch = i % num_channels;
+        double phase = fmod((i / num_channels) * (ch + 1) / samples_per_cycle, 1.0);
+        frame[i] = clamp((phase < 0.5 ? 40 : 215) + noise(noise_lsb));
+    }
+}
+
+static void make_noise() {
+    for (int i = 0; i < BENCH_FRAME_SIZE; i++) {
+        frame[i] = (uint8_t)rand();
+    }
+}
+
+// Encode the frame a message at a time, like scoppy_write_outgoing_samples_msg(). Returns the number of sample bytes
+// that would be sent (the raw samples when the encoding doesn't make them smaller).
+static uint64_t encode_frame(uint8_t num_channels) {
+    uint64_t total = 0;
+    for (int offset = 0; offset < BENCH_FRAME_SIZE; offset += SCOPPY_OUTGOING_MAX_SAMPLE_BYTES) {
+        uint32_t len = BENCH_FRAME_SIZE - offset;
+        if (len > SCOPPY_OUTGOING_MAX_SAMPLE_BYTES) {
+            len = SCOPPY_OUTGOING_MAX_SAMPLE_BYTES;
+        }
+        struct scoppy_iovec segment = {frame + offset, len};
+        uint32_t encoded_len = scoppy_delta_encode(&segment, 1, num_channels, encoded, len - 1);
+        total += encoded_len > 0 ? encoded_len : len;
+    }
+    return total;
+}
+
+static void bench(const char *name, uint8_t num_channels) {
+    // warm up
+    uint64_t encoded_bytes = encode_frame(num_channels);
+
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        encode_frame(num_channels);
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+
+    printf("  %-22s: ratio %5.2f, encode %8.1f MB/s\n", name, (double)BENCH_FRAME_SIZE / (double)encoded_bytes,
+           scoppy_bench_mb_per_sec((uint64_t)BENCH_FRAME_SIZE * BENCH_ITERATIONS, elapsed));
+    scoppy_bench_report("delta-encode-frame", name, BENCH_ITERATIONS, (uint64_t)BENCH_FRAME_SIZE * BENCH_ITERATIONS, elapsed);
+}
+
+void run_scoppy_delta_codec_bench() {
+    printf("scoppy-delta-codec-bench: frame=%d bytes\n", BENCH_FRAME_SIZE);
+    srand(42);
+
+    make_sine(1, 500, 1);
+    bench("sine 1ch slow", 1);
+    make_sine(2, 500, 1);
+    bench("sine 2ch slow", 2);
+    make_sine(1, 50, 1);
+    bench("sine 1ch fast", 1);
+    make_sine(1, 2000, 0);
+    bench("sine 1ch no noise", 1);
+    make_square(1, 200, 1);
+    bench("square 1ch", 1);
+    make_square(2, 1000, 0);
+    bench("square 2ch no noise", 2);
+    make_noise();
+    bench("noise", 1);
+}
@@ -0,0 +1,370 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "delta-decoder.h"
+#include "fake-serial.h"
+#include "scoppy-delta-codec-test.h"
+#include "scoppy-delta-codec.h"
+#include "scoppy-message.h"
+#include "scoppy-test.h"
+
+static uint32_t encode(const uint8_t *samples, uint32_t len, uint8_t num_channels, uint8_t *dest, uint32_t dest_size) {
+    struct scoppy_iovec segment = {samples, len};
+    return scoppy_delta_encode(&segment, 1, num_channels, dest, dest_size);
+}
+
+static void delta_codec_basic_test() {
+    TPRINTF("delta_codec_basic_test...");
+
+    uint8_t encoded[16];
+
+    // deltas 0, 1, -2, 1 -> zig-zag 0, 2, 3, 2
+    uint8_t small[] = {0x80, 0x81, 0x7F, 0x80};
+    TASSERT(encode(small, sizeof(small), 1, encoded, sizeof(encoded)) == 2);
+    TASSERT(encoded[0] == 0x02);
+    TASSERT(encoded[1] == 0x32);
+
+    // delta 16 -> zig-zag 32 which needs an escape. The last nibble is padding.
+    uint8_t big[] = {0x80, 0x90};
+    TASSERT(encode(big, sizeof(big), 1, encoded, sizeof(encoded)) == 2);
+    TASSERT(encoded[0] == 0x0F);
+    TASSERT(encoded[1] == 0x20);
+    uint8_t odd[] = {0x80, 0x90, 0x90};
+    TASSERT(encode(odd, sizeof(odd), 1, encoded, sizeof(encoded)) == 3);
+    TASSERT(encoded[2] == 0x00);
+
+    // Each channel is compared with its own previous sample
+    uint8_t two_channels[] = {0x80, 0x10, 0x81, 0x10, 0x82, 0x11};
+    TASSERT(encode(two_channels, sizeof(two_channels), 2, encoded, sizeof(encoded)) == 4);
+    TASSERT(encoded[0] == 0x0F); // ch0 0, ch1 escape...
+    TASSERT(encoded[3] == 0x22); // ch0 +1, ch1 +1
+
+    // A flat signal is runs of zero differences: 17 + 17 + 6
+    uint8_t flat[40];
+    memset(flat, 0x80, sizeof(flat));
+    TASSERT(encode(flat, sizeof(flat), 1, encoded, sizeof(encoded)) == 3);
+    TASSERT(encoded[0] == 0xEF);
+    TASSERT(encoded[1] == 0xEF);
+    TASSERT(encoded[2] == 0xE4);
+    uint8_t decoded[40];
+    TASSERT(delta_decode(encoded, 3, 1, decoded, sizeof(decoded)) == 3);
+    TASSERT(memcmp(flat, decoded, sizeof(flat)) == 0);
+
+    // Doesn't fit
+    TASSERT(encode(odd, sizeof(odd), 1, encoded, 2) == 0);
+    TASSERT(encode(small, sizeof(small), 1, encoded, 1) == 0);
+
+    printf("OK\n");
+}
+
+// Encode, split across two segments, and decode again
+static void round_trip(const uint8_t *samples, uint32_t len, uint8_t num_channels) {
+    static uint8_t encoded[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE * 2];
+    static uint8_t decoded[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE];
+    TASSERT(len <= sizeof(decoded));
+
+    uint32_t encoded_len = encode(samples, len, num_channels, encoded, sizeof(encoded));
+    TASSERT(encoded_len > 0 || len == 0);
+    TASSERT(delta_decode(encoded, encoded_len, num_channels, decoded, len) == (int)encoded_len);
+    TASSERT(memcmp(samples, decoded, len) == 0);
+
+    // The split doesn't make any difference eg. a wrapped ring buffer
+    static uint8_t split_encoded[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE * 2];
+    uint32_t splits[] = {0, 1, len / 3, len / 2 + 1, len};
+    for (int i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+        uint32_t split = splits[i] > len ? len : splits[i];
+        struct scoppy_iovec segments[2] = {{samples, split}, {samples + split, len - split}};
+        TASSERT(scoppy_delta_encode(segments, 2, num_channels, split_encoded, sizeof(split_encoded)) == encoded_len);
+        TASSERT(memcmp(encoded, split_encoded, encoded_len) == 0);
+    }
+}
+
+static void delta_codec_round_trip_test() {
+    TPRINTF("delta_codec_round_trip_test...");
+
+    static uint8_t samples[SCOPPY_OUTGOING_MAX_SAMPLE_BYTES];
+    srand(1234);
+    for (uint8_t num_channels = 1; num_channels <= 3; num_channels++) {
+        // noise, including the biggest deltas
+        for (int i = 0; i < sizeof(samples); i++) {
+            samples[i] = (uint8_t)rand();
+        }
+        samples[0] = 0;
+        samples[num_channels] = 255;
+        round_trip(samples, sizeof(samples), num_channels);
+
+        // sine wave (a different one on each channel) with a bit of noise
+        for (int i = 0; i < sizeof(samples); i++) {
+            int ch = i % num_channels;
+            double v = 128 + 100 * sin((i / num_channels) * 0.01 * (ch + 1)) + (rand() % 3) - 1;
+            samples[i] = (uint8_t)v;
+        }
+        round_trip(samples, sizeof(samples), num_channels);
+
+        round_trip(samples, 1, num_channels);
+        round_trip(samples, 0, num_channels);
+    }
+
+    printf("OK\n");
+}
+
+struct decoded_samples_msg {
+    uint8_t version;
+    uint8_t flags;
+    uint8_t num_channels;
+    uint8_t encoding;
+    uint32_t num_samples;
+    uint16_t unscanned_permille;
+    uint16_t trigger_fraction;
+    uint32_t msg_size;
+    uint8_t samples[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE];
+};
+
+// Parse a samples message like the app does
+static void decode_samples_msg(const uint8_t *data, uint32_t len, struct decoded_samples_msg *decoded) {
+    TASSERT(data[0] == scoppy_start_of_message_byte);
+    decoded->msg_size = ((uint32_t)data[1] << 8) | data[2];
+    TASSERT(decoded->msg_size == len);
+    TASSERT(data[3] == SCOPPY_OUTGOING_MSG_TYPE_SAMPLES);
+    decoded->version = data[5];
+
+    const uint8_t *payload = data + 6;
+    uint32_t i = 0;
+    decoded->flags = payload[i++];
+    decoded->num_channels = payload[i++];
+    i += decoded->num_channels; // channel ids
+    i += 4;                     // sample rate
+    i += 4;                     // trigger index
+
+    decoded->encoding = SCOPPY_SAMPLES_ENCODING_RAW;
+    uint32_t samples_len = len - 6 - i;
+    decoded->num_samples = samples_len;
+    if (decoded->version >= 2) {
+        decoded->encoding = payload[i++];
+        decoded->num_samples = ((uint32_t)payload[i] << 8) | payload[i + 1];
+        i += 2;
+        samples_len -= 3;
+    }
+    decoded->unscanned_permille = 0;
+    if (decoded->version >= 3) {
+        decoded->unscanned_permille = (uint16_t)(((uint16_t)payload[i] << 8) | payload[i + 1]);
+        i += 2;
+        samples_len -= 2;
+    }
+    decoded->trigger_fraction = 0;
+    if (decoded->version >= 4) {
+        decoded->trigger_fraction = (uint16_t)(((uint16_t)payload[i] << 8) | payload[i + 1]);
+        i += 2;
+        samples_len -= 2;
+    }
+
+    if (decoded->encoding == SCOPPY_SAMPLES_ENCODING_DELTA) {
+        TASSERT(delta_decode(payload + i, samples_len, decoded->num_channels, decoded->samples, decoded->num_samples) == (int)samples_len);
+    } else {
+        TASSERT(decoded->encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+        TASSERT(samples_len == decoded->num_samples);
+        memcpy(decoded->samples, payload + i, samples_len);
+    }
+}
+
+static uint32_t write_samples_msg(uint8_t version, bool is_logic_mode, const struct scoppy_samples_msg_info *info, const uint8_t *samples, uint32_t len,
+                                  uint8_t *buf, int buf_size) {
+    struct scoppy_channel channels[MAX_CHANNELS] = {0};
+    channels[0].enabled = true;
+    channels[1].enabled = true;
+
+    struct scoppy_outgoing *msg = scoppy_new_outgoing_samples_msg(500000, channels, true, true, false, false, -1, is_logic_mode);
+    struct scoppy_iovec segments[2] = {{samples, len / 2}, {samples + len / 2, len - len / 2}};
+
+    fake_serial_set_write_buffer(buf, buf_size);
+    int ret = scoppy_write_outgoing_samples_msg(fake_serial_write_v, msg, version, info, segments, 2);
+    TASSERT(ret == msg->msg_size);
+    TASSERT(fake_serial_get_write_count() == ret);
+    fake_serial_set_write_buffer(NULL, 0);
+
+    scoppy_release_outgoing(msg);
+    return (uint32_t)ret;
+}
+
+static void samples_msg_v2_test() {
+    TPRINTF("samples_msg_v2_test...");
+
+    static uint8_t samples[SCOPPY_OUTGOING_MAX_SAMPLE_BYTES];
+    static uint8_t buf[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 10];
+    static struct decoded_samples_msg decoded;
+
+    // two slow sine waves
+    for (int i = 0; i < sizeof(samples); i++) {
+        samples[i] = (uint8_t)(128 + 100 * sin((i / 2) * ((i & 1) ? 0.02 : 0.01)));
+    }
+
+    // v1 is unchanged
+    uint32_t v1_len = write_samples_msg(1, false, NULL, samples, sizeof(samples), buf, sizeof(buf));
+    decode_samples_msg(buf, v1_len, &decoded);
+    TASSERT(decoded.version == 1);
+    TASSERT(decoded.num_samples == sizeof(samples));
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+
+    // v2 is a lot smaller
+    uint32_t v2_len = write_samples_msg(2, false, NULL, samples, sizeof(samples), buf, sizeof(buf));
+    decode_samples_msg(buf, v2_len, &decoded);
+    TASSERT(decoded.version == 2);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_DELTA);
+    TASSERT(decoded.num_channels == 2);
+    TASSERT(decoded.num_samples == sizeof(samples));
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+    TASSERT(v2_len * 2 < v1_len);
+
+    // noise doesn't get any smaller so it's sent as is
+    srand(99);
+    for (int i = 0; i < sizeof(samples); i++) {
+        samples[i] = (uint8_t)rand();
+    }
+    v2_len = write_samples_msg(2, false, NULL, samples, sizeof(samples), buf, sizeof(buf));
+    decode_samples_msg(buf, v2_len, &decoded);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(v2_len == v1_len + 3);
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+
+    // logic samples are never encoded
+    memset(samples, 0, sizeof(samples));
+    uint32_t len = write_samples_msg(2, true, NULL, samples, 1000, buf, sizeof(buf));
+    decode_samples_msg(buf, len, &decoded);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(decoded.num_samples == 1000);
+
+    // no samples
+    len = write_samples_msg(2, false, NULL, samples, 0, buf, sizeof(buf));
+    decode_samples_msg(buf, len, &decoded);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(decoded.num_samples == 0);
+
+    printf("OK\n");
+}
+
+static void samples_msg_v3_test() {
+    TPRINTF("samples_msg_v3_test...");
+
+    static uint8_t samples[SCOPPY_OUTGOING_MAX_SAMPLE_BYTES];
+    static uint8_t buf[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 10];
+    static struct decoded_samples_msg decoded;
+
+    for (int i = 0; i < sizeof(samples); i++) {
+        samples[i] = (uint8_t)(128 + 100 * sin((i / 2) * 0.01));
+    }
+
+    // v3 adds the part of the trigger search that wasn't scanned
+    struct scoppy_samples_msg_info info = {.unscanned_permille = 375};
+    uint32_t v2_len = write_samples_msg(2, false, &info, samples, sizeof(samples), buf, sizeof(buf));
+    uint32_t v3_len = write_samples_msg(3, false, &info, samples, sizeof(samples), buf, sizeof(buf));
+    TASSERT(v3_len == v2_len + 2);
+    decode_samples_msg(buf, v3_len, &decoded);
+    TASSERT(decoded.version == 3);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_DELTA);
+    TASSERT(decoded.unscanned_permille == 375);
+    TASSERT(decoded.num_samples == sizeof(samples));
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+
+    // no info means everything was scanned
+    uint32_t len = write_samples_msg(3, true, NULL, samples, 1000, buf, sizeof(buf));
+    decode_samples_msg(buf, len, &decoded);
+    TASSERT(decoded.unscanned_permille == 0);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(decoded.num_samples == 1000);
+    TASSERT(memcmp(decoded.samples, samples, 1000) == 0);
+
+    // noise at the biggest size still fits
+    srand(7);
+    for (int i = 0; i < sizeof(samples); i++) {
+        samples[i] = (uint8_t)rand();
+    }
+    info.unscanned_permille = 1000;
+    len = write_samples_msg(3, false, &info, samples, sizeof(samples), buf, sizeof(buf));
+    decode_samples_msg(buf, len, &decoded);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(decoded.unscanned_permille == 1000);
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+
+    printf("OK\n");
+}
+
+static void samples_msg_v4_test() {
+    TPRINTF("samples_msg_v4_test...");
+
+    static uint8_t samples[SCOPPY_OUTGOING_MAX_SAMPLE_BYTES];
+    static uint8_t buf[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 10];
+    static struct decoded_samples_msg decoded;
+
+    for (int i = 0; i < sizeof(samples); i++) {
+        samples[i] = (uint8_t)(128 + 100 * sin(i * 0.01));
+    }
+
+    // v4 adds the fractional trigger position after the v3 field
+    struct scoppy_samples_msg_info info = {.unscanned_permille = 12, .trigger_fraction = 0xC123};
+    uint32_t v3_len = write_samples_msg(3, false, &info, samples, sizeof(samples), buf, sizeof(buf));
+    uint32_t v4_len = write_samples_msg(4, false, &info, samples, sizeof(samples), buf, sizeof(buf));
+    TASSERT(v4_len == v3_len + 2);
+    decode_samples_msg(buf, v4_len, &decoded);
+    TASSERT(decoded.version == 4);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_DELTA);
+    TASSERT(decoded.unscanned_permille == 12);
+    TASSERT(decoded.trigger_fraction == 0xC123);
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+
+    // Older versions don't have it
+    decode_samples_msg(buf, write_samples_msg(3, false, &info, samples, sizeof(samples), buf, sizeof(buf)), &decoded);
+    TASSERT(decoded.unscanned_permille == 12);
+    TASSERT(decoded.trigger_fraction == 0);
+
+    // No info means the trigger was on a sample
+    uint32_t len = write_samples_msg(4, true, NULL, samples, 1000, buf, sizeof(buf));
+    decode_samples_msg(buf, len, &decoded);
+    TASSERT(decoded.trigger_fraction == 0);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(memcmp(decoded.samples, samples, 1000) == 0);
+
+    // Noise at the biggest size still fits
+    srand(11);
+    for (int i = 0; i < sizeof(samples); i++) {
+        samples[i] = (uint8_t)rand();
+    }
+    info.trigger_fraction = UINT16_MAX;
+    len = write_samples_msg(4, false, &info, samples, sizeof(samples), buf, sizeof(buf));
+    decode_samples_msg(buf, len, &decoded);
+    TASSERT(decoded.encoding == SCOPPY_SAMPLES_ENCODING_RAW);
+    TASSERT(decoded.trigger_fraction == UINT16_MAX);
+    TASSERT(memcmp(decoded.samples, samples, sizeof(samples)) == 0);
+
+    printf("OK\n");
+}
+
+void run_scoppy_delta_codec_tests() {
+    TPRINTF("run_scoppy_delta_codec_tests...\n");
+    delta_codec_basic_test();
+    delta_codec_round_trip_test();
+    samples_msg_v2_test();
+    samples_msg_v3_test();
+    samples_msg_v4_test();
+}
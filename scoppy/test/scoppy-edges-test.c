@@ -0,0 +1,147 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "edge-decoder.h"
+#include "fake-serial.h"
+#include "logic-signal.h"
+#include "scoppy-edges-test.h"
+#include "scoppy-edges.h"
+#include "scoppy-frame-queue.h"
+#include "scoppy-message.h"
+#include "scoppy-test.h"
+#include "scoppy-util/number.h"
+
+static void edges_basic_test() {
+    TPRINTF("edges_basic_test...");
+
+    uint8_t records[64];
+    struct scoppy_edge_encoder enc;
+
+    // No changes, no records
+    uint8_t flat[100];
+    memset(flat, 0x5A, sizeof(flat));
+    scoppy_edge_encoder_init(&enc, 0x5A, records, sizeof(records));
+    TASSERT(scoppy_edge_encode(&enc, flat, sizeof(flat)) == sizeof(flat));
+    TASSERT(scoppy_edge_encoder_get_len(&enc) == 0);
+
+    // A change after 200 samples (2 byte varint) and another one straight after
+    uint8_t samples[202];
+    memset(samples, 0x01, sizeof(samples));
+    samples[200] = 0x03;
+    samples[201] = 0x02;
+    scoppy_edge_encoder_init(&enc, 0x01, records, sizeof(records));
+    TASSERT(scoppy_edge_encode(&enc, samples, sizeof(samples)) == sizeof(samples));
+    TASSERT(scoppy_edge_encoder_get_len(&enc) == 5);
+    TASSERT(records[0] == (0x80 | (200 & 0x7F)));
+    TASSERT(records[1] == 200 >> 7);
+    TASSERT(records[2] == 0x03);
+    TASSERT(records[3] == 1);
+    TASSERT(records[4] == 0x02);
+
+    uint8_t decoded[sizeof(samples)];
+    TASSERT(edge_decode(records, 5, 0x01, decoded, sizeof(decoded)) == 0);
+    TASSERT(memcmp(decoded, samples, sizeof(samples)) == 0);
+
+    // Stops when there is no room for another record
+    scoppy_edge_encoder_init(&enc, 0x01, records, SCOPPY_EDGE_MAX_RECORD_SIZE + 2);
+    TASSERT(scoppy_edge_encode(&enc, samples, sizeof(samples)) == 201);
+    TASSERT(scoppy_edge_encoder_get_len(&enc) == 3);
+
+    printf("OK\n");
+}
+
+// Encode the samples as a series of messages (split like a wrapped ring buffer), decode them and compare
+static void edges_round_trip_test() {
+    TPRINTF("edges_round_trip_test...");
+
+    static uint8_t samples[200000];
+    static uint8_t decoded[sizeof(samples)];
+    static uint8_t buf[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 10];
+
+    srand(4321);
+    uint32_t mean_runs[] = {1, 3, 50, 1000, 100000};
+    for (int r = 0; r < sizeof(mean_runs) / sizeof(mean_runs[0]); r++) {
+        make_logic_signal(samples, sizeof(samples), mean_runs[r]);
+        memset(decoded, 0xEE, sizeof(decoded));
+
+        // Start part way into the array so that the word skipping starts unaligned
+        uint32_t idx = 3;
+        uint32_t split = sizeof(samples) / 3 + 1;
+        uint32_t num_msgs = 0;
+        while (idx < sizeof(samples)) {
+            struct scoppy_iovec segments[2];
+            int num_segments = 1;
+            segments[0].base = samples + idx;
+            if (idx < split) {
+                segments[0].len = split - idx;
+                segments[1].base = samples + split;
+                segments[1].len = sizeof(samples) - split;
+                num_segments = 2;
+            } else {
+                segments[0].len = sizeof(samples) - idx;
+            }
+
+            uint32_t num_encoded;
+            struct scoppy_iovec edges;
+            struct scoppy_outgoing *msg = scoppy_new_outgoing_logic_edges_msg(1000000, idx == 3, idx, segments, num_segments, &num_encoded, &edges);
+            TASSERT(num_encoded > 0);
+            // The header has to fit in a frame queue descriptor. See scoppy_frame_queue_push_v().
+            TASSERT(6 + msg->payload_len <= SCOPPY_FRAME_QUEUE_MAX_HEADER_SIZE);
+            fake_serial_set_write_buffer(buf, sizeof(buf));
+            int len = scoppy_write_outgoing_v(fake_serial_write_v, msg, &edges, 1);
+            fake_serial_set_write_buffer(NULL, 0);
+            scoppy_release_outgoing(msg);
+            TASSERT(len <= SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 6);
+
+            // The app's side
+            TASSERT(buf[3] == SCOPPY_OUTGOING_MSG_TYPE_LOGIC_EDGES);
+            uint8_t *payload = buf + 6;
+            TASSERT(payload[0] == (idx == 3 ? 0x01 : 0x00));
+            TASSERT(scoppy_uint32_from_4_network_bytes(payload + 1) == 1000000);
+            uint64_t start_idx = scoppy_uint64_from_8_network_bytes(payload + 5);
+            uint32_t num_samples = scoppy_uint32_from_4_network_bytes(payload + 13);
+            uint8_t initial_state = payload[17];
+            TASSERT(start_idx == idx);
+            TASSERT(num_samples == num_encoded);
+            TASSERT(edge_decode(payload + 18, len - 6 - 18, initial_state, decoded + start_idx, num_samples) == 0);
+
+            idx += num_encoded;
+            num_msgs++;
+        }
+
+        TASSERT(memcmp(samples + 3, decoded + 3, sizeof(samples) - 3) == 0);
+        if (mean_runs[r] >= 1000) {
+            // a few changes per message would be silly
+            TASSERT(num_msgs == 1);
+        }
+    }
+
+    printf("OK\n");
+}
+
+void run_scoppy_edges_tests() {
+    TPRINTF("run_scoppy_edges_tests...\n");
+    edges_basic_test();
+    edges_round_trip_test();
+}
@@ -0,0 +1,209 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-frame-queue-test.h"
+#include "scoppy-frame-queue.h"
+#include "scoppy-test.h"
+#include "scoppy-util/number.h"
+
+static void frame_queue_basic_test() {
+    TPRINTF("frame_queue_basic_test...");
+
+    struct scoppy_frame_desc descs[4];
+    struct scoppy_frame_queue queue;
+    scoppy_frame_queue_init(&queue, descs, 4);
+
+    TASSERT(scoppy_frame_queue_peek(&queue) == NULL);
+    uint32_t ticket = scoppy_frame_queue_get_ticket(&queue);
+    TASSERT(scoppy_frame_queue_is_written(&queue, ticket));
+
+    // Make the counts wrap
+    queue.head = queue.tail = 0xFFFFFFFEu;
+
+    uint8_t header[3] = {1, 2, 3};
+    uint8_t samples[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    struct scoppy_iovec iov[3] = {{header, sizeof(header)}, {samples, 6}, {samples + 6, 4}};
+    for (int i = 0; i < 4; i++) {
+        header[0] = i;
+        bool pushed = scoppy_frame_queue_push_v(&queue, iov, 3);
+        TASSERT(pushed);
+    }
+    // full
+    bool pushed_when_full = scoppy_frame_queue_push_v(&queue, iov, 3);
+    TASSERT(!pushed_when_full);
+    uint32_t full_ticket = scoppy_frame_queue_get_ticket(&queue);
+    TASSERT(!scoppy_frame_queue_is_written(&queue, full_ticket));
+
+    for (int i = 0; i < 4; i++) {
+        struct scoppy_frame_desc *desc = scoppy_frame_queue_peek(&queue);
+        TASSERT(desc != NULL);
+        // The header was copied, the segments weren't
+        TASSERT(desc->header_len == 3 && desc->header[0] == i && desc->header[2] == 3);
+        TASSERT(desc->num_segments == 2);
+        TASSERT(desc->segments[0].base == samples && desc->segments[0].len == 6);
+        TASSERT(desc->segments[1].base == samples + 6 && desc->segments[1].len == 4);
+        TASSERT(!scoppy_frame_queue_is_written(&queue, full_ticket));
+        scoppy_frame_queue_pop(&queue);
+    }
+    TASSERT(scoppy_frame_queue_peek(&queue) == NULL);
+    TASSERT(scoppy_frame_queue_is_written(&queue, full_ticket));
+    TASSERT(queue.head == 2);
+
+    // Messages without segments
+    bool pushed_header = scoppy_frame_queue_push_v(&queue, iov, 1);
+    TASSERT(pushed_header);
+    TASSERT(scoppy_frame_queue_peek(&queue)->num_segments == 0);
+
+    printf("OK\n");
+}
+
+//
+// A producer thread (the sampler) and a consumer thread (the usb writer). The producer writes frames into a ring and
+// queues them as messages that point into the ring. It waits for a frame to be written before overwriting the memory.
+//
+
+#define THREAD_TEST_NUM_FRAMES 20000
+#define THREAD_TEST_RING_SIZE 1024
+#define THREAD_TEST_MAX_FRAME_SIZE 300
+
+static uint8_t thread_test_ring[THREAD_TEST_RING_SIZE];
+static struct scoppy_frame_desc thread_test_descs[8];
+static struct scoppy_frame_queue thread_test_queue;
+static bool thread_test_done;
+
+// consumer state
+static uint32_t consumer_frame_num;
+static uint64_t consumer_num_bytes;
+
+static inline uint8_t frame_byte(uint32_t frame_num, uint32_t i) { return (uint8_t)(frame_num * 7 + i); }
+
+static inline uint32_t frame_size(uint32_t frame_num) { return 1 + (frame_num * 37) % THREAD_TEST_MAX_FRAME_SIZE; }
+
+static int check_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    TASSERT(iov[0].len == 4);
+    uint32_t frame_num = scoppy_uint32_from_4_network_bytes(iov[0].base);
+    TASSERT(frame_num == consumer_frame_num);
+
+    uint32_t n = 0;
+    for (int i = 1; i < count; i++) {
+        for (uint32_t j = 0; j < iov[i].len; j++) {
+            // The producer must not have overwritten the frame yet
+            TASSERT(iov[i].base[j] == frame_byte(frame_num, n));
+            n++;
+        }
+    }
+    TASSERT(n == frame_size(frame_num));
+
+    consumer_frame_num++;
+    consumer_num_bytes += n;
+    return n + 4;
+}
+
+static void *consumer_thread(void *arg) {
+    while (!__atomic_load_n(&thread_test_done, __ATOMIC_ACQUIRE) || scoppy_frame_queue_peek(&thread_test_queue) != NULL) {
+        if (scoppy_frame_queue_write(&thread_test_queue, check_write_serial_v, 3) == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *producer_thread(void *arg) {
+    uint64_t num_bytes = 0;
+    uint32_t write_pos = 0;
+
+    // The ring is split in two halves (like the dual buffers). Before writing to a half we wait until all the frames that
+    // used it have been written. A frame is never bigger than a half so it uses at most two halves.
+    uint32_t half_size = THREAD_TEST_RING_SIZE / 2;
+    uint32_t tickets[2] = {0, 0};
+    for (uint32_t frame_num = 0; frame_num < THREAD_TEST_NUM_FRAMES; frame_num++) {
+        uint32_t size = frame_size(frame_num);
+        uint32_t prev_half = ((write_pos + THREAD_TEST_RING_SIZE - 1) % THREAD_TEST_RING_SIZE) / half_size;
+        uint32_t first_half = write_pos / half_size;
+        uint32_t last_half = ((write_pos + size - 1) % THREAD_TEST_RING_SIZE) / half_size;
+        if (first_half != prev_half || last_half != first_half) {
+            uint32_t new_half = first_half != prev_half ? first_half : last_half;
+            while (!scoppy_frame_queue_is_written(&thread_test_queue, tickets[new_half])) {
+                sched_yield();
+            }
+        }
+
+        uint32_t start = write_pos;
+        for (uint32_t i = 0; i < size; i++) {
+            thread_test_ring[write_pos] = frame_byte(frame_num, i);
+            write_pos = (write_pos + 1) % THREAD_TEST_RING_SIZE;
+        }
+
+        uint8_t header[4];
+        scoppy_uint32_to_4_network_bytes(header, frame_num);
+        struct scoppy_iovec iov[3] = {{header, 4}, {thread_test_ring + start, size}, {thread_test_ring, 0}};
+        int count = 2;
+        if (start + size > THREAD_TEST_RING_SIZE) {
+            iov[1].len = THREAD_TEST_RING_SIZE - start;
+            iov[2].len = size - iov[1].len;
+            count = 3;
+        }
+
+        while (!scoppy_frame_queue_push_v(&thread_test_queue, iov, count)) {
+            sched_yield();
+        }
+        tickets[first_half] = tickets[last_half] = scoppy_frame_queue_get_ticket(&thread_test_queue);
+        num_bytes += size;
+    }
+
+    __atomic_store_n(&thread_test_done, true, __ATOMIC_RELEASE);
+    return (void *)(uintptr_t)num_bytes;
+}
+
+static void frame_queue_thread_test() {
+    TPRINTF("frame_queue_thread_test...");
+
+    scoppy_frame_queue_init(&thread_test_queue, thread_test_descs, 8);
+    thread_test_done = false;
+    consumer_frame_num = 0;
+    consumer_num_bytes = 0;
+
+    pthread_t producer, consumer;
+    int consumer_err = pthread_create(&consumer, NULL, consumer_thread, NULL);
+    int producer_err = pthread_create(&producer, NULL, producer_thread, NULL);
+    TASSERT(consumer_err == 0 && producer_err == 0);
+
+    void *num_bytes_produced;
+    pthread_join(producer, &num_bytes_produced);
+    pthread_join(consumer, NULL);
+
+    TASSERT(consumer_frame_num == THREAD_TEST_NUM_FRAMES);
+    TASSERT(consumer_num_bytes == (uint64_t)(uintptr_t)num_bytes_produced);
+    TASSERT(scoppy_frame_queue_peek(&thread_test_queue) == NULL);
+
+    printf("OK\n");
+}
+
+void run_scoppy_frame_queue_tests() {
+    TPRINTF("run_scoppy_frame_queue_tests...\n");
+    frame_queue_basic_test();
+    frame_queue_thread_test();
+}
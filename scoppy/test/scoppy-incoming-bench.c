@@ -0,0 +1,117 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-incoming.h"
+#include "scoppy-message.h"
+
+//
+// Framing of incoming messages by scoppy_read_incoming(). The serial port hands over whatever is waiting, which is
+// usually several messages at once (eg. when the user scrolls the timebase).
+//
+
+#define BENCH_STREAM_SIZE (64 * 1024)
+#define BENCH_ITERATIONS 200
+
+static uint8_t stream[BENCH_STREAM_SIZE];
+static int stream_len = 0;
+static int stream_pos = 0;
+// The most bytes the fake serial port returns per read (like a USB packet)
+static int max_read_size = 64;
+
+static int bench_read_serial(uint8_t *buf, int offset, int len) {
+    int n = stream_len - stream_pos;
+    if (n > len) {
+        n = len;
+    }
+    if (n > max_read_size) {
+        n = max_read_size;
+    }
+    memcpy(buf + offset, stream + stream_pos, n);
+    stream_pos += n;
+    return n;
+}
+
+// Fill the stream with messages with payload_len byte payloads. Returns the number of messages.
+static int make_stream(uint8_t msg_type, int payload_len) {
+    int msg_size = payload_len + 7;
+    int num_msgs = 0;
+    stream_len = 0;
+    while (stream_len + msg_size <= BENCH_STREAM_SIZE) {
+        stream[stream_len++] = scoppy_start_of_message_byte;
+        stream[stream_len++] = (uint8_t)(msg_size >> 8);
+        stream[stream_len++] = (uint8_t)msg_size;
+        stream[stream_len++] = msg_type;
+        stream[stream_len++] = msg_type + 5;
+        stream[stream_len++] = 1;
+        for (int i = 0; i < payload_len; i++) {
+            // never the end of message byte
+            stream[stream_len++] = (uint8_t)(i & 0x3F);
+        }
+        stream[stream_len++] = scoppy_end_of_message_byte;
+        num_msgs++;
+    }
+    return num_msgs;
+}
+
+static void bench(const char *name, uint8_t msg_type, int payload_len, int read_size) {
+    static struct scoppy_incoming incoming;
+    scoppy_init_incoming(&incoming);
+    int num_msgs = make_stream(msg_type, payload_len);
+    max_read_size = read_size;
+
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        stream_pos = 0;
+        int num_read = 0;
+        for (;;) {
+            int ret = scoppy_read_incoming(bench_read_serial, &incoming);
+            assert(ret != SCOPPY_INCOMING_ERROR);
+            if (ret == SCOPPY_INCOMING_COMPLETE) {
+                scoppy_prepare_incoming(&incoming);
+                num_read++;
+            } else if (stream_pos == stream_len) {
+                // Incomplete and there's nothing more to read
+                break;
+            }
+        }
+        assert(num_read == num_msgs);
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+
+    uint64_t total_msgs = (uint64_t)num_msgs * BENCH_ITERATIONS;
+    uint64_t total_bytes = (uint64_t)stream_len * BENCH_ITERATIONS;
+    printf("  %-16s: %8.1f ns/msg %8.1f MB/s\n", name, (double)elapsed / total_msgs, scoppy_bench_mb_per_sec(total_bytes, elapsed));
+    scoppy_bench_report("incoming-msg", name, total_msgs, total_bytes, elapsed);
+}
+
+void run_scoppy_incoming_bench() {
+    printf("scoppy-incoming-bench: %d byte stream\n", BENCH_STREAM_SIZE);
+
+    // eg. TRIGGER_CHANGED
+    bench("small_64b_reads", SCOPPY_INCOMING_MSG_TYPE_TRIGGER_CHANGED, 5, 64);
+    bench("small_1b_reads", SCOPPY_INCOMING_MSG_TYPE_TRIGGER_CHANGED, 5, 1);
+    // about the size of a sync response
+    bench("sync_64b_reads", SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE, 24, 64);
+}
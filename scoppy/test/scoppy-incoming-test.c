@@ -19,6 +19,7 @@
  */
 
 #include <stdio.h>
+#include <time.h>
 
 // my stuff
 #include "scoppy-incoming.h"
@@ -30,7 +31,8 @@
 static int read_message(struct scoppy_incoming *incoming) {
 
     int ret;
-    while ((ret = scoppy_read_incoming(fake_serial_read, incoming)) == SCOPPY_INCOMING_INCOMPLETE) {
+    int tries = 0;
+    while ((ret = scoppy_read_incoming(fake_serial_read, incoming)) == SCOPPY_INCOMING_INCOMPLETE && tries++ < 10000) {
         //scoppy_debug_incoming(msg);
     }
 
@@ -41,8 +43,8 @@ static int read_message(struct scoppy_incoming *incoming) {
     return ret;
 }
 
-void run_scoppy_incoming_test() {
-    TPRINTF("scoppy_incoming_test...");
+static void incoming_basic_test() {
+    TPRINTF("incoming_basic_test...");
 
     //
     // NB. This doesn't test the payload itself.  Just message size etc.
@@ -61,13 +63,16 @@ void run_scoppy_incoming_test() {
     // eom - 86
 
     TPRINTF(" 1 ");
-    uint8_t serial_data[] = {255, 0, 9, 10, 15, 1, 99, 99, 86, 77,77,77,77};
+    uint8_t serial_data[] = {255, 0, 9, 10, 15, 1, 99, 98, 86, 77,77,77,77};
+    fake_serial_set_max_read_count(9999);
     fake_serial_set_data(serial_data, sizeof(serial_data));
     int ret = read_message(&incoming);
     if(ret != SCOPPY_INCOMING_COMPLETE) {
         printf("%s\n", scoppy_incoming_error());
     }
     assert(ret == SCOPPY_INCOMING_COMPLETE);
+    assert(incoming.msg_type == 10 && incoming.msg_version == 1 && incoming.msg_size == 9);
+    assert(incoming.payload_len == 2 && incoming.payload[0] == 99 && incoming.payload[1] == 98);
     scoppy_init_incoming(&incoming);
 
     TPRINTF(" 2 ");
@@ -75,27 +80,145 @@ void run_scoppy_incoming_test() {
     fake_serial_set_max_read_count(1);
     ret = read_message(&incoming);
     assert(ret == SCOPPY_INCOMING_COMPLETE);
+    assert(incoming.payload_len == 2 && incoming.payload[1] == 98);
     scoppy_init_incoming(&incoming);
 
     TPRINTF(" 3 ");
-    uint8_t serial_data2[] = {66, 66, 66, 255, 0, 7, 10, 99, 99, 86};
+    uint8_t serial_data2[] = {66, 66, 66, 255, 0, 8, 10, 15, 1, 99, 86};
     fake_serial_set_data(serial_data2, sizeof(serial_data2));
     fake_serial_set_max_read_count(1);
     ret = read_message(&incoming);
     assert(ret == SCOPPY_INCOMING_COMPLETE);
+    assert(incoming.bytes_skipped == 3);
     scoppy_init_incoming(&incoming);
 
     // Now try an invalid message (0 message type) followed by valid message
-    TPRINTF(" 3 ");
-    uint8_t serial_data3[] = {255, 0, 7, 0, 99, 99, 86, 255, 0, 7, 10, 99, 99, 86};
+    TPRINTF(" 4 ");
+    uint8_t serial_data3[] = {255, 0, 8, 0, 5, 1, 99, 86, 255, 0, 8, 10, 15, 1, 99, 86};
     fake_serial_set_data(serial_data3, sizeof(serial_data3));
     // ... the first try will fail
     ret = read_message(&incoming);
     assert(ret == SCOPPY_INCOMING_ERROR);
+    scoppy_prepare_incoming(&incoming);
     // ... the second should succeed
     ret = read_message(&incoming);
     assert(ret == SCOPPY_INCOMING_COMPLETE);
+    assert(incoming.msg_type == 10);
     scoppy_init_incoming(&incoming);
 
     printf(" OK\n");
 }
+
+// After a framing error the bytes following the bad start byte are searched for the next message. The old byte at a
+// time parser had already consumed them.
+static void incoming_resync_test() {
+    TPRINTF("incoming_resync_test...");
+
+    struct scoppy_incoming incoming;
+    scoppy_init_incoming(&incoming);
+
+    // A stray start byte immediately before a message. Its size would be 255 << 8.
+    uint8_t data1[] = {255, 255, 0, 8, 10, 15, 1, 42, 86};
+    fake_serial_set_max_read_count(9999);
+    fake_serial_set_data(data1, sizeof(data1));
+    assert(read_message(&incoming) == SCOPPY_INCOMING_ERROR);
+    scoppy_prepare_incoming(&incoming);
+    assert(read_message(&incoming) == SCOPPY_INCOMING_COMPLETE);
+    assert(incoming.msg_type == 10 && incoming.payload_len == 1 && incoming.payload[0] == 42);
+    assert(incoming.staging.num_framing_errors == 1);
+    scoppy_init_incoming(&incoming);
+
+    // A truncated message (no EOM where expected) that contains the start of the next one
+    uint8_t data2[] = {255, 0, 10, 11, 16, 1, 255, 0, 8, 12, 17, 1, 43, 86};
+    fake_serial_set_data(data2, sizeof(data2));
+    assert(read_message(&incoming) == SCOPPY_INCOMING_ERROR);
+    scoppy_prepare_incoming(&incoming);
+    assert(read_message(&incoming) == SCOPPY_INCOMING_COMPLETE);
+    assert(incoming.msg_type == 12 && incoming.payload[0] == 43);
+    scoppy_init_incoming(&incoming);
+
+    printf("OK\n");
+}
+
+// Append a message with the given payload size. Returns the new length.
+static int append_message(uint8_t *buf, int len, uint8_t msg_type, int payload_len, uint8_t fill) {
+    int msg_size = payload_len + 7;
+    buf[len++] = 255;
+    buf[len++] = (uint8_t)(msg_size >> 8);
+    buf[len++] = (uint8_t)msg_size;
+    buf[len++] = msg_type;
+    buf[len++] = msg_type + 5;
+    buf[len++] = 1;
+    for (int i = 0; i < payload_len; i++) {
+        buf[len++] = (uint8_t)(fill + i);
+    }
+    buf[len++] = 86;
+    return len;
+}
+
+// Parse a burst of queued messages (with some garbage between them) and count the calls to read_serial
+static void incoming_throughput_test() {
+    TPRINTF("incoming_throughput_test...\n");
+
+    static uint8_t data[200000];
+    int num_msgs = 0;
+    int len = 0;
+    while (len < sizeof(data) - 600) {
+        // Config messages are mostly small
+        int payload_len = (num_msgs % 10 == 0) ? (num_msgs * 7) % 400 : (num_msgs % 13);
+        len = append_message(data, len, 80 + num_msgs % 8, payload_len, (uint8_t)num_msgs);
+        num_msgs++;
+        if (num_msgs % 50 == 0) {
+            // garbage
+            data[len++] = 1;
+            data[len++] = 2;
+        }
+    }
+
+    int read_sizes[] = {1, 64, 9999};
+    for (int r = 0; r < 3; r++) {
+        struct scoppy_incoming incoming;
+        scoppy_init_incoming(&incoming);
+        fake_serial_set_max_read_count(read_sizes[r]);
+        fake_serial_set_data(data, len);
+
+        clock_t start = clock();
+        int num_read = 0;
+        for (;;) {
+            int ret = scoppy_read_incoming(fake_serial_read, &incoming);
+            if (ret != SCOPPY_INCOMING_COMPLETE) {
+                assert(ret == SCOPPY_INCOMING_INCOMPLETE);
+                if (incoming.staging.write_count == len) {
+                    // everything has been read from the serial port
+                    break;
+                }
+                continue;
+            }
+            assert(incoming.msg_type == 80 + num_read % 8);
+            assert(incoming.payload_len == 0 || incoming.payload[0] == (uint8_t)num_read);
+            num_read++;
+            scoppy_prepare_incoming(&incoming);
+        }
+        double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        assert(num_read == num_msgs);
+        assert(incoming.staging.num_framing_errors == 0);
+        int num_calls = fake_serial_get_num_read_calls();
+        printf("  max read=%d: %d msgs, %d bytes, %d read_serial calls (%.3f per msg), %.1f MB/s\n", read_sizes[r], num_read, len, num_calls,
+                (double)num_calls / num_read, secs > 0 ? len / secs / 1e6 : 0.0);
+        if (read_sizes[r] == 9999) {
+            // Several messages per read
+            assert(num_calls < num_read / 4);
+        }
+    }
+
+    fake_serial_set_max_read_count(9999);
+    TPRINTF("OK\n");
+}
+
+void run_scoppy_incoming_test() {
+    TPRINTF("run_scoppy_incoming_test...\n");
+    incoming_basic_test();
+    incoming_resync_test();
+    incoming_throughput_test();
+}
@@ -20,13 +20,357 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 
 //
+#include "fake-serial.h"
+#include "scoppy-frame-queue.h"
 #include "scoppy-message.h"
 #include "scoppy-message-test.h"
 #include "scoppy-test.h"
+#include "scoppy-trigger-fsm.h"
+#include "scoppy-util/number.h"
+#include "scoppy.h"
 
-void run_scoppy_message_test() {
+static int quiet_printf(const char *fmt, ...) { return 0; }
+
+static void test_fatal_error_handler(int error) { assert(false); }
+
+static void test_sleep_ms(uint32_t ms) {}
+
+// Append a message with the given payload. Returns the new length.
+static int append_message(uint8_t *buf, int len, uint8_t msg_type, const uint8_t *payload, int payload_len) {
+    int msg_size = payload_len + 7;
+    buf[len++] = scoppy_start_of_message_byte;
+    buf[len++] = (uint8_t)(msg_size >> 8);
+    buf[len++] = (uint8_t)msg_size;
+    buf[len++] = msg_type;
+    buf[len++] = msg_type + 5;
+    buf[len++] = 1;
+    for (int i = 0; i < payload_len; i++) {
+        buf[len++] = payload[i];
+    }
+    buf[len++] = scoppy_end_of_message_byte;
+    return len;
+}
+
+static int read_and_process(struct scoppy_context *ctx) {
+    int ret = scoppy_read_and_process_incoming_message(ctx, 1, 0);
+    scoppy_prepare_incoming(ctx->incoming);
+    return ret;
+}
+
+static uint64_t test_now_us = 0;
+static uint64_t test_time_us(void) { return test_now_us; }
+
+static void init_test_context(struct scoppy_context *ctx) {
+    static struct scoppy_incoming incoming;
+    scoppy_init_incoming(&incoming);
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->incoming = &incoming;
+    ctx->read_serial = fake_serial_read;
+    ctx->sleep_ms = test_sleep_ms;
+    ctx->debugf = quiet_printf;
+    ctx->errorf = quiet_printf;
+    ctx->fatal_error_handler = test_fatal_error_handler;
+}
+
+// The app says which samples message versions it can read in bits 4-6 of the sync response flags and whether it
+// wants logic edges in bit 7
+static void sync_response_flags_test() {
+    TPRINTF("sync_response_flags_test...");
+
+    struct scoppy_context ctx;
+    init_test_context(&ctx);
+
+    uint8_t payload[] = {
+        0x00,                // flags
+        0, 0, 0, 0,          // unused
+        2, 0x01, 0x00,       // channels
+        0, 0,                // voltage range offsets
+        0, 0, 0x27, 0x10,    // timebase
+        0, 0, 0, 0, 128,     // trigger
+    };
+    static uint8_t data[256];
+    fake_serial_set_max_read_count(9999);
+
+    // Older apps
+    int len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE, payload, sizeof(payload));
+    fake_serial_set_data(data, len);
+    scoppy.app.samples_msg_version = 0;
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.samples_msg_version == 1);
+
+    payload[0] = 2 << 4;
+    len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE, payload, sizeof(payload));
+    fake_serial_set_data(data, len);
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.samples_msg_version == 2);
+
+    // An app that's newer than us gets our newest version
+    payload[0] = 7 << 4;
+    len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE, payload, sizeof(payload));
+    fake_serial_set_data(data, len);
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.samples_msg_version == SCOPPY_SAMPLES_MSG_MAX_VERSION);
+    assert(scoppy.app.run_mode == 0);
+    assert(!scoppy.app.is_logic_mode);
+    assert(!scoppy.app.logic_edges);
+
+    // Bit 7 asks for logic edges
+    payload[0] = 0x80 | (2 << 4);
+    len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_SYNC_RESPONSE, payload, sizeof(payload));
+    fake_serial_set_data(data, len);
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.logic_edges);
+    assert(scoppy.app.samples_msg_version == 2);
+
+    printf("OK\n");
+}
+
+static void config_batch_test() {
+    TPRINTF("config_batch_test...");
+
+    struct scoppy_context ctx;
+    init_test_context(&ctx);
+
+    // The app scrolls the timebase
+    static uint8_t data[1024];
+    int len = 0;
+    uint8_t timebase[4] = {0, 0, 0x27, 0x10};
+    uint8_t sample_rate[4] = {0, 1, 0x86, 0xA0};
+    uint8_t pre_trigger[1] = {25};
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_CONFIG_BEGIN, NULL, 0);
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_HORZ_SCALE_CHANGED, timebase, 4);
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_SELECTED_SAMPLE_RATE, sample_rate, 4);
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_PRE_TRIGGER_SAMPLES, pre_trigger, 1);
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_CONFIG_COMMIT, NULL, 0);
+    fake_serial_set_max_read_count(9999);
+    fake_serial_set_data(data, len);
+
+    scoppy.app.dirty = false;
+    scoppy.app.config_batch_open = false;
+    for (int i = 0; i < 4; i++) {
+        assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+        // The changes are made but the batch is still open so they won't be applied yet
+        assert(scoppy.app.config_batch_open);
+    }
+    assert(scoppy.app.dirty);
+    assert(scoppy.app.timebasePs == 10000ull * 10000);
+    assert(scoppy.app.selectedSampleRate == 100000);
+    assert(scoppy.app.preTriggerSamples == 25);
+
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(!scoppy.app.config_batch_open);
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_INCOMPLETE);
+
+    // If the commit is lost the batch is closed eventually
+    len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_CONFIG_BEGIN, NULL, 0);
+    for (int i = 0; i < SCOPPY_MAX_CONFIG_BATCH_MSGS + 1; i++) {
+        len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_PRE_TRIGGER_SAMPLES, pre_trigger, 1);
+    }
+    fake_serial_set_data(data, len);
+    for (int i = 0; i < SCOPPY_MAX_CONFIG_BATCH_MSGS + 1; i++) {
+        assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+        assert(scoppy.app.config_batch_open);
+    }
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(!scoppy.app.config_batch_open);
+
+    // Or if the app goes quiet after a few changes, once it has been open too long
+    ctx.time_us = test_time_us;
+    test_now_us = 5000000;
+    len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_CONFIG_BEGIN, NULL, 0);
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_PRE_TRIGGER_SAMPLES, pre_trigger, 1);
+    fake_serial_set_data(data, len);
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.config_batch_open);
+    test_now_us += SCOPPY_CONFIG_BATCH_TIMEOUT_US - 1;
+    assert(!scoppy_expire_config_batch(&ctx));
+    assert(scoppy.app.config_batch_open);
+    test_now_us++;
+    assert(scoppy_expire_config_batch(&ctx));
+    assert(!scoppy.app.config_batch_open);
+    assert(!scoppy_expire_config_batch(&ctx));
+
+    printf("OK\n");
+}
+
+// core1 writes through the frame queue (see pico_scoppy_queue_write_serial_v())
+static struct scoppy_frame_desc segment_info_queue_descs[2];
+static struct scoppy_frame_queue segment_info_queue;
+
+static int segment_info_queue_write_v(const struct scoppy_iovec *iov, int count) {
+    if (!scoppy_frame_queue_push_v(&segment_info_queue, iov, count)) {
+        return -1;
+    }
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].len;
+    }
+    return total;
+}
+
+static void segmented_capture_test() {
+    TPRINTF("segmented_capture_test...");
+
+    struct scoppy_context ctx;
+    init_test_context(&ctx);
+
+    static uint8_t data[256];
+    uint8_t num_segments[1] = {4};
+    int len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_SEGMENTED_CAPTURE, num_segments, 1);
+    num_segments[0] = SCOPPY_MAX_SEGMENTS + 1;
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_SEGMENTED_CAPTURE, num_segments, 1);
+    fake_serial_set_max_read_count(9999);
+    fake_serial_set_data(data, len);
+
+    scoppy.app.dirty = false;
+    TASSERT(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    TASSERT(scoppy.app.num_segments == 4);
+    TASSERT(scoppy.app.dirty);
+
+    // Too many is the most we can do
+    TASSERT(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    TASSERT(scoppy.app.num_segments == SCOPPY_MAX_SEGMENTS);
+
+    // The segment info that comes before the frames. It goes through the frame queue like everything else that core1
+    // writes so even the most segments must fit.
+    struct scoppy_segment_info segments[SCOPPY_MAX_SEGMENTS];
+    for (int i = 0; i < SCOPPY_MAX_SEGMENTS; i++) {
+        segments[i].trigger_time_us = 0x0102030405060708ull + i * 0x700;
+        segments[i].trigger_idx = i == 1 ? -2 : 1000 + i;
+        segments[i].num_bytes = 2000;
+    }
+    struct scoppy_iovec records;
+    struct scoppy_outgoing *msg = scoppy_new_outgoing_segment_info_msg(500000, segments, SCOPPY_MAX_SEGMENTS, &records);
+    TASSERT(msg->msg_type == SCOPPY_OUTGOING_MSG_TYPE_SEGMENT_INFO);
+    TASSERT(records.len == SCOPPY_MAX_SEGMENTS * 16);
+
+    scoppy_frame_queue_init(&segment_info_queue, segment_info_queue_descs, 2);
+    len = scoppy_write_outgoing_v(segment_info_queue_write_v, msg, &records, 1);
+    TASSERT(len == 6 + 5 + SCOPPY_MAX_SEGMENTS * 16);
+
+    static uint8_t buf[512];
+    fake_serial_set_write_buffer(buf, sizeof(buf));
+    uint32_t num_written = scoppy_frame_queue_write(&segment_info_queue, fake_serial_write_v, 2);
+    int write_count = fake_serial_get_write_count();
+    fake_serial_set_write_buffer(NULL, 0);
+    scoppy_release_outgoing(msg);
+    TASSERT(num_written == 1);
+    TASSERT(write_count == len);
+
+    uint8_t *payload = buf + 6;
+    TASSERT(scoppy_uint16_from_2_network_bytes(buf + 1) == len);
+    TASSERT(payload[0] == SCOPPY_MAX_SEGMENTS);
+    TASSERT(scoppy_uint32_from_4_network_bytes(payload + 1) == 500000);
+    TASSERT(scoppy_uint64_from_8_network_bytes(payload + 5) == segments[0].trigger_time_us);
+    TASSERT(scoppy_int32_from_4_network_bytes(payload + 13) == 1000);
+    TASSERT(scoppy_uint32_from_4_network_bytes(payload + 17) == 2000);
+    TASSERT(scoppy_uint64_from_8_network_bytes(payload + 21) == segments[1].trigger_time_us);
+    TASSERT(scoppy_int32_from_4_network_bytes(payload + 29) == -2);
+    uint8_t *last = payload + 5 + (SCOPPY_MAX_SEGMENTS - 1) * 16;
+    TASSERT(scoppy_uint64_from_8_network_bytes(last) == segments[SCOPPY_MAX_SEGMENTS - 1].trigger_time_us);
+    TASSERT(scoppy_int32_from_4_network_bytes(last + 8) == 1000 + SCOPPY_MAX_SEGMENTS - 1);
+
+    printf("OK\n");
+}
+
+static void telemetry_request_test() {
+    TPRINTF("telemetry_request_test...");
+
+    struct scoppy_context ctx;
+    init_test_context(&ctx);
+
+    static uint8_t data[256];
+    uint8_t flags[1] = {0x01};
+    int len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_TELEMETRY_REQUEST, NULL, 0);
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_TELEMETRY_REQUEST, flags, 1);
+    fake_serial_set_max_read_count(9999);
+    fake_serial_set_data(data, len);
+
+    // Asking for telemetry doesn't restart sampling
+    scoppy.app.dirty = false;
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.telemetry_requested && !scoppy.app.telemetry_reset);
+    assert(!scoppy.app.dirty);
+
+    scoppy.app.telemetry_requested = false;
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.telemetry_requested && scoppy.app.telemetry_reset);
+    scoppy.app.telemetry_requested = false;
+
+    printf("OK\n");
+}
+
+// Newer apps append the trigger hysteresis to the trigger params
+static void trigger_hysteresis_test() {
+    TPRINTF("trigger_hysteresis_test...");
+
+    struct scoppy_context ctx;
+    init_test_context(&ctx);
+
+    static uint8_t data[256];
+    // mode, channel, type, level
+    uint8_t old_trigger[] = {TRIGGER_MODE_NORMAL, 0, TRIGGER_TYPE_FALLING_EDGE, 0, 100};
+    uint8_t new_trigger[] = {TRIGGER_MODE_NORMAL, 0, TRIGGER_TYPE_RISING_EDGE, 0, 120, 6};
+    int len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_TRIGGER_CHANGED, new_trigger, sizeof(new_trigger));
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_TRIGGER_CHANGED, old_trigger, sizeof(old_trigger));
+    fake_serial_set_max_read_count(9999);
+    fake_serial_set_data(data, len);
+
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.trigger_type == TRIGGER_TYPE_RISING_EDGE && scoppy.app.trigger_level == 120);
+    assert(scoppy.app.trigger_hysteresis == 6);
+
+    // Older apps don't send it
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.trigger_type == TRIGGER_TYPE_FALLING_EDGE && scoppy.app.trigger_level == 100);
+    assert(scoppy.app.trigger_hysteresis == 0);
+
+    printf("OK\n");
+}
+
+// The settings for pulse width, runt, window and slope triggers follow the hysteresis
+static void trigger_fsm_params_test() {
+    TPRINTF("trigger_fsm_params_test...");
+
+    struct scoppy_context ctx;
+    init_test_context(&ctx);
+
+    static uint8_t data[256];
+    uint8_t trigger[] = {
+        TRIGGER_MODE_NORMAL, 0, TRIGGER_TYPE_RUNT, 0, 100, // mode, channel, type, level
+        0,                                                 // hysteresis
+        0, 180,                                            // level2
+        SCOPPY_TRIGGER_OPTION_NEGATIVE | (SCOPPY_TRIGGER_CONDITION_IN_RANGE << SCOPPY_TRIGGER_OPTION_CONDITION_SHIFT),
+        0, 0, 0, 10,    // time_min
+        0, 1, 0x86, 0xA0 // time_max
+    };
+    int len = append_message(data, 0, SCOPPY_INCOMING_MSG_TYPE_TRIGGER_CHANGED, trigger, sizeof(trigger));
+    // The logic analyser only has edge triggers
+    len = append_message(data, len, SCOPPY_INCOMING_MSG_TYPE_TRIGGER_CHANGED, trigger, 5);
+    fake_serial_set_max_read_count(9999);
+    fake_serial_set_data(data, len);
+
+    scoppy.app.is_logic_mode = false;
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.trigger_type == TRIGGER_TYPE_RUNT && scoppy.app.trigger_level == 100 && scoppy.app.trigger_level2 == 180);
+    assert(scoppy.app.trigger_options == trigger[8]);
+    assert(scoppy.app.trigger_time_min == 10 && scoppy.app.trigger_time_max == 100000);
+
+    scoppy.app.is_logic_mode = true;
+    assert(read_and_process(&ctx) == SCOPPY_INCOMING_COMPLETE);
+    assert(scoppy.app.trigger_type == TRIGGER_TYPE_RISING_EDGE);
+    assert(scoppy.app.trigger_level2 == 100 && scoppy.app.trigger_options == 0);
+    scoppy.app.is_logic_mode = false;
+
+    printf("OK\n");
+}
+
+static void sync_msg_test() {
     TPRINTF("scoppy_message_test...");
 
     struct scoppy_context ctx;
@@ -58,5 +402,17 @@ void run_scoppy_message_test() {
     assert((msg->payload[16] & 0xFF) == 0x45); // 
     assert((msg->payload[17] & 0xFF) == 0x89); // lsb of build number
 
+    scoppy_release_outgoing(msg);
+
     printf(" OK\n");
 }
+
+void run_scoppy_message_test() {
+    sync_msg_test();
+    config_batch_test();
+    sync_response_flags_test();
+    segmented_capture_test();
+    telemetry_request_test();
+    trigger_hysteresis_test();
+    trigger_fsm_params_test();
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-util/number.h"
+
+//
+// The network byte order conversions used to build and parse every message
+//
+
+#define BENCH_NUM_VALUES 4096
+#define BENCH_ITERATIONS 2000
+
+static uint8_t bytes[BENCH_NUM_VALUES * 8];
+static volatile uint64_t sink = 0;
+
+static void report(const char *name, uint32_t value_size, uint64_t elapsed) {
+    uint64_t num_ops = (uint64_t)BENCH_NUM_VALUES * BENCH_ITERATIONS;
+    printf("  %-10s: %8.2f ns/op %8.1f MB/s\n", name, (double)elapsed / num_ops, scoppy_bench_mb_per_sec(num_ops * value_size, elapsed));
+    scoppy_bench_report("number", name, num_ops, num_ops * value_size, elapsed);
+}
+
+void run_scoppy_number_bench() {
+    printf("scoppy-number-bench: %d values\n", BENCH_NUM_VALUES);
+
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (uint32_t j = 0; j < BENCH_NUM_VALUES; j++) {
+            scoppy_uint32_to_4_network_bytes(bytes + j * 4, j * 2654435761u + i);
+        }
+    }
+    report("u32_to", 4, scoppy_bench_now_ns() - start);
+
+    uint64_t total = 0;
+    start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (uint32_t j = 0; j < BENCH_NUM_VALUES; j++) {
+            total += scoppy_uint32_from_4_network_bytes(bytes + j * 4);
+        }
+    }
+    report("u32_from", 4, scoppy_bench_now_ns() - start);
+
+    start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (uint32_t j = 0; j < BENCH_NUM_VALUES; j++) {
+            scoppy_uint64_to_8_network_bytes(bytes + j * 8, (uint64_t)j * 0x9E3779B97F4A7C15ull + i);
+        }
+    }
+    report("u64_to", 8, scoppy_bench_now_ns() - start);
+
+    start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (uint32_t j = 0; j < BENCH_NUM_VALUES; j++) {
+            total += scoppy_uint64_from_8_network_bytes(bytes + j * 8);
+        }
+    }
+    report("u64_from", 8, scoppy_bench_now_ns() - start);
+
+    start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (uint32_t j = 0; j < BENCH_NUM_VALUES; j++) {
+            total += scoppy_int16_from_2_network_bytes(bytes + j * 2);
+        }
+    }
+    report("i16_from", 2, scoppy_bench_now_ns() - start);
+
+    sink += total;
+}
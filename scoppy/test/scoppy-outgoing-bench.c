@@ -0,0 +1,145 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-chunked-ring-buffer.h"
+#include "scoppy-message.h"
+#include "scoppy-outgoing.h"
+
+//
+// Compares sending a frame of samples messages from a chunked ring buffer by copying it into the outgoing message
+// (read_from() and scoppy_write_outgoing()) with sending it directly from the ring buffer (scoppy_write_outgoing_v()).
+//
+
+#define BENCH_RING_SIZE (128 * 1024)
+#define BENCH_CHUNK_SIZE 512
+#define BENCH_FRAME_SIZE (100 * 1000)
+#define BENCH_ITERATIONS 2000
+
+static uint8_t ring_arr[BENCH_RING_SIZE];
+static struct scoppy_uint8_chunked_ring_buffer ring;
+static struct scoppy_channel channels[MAX_CHANNELS] = {{true, 0}};
+
+// Pretend to be the usb stack which copies the data into its own fifo
+static uint8_t usb_fifo[1024];
+static volatile uint32_t usb_checksum = 0;
+
+static void usb_write(const uint8_t *buf, uint32_t len) {
+    while (len > 0) {
+        uint32_t n = len < sizeof(usb_fifo) ? len : sizeof(usb_fifo);
+        memcpy(usb_fifo, buf, n);
+        usb_checksum += usb_fifo[n - 1];
+        buf += n;
+        len -= n;
+    }
+}
+
+static int bench_write_serial(uint8_t *buf, int offset, int len) {
+    usb_write(buf + offset, len);
+    return len;
+}
+
+static int bench_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        usb_write(iov[i].base, iov[i].len);
+        total += iov[i].len;
+    }
+    return total;
+}
+
+static void fill_ring() {
+    scoppy_uint8_chunked_ring_buffer_init(&ring, ring_arr, sizeof(ring_arr), BENCH_CHUNK_SIZE);
+    ring.clear(&ring);
+
+    // write enough chunks so that the buffer has wrapped
+    uint32_t num_chunks = (sizeof(ring_arr) / BENCH_CHUNK_SIZE) + 37;
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        uint8_t *chunk = ring.reserve_chunk(&ring);
+        for (int j = 0; j < BENCH_CHUNK_SIZE; j++) {
+            chunk[j] = (uint8_t)(i + j);
+        }
+        ring.unreserve_chunk(&ring, chunk);
+    }
+    assert(ring.end_addr < ring.start_addr);
+    assert(ring.size(&ring) >= BENCH_FRAME_SIZE);
+}
+
+static uint64_t send_frame(bool vectored) {
+    uint8_t *copy_from = ring.end_addr;
+    int32_t copy_from_offset = (BENCH_FRAME_SIZE - 1) * -1;
+    uint64_t total = 0;
+    bool new_record = true;
+
+    int remaining = BENCH_FRAME_SIZE;
+    while (remaining > 0) {
+        int this_message_size = remaining < SCOPPY_OUTGOING_MAX_SAMPLE_BYTES ? remaining : SCOPPY_OUTGOING_MAX_SAMPLE_BYTES;
+        remaining -= this_message_size;
+
+        struct scoppy_outgoing *msg =
+            scoppy_new_outgoing_samples_msg(500000, channels, new_record, remaining == 0, false, false, -1, false);
+
+        if (vectored) {
+            struct scoppy_uint8_span span0, span1;
+            ring.get_spans(&ring, copy_from, copy_from_offset, this_message_size, &span0, &span1);
+            struct scoppy_iovec segments[2] = {{span0.ptr, span0.len}, {span1.ptr, span1.len}};
+            total += scoppy_write_outgoing_v(bench_write_serial_v, msg, segments, span1.len > 0 ? 2 : 1);
+        } else {
+            uint32_t num_copied = ring.read_from(&ring, copy_from, copy_from_offset, msg->payload + msg->payload_len, this_message_size);
+            assert(num_copied == this_message_size);
+            msg->payload_len += num_copied;
+            total += scoppy_write_outgoing(bench_write_serial, msg);
+        }
+        scoppy_release_outgoing(msg);
+
+        copy_from_offset += this_message_size;
+        new_record = false;
+    }
+
+    return total;
+}
+
+static void bench(const char *name, bool vectored) {
+    // warm up
+    send_frame(vectored);
+
+    uint64_t total_bytes = 0;
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        total_bytes += send_frame(vectored);
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+
+    printf("  %-10s: %8.1f MB/s (%llu bytes in %llu us)\n", name, scoppy_bench_mb_per_sec(total_bytes, elapsed), (unsigned long long)total_bytes,
+           (unsigned long long)(elapsed / 1000));
+    scoppy_bench_report("outgoing-frame", name, BENCH_ITERATIONS, total_bytes, elapsed);
+}
+
+void run_scoppy_outgoing_bench() {
+    printf("scoppy-outgoing-bench: frame=%d bytes\n", BENCH_FRAME_SIZE);
+    fill_ring();
+
+    bench("copying", false);
+    bench("vectored", true);
+}
@@ -18,6 +18,7 @@
  * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -27,6 +28,7 @@
 #include "assert.h"
 #include "fake-serial.h"
 #include "scoppy-outgoing-test.h"
+#include "scoppy-test.h"
 
 void read_message() {
 
@@ -43,9 +45,142 @@ void read_message() {
     // assert(ret == SCOPPY_INCOMING_COMPLETE);
 }
 
+// The vectored write must produce exactly the same bytes as copying the segments into the payload
+static void test_write_outgoing_v() {
+    static uint8_t segment_data[3000];
+    for (int i = 0; i < sizeof(segment_data); i++) {
+        segment_data[i] = (uint8_t)(i * 7);
+    }
+
+    static uint8_t copied[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 10];
+    static uint8_t vectored[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 10];
+
+    // eg. a wrapped ring buffer: the end of the array followed by the start
+    struct scoppy_iovec segments[2];
+    segments[0].base = segment_data + 1000;
+    segments[0].len = 2000;
+    segments[1].base = segment_data;
+    segments[1].len = 1000;
+
+    // copying
+    fake_serial_set_write_buffer(copied, sizeof(copied));
+    struct scoppy_outgoing *msg = scoppy_new_outgoing(61, 1);
+    msg->payload[msg->payload_len++] = 11;
+    msg->payload[msg->payload_len++] = 22;
+    memcpy(msg->payload + msg->payload_len, segments[0].base, segments[0].len);
+    msg->payload_len += segments[0].len;
+    memcpy(msg->payload + msg->payload_len, segments[1].base, segments[1].len);
+    msg->payload_len += segments[1].len;
+    scoppy_write_outgoing(fake_serial_write, msg);
+    scoppy_release_outgoing(msg);
+    int copied_count = fake_serial_get_write_count();
+    TASSERT(copied_count == 6 + 2 + 3000);
+
+    // vectored
+    fake_serial_set_write_buffer(vectored, sizeof(vectored));
+    msg = scoppy_new_outgoing(61, 1);
+    msg->payload[msg->payload_len++] = 11;
+    msg->payload[msg->payload_len++] = 22;
+    int ret = scoppy_write_outgoing_v(fake_serial_write_v, msg, segments, 2);
+    TASSERT(ret == copied_count);
+    TASSERT(fake_serial_get_write_count() == copied_count);
+    TASSERT(msg->msg_size == copied_count);
+    TASSERT(memcmp(copied, vectored, copied_count) == 0);
+    scoppy_release_outgoing(msg);
+
+    // no segments
+    fake_serial_set_write_buffer(vectored, sizeof(vectored));
+    msg = scoppy_new_outgoing(61, 1);
+    msg->payload[msg->payload_len++] = 11;
+    ret = scoppy_write_outgoing_v(fake_serial_write_v, msg, segments, 0);
+    TASSERT(ret == 7);
+    TASSERT(vectored[2] == 7); // size
+    TASSERT(vectored[6] == 11);
+    scoppy_release_outgoing(msg);
+
+    fake_serial_set_write_buffer(NULL, 0);
+}
+
+// Every message can be acquired once, and is reused after it's released
+static void test_pool() {
+    struct scoppy_outgoing *msgs[SCOPPY_OUTGOING_POOL_SIZE];
+    for (int i = 0; i < SCOPPY_OUTGOING_POOL_SIZE; i++) {
+        msgs[i] = scoppy_try_new_outgoing(61, 1);
+        TASSERT(msgs[i] != NULL);
+        for (int j = 0; j < i; j++) {
+            TASSERT(msgs[i] != msgs[j]);
+        }
+    }
+
+    TASSERT(scoppy_try_new_outgoing(61, 1) == NULL);
+
+    scoppy_release_outgoing(msgs[1]);
+    struct scoppy_outgoing *msg = scoppy_try_new_outgoing(60, 2);
+    TASSERT(msg == msgs[1]);
+    TASSERT(msg->msg_type == 60);
+    TASSERT(msg->msg_version == 2);
+    TASSERT(msg->payload_len == 0);
+
+    for (int i = 0; i < SCOPPY_OUTGOING_POOL_SIZE; i++) {
+        scoppy_release_outgoing(msgs[i]);
+    }
+}
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void lock_pool() {
+    pthread_mutex_lock(&pool_mutex);
+}
+static void unlock_pool() {
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+#define POOL_THREAD_ITERATIONS 20000
+
+// Each thread stamps its message and makes sure no one else had it at the same time (like core0 and core1 would)
+static void *pool_thread(void *arg) {
+    uint8_t id = (uint8_t)(uintptr_t)arg;
+    for (int i = 0; i < POOL_THREAD_ITERATIONS; i++) {
+        struct scoppy_outgoing *msg = scoppy_new_outgoing(61, id);
+        memset(msg->payload, id, 64);
+        msg->payload_len = 64;
+        for (int j = 0; j < 64; j++) {
+            TASSERT(msg->payload[j] == id);
+        }
+        TASSERT(msg->msg_version == id);
+        scoppy_release_outgoing(msg);
+    }
+    return NULL;
+}
+
+static void test_pool_threads() {
+    scoppy_set_outgoing_pool_lock(lock_pool, unlock_pool);
+
+    // More threads than messages so that some have to wait
+    pthread_t threads[SCOPPY_OUTGOING_POOL_SIZE + 2];
+    int num_threads = sizeof(threads) / sizeof(threads[0]);
+    for (int i = 0; i < num_threads; i++) {
+        int ret = pthread_create(&threads[i], NULL, pool_thread, (void *)(uintptr_t)(i + 1));
+        TASSERT(ret == 0);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Everything was released
+    for (int i = 0; i < SCOPPY_OUTGOING_POOL_SIZE; i++) {
+        TASSERT(scoppy_try_new_outgoing(61, 1) != NULL);
+    }
+    TASSERT(scoppy_try_new_outgoing(61, 1) == NULL);
+    scoppy_init_outgoing();
+
+    scoppy_set_outgoing_pool_lock(NULL, NULL);
+}
+
 void run_scoppy_outgoing_test() {
     printf("scoppy-outgoing-test: ");
 
+    scoppy_init_outgoing();
+
     uint8_t msg_type = 33;
     struct scoppy_outgoing *msg = scoppy_new_outgoing(msg_type, 1);
     assert(msg->msg_type == msg_type);
@@ -55,12 +190,13 @@ void run_scoppy_outgoing_test() {
 
     scoppy_prepare_outgoing(msg);
     assert(msg->payload_len == 0);
-    assert(msg->msg_size == 5);
+    TASSERT(msg->msg_size == 6);
     assert(msg->data[0] == scoppy_start_of_message_byte);
     assert(msg->data[1] == 0);  // size
-    assert(msg->data[2] == 5);  // size
+    TASSERT(msg->data[2] == 6);  // size
     assert(msg->data[3] == 33); // type
     assert(msg->data[4] == 38); // type
+    TASSERT(msg->data[5] == 1);  // version
     //assert(msg->data[4] == scoppy_start_of_message_byte);
 
     // A payload of one byte
@@ -68,13 +204,14 @@ void run_scoppy_outgoing_test() {
     msg->payload_len = 1;
 
     scoppy_prepare_outgoing(msg);
-    assert(msg->msg_size == 6);
+    TASSERT(msg->msg_size == 7);
     assert(msg->data[0] == scoppy_start_of_message_byte);
     assert(msg->data[1] == 0);  // size
-    assert(msg->data[2] == 6);  // size
+    TASSERT(msg->data[2] == 7);  // size
     assert(msg->data[3] == 33); // type
     assert(msg->data[4] == 38); // type
-    assert(msg->data[5] == 44); // payload
+    TASSERT(msg->data[5] == 1);  // version
+    TASSERT(msg->data[6] == 44); // payload
     //assert(msg->data[5] == scoppy_start_of_message_byte);
 
     // max payload size
@@ -82,15 +219,21 @@ void run_scoppy_outgoing_test() {
     msg->payload_len = SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE;
 
     scoppy_prepare_outgoing(msg);
-    assert(msg->msg_size == SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 5); // 4101 = 1005
+    TASSERT(msg->msg_size == SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 6); // 4102 = 1006
     assert(msg->data[0] == scoppy_start_of_message_byte);
     assert(msg->data[1] == 16);  // size
-    assert(msg->data[2] == 5);  // size
+    TASSERT(msg->data[2] == 6);  // size
     assert(msg->data[3] == 33); // type
     assert(msg->data[4] == 38); // type
-    assert(msg->data[5] == 55); // start payload
-    assert(msg->data[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 3] == 55); // end of payload
+    TASSERT(msg->data[5] == 1);  // version
+    TASSERT(msg->data[6] == 55); // start payload
+    TASSERT(msg->data[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 5] == 55); // end of payload
     //assert(msg->data[SCOPPY_OUTGOING_MAX_PAYLOAD_SIZE + 4] == scoppy_start_of_message_byte);
+    scoppy_release_outgoing(msg);
+
+    test_write_outgoing_v();
+    test_pool();
+    test_pool_threads();
 
     printf("OK\n");
 }
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-ring-buffer.h"
+
+//
+// The byte at a time ring buffer used by continuous mode. The dma interrupt handler puts the samples and the sampling
+// loop reads them all out in one go.
+//
+
+#define BENCH_RING_SIZE (16 * 1024)
+#define BENCH_FILL_SIZE (12 * 1024)
+#define BENCH_ITERATIONS 2000
+
+static uint8_t ring_arr[BENCH_RING_SIZE];
+static uint8_t dest[BENCH_RING_SIZE];
+static volatile uint32_t sink = 0;
+
+static void fill(struct scoppy_uint8_ring_buffer *ring) {
+    for (uint32_t i = 0; i < BENCH_FILL_SIZE; i++) {
+        ring->put(ring, (uint8_t)i);
+    }
+}
+
+static void bench_put(struct scoppy_uint8_ring_buffer *ring) {
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fill(ring);
+        // empty it again without reading the values
+        ring->read_idx = ring->write_idx;
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+
+    uint64_t num_bytes = (uint64_t)BENCH_FILL_SIZE * BENCH_ITERATIONS;
+    printf("  put       : %8.2f ns/op %8.1f MB/s\n", (double)elapsed / num_bytes, scoppy_bench_mb_per_sec(num_bytes, elapsed));
+    scoppy_bench_report("ring-buffer", "put", num_bytes, num_bytes, elapsed);
+}
+
+static void bench_get(struct scoppy_uint8_ring_buffer *ring) {
+    uint64_t elapsed = 0;
+    uint32_t total = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fill(ring);
+        uint64_t start = scoppy_bench_now_ns();
+        while (!ring->is_empty(ring)) {
+            total += ring->get(ring);
+        }
+        elapsed += scoppy_bench_now_ns() - start;
+    }
+    sink += total;
+
+    uint64_t num_bytes = (uint64_t)BENCH_FILL_SIZE * BENCH_ITERATIONS;
+    printf("  get       : %8.2f ns/op %8.1f MB/s\n", (double)elapsed / num_bytes, scoppy_bench_mb_per_sec(num_bytes, elapsed));
+    scoppy_bench_report("ring-buffer", "get", num_bytes, num_bytes, elapsed);
+}
+
+static void bench_read_all(struct scoppy_uint8_ring_buffer *ring) {
+    uint64_t elapsed = 0;
+    uint64_t num_bytes = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fill(ring);
+        uint64_t start = scoppy_bench_now_ns();
+        num_bytes += ring->read_all(ring, dest);
+        elapsed += scoppy_bench_now_ns() - start;
+        sink += dest[0];
+    }
+    assert(num_bytes == (uint64_t)BENCH_FILL_SIZE * BENCH_ITERATIONS);
+
+    printf("  read_all  : %8.1f ns/op %8.1f MB/s\n", (double)elapsed / BENCH_ITERATIONS, scoppy_bench_mb_per_sec(num_bytes, elapsed));
+    scoppy_bench_report("ring-buffer", "read_all", BENCH_ITERATIONS, num_bytes, elapsed);
+}
+
+void run_scoppy_ring_buffer_bench() {
+    printf("scoppy-ring-buffer-bench: %d bytes at a time (put/get are per byte)\n", BENCH_FILL_SIZE);
+
+    struct scoppy_uint8_ring_buffer ring;
+    scoppy_uint8_ring_buffer_init(&ring, ring_arr, sizeof(ring_arr));
+
+    // Start part way round so that the reads wrap
+    ring.read_idx = ring.write_idx = BENCH_RING_SIZE - 1000;
+
+    bench_put(&ring);
+    bench_get(&ring);
+    bench_read_all(&ring);
+}
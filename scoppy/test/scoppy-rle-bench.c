@@ -0,0 +1,126 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-rle.h"
+
+//
+// Deep single shot capture compresses the logic samples a dma chunk at a time so it has to keep up with the chunk
+// rate. This times the compression of typical buses at 25 MS/s (1 byte per sample) and shows the compression ratio.
+//
+
+#define BENCH_SAMPLE_RATE 25000000
+#define BENCH_CHUNK_SIZE 1024
+#define BENCH_NUM_SAMPLES (4 * 1024 * 1024)
+#define BENCH_ITERATIONS 10
+// About the same memory as a deep capture has for records
+#define BENCH_NUM_RECORDS (100 * 1024 / 4)
+
+static uint8_t samples[BENCH_NUM_SAMPLES] __attribute__((aligned(4)));
+static uint32_t records[BENCH_NUM_RECORDS];
+
+static void set_bit(uint32_t from, uint32_t len, uint8_t mask, int value) {
+    for (uint32_t i = from; i < from + len && i < BENCH_NUM_SAMPLES; i++) {
+        samples[i] = value ? (samples[i] | mask) : (samples[i] & ~mask);
+    }
+}
+
+// SCL on bit 0 and SDA on bit 1. 100 kHz with a 4 byte transfer every 2ms.
+static void make_i2c() {
+    memset(samples, 0x03, sizeof(samples));
+    const uint32_t bit_len = BENCH_SAMPLE_RATE / 100000;
+    for (uint32_t start = 1000; start < BENCH_NUM_SAMPLES; start += BENCH_SAMPLE_RATE / 500) {
+        uint32_t t = start;
+        for (int bit = 0; bit < 4 * 9; bit++) {
+            set_bit(t, bit_len / 2, 0x01, 0);
+            set_bit(t + bit_len / 4, bit_len, 0x02, rand() & 1);
+            t += bit_len;
+        }
+    }
+}
+
+// 115200 baud on bit 0 with back to back bytes half of the time
+static void make_uart() {
+    memset(samples, 0x01, sizeof(samples));
+    const uint32_t bit_len = BENCH_SAMPLE_RATE / 115200;
+    uint32_t t = 0;
+    while (t < BENCH_NUM_SAMPLES) {
+        if (rand() & 1) {
+            t += 20 * bit_len;
+            continue;
+        }
+        uint8_t byte = (uint8_t)rand();
+        set_bit(t, bit_len, 0x01, 0);
+        for (int bit = 0; bit < 8; bit++) {
+            set_bit(t + (bit + 1) * bit_len, bit_len, 0x01, (byte >> bit) & 1);
+        }
+        t += 10 * bit_len;
+    }
+}
+
+static void make_idle() { memset(samples, 0x5A, sizeof(samples)); }
+
+// The worst case. Every sample is different to the one before.
+static void make_busy() {
+    for (uint32_t i = 0; i < BENCH_NUM_SAMPLES; i++) {
+        samples[i] = (uint8_t)(i ^ (i >> 8));
+    }
+}
+
+static void bench(const char *name) {
+    struct scoppy_rle_buffer rle;
+    scoppy_rle_init(&rle, records, BENCH_NUM_RECORDS);
+
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        scoppy_rle_clear(&rle);
+        for (uint32_t offset = 0; offset < BENCH_NUM_SAMPLES; offset += BENCH_CHUNK_SIZE) {
+            scoppy_rle_compress(&rle, samples + offset, BENCH_CHUNK_SIZE);
+        }
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+
+    // How many samples the records could hold if they didn't wrap
+    double ratio = (double)scoppy_rle_num_samples(&rle) / ((rle.count + 1) * 4.0);
+    double ns_per_chunk = (double)elapsed / ((double)BENCH_ITERATIONS * (BENCH_NUM_SAMPLES / BENCH_CHUNK_SIZE));
+    double chunk_period_ns = 1e9 * BENCH_CHUNK_SIZE / BENCH_SAMPLE_RATE;
+    printf("  %-6s: ratio %7.1f, %8.1f MB/s, %7.0f ns/chunk (%.0fx the 25 MS/s chunk rate)\n", name, ratio,
+           scoppy_bench_mb_per_sec((uint64_t)BENCH_NUM_SAMPLES * BENCH_ITERATIONS, elapsed), ns_per_chunk, chunk_period_ns / ns_per_chunk);
+    scoppy_bench_report("rle-compress-chunk", name, (uint64_t)BENCH_ITERATIONS * (BENCH_NUM_SAMPLES / BENCH_CHUNK_SIZE),
+                        (uint64_t)BENCH_NUM_SAMPLES * BENCH_ITERATIONS, elapsed);
+}
+
+void run_scoppy_rle_bench() {
+    printf("scoppy-rle-bench: %d samples, chunk=%d bytes, %d records\n", BENCH_NUM_SAMPLES, BENCH_CHUNK_SIZE, BENCH_NUM_RECORDS);
+    srand(42);
+
+    make_i2c();
+    bench("i2c");
+    make_uart();
+    bench("uart");
+    make_idle();
+    bench("idle");
+    make_busy();
+    bench("busy");
+}
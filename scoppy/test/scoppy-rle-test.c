@@ -0,0 +1,212 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "logic-signal.h"
+#include "scoppy-rle-test.h"
+#include "scoppy-rle.h"
+#include "scoppy-test.h"
+
+static uint32_t num_literals_in(uint32_t record) { return (record >> 24) & 0x03; }
+
+static void rle_basic_test() {
+    TPRINTF("rle_basic_test...");
+
+    uint32_t records[8];
+    struct scoppy_rle_buffer rle;
+    scoppy_rle_init(&rle, records, 8);
+
+    // 100 x A, 1 x B, 2 x C, 5 x D
+    uint8_t samples[108];
+    memset(samples, 0xA0, 100);
+    samples[100] = 0xB0;
+    samples[101] = 0xC0;
+    samples[102] = 0xC0;
+    memset(samples + 103, 0xD0, 5);
+    scoppy_rle_compress(&rle, samples, sizeof(samples));
+
+    // B and C are packed into one literal record. D is the current run.
+    TASSERT(rle.count == 2);
+    TASSERT(records[0] == ((99u << 8) | 0xA0));
+    TASSERT(records[1] == (SCOPPY_RLE_LITERAL_FLAG | (3u << 24) | (0xC0u << 16) | (0xC0u << 8) | 0xB0));
+    TASSERT(rle.state == 0xD0 && rle.run == 5);
+    TASSERT(rle.first_sample == 0 && rle.end_sample == sizeof(samples));
+
+    uint8_t decoded[sizeof(samples) + 10];
+    struct scoppy_rle_reader reader;
+    scoppy_rle_reader_init(&reader, &rle, 0);
+    TASSERT(scoppy_rle_read(&reader, decoded, sizeof(decoded)) == sizeof(samples));
+    TASSERT(memcmp(decoded, samples, sizeof(samples)) == 0);
+
+    // From the middle of each kind of record
+    uint64_t starts[] = {50, 101, 102, 105, 108};
+    for (int i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+        scoppy_rle_reader_init(&reader, &rle, starts[i]);
+        uint32_t n = scoppy_rle_read(&reader, decoded, sizeof(decoded));
+        TASSERT(n == sizeof(samples) - starts[i]);
+        TASSERT(memcmp(decoded, samples + starts[i], n) == 0);
+    }
+
+    // Reading a few at a time
+    scoppy_rle_reader_init(&reader, &rle, 0);
+    uint32_t total = 0;
+    uint32_t n;
+    while ((n = scoppy_rle_read(&reader, decoded + total, 2)) > 0) {
+        total += n;
+    }
+    TASSERT(total == sizeof(samples));
+    TASSERT(memcmp(decoded, samples, sizeof(samples)) == 0);
+
+    // Every sample different costs 4 bytes per 3 samples
+    scoppy_rle_clear(&rle);
+    for (int i = 0; i < 12; i++) {
+        samples[i] = (uint8_t)i;
+    }
+    scoppy_rle_compress(&rle, samples, 12);
+    TASSERT(rle.count == 4 && rle.run == 1);
+    // fills the last literal record
+    scoppy_rle_compress(&rle, samples, 1);
+    TASSERT(rle.count == 4 && rle.run == 1);
+    TASSERT(num_literals_in(records[3]) == 3);
+
+    printf("OK\n");
+}
+
+// Compress the samples in randomly sized chunks (like the dma transfers) and read them back
+static void rle_round_trip_test() {
+    TPRINTF("rle_round_trip_test...");
+
+    static uint8_t samples[300000];
+    static uint8_t decoded[sizeof(samples)];
+    static uint32_t records[sizeof(samples)];
+
+    srand(2468);
+    uint32_t mean_runs[] = {1, 2, 5, 100, 10000};
+    for (int r = 0; r < sizeof(mean_runs) / sizeof(mean_runs[0]); r++) {
+        make_logic_signal(samples, sizeof(samples), mean_runs[r]);
+
+        struct scoppy_rle_buffer rle;
+        scoppy_rle_init(&rle, records, sizeof(records) / sizeof(records[0]));
+
+        uint32_t idx = 0;
+        while (idx < sizeof(samples)) {
+            uint32_t len = 1 + rand() % 3000;
+            if (len > sizeof(samples) - idx) {
+                len = sizeof(samples) - idx;
+            }
+            scoppy_rle_compress(&rle, samples + idx, len);
+            idx += len;
+        }
+
+        // Big enough that nothing was dropped
+        TASSERT(rle.first_sample == 0 && rle.end_sample == sizeof(samples));
+        if (mean_runs[r] >= 100) {
+            TASSERT(rle.count * 4 < sizeof(samples) / 10);
+        }
+        // never worse than 4 bytes per 3 samples (plus a record for each change of kind)
+        TASSERT(rle.count <= sizeof(samples) / 2);
+
+        memset(decoded, 0xEE, sizeof(decoded));
+        struct scoppy_rle_reader reader;
+        scoppy_rle_reader_init(&reader, &rle, 0);
+        TASSERT(scoppy_rle_read(&reader, decoded, sizeof(decoded)) == sizeof(samples));
+        TASSERT(memcmp(decoded, samples, sizeof(samples)) == 0);
+    }
+
+    printf("OK\n");
+}
+
+// When the records run out the oldest samples are dropped
+static void rle_wrap_test() {
+    TPRINTF("rle_wrap_test...");
+
+    static uint8_t samples[100000];
+    static uint8_t decoded[sizeof(samples)];
+    uint32_t records[500];
+
+    srand(1357);
+    make_logic_signal(samples, sizeof(samples), 20);
+
+    struct scoppy_rle_buffer rle;
+    scoppy_rle_init(&rle, records, sizeof(records) / sizeof(records[0]));
+    for (uint32_t idx = 0; idx < sizeof(samples); idx += 1000) {
+        scoppy_rle_compress(&rle, samples + idx, 1000);
+
+        TASSERT(rle.end_sample == idx + 1000);
+        if (scoppy_rle_is_full(&rle)) {
+            // Whatever is left must still be correct
+            uint32_t n = (uint32_t)scoppy_rle_num_samples(&rle);
+            TASSERT(n < idx + 1000);
+            struct scoppy_rle_reader reader;
+            scoppy_rle_reader_init(&reader, &rle, rle.first_sample);
+            TASSERT(scoppy_rle_read(&reader, decoded, sizeof(decoded)) == n);
+            TASSERT(memcmp(decoded, samples + rle.first_sample, n) == 0);
+        }
+    }
+    TASSERT(scoppy_rle_is_full(&rle));
+
+    printf("OK\n");
+}
+
+// A run longer than a record can hold
+static void rle_long_run_test() {
+    TPRINTF("rle_long_run_test...");
+
+    uint32_t records[8];
+    struct scoppy_rle_buffer rle;
+    scoppy_rle_init(&rle, records, 8);
+
+    static uint8_t chunk[4096];
+    memset(chunk, 0x11, sizeof(chunk));
+    uint32_t num_chunks = (SCOPPY_RLE_MAX_RUN / sizeof(chunk)) * 2 + 1;
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        scoppy_rle_compress(&rle, chunk, sizeof(chunk));
+    }
+    uint64_t total = (uint64_t)num_chunks * sizeof(chunk);
+    TASSERT(rle.end_sample == total);
+    TASSERT(rle.count == 2);
+    TASSERT(rle.run == total - 2 * SCOPPY_RLE_MAX_RUN);
+
+    uint8_t change = 0x22;
+    scoppy_rle_compress(&rle, &change, 1);
+    TASSERT(rle.count == 3 && rle.run == 1);
+
+    uint8_t decoded[10];
+    struct scoppy_rle_reader reader;
+    scoppy_rle_reader_init(&reader, &rle, total - 9);
+    TASSERT(scoppy_rle_read(&reader, decoded, sizeof(decoded)) == 10);
+    for (int i = 0; i < 9; i++) {
+        TASSERT(decoded[i] == 0x11);
+    }
+    TASSERT(decoded[9] == 0x22);
+
+    printf("OK\n");
+}
+
+void run_scoppy_rle_tests() {
+    TPRINTF("run_scoppy_rle_tests...\n");
+    rle_basic_test();
+    rle_round_trip_test();
+    rle_wrap_test();
+    rle_long_run_test();
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-seqlock-test.h"
+#include "scoppy-seqlock.h"
+#include "scoppy-test.h"
+
+// Like the live sampling params. pre + post must always add up to total.
+struct seqlock_test_params {
+    uint8_t trigger_type;
+    uint8_t trigger_level;
+    int32_t pre;
+    int32_t post;
+    int32_t total;
+};
+
+static void seqlock_basic_test() {
+    TPRINTF("seqlock_basic_test...");
+
+    struct scoppy_seqlock lock;
+    scoppy_seqlock_init(&lock);
+    struct seqlock_test_params shared = {0}, params = {1, 128, 10, 90, 100}, copy;
+
+    TASSERT(scoppy_seqlock_get_generation(&lock) == 0);
+    scoppy_seqlock_write(&lock, &shared, &params, sizeof(params));
+    TASSERT(scoppy_seqlock_get_generation(&lock) == 1);
+    TASSERT(scoppy_seqlock_read(&lock, &copy, &shared, sizeof(copy)) == 1);
+    TASSERT(memcmp(&copy, &params, sizeof(params)) == 0);
+
+    params.trigger_level = 200;
+    scoppy_seqlock_write(&lock, &shared, &params, sizeof(params));
+    TASSERT(scoppy_seqlock_read(&lock, &copy, &shared, sizeof(copy)) == 2);
+    TASSERT(copy.trigger_level == 200);
+
+    printf("OK\n");
+}
+
+#define THREAD_TEST_NUM_WRITES 200000
+
+static struct scoppy_seqlock thread_test_lock;
+static struct seqlock_test_params thread_test_shared;
+static bool thread_test_done;
+
+static void *writer_thread(void *arg) {
+    struct seqlock_test_params params = {0, 0, 0, 0, 0};
+    for (int32_t i = 1; i <= THREAD_TEST_NUM_WRITES; i++) {
+        params.trigger_type = (uint8_t)(i % 3);
+        params.trigger_level = (uint8_t)i;
+        params.total = 1000 + i;
+        params.pre = params.total * (i % 101) / 100;
+        params.post = params.total - params.pre;
+        scoppy_seqlock_write(&thread_test_lock, &thread_test_shared, &params, sizeof(params));
+        if (i % 64 == 0) {
+            sched_yield();
+        }
+    }
+    __atomic_store_n(&thread_test_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *reader_thread(void *arg) {
+    uint32_t last_generation = 0;
+    uint32_t num_changes = 0;
+    for (;;) {
+        bool done = __atomic_load_n(&thread_test_done, __ATOMIC_ACQUIRE);
+
+        struct seqlock_test_params params;
+        uint32_t generation = scoppy_seqlock_read(&thread_test_lock, &params, &thread_test_shared, sizeof(params));
+        TASSERT(generation >= last_generation);
+        if (generation != last_generation) {
+            // Never a mixture of two writes
+            int32_t i = params.total - 1000;
+            TASSERT(i == (int32_t)generation);
+            TASSERT(params.pre + params.post == params.total);
+            TASSERT(params.trigger_type == (uint8_t)(i % 3) && params.trigger_level == (uint8_t)i);
+            last_generation = generation;
+            num_changes++;
+        }
+
+        if (done) {
+            break;
+        }
+    }
+
+    TASSERT(last_generation == THREAD_TEST_NUM_WRITES);
+    return (void *)(uintptr_t)num_changes;
+}
+
+static void seqlock_thread_test() {
+    TPRINTF("seqlock_thread_test...");
+
+    scoppy_seqlock_init(&thread_test_lock);
+    memset(&thread_test_shared, 0, sizeof(thread_test_shared));
+    thread_test_done = false;
+
+    pthread_t writer, reader;
+    int reader_err = pthread_create(&reader, NULL, reader_thread, NULL);
+    int writer_err = pthread_create(&writer, NULL, writer_thread, NULL);
+    TASSERT(reader_err == 0 && writer_err == 0);
+
+    void *num_changes;
+    pthread_join(writer, NULL);
+    pthread_join(reader, &num_changes);
+    TASSERT((uintptr_t)num_changes > 0);
+
+    printf("OK\n");
+}
+
+void run_scoppy_seqlock_tests() {
+    TPRINTF("run_scoppy_seqlock_tests...\n");
+    seqlock_basic_test();
+    seqlock_thread_test();
+}
@@ -0,0 +1,299 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "edge-decoder.h"
+#include "fake-serial.h"
+#include "scoppy-message.h"
+#include "scoppy-stream-test.h"
+#include "scoppy-stream.h"
+#include "scoppy-test.h"
+#include "scoppy-util/number.h"
+#include "scoppy.h"
+
+//
+// Soak test. The ADC/DMA is simulated. Time only advances while writing to the (throttled) fake serial port or when
+// the stream has nothing to send. The app side parses the messages and checks that the samples it gets are in order
+// and that every sample is accounted for.
+//
+
+#define SIM_RING_SIZE 16384
+static uint8_t sim_ring[SIM_RING_SIZE];
+static uint64_t sim_idle_ns;
+static uint64_t sim_bytes_per_sec;
+static uint8_t sim_num_channels;
+static uint64_t sim_written;
+// The value of sim_written when the 'DMA' was (re)started
+static uint64_t sim_write_base;
+
+static uint64_t sim_now_ns() { return sim_idle_ns + fake_serial_get_write_time_ns(); }
+
+static uint64_t sim_get_time_us() { return sim_now_ns() / 1000; }
+
+// Logic samples streamed as edges. They change every sim_edge_run samples.
+static bool sim_edge_mode;
+static uint32_t sim_edge_run;
+
+static uint8_t sim_value(uint64_t set, uint32_t ch) {
+    if (sim_edge_mode) {
+        return (uint8_t)(set / sim_edge_run);
+    }
+    return (uint8_t)(ch == 0 ? set : ~set);
+}
+
+// The 'DMA' writes everything up to now into the ring
+static uint32_t sim_get_write_count() {
+    uint64_t target = sim_now_ns() * sim_bytes_per_sec / 1000000000u;
+    for (; sim_written < target; sim_written++) {
+        sim_ring[(sim_written - sim_write_base) % SIM_RING_SIZE] = sim_value(sim_written / sim_num_channels, sim_written % sim_num_channels);
+    }
+    return (uint32_t)(sim_written - sim_write_base);
+}
+
+struct app_state {
+    uint64_t num_received;
+    uint64_t num_records;
+    int64_t last_set; // modulo 256
+    uint64_t next_edge_idx;
+    uint32_t num_stats_msgs;
+    uint32_t last_max_lossless_rate;
+};
+
+static uint8_t write_buf[64 * 1024];
+
+static void app_parse(struct app_state *app) {
+    int len = fake_serial_get_write_count();
+    TASSERT(len <= sizeof(write_buf));
+
+    int i = 0;
+    while (i < len) {
+        uint8_t *m = write_buf + i;
+        TASSERT(m[0] == scoppy_start_of_message_byte);
+        uint16_t msg_size = scoppy_uint16_from_2_network_bytes(m + 1);
+        uint8_t type = m[3];
+        TASSERT(m[4] == (uint8_t)(type + 5));
+        uint8_t *payload = m + 6;
+        int payload_len = msg_size - 6;
+
+        if (type == SCOPPY_OUTGOING_MSG_TYPE_SAMPLES) {
+            uint8_t flags = payload[0];
+            uint8_t num_data_channels = payload[1];
+            TASSERT(num_data_channels == sim_num_channels);
+            int header_len = 2 + num_data_channels + 4 + 4;
+            uint8_t *samples = payload + header_len;
+            int num_bytes = payload_len - header_len;
+            TASSERT(num_bytes % sim_num_channels == 0);
+
+            if (flags & 0x01) {
+                app->num_records++;
+                app->last_set = -1;
+            } else {
+                TASSERT(app->last_set >= 0);
+            }
+
+            for (int j = 0; j < num_bytes; j += sim_num_channels) {
+                uint8_t set = samples[j];
+                if (app->last_set >= 0) {
+                    TASSERT(set == (uint8_t)(app->last_set + 1));
+                }
+                for (int ch = 1; ch < sim_num_channels; ch++) {
+                    TASSERT(samples[j + ch] == sim_value(set, ch));
+                }
+                app->last_set = set;
+            }
+            app->num_received += num_bytes / sim_num_channels;
+        } else if (type == SCOPPY_OUTGOING_MSG_TYPE_LOGIC_EDGES) {
+            uint8_t flags = payload[0];
+            uint64_t start_idx = scoppy_uint64_from_8_network_bytes(payload + 5);
+            uint32_t num_samples = scoppy_uint32_from_4_network_bytes(payload + 13);
+            if (flags & 0x01) {
+                app->num_records++;
+            } else {
+                // no gap
+                TASSERT(start_idx == app->next_edge_idx);
+            }
+
+            static uint8_t decoded[SIM_RING_SIZE];
+            TASSERT(num_samples <= SIM_RING_SIZE);
+            TASSERT(edge_decode(payload + 18, payload_len - 18, payload[17], decoded, num_samples) == 0);
+            for (uint32_t j = 0; j < num_samples; j++) {
+                TASSERT(decoded[j] == sim_value(start_idx + j, 0));
+            }
+            app->next_edge_idx = start_idx + num_samples;
+            app->num_received += num_samples;
+        } else {
+            TASSERT(type == SCOPPY_OUTGOING_MSG_TYPE_STREAM_STATS);
+            TASSERT(payload_len == 48);
+            uint64_t captured = scoppy_uint64_from_8_network_bytes(payload + 8);
+            uint64_t sent = scoppy_uint64_from_8_network_bytes(payload + 16);
+            uint64_t dropped = scoppy_uint64_from_8_network_bytes(payload + 24);
+            TASSERT(sent + dropped <= captured);
+            app->last_max_lossless_rate = scoppy_uint32_from_4_network_bytes(payload + 44);
+            app->num_stats_msgs++;
+        }
+
+        i += msg_size;
+    }
+    TASSERT(i == len);
+
+    fake_serial_set_write_buffer(write_buf, sizeof(write_buf));
+}
+
+// Stream for duration_ms at the given rate over a link with the given throughput
+static void soak(struct scoppy_stream *stream, struct app_state *app, uint32_t sample_rate, uint8_t num_channels, uint32_t link_bytes_per_sec,
+                 uint32_t duration_ms, uint32_t restart_at_ms) {
+    static struct scoppy_channel channels[MAX_CHANNELS];
+    memset(channels, 0, sizeof(channels));
+    for (int ch = 0; ch < num_channels; ch++) {
+        channels[ch].enabled = true;
+    }
+
+    sim_idle_ns = 0;
+    sim_written = 0;
+    sim_write_base = 0;
+    sim_bytes_per_sec = (uint64_t)sample_rate * num_channels;
+    sim_num_channels = num_channels;
+    fake_serial_set_write_throttle(link_bytes_per_sec);
+    fake_serial_set_write_buffer(write_buf, sizeof(write_buf));
+
+    memset(app, 0, sizeof(*app));
+    app->last_set = -1;
+
+    stream->get_write_count = sim_get_write_count;
+    stream->get_time_us = sim_get_time_us;
+    stream->write_serial_v = fake_serial_write_v;
+    scoppy_stream_init(stream, sim_ring, SIM_RING_SIZE, num_channels, sample_rate, channels, sim_edge_mode);
+    stream->edge_mode = sim_edge_mode;
+
+    bool restarted = false;
+    while (sim_now_ns() < (uint64_t)duration_ms * 1000000u) {
+        if (!restarted && restart_at_ms > 0 && sim_now_ns() >= (uint64_t)restart_at_ms * 1000000u) {
+            // Restart the 'DMA' (which always starts with the first channel)
+            scoppy_stream_update_stats(stream);
+            sim_written -= sim_written % num_channels;
+            sim_write_base = sim_written;
+            scoppy_stream_restart(stream);
+            restarted = true;
+        }
+
+        if (scoppy_stream_send(stream) == 0) {
+            // nothing to send so wait a bit (like the sampling loop)
+            sim_idle_ns += 100000;
+        }
+        app_parse(app);
+    }
+
+    // Every sample that was captured has been sent, dropped or is still waiting to be sent
+    scoppy_stream_update_stats(stream);
+    struct scoppy_stream_stats *stats = &stream->stats;
+    uint64_t pending = (uint32_t)(sim_get_write_count() - stream->reader.read_count) / num_channels;
+    TASSERT(stats->num_captured == (sim_written / num_channels));
+    TASSERT(stats->num_sent + stats->num_dropped + pending == stats->num_captured);
+
+    // The app got everything that was sent. It might also have got some samples that we counted as dropped because
+    // they were overwritten while being sent (the fake serial port copies them before the simulated time passes).
+    TASSERT(app->num_received >= stats->num_sent);
+    TASSERT(app->num_received <= stats->num_sent + stats->num_dropped);
+    // a new record is started after each gap (several gaps may be reported by the same message) and after a restart
+    TASSERT(app->num_records >= 1 && app->num_records <= 1 + stats->num_drop_events + (restarted ? 1 : 0));
+    TASSERT(app->num_stats_msgs >= duration_ms / 1000 - 1);
+}
+
+static void stream_soak_test() {
+    TPRINTF("stream_soak_test...");
+
+    struct scoppy_stream stream;
+    struct app_state app;
+
+    // Plenty of bandwidth
+    soak(&stream, &app, 50000, 2, 1000000, 5000, 0);
+    TASSERT(stream.stats.num_dropped == 0 && stream.stats.num_drop_events == 0);
+    TASSERT(app.num_received == stream.stats.num_sent);
+    TASSERT(app.num_records == 1);
+    uint32_t delivered = scoppy_stream_stats_delivered_rate(&stream.stats);
+    TASSERT(delivered > 49000 && delivered <= 50000);
+
+    // The link can't keep up. Samples are dropped but every one is accounted for.
+    soak(&stream, &app, 500000, 1, 200000, 5000, 0);
+    TASSERT(stream.stats.num_dropped > 0 && stream.stats.num_drop_events > 0);
+    uint32_t link = scoppy_stream_stats_link_bytes_per_sec(&stream.stats);
+    TASSERT(link > 195000 && link <= 200000);
+    uint32_t max_lossless_rate = scoppy_stream_stats_max_lossless_rate(&stream.stats, 1);
+    TASSERT(max_lossless_rate < 200000 && max_lossless_rate > 190000);
+    TASSERT(app.last_max_lossless_rate > 190000);
+
+    // Just below the rate that the stream said the link would sustain
+    soak(&stream, &app, max_lossless_rate * 98 / 100, 1, 200000, 5000, 0);
+    TASSERT(stream.stats.num_dropped == 0);
+    TASSERT(app.num_received == stream.stats.num_sent);
+
+    // Restarting the DMA part way through
+    soak(&stream, &app, 20000, 2, 1000000, 3000, 1500);
+    TASSERT(app.num_records == 2);
+    soak(&stream, &app, 300000, 2, 400000, 3000, 1234);
+    TASSERT(stream.stats.num_dropped > 0);
+
+    fake_serial_set_write_throttle(0);
+    fake_serial_set_write_buffer(NULL, 0);
+
+    printf("OK\n");
+}
+
+// Logic samples that don't change very often can be streamed at a much higher rate than the link could carry them
+static void stream_edges_test() {
+    TPRINTF("stream_edges_test...");
+
+    struct scoppy_stream stream;
+    struct app_state app;
+    sim_edge_mode = true;
+
+    // 10MS/s over a 200kB/s link
+    sim_edge_run = 997;
+    soak(&stream, &app, 10000000, 1, 200000, 2000, 0);
+    TASSERT(stream.stats.num_dropped == 0);
+    TASSERT(app.num_received == stream.stats.num_sent);
+    TASSERT(app.num_records == 1);
+    TASSERT(stream.stats.num_sent > stream.stats.num_captured - SIM_RING_SIZE);
+
+    // Changing all the time is too much for the link. Samples are dropped but every one is accounted for.
+    sim_edge_run = 1;
+    soak(&stream, &app, 1000000, 1, 200000, 2000, 0);
+    TASSERT(stream.stats.num_dropped > 0);
+
+    // and restarting
+    sim_edge_run = 200;
+    soak(&stream, &app, 5000000, 1, 200000, 2000, 1000);
+    TASSERT(app.num_records == 2);
+
+    sim_edge_mode = false;
+    fake_serial_set_write_throttle(0);
+    fake_serial_set_write_buffer(NULL, 0);
+
+    printf("OK\n");
+}
+
+void run_scoppy_stream_tests() {
+    TPRINTF("run_scoppy_stream_tests...\n");
+    stream_soak_test();
+    stream_edges_test();
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+//
+#include "scoppy-message.h"
+#include "scoppy-telemetry-test.h"
+#include "scoppy-telemetry.h"
+#include "scoppy-test.h"
+#include "scoppy-util/number.h"
+
+static void histogram_bucket_test() {
+    TPRINTF("histogram_bucket_test...");
+
+    TASSERT(scoppy_histogram_bucket(0) == 0);
+    TASSERT(scoppy_histogram_bucket(1) == 1);
+    TASSERT(scoppy_histogram_bucket(2) == 2);
+    TASSERT(scoppy_histogram_bucket(3) == 2);
+    TASSERT(scoppy_histogram_bucket(4) == 3);
+    TASSERT(scoppy_histogram_bucket(1023) == 10);
+    TASSERT(scoppy_histogram_bucket(1024) == 11);
+
+    // Everything too big goes into the last bucket
+    TASSERT(scoppy_histogram_bucket((1u << (SCOPPY_HISTOGRAM_NUM_BUCKETS - 2)) - 1) == SCOPPY_HISTOGRAM_NUM_BUCKETS - 2);
+    TASSERT(scoppy_histogram_bucket(1u << (SCOPPY_HISTOGRAM_NUM_BUCKETS - 2)) == SCOPPY_HISTOGRAM_NUM_BUCKETS - 1);
+    TASSERT(scoppy_histogram_bucket(UINT32_MAX) == SCOPPY_HISTOGRAM_NUM_BUCKETS - 1);
+
+    struct scoppy_histogram hist;
+    scoppy_histogram_clear(&hist);
+    scoppy_histogram_add(&hist, 0);
+    scoppy_histogram_add(&hist, 5);
+    scoppy_histogram_add(&hist, 7);
+    scoppy_histogram_add(&hist, 100000000);
+    TASSERT(hist.count == 4);
+    TASSERT(hist.max == 100000000);
+    TASSERT(hist.buckets[0] == 1);
+    TASSERT(hist.buckets[3] == 2);
+    TASSERT(hist.buckets[SCOPPY_HISTOGRAM_NUM_BUCKETS - 1] == 1);
+
+    printf("OK\n");
+}
+
+static void telemetry_msg_test() {
+    TPRINTF("telemetry_msg_test...");
+
+    struct scoppy_telemetry telemetry;
+    memset(&telemetry, 0xFF, sizeof(telemetry));
+    telemetry.sample_rate = 500000;
+    telemetry.chunk_size = 256;
+    scoppy_telemetry_clear(&telemetry);
+
+    // Clearing keeps the settings
+    TASSERT(telemetry.sample_rate == 500000 && telemetry.chunk_size == 256);
+    TASSERT(telemetry.num_frames == 0 && telemetry.histograms[SCOPPY_TELEMETRY_USB_WRITE].count == 0);
+
+    telemetry.num_frames = 10;
+    telemetry.num_timeouts = 2;
+    telemetry.max_trigger_queue_size = 3;
+    telemetry.num_rle_overruns = 4;
+    scoppy_telemetry_add(&telemetry, SCOPPY_TELEMETRY_TRIGGER_WAIT, 1500);
+    scoppy_telemetry_add(&telemetry, SCOPPY_TELEMETRY_USB_WRITE, 40);
+
+    struct scoppy_telemetry copy;
+    scoppy_telemetry_copy(&copy, &telemetry);
+    TASSERT(memcmp(&copy, &telemetry, sizeof(copy)) == 0);
+
+    struct scoppy_outgoing *msg = scoppy_new_outgoing_telemetry_msg(&copy);
+    TASSERT(msg->msg_type == SCOPPY_OUTGOING_MSG_TYPE_TELEMETRY);
+
+    int hist_size = 8 + 4 * SCOPPY_HISTOGRAM_NUM_BUCKETS;
+    TASSERT(msg->payload_len == 22 + SCOPPY_TELEMETRY_NUM_HISTOGRAMS * hist_size + 4);
+    TASSERT(msg->payload[0] == SCOPPY_TELEMETRY_NUM_HISTOGRAMS);
+    TASSERT(msg->payload[1] == SCOPPY_HISTOGRAM_NUM_BUCKETS);
+    TASSERT(scoppy_uint32_from_4_network_bytes(msg->payload + 2) == 500000);
+    TASSERT(scoppy_uint32_from_4_network_bytes(msg->payload + 6) == 256);
+    TASSERT(scoppy_uint32_from_4_network_bytes(msg->payload + 10) == 10);
+    TASSERT(scoppy_uint32_from_4_network_bytes(msg->payload + 14) == 2);
+    TASSERT(scoppy_uint32_from_4_network_bytes(msg->payload + 18) == 3);
+
+    const uint8_t *trigger_wait = msg->payload + 22 + SCOPPY_TELEMETRY_TRIGGER_WAIT * hist_size;
+    TASSERT(scoppy_uint32_from_4_network_bytes(trigger_wait) == 1);
+    TASSERT(scoppy_uint32_from_4_network_bytes(trigger_wait + 4) == 1500);
+    TASSERT(scoppy_uint32_from_4_network_bytes(trigger_wait + 8 + 4 * scoppy_histogram_bucket(1500)) == 1);
+
+    const uint8_t *usb_write = msg->payload + 22 + SCOPPY_TELEMETRY_USB_WRITE * hist_size;
+    TASSERT(scoppy_uint32_from_4_network_bytes(usb_write + 4) == 40);
+
+    TASSERT(scoppy_uint32_from_4_network_bytes(msg->payload + msg->payload_len - 4) == 4);
+
+    scoppy_release_outgoing(msg);
+
+    printf("OK\n");
+}
+
+void run_scoppy_telemetry_tests() {
+    histogram_bucket_test();
+    telemetry_msg_test();
+}
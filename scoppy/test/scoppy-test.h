@@ -21,5 +21,16 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdlib.h>
 
-#define TPRINTF(x) printf(x);fflush(stdout);
\ No newline at end of file
+#define TPRINTF(x) printf(x);fflush(stdout);
+
+// Like assert() but it is still evaluated and checked when NDEBUG is defined, so a Release build of the tests makes
+// the same calls and checks the same results
+#define TASSERT(x)                                                                                                      \
+    do {                                                                                                                \
+        if (!(x)) {                                                                                                     \
+            fprintf(stderr, "%s:%d: %s: check '%s' failed\n", __FILE__, __LINE__, __func__, #x);                        \
+            abort();                                                                                                    \
+        }                                                                                                               \
+    } while (0)
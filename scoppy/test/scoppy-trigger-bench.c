@@ -0,0 +1,102 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-bench.h"
+#include "scoppy-trigger.h"
+#include "scoppy.h"
+
+//
+// Samples/sec for the trigger kernels. The data never crosses the trigger level so every sample is scanned (this
+// is what happens while waiting for a trigger in normal mode). With hysteresis the rising edge scanner is armed the
+// whole time and the falling edge one never arms so both paths through the hysteresis kernels are measured.
+//
+
+#define BENCH_BUF_SIZE (64 * 1024)
+#define BENCH_ITERATIONS 200
+
+static uint8_t buf[BENCH_BUF_SIZE] __attribute__((aligned(4)));
+static volatile int32_t sink = 0;
+
+#define BENCH_HYSTERESIS 8
+
+static const char *trigger_type_name(uint8_t trigger_type) {
+    static const char *names[] = {"rising", "falling", "pulse", "runt", "window", "slope"};
+    return trigger_type <= TRIGGER_TYPE_LAST ? names[trigger_type] : "?";
+}
+
+static void bench(uint8_t trigger_type, uint8_t num_bytes_per_sample, uint8_t trigger_channel_idx, bool generic, uint8_t hysteresis) {
+    struct scoppy_trigger_scanner scanner;
+    if (generic) {
+        scoppy_trigger_scanner_init_generic(&scanner, trigger_type, 128, num_bytes_per_sample, trigger_channel_idx);
+    } else {
+        scoppy_trigger_scanner_init(&scanner, trigger_type, 128, num_bytes_per_sample, trigger_channel_idx);
+    }
+    scoppy_trigger_scanner_set_hysteresis(&scanner, hysteresis);
+
+    uint32_t num_samples = BENCH_BUF_SIZE / num_bytes_per_sample;
+    uint64_t start = scoppy_bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        scanner.last_sample_value = buf[trigger_channel_idx];
+        scanner.armed = false;
+        sink += scanner.scan(&scanner, buf, num_samples);
+    }
+    uint64_t elapsed = scoppy_bench_now_ns() - start;
+
+    double msamples_per_sec = ((double)num_samples * BENCH_ITERATIONS / 1e6) / ((double)elapsed / 1e9);
+    printf("  %-21s (%-7s, %d bytes/sample, idx=%d): %8.1f MS/s\n", scanner.kernel_name, trigger_type_name(trigger_type), (int)num_bytes_per_sample,
+           (int)trigger_channel_idx, msamples_per_sec);
+
+    char result_name[64];
+    snprintf(result_name, sizeof(result_name), "%s_%s_%dbps_idx%d", scanner.kernel_name, trigger_type_name(trigger_type), (int)num_bytes_per_sample,
+             (int)trigger_channel_idx);
+    uint64_t total_samples = (uint64_t)num_samples * BENCH_ITERATIONS;
+    scoppy_bench_report("trigger-sample", result_name, total_samples, total_samples * num_bytes_per_sample, elapsed);
+}
+
+void run_scoppy_trigger_bench() {
+    printf("scoppy-trigger-bench:\n");
+
+    // all values are below the trigger level so a trigger is never found
+    srand(1);
+    for (int i = 0; i < BENCH_BUF_SIZE; i++) {
+        buf[i] = rand() % 100;
+    }
+
+    for (uint8_t trigger_type = TRIGGER_TYPE_RISING_EDGE; trigger_type <= TRIGGER_TYPE_FALLING_EDGE; trigger_type++) {
+        bench(trigger_type, 1, 0, true, 0);
+        bench(trigger_type, 1, 0, false, 0);
+        bench(trigger_type, 2, 0, true, 0);
+        bench(trigger_type, 2, 0, false, 0);
+        bench(trigger_type, 2, 1, false, 0);
+        bench(trigger_type, 1, 0, true, BENCH_HYSTERESIS);
+        bench(trigger_type, 1, 0, false, BENCH_HYSTERESIS);
+        bench(trigger_type, 2, 0, false, BENCH_HYSTERESIS);
+    }
+
+    // The state machine triggers
+    for (uint8_t trigger_type = TRIGGER_TYPE_PULSE_WIDTH; trigger_type <= TRIGGER_TYPE_SLOPE; trigger_type++) {
+        bench(trigger_type, 1, 0, false, 0);
+        bench(trigger_type, 2, 1, false, 0);
+    }
+}
@@ -0,0 +1,277 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-test.h"
+#include "scoppy-trigger-dispatch-test.h"
+#include "scoppy-trigger-dispatch.h"
+#include "scoppy.h"
+
+#define MAX_CHUNKS 64
+#define MAX_CHUNK_SIZE 96
+
+// A frame's worth of chunks. They're laid out in a random order in memory (like a ring buffer that has wrapped or the
+// two buffers in dual buffer mode) so the sample before a chunk isn't the byte before it.
+struct dispatch_test_frame {
+    uint8_t trigger_type;
+    uint8_t trigger_level;
+    uint8_t num_bytes_per_sample;
+    uint8_t trigger_channel_idx;
+    uint32_t samples_per_chunk;
+    int num_chunks;
+    const uint8_t *chunks[MAX_CHUNKS];
+    bool restarts[MAX_CHUNKS];
+
+    // The first trigger found by scanning the chunks one after the other. -1 if there isn't one.
+    int expected_chunk;
+    int32_t expected_sample_idx;
+};
+
+static uint8_t frame_buf[MAX_CHUNKS * MAX_CHUNK_SIZE];
+
+static void make_frame(struct dispatch_test_frame *frame) {
+    frame->trigger_type = rand() % 2;
+    frame->trigger_level = rand() % 256;
+    frame->num_bytes_per_sample = 1 + rand() % 3;
+    frame->trigger_channel_idx = rand() % frame->num_bytes_per_sample;
+    frame->samples_per_chunk = 1 + rand() % (MAX_CHUNK_SIZE / frame->num_bytes_per_sample);
+    frame->num_chunks = 1 + rand() % MAX_CHUNKS;
+
+    // Noise around a level that sometimes jumps so that most chunks don't have a trigger
+    int value = rand() % 256;
+    int noise_range = 1 + rand() % 16;
+    int jump_odds = 50 + rand() % 3000;
+    for (int i = 0; i < sizeof(frame_buf); i++) {
+        if (rand() % jump_odds == 0) {
+            value = rand() % 256;
+        }
+        int v = value + (rand() % noise_range) - noise_range / 2;
+        frame_buf[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+    }
+
+    // A random order in memory
+    int order[MAX_CHUNKS];
+    for (int i = 0; i < MAX_CHUNKS; i++) {
+        order[i] = i;
+    }
+    for (int i = MAX_CHUNKS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (int i = 0; i < frame->num_chunks; i++) {
+        frame->chunks[i] = frame_buf + order[i] * MAX_CHUNK_SIZE;
+        frame->restarts[i] = i == 0 || rand() % 20 == 0;
+    }
+
+    // What a single core would find
+    struct scoppy_trigger_scanner scanner;
+    scoppy_trigger_scanner_init(&scanner, frame->trigger_type, frame->trigger_level, frame->num_bytes_per_sample, frame->trigger_channel_idx);
+    frame->expected_chunk = -1;
+    frame->expected_sample_idx = -1;
+    for (int i = 0; i < frame->num_chunks; i++) {
+        if (frame->restarts[i]) {
+            scoppy_trigger_scanner_restart(&scanner, frame->chunks[i][frame->trigger_channel_idx]);
+        }
+        int32_t idx = scanner.scan(&scanner, frame->chunks[i], frame->samples_per_chunk);
+        if (idx >= 0) {
+            frame->expected_chunk = i;
+            frame->expected_sample_idx = idx;
+            break;
+        }
+    }
+}
+
+static void start_frame(struct scoppy_trigger_dispatch *dispatch, struct dispatch_test_frame *frame) {
+    struct scoppy_trigger_scanner scanner;
+    scoppy_trigger_scanner_init(&scanner, frame->trigger_type, frame->trigger_level, frame->num_bytes_per_sample, frame->trigger_channel_idx);
+    scoppy_trigger_dispatch_start(dispatch, &scanner, frame->samples_per_chunk);
+}
+
+// Run the owner's side of a search. help_odds is how often (1 in help_odds) to call the helper from the same thread and
+// yield_odds how often to give a helper thread a chance to run (like an interrupt on the owner's core). 0 for never.
+static void search_frame(struct scoppy_trigger_dispatch *dispatch, struct dispatch_test_frame *frame, int help_odds, int yield_odds) {
+    start_frame(dispatch, frame);
+
+    int next_chunk = 0;
+    const uint8_t *trigger_chunk = NULL;
+    int32_t trigger_sample_idx = -1;
+    bool found = false;
+    while (!found && (int)scoppy_trigger_dispatch_num_completed(dispatch) < frame->num_chunks) {
+        // Publish a few chunks at a time like the dma handlers would add them to the queue
+        int n = rand() % 4;
+        while (n-- > 0 && next_chunk < frame->num_chunks && !scoppy_trigger_dispatch_is_full(dispatch)) {
+            scoppy_trigger_dispatch_publish(dispatch, frame->chunks[next_chunk], frame->restarts[next_chunk]);
+            next_chunk++;
+        }
+        if (help_odds > 0 && rand() % help_odds == 0) {
+            scoppy_trigger_dispatch_help(dispatch);
+        }
+        if (yield_odds > 0 && rand() % yield_odds == 0) {
+            sched_yield();
+        }
+        found = scoppy_trigger_dispatch_work(dispatch, &trigger_chunk, &trigger_sample_idx);
+    }
+    scoppy_trigger_dispatch_stop(dispatch);
+
+    if (frame->expected_chunk < 0) {
+        TASSERT(!found);
+        TASSERT((int)scoppy_trigger_dispatch_num_completed(dispatch) == frame->num_chunks);
+    } else {
+        TASSERT(found);
+        TASSERT(trigger_chunk == frame->chunks[frame->expected_chunk]);
+        TASSERT(trigger_sample_idx == frame->expected_sample_idx);
+        TASSERT((int)scoppy_trigger_dispatch_num_completed(dispatch) == frame->expected_chunk + 1);
+    }
+}
+
+static void trigger_dispatch_basic_test() {
+    TPRINTF("trigger_dispatch_basic_test...");
+
+    static struct scoppy_trigger_dispatch dispatch;
+    scoppy_trigger_dispatch_init(&dispatch);
+
+    struct scoppy_trigger_scanner scanner;
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 100, 1, 0);
+    TASSERT(scoppy_trigger_dispatch_supports(&scanner));
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 5);
+    TASSERT(!scoppy_trigger_dispatch_supports(&scanner));
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_PULSE_WIDTH, 100, 1, 0);
+    TASSERT(!scoppy_trigger_dispatch_supports(&scanner));
+
+    // The edge is between the chunks, which aren't next to each other in memory
+    uint8_t buf[] = {150, 160, 170, 180, 10, 20, 30, 40};
+    const uint8_t *trigger_chunk;
+    int32_t trigger_sample_idx;
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 100, 1, 0);
+    scoppy_trigger_dispatch_start(&dispatch, &scanner, 4);
+    scoppy_trigger_dispatch_publish(&dispatch, buf + 4, true);
+    scoppy_trigger_dispatch_publish(&dispatch, buf, false);
+    TASSERT(dispatch.chunks[1].last_sample_value == 40);
+
+    // The helper takes the second chunk
+    TASSERT(scoppy_trigger_dispatch_help(&dispatch) == 1);
+    TASSERT(scoppy_trigger_dispatch_work(&dispatch, &trigger_chunk, &trigger_sample_idx));
+    TASSERT(trigger_chunk == buf && trigger_sample_idx == 0);
+    TASSERT(scoppy_trigger_dispatch_num_completed(&dispatch) == 2);
+    TASSERT(scoppy_trigger_dispatch_trigger_chunk_last_sample_value(&dispatch) == 40);
+    scoppy_trigger_dispatch_stop(&dispatch);
+    TASSERT(dispatch.num_helper_chunks_scanned == 1);
+
+    // Not after a restart
+    scoppy_trigger_dispatch_start(&dispatch, &scanner, 4);
+    scoppy_trigger_dispatch_publish(&dispatch, buf + 4, true);
+    scoppy_trigger_dispatch_publish(&dispatch, buf, true);
+    // Without the helper the owner scans them both, one at a time
+    TASSERT(!scoppy_trigger_dispatch_work(&dispatch, &trigger_chunk, &trigger_sample_idx));
+    TASSERT(scoppy_trigger_dispatch_num_completed(&dispatch) == 1);
+    TASSERT(!scoppy_trigger_dispatch_work(&dispatch, &trigger_chunk, &trigger_sample_idx));
+    TASSERT(scoppy_trigger_dispatch_num_completed(&dispatch) == 2);
+
+    // The owner already has them all so there's nothing for the helper
+    TASSERT(scoppy_trigger_dispatch_help(&dispatch) == 0);
+    scoppy_trigger_dispatch_stop(&dispatch);
+
+    // Nothing to help with once the search has stopped
+    TASSERT(scoppy_trigger_dispatch_help(&dispatch) == 0);
+
+    printf("OK\n");
+}
+
+// Any mix of owner and helper must find the same trigger as a single core
+static void trigger_dispatch_random_test() {
+    TPRINTF("trigger_dispatch_random_test...");
+
+    static struct scoppy_trigger_dispatch dispatch;
+    static struct dispatch_test_frame frame;
+    scoppy_trigger_dispatch_init(&dispatch);
+    srand(2468);
+
+    uint32_t num_helper_chunks = 0;
+    for (int iteration = 0; iteration < 5000; iteration++) {
+        make_frame(&frame);
+        search_frame(&dispatch, &frame, iteration % 4, 0);
+        num_helper_chunks += dispatch.num_helper_chunks_scanned;
+    }
+    TASSERT(num_helper_chunks > 0);
+
+    printf("OK\n");
+}
+
+#define THREAD_TEST_NUM_FRAMES 3000
+
+static struct scoppy_trigger_dispatch thread_test_dispatch;
+static bool thread_test_done;
+
+// Like the core0 loop
+static void *helper_thread(void *arg) {
+    unsigned int seed = 97531;
+    uint32_t num_scanned = 0;
+    while (!__atomic_load_n(&thread_test_done, __ATOMIC_ACQUIRE)) {
+        num_scanned += scoppy_trigger_dispatch_help(&thread_test_dispatch);
+        if (rand_r(&seed) % 8 == 0) {
+            sched_yield();
+        }
+    }
+    return (void *)(uintptr_t)num_scanned;
+}
+
+static void trigger_dispatch_thread_test() {
+    TPRINTF("trigger_dispatch_thread_test...");
+
+    static struct dispatch_test_frame frame;
+    scoppy_trigger_dispatch_init(&thread_test_dispatch);
+    thread_test_done = false;
+    srand(1357);
+
+    pthread_t helper;
+    int err = pthread_create(&helper, NULL, helper_thread, NULL);
+    TASSERT(err == 0);
+
+    uint32_t num_helper_chunks = 0;
+    for (int i = 0; i < THREAD_TEST_NUM_FRAMES; i++) {
+        make_frame(&frame);
+        search_frame(&thread_test_dispatch, &frame, 0, 4);
+        num_helper_chunks += thread_test_dispatch.num_helper_chunks_scanned;
+    }
+
+    __atomic_store_n(&thread_test_done, true, __ATOMIC_RELEASE);
+    void *num_scanned;
+    pthread_join(helper, &num_scanned);
+
+    // Every chunk the helper scanned was counted in a frame
+    TASSERT((uintptr_t)num_scanned == num_helper_chunks);
+    TASSERT(num_helper_chunks > 0);
+
+    printf("OK (helper scanned %lu chunks)\n", (unsigned long)num_helper_chunks);
+}
+
+void run_scoppy_trigger_dispatch_tests() {
+    TPRINTF("run_scoppy_trigger_dispatch_tests...\n");
+    trigger_dispatch_basic_test();
+    trigger_dispatch_random_test();
+    trigger_dispatch_thread_test();
+}
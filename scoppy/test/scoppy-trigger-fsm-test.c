@@ -0,0 +1,303 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-test.h"
+#include "scoppy-trigger-fsm-test.h"
+#include "scoppy-trigger-fsm.h"
+#include "scoppy-trigger.h"
+#include "scoppy.h"
+
+#define WAVEFORM_SIZE 2000
+#define MAX_TRIGGERS 512
+
+static uint8_t waveform[WAVEFORM_SIZE];
+
+static void fill(uint8_t value) { memset(waveform, value, sizeof(waveform)); }
+
+static void pulse(int start, int width, uint8_t value) { memset(waveform + start, value, width); }
+
+// A straight line from 'from' to 'to' over num_samples samples
+static void ramp(int start, int num_samples, uint8_t from, uint8_t to) {
+    for (int i = 0; i < num_samples; i++) {
+        waveform[start + i] = (uint8_t)(from + ((int)to - (int)from) * i / (num_samples - 1));
+    }
+}
+
+// Scan the whole waveform (in pieces of chunk_size samples) and return the index of every trigger
+static int find_triggers(uint8_t trigger_type, uint8_t level, const struct scoppy_trigger_fsm_params *params, uint32_t chunk_size,
+                         int32_t *triggers) {
+    struct scoppy_trigger_fsm fsm;
+    scoppy_trigger_fsm_init(&fsm, trigger_type, level, params);
+    fsm.last_sample_value = waveform[0];
+
+    int num_triggers = 0;
+    uint32_t done = 0;
+    while (done < WAVEFORM_SIZE) {
+        uint32_t n = WAVEFORM_SIZE - done < chunk_size ? WAVEFORM_SIZE - done : chunk_size;
+        int32_t idx = scoppy_trigger_fsm_scan(&fsm, waveform + done, n, 1);
+        if (idx >= 0) {
+            TASSERT(num_triggers < MAX_TRIGGERS);
+            triggers[num_triggers++] = done + idx;
+            done += idx + 1;
+        } else {
+            done += n;
+        }
+        TASSERT(fsm.sample_idx == done);
+    }
+    return num_triggers;
+}
+
+static uint8_t options(bool negative, uint8_t condition) {
+    return (negative ? SCOPPY_TRIGGER_OPTION_NEGATIVE : 0) | (condition << SCOPPY_TRIGGER_OPTION_CONDITION_SHIFT);
+}
+
+static void pulse_width_test() {
+    TPRINTF("pulse_width_test...");
+
+    int32_t triggers[MAX_TRIGGERS];
+
+    // positive pulses 3, 10 and 50 samples wide
+    fill(20);
+    pulse(100, 3, 200);
+    pulse(300, 10, 200);
+    pulse(600, 50, 200);
+
+    struct scoppy_trigger_fsm_params params = {.options = options(false, SCOPPY_TRIGGER_CONDITION_GREATER), .time_min = 20};
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, &params, 64, triggers) == 1 && triggers[0] == 650);
+
+    // a glitch
+    params.options = options(false, SCOPPY_TRIGGER_CONDITION_LESS);
+    params.time_max = 5;
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, &params, 64, triggers) == 1 && triggers[0] == 103);
+
+    params.options = options(false, SCOPPY_TRIGGER_CONDITION_IN_RANGE);
+    params.time_min = 10;
+    params.time_max = 10;
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, &params, 7, triggers) == 1 && triggers[0] == 310);
+
+    // no negative pulses (the gaps between the positive ones are only measured once the signal has gone high first)
+    params.options = options(true, SCOPPY_TRIGGER_CONDITION_LESS);
+    params.time_max = 5;
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, &params, 64, triggers) == 0);
+
+    // negative pulses
+    fill(200);
+    pulse(100, 3, 20);
+    pulse(300, 10, 20);
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, &params, 64, triggers) == 1 && triggers[0] == 103);
+
+    // without params any pulse will do
+    fill(20);
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, NULL, 1, triggers) == 0);
+    pulse(100, 3, 200);
+    pulse(300, 10, 200);
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, NULL, 1, triggers) == 2 && triggers[0] == 103 && triggers[1] == 310);
+
+    // a pulse that is still going at the end of the waveform doesn't count
+    pulse(1990, 10, 200);
+    TASSERT(find_triggers(TRIGGER_TYPE_PULSE_WIDTH, 128, NULL, 64, triggers) == 2);
+
+    printf("OK\n");
+}
+
+static void runt_test() {
+    TPRINTF("runt_test...");
+
+    int32_t triggers[MAX_TRIGGERS];
+
+    // normal pulses and a runt that only gets to 120
+    fill(20);
+    pulse(100, 10, 200);
+    pulse(300, 10, 120);
+    pulse(500, 10, 200);
+    // 2 steps up to the upper level is a normal pulse
+    pulse(700, 5, 150);
+    pulse(705, 5, 200);
+
+    // the levels can be either way round
+    struct scoppy_trigger_fsm_params params = {.level2 = 180, .options = options(false, SCOPPY_TRIGGER_CONDITION_GREATER), .time_min = 0};
+    TASSERT(find_triggers(TRIGGER_TYPE_RUNT, 100, &params, 64, triggers) == 1 && triggers[0] == 310);
+    params.level2 = 100;
+    TASSERT(find_triggers(TRIGGER_TYPE_RUNT, 180, &params, 3, triggers) == 1 && triggers[0] == 310);
+
+    // runts that are too short
+    params.time_min = 20;
+    TASSERT(find_triggers(TRIGGER_TYPE_RUNT, 180, &params, 64, triggers) == 0);
+
+    // negative runt
+    fill(200);
+    pulse(100, 10, 20);
+    pulse(300, 10, 150);
+    params.options = options(true, SCOPPY_TRIGGER_CONDITION_GREATER);
+    params.time_min = 0;
+    TASSERT(find_triggers(TRIGGER_TYPE_RUNT, 180, &params, 64, triggers) == 1 && triggers[0] == 310);
+
+    printf("OK\n");
+}
+
+static void window_test() {
+    TPRINTF("window_test...");
+
+    int32_t triggers[MAX_TRIGGERS];
+
+    fill(20);
+    pulse(100, 10, 120);
+    pulse(300, 10, 200);
+    // straight through the window without stopping
+    waveform[500] = 250;
+    waveform[501] = 10;
+
+    struct scoppy_trigger_fsm_params params = {.level2 = 150};
+    TASSERT(find_triggers(TRIGGER_TYPE_WINDOW, 100, &params, 64, triggers) == 1 && triggers[0] == 100);
+
+    params.options = SCOPPY_TRIGGER_OPTION_WINDOW_EXIT;
+    TASSERT(find_triggers(TRIGGER_TYPE_WINDOW, 100, &params, 64, triggers) == 1 && triggers[0] == 110);
+
+    // the levels are inside the window
+    fill(100);
+    pulse(100, 10, 99);
+    pulse(300, 10, 151);
+    params.options = 0;
+    TASSERT(find_triggers(TRIGGER_TYPE_WINDOW, 100, &params, 5, triggers) == 2 && triggers[0] == 110 && triggers[1] == 310);
+
+    printf("OK\n");
+}
+
+static void slope_test() {
+    TPRINTF("slope_test...");
+
+    int32_t triggers[MAX_TRIGGERS];
+
+    // Rising edges from 0 to 250 taking 11, 51 and 2 samples. Crossing 50 -> 200 takes about 60% of that.
+    fill(0);
+    ramp(100, 11, 0, 250);
+    pulse(111, 50, 250);
+    ramp(300, 51, 0, 250);
+    pulse(351, 50, 250);
+    ramp(600, 2, 0, 250);
+    pulse(602, 50, 250);
+    // starts to rise but goes back down
+    ramp(800, 11, 0, 100);
+
+    struct scoppy_trigger_fsm_params params = {.level2 = 200, .options = options(false, SCOPPY_TRIGGER_CONDITION_GREATER), .time_min = 20};
+    TASSERT(find_triggers(TRIGGER_TYPE_SLOPE, 50, &params, 64, triggers) == 1 && triggers[0] == 300 + 40);
+
+    params.options = options(false, SCOPPY_TRIGGER_CONDITION_IN_RANGE);
+    params.time_min = 5;
+    params.time_max = 7;
+    TASSERT(find_triggers(TRIGGER_TYPE_SLOPE, 50, &params, 64, triggers) == 1 && triggers[0] == 100 + 8);
+
+    // both levels in one sample
+    params.options = options(false, SCOPPY_TRIGGER_CONDITION_LESS);
+    params.time_max = 1;
+    TASSERT(find_triggers(TRIGGER_TYPE_SLOPE, 50, &params, 64, triggers) == 1 && triggers[0] == 601);
+
+    // falling edges
+    params.options = options(true, SCOPPY_TRIGGER_CONDITION_IN_RANGE);
+    params.time_min = 0;
+    params.time_max = 1000;
+    TASSERT(find_triggers(TRIGGER_TYPE_SLOPE, 50, &params, 1, triggers) == 3 && triggers[0] == 161 && triggers[1] == 401 && triggers[2] == 652);
+
+    printf("OK\n");
+}
+
+// The scanner uses the state machine for these trigger types. The trigger channel can be any byte of the sample.
+static void fsm_scanner_test() {
+    TPRINTF("fsm_scanner_test...");
+
+    static uint8_t samples[WAVEFORM_SIZE * 2];
+    fill(20);
+    pulse(100, 3, 200);
+    pulse(600, 50, 200);
+    for (int i = 0; i < WAVEFORM_SIZE; i++) {
+        samples[i * 2] = (uint8_t)rand();
+        samples[i * 2 + 1] = waveform[i];
+    }
+
+    struct scoppy_trigger_scanner scanner;
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_PULSE_WIDTH, 128, 2, 1);
+    TASSERT(strcmp(scanner.kernel_name, "fsm") == 0);
+    struct scoppy_trigger_fsm_params params = {.options = options(false, SCOPPY_TRIGGER_CONDITION_GREATER), .time_min = 20};
+    scoppy_trigger_scanner_set_fsm_params(&scanner, &params);
+    scanner.last_sample_value = samples[1];
+
+    uint32_t samples_per_chunk = 128;
+    int32_t trigger_idx = -1;
+    for (uint32_t c = 0; c < WAVEFORM_SIZE / samples_per_chunk && trigger_idx < 0; c++) {
+        int32_t idx = scanner.scan(&scanner, samples + c * samples_per_chunk * 2, samples_per_chunk);
+        if (idx >= 0) {
+            trigger_idx = c * samples_per_chunk + idx;
+        }
+    }
+    TASSERT(trigger_idx == 650);
+    TASSERT(scanner.fsm.last_duration == 50);
+
+    printf("OK\n");
+}
+
+// Random signals scanned in random sized pieces find the same triggers as scanning a sample at a time
+static void fsm_random_test() {
+    TPRINTF("fsm_random_test...");
+
+    srand(2468);
+    int32_t expected[MAX_TRIGGERS], triggers[MAX_TRIGGERS];
+
+    for (int iteration = 0; iteration < 2000; iteration++) {
+        // a square-ish wave with random widths, levels and the odd glitch
+        int i = 0;
+        while (i < WAVEFORM_SIZE) {
+            int width = 1 + rand() % 150;
+            uint8_t value = (uint8_t)rand();
+            for (int j = 0; j < width && i < WAVEFORM_SIZE; j++, i++) {
+                waveform[i] = rand() % 50 == 0 ? (uint8_t)rand() : value;
+            }
+        }
+
+        uint8_t trigger_type = TRIGGER_TYPE_PULSE_WIDTH + rand() % 4;
+        uint8_t level = (uint8_t)rand();
+        struct scoppy_trigger_fsm_params params = {
+            .level2 = (uint8_t)rand(),
+            .options = (uint8_t)(rand() % 4) | (uint8_t)((rand() % 3) << SCOPPY_TRIGGER_OPTION_CONDITION_SHIFT),
+            .time_min = rand() % 100,
+            .time_max = rand() % 200,
+        };
+
+        int num_expected = find_triggers(trigger_type, level, &params, 1, expected);
+        int num_triggers = find_triggers(trigger_type, level, &params, 1 + rand() % 300, triggers);
+        TASSERT(num_triggers == num_expected);
+        TASSERT(memcmp(triggers, expected, num_triggers * sizeof(triggers[0])) == 0);
+    }
+
+    printf("OK\n");
+}
+
+void run_scoppy_trigger_fsm_tests() {
+    TPRINTF("run_scoppy_trigger_fsm_tests...\n");
+    pulse_width_test();
+    runt_test();
+    window_test();
+    slope_test();
+    fsm_scanner_test();
+    fsm_random_test();
+}
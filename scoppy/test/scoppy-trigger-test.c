@@ -0,0 +1,340 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+#include "scoppy-test.h"
+#include "scoppy-trigger-test.h"
+#include "scoppy-trigger.h"
+#include "scoppy.h"
+
+static void trigger_basic_test() {
+    TPRINTF("trigger_basic_test...");
+
+    struct scoppy_trigger_scanner scanner;
+
+    // 1 channel, rising edge
+    uint8_t samples1[] = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 55, 1, 0);
+    TASSERT(strcmp(scanner.kernel_name, "rising_1ch") == 0);
+    scanner.last_sample_value = samples1[0];
+    TASSERT(scanner.scan(&scanner, samples1, sizeof(samples1)) == 5);
+
+    // the level itself counts as crossing for a rising edge
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 60, 1, 0);
+    scanner.last_sample_value = samples1[0];
+    TASSERT(scanner.scan(&scanner, samples1, sizeof(samples1)) == 5);
+
+    // no falling edge
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 55, 1, 0);
+    TASSERT(strcmp(scanner.kernel_name, "falling_1ch") == 0);
+    scanner.last_sample_value = samples1[0];
+    TASSERT(scanner.scan(&scanner, samples1, sizeof(samples1)) == -1);
+    TASSERT(scanner.last_sample_value == 100);
+
+    // the edge is between 2 chunks
+    scanner.last_sample_value = 100;
+    uint8_t samples2[] = {50, 40};
+    TASSERT(scanner.scan(&scanner, samples2, sizeof(samples2)) == 0);
+
+    // 2 channels, trigger on the second channel
+    uint8_t samples3[] = {0, 200, 255, 200, 0, 100, 255, 50};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 150, 2, 1);
+    TASSERT(strcmp(scanner.kernel_name, "falling_2ch_idx1") == 0);
+    scanner.last_sample_value = samples3[1];
+    TASSERT(scanner.scan(&scanner, samples3, 4) == 2);
+
+    // 3 channels use the generic kernel
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 150, 3, 1);
+    TASSERT(strcmp(scanner.kernel_name, "generic") == 0);
+
+    printf("OK\n");
+}
+
+// The specialised kernels must give exactly the same results as the generic kernel
+static void trigger_random_test() {
+    TPRINTF("trigger_random_test...");
+
+    static uint8_t buf[1024 + 8];
+    srand(5678);
+
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        uint8_t trigger_type = rand() % 2;
+        uint8_t num_bytes_per_sample = 1 + rand() % 3;
+        uint8_t trigger_channel_idx = rand() % num_bytes_per_sample;
+        uint8_t trigger_level;
+        switch (rand() % 4) {
+        case 0:
+            trigger_level = 0;
+            break;
+        case 1:
+            trigger_level = 255;
+            break;
+        default:
+            trigger_level = rand() % 256;
+            break;
+        }
+
+        // Sometimes random noise, sometimes values close to the trigger level
+        bool noisy = rand() % 2;
+        for (int i = 0; i < sizeof(buf); i++) {
+            buf[i] = noisy ? (uint8_t)rand() : (uint8_t)(trigger_level + (rand() % 5) - 2);
+        }
+
+        // random alignment and length
+        const uint8_t *chunk = buf + rand() % 4;
+        uint32_t num_samples = rand() % (1024 / num_bytes_per_sample);
+        uint8_t last_sample_value = (uint8_t)rand();
+
+        struct scoppy_trigger_scanner scanner, generic;
+        scoppy_trigger_scanner_init(&scanner, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx);
+        scoppy_trigger_scanner_init_generic(&generic, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx);
+        scanner.last_sample_value = last_sample_value;
+        generic.last_sample_value = last_sample_value;
+
+        // scan in a few pieces to check that the last sample value is carried over correctly
+        uint32_t done = 0;
+        while (done < num_samples) {
+            uint32_t n = 1 + rand() % (num_samples - done);
+            const uint8_t *addr = chunk + done * num_bytes_per_sample;
+            int32_t idx = scanner.scan(&scanner, addr, n);
+            int32_t expected_idx = generic.scan(&generic, addr, n);
+            TASSERT(idx == expected_idx);
+            if (idx >= 0) {
+                break;
+            }
+            TASSERT(scanner.last_sample_value == generic.last_sample_value);
+            done += n;
+        }
+    }
+
+    printf("OK\n");
+}
+
+static void trigger_hysteresis_test() {
+    TPRINTF("trigger_hysteresis_test...");
+
+    struct scoppy_trigger_scanner scanner;
+
+    // Noise around the level and then a real rising edge
+    uint8_t samples[] = {100, 98, 101, 99, 102, 97, 90, 95, 99, 100, 104, 120, 150, 110, 95};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 100, 1, 0);
+    scanner.last_sample_value = samples[0];
+    TASSERT(scanner.scan(&scanner, samples, sizeof(samples)) == 2);
+
+    // Arms at sample 6 (90 < 100 - 5) and fires on the next crossing
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 100, 1, 0);
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 5);
+    TASSERT(strcmp(scanner.kernel_name, "rising_1ch_hyst") == 0);
+    TASSERT(scanner.arm_level == 95);
+    scanner.last_sample_value = samples[0];
+    TASSERT(scanner.scan(&scanner, samples, sizeof(samples)) == 9);
+
+    // Too much hysteresis for this signal
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 20);
+    scanner.last_sample_value = samples[0];
+    TASSERT(scanner.scan(&scanner, samples, sizeof(samples)) == -1);
+    TASSERT(!scanner.armed);
+
+    // Falling edge. The armed state is carried over to the next chunk.
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 100, 1, 0);
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 10);
+    TASSERT(strcmp(scanner.kernel_name, "falling_1ch_hyst") == 0);
+    scanner.last_sample_value = samples[0];
+    TASSERT(scanner.scan(&scanner, samples, 13) == -1);
+    TASSERT(scanner.armed);
+    TASSERT(scanner.scan(&scanner, samples + 13, 2) == 1);
+
+    // The band is clamped to the range of the adc
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 10, 1, 0);
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 50);
+    TASSERT(scanner.arm_level == 1);
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 250, 1, 0);
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 50);
+    TASSERT(scanner.arm_level == 254);
+
+    // Turning it off again selects the normal kernel
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 0);
+    TASSERT(strcmp(scanner.kernel_name, "falling_1ch") == 0);
+
+    // The generic kernel stays generic
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 150, 3, 1);
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 3);
+    TASSERT(strcmp(scanner.kernel_name, "generic_hyst") == 0);
+
+    printf("OK\n");
+}
+
+// The specialised hysteresis kernels must give exactly the same results as the generic kernel
+static void trigger_hysteresis_random_test() {
+    TPRINTF("trigger_hysteresis_random_test...");
+
+    static uint8_t buf[2048 + 8];
+    srand(4321);
+
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        uint8_t trigger_type = rand() % 2;
+        uint8_t num_bytes_per_sample = 1 + rand() % 3;
+        uint8_t trigger_channel_idx = rand() % num_bytes_per_sample;
+        uint8_t trigger_level = rand() % 4 == 0 ? 255 * (rand() % 2) : rand() % 256;
+        uint8_t hysteresis = rand() % 4 == 0 ? rand() % 256 : rand() % 16;
+
+        // Noise around a level that sometimes jumps
+        int value = rand() % 256;
+        int noise_range = 1 + rand() % 32;
+        for (int i = 0; i < sizeof(buf); i++) {
+            if (rand() % 300 == 0) {
+                value = rand() % 256;
+            }
+            int v = value + (rand() % noise_range) - noise_range / 2;
+            buf[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+        }
+
+        const uint8_t *chunk = buf + rand() % 4;
+        uint32_t samples_per_chunk = 1 + rand() % 64;
+        uint32_t num_chunks = 2048 / (samples_per_chunk * num_bytes_per_sample);
+
+        struct scoppy_trigger_scanner scanner, generic;
+        scoppy_trigger_scanner_init(&scanner, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx);
+        scoppy_trigger_scanner_init_generic(&generic, trigger_type, trigger_level, num_bytes_per_sample, trigger_channel_idx);
+        scoppy_trigger_scanner_set_hysteresis(&scanner, hysteresis);
+        scoppy_trigger_scanner_set_hysteresis(&generic, hysteresis);
+        scanner.last_sample_value = generic.last_sample_value = chunk[trigger_channel_idx];
+
+        for (uint32_t c = 0; c < num_chunks; c++) {
+            const uint8_t *addr = chunk + c * samples_per_chunk * num_bytes_per_sample;
+            int32_t idx = scanner.scan(&scanner, addr, samples_per_chunk);
+            int32_t expected_idx = generic.scan(&generic, addr, samples_per_chunk);
+            TASSERT(idx == expected_idx);
+            if (idx >= 0) {
+                // a real crossing of the level
+                uint8_t prev = idx > 0 ? addr[(idx - 1) * num_bytes_per_sample + trigger_channel_idx] : generic.last_sample_value;
+                uint8_t cur = addr[idx * num_bytes_per_sample + trigger_channel_idx];
+                TASSERT(trigger_type == TRIGGER_TYPE_RISING_EDGE ? (prev < trigger_level && cur >= trigger_level)
+                                                                : (prev > trigger_level && cur <= trigger_level));
+                break;
+            }
+            TASSERT(scanner.last_sample_value == generic.last_sample_value);
+            TASSERT(scanner.armed == generic.armed);
+        }
+    }
+
+    printf("OK\n");
+}
+
+// Restarting after a gap between chunks (skipped chunks) mustn't find an edge across the gap
+static void trigger_restart_test() {
+    TPRINTF("trigger_restart_test...");
+
+    struct scoppy_trigger_scanner scanner;
+
+    // Without a restart the gap between 10 and 200 looks like a rising edge
+    uint8_t before[] = {10, 10, 10, 10};
+    uint8_t after[] = {200, 210, 220, 230};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 100, 1, 0);
+    scanner.last_sample_value = before[0];
+    TASSERT(scanner.scan(&scanner, before, sizeof(before)) == -1);
+    TASSERT(scanner.scan(&scanner, after, sizeof(after)) == 0);
+
+    scanner.last_sample_value = before[0];
+    TASSERT(scanner.scan(&scanner, before, sizeof(before)) == -1);
+    scoppy_trigger_scanner_restart(&scanner, after[0]);
+    TASSERT(scanner.last_sample_value == 200);
+    TASSERT(scanner.scan(&scanner, after, sizeof(after)) == -1);
+
+    // The hysteresis arming isn't carried over the gap
+    uint8_t low[] = {50, 50, 50, 50};
+    uint8_t crossing[] = {99, 100, 101, 102};
+    scoppy_trigger_scanner_set_hysteresis(&scanner, 5);
+    scanner.last_sample_value = low[0];
+    TASSERT(scanner.scan(&scanner, low, sizeof(low)) == -1);
+    TASSERT(scanner.armed);
+    scoppy_trigger_scanner_restart(&scanner, crossing[0]);
+    TASSERT(!scanner.armed);
+    TASSERT(scanner.scan(&scanner, crossing, sizeof(crossing)) == -1);
+
+    // Nor is a pulse that was in progress
+    uint8_t pulse_start[] = {0, 0, 200, 200};
+    uint8_t pulse_end[] = {200, 0, 0, 0};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_PULSE_WIDTH, 100, 1, 0);
+    scoppy_trigger_scanner_set_fsm_params(&scanner, NULL);
+    scanner.last_sample_value = pulse_start[0];
+    TASSERT(scanner.scan(&scanner, pulse_start, sizeof(pulse_start)) == -1);
+    TASSERT(scanner.fsm.active);
+    scoppy_trigger_scanner_restart(&scanner, pulse_end[0]);
+    TASSERT(!scanner.fsm.active);
+    TASSERT(scanner.scan(&scanner, pulse_end, sizeof(pulse_end)) == -1);
+
+    printf("OK\n");
+}
+
+static void trigger_crossing_fraction_test() {
+    TPRINTF("trigger_crossing_fraction_test...");
+
+    struct scoppy_trigger_scanner scanner;
+
+    // 100 is 3/4 of the way from 40 to 120 so the crossing is 1/4 of a sample before the trigger sample
+    uint8_t rising[] = {40, 120, 130};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 100, 1, 0);
+    scanner.last_sample_value = rising[0];
+    TASSERT(scanner.scan(&scanner, rising, sizeof(rising)) == 1);
+    TASSERT(scoppy_trigger_crossing_fraction(&scanner, rising, 1, scanner.last_sample_value) == 16384);
+
+    // Exactly on the level
+    uint8_t on_level[] = {90, 100};
+    TASSERT(scoppy_trigger_crossing_fraction(&scanner, on_level, 1, 0) == 0);
+
+    // The sample before the first one in the chunk comes from the previous chunk
+    scanner.last_sample_value = 99;
+    uint8_t first[] = {101, 110};
+    TASSERT(scanner.scan(&scanner, first, sizeof(first)) == 0);
+    TASSERT(scanner.last_sample_value == 99);
+    TASSERT(scoppy_trigger_crossing_fraction(&scanner, first, 0, scanner.last_sample_value) == 32768);
+
+    // Falling edge on the second channel. 160 is 1/5 of the way from 200 to 0 so the crossing is 4/5 of a sample before.
+    uint8_t falling[] = {0, 200, 0, 0, 0, 0};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_FALLING_EDGE, 160, 2, 1);
+    scanner.last_sample_value = 200;
+    TASSERT(scanner.scan(&scanner, falling, 3) == 1);
+    TASSERT(scoppy_trigger_crossing_fraction(&scanner, falling, 1, scanner.last_sample_value) == 52429);
+
+    // The biggest fraction is still less than a whole sample
+    uint8_t big_step[] = {0, 255};
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_RISING_EDGE, 1, 1, 0);
+    TASSERT(scoppy_trigger_crossing_fraction(&scanner, big_step, 1, 0) == 65279);
+
+    // Not for the other trigger types
+    scoppy_trigger_scanner_init(&scanner, TRIGGER_TYPE_PULSE_WIDTH, 100, 1, 0);
+    TASSERT(scoppy_trigger_crossing_fraction(&scanner, rising, 1, 0) == 0);
+
+    printf("OK\n");
+}
+
+void run_scoppy_trigger_tests() {
+    TPRINTF("run_scoppy_trigger_tests...\n");
+    trigger_basic_test();
+    trigger_random_test();
+    trigger_hysteresis_test();
+    trigger_hysteresis_random_test();
+    trigger_restart_test();
+    trigger_crossing_fraction_test();
+}
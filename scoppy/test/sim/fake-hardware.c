@@ -0,0 +1,677 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "pico/util/queue.h"
+
+// my stuff
+#include "scoppy-adc-timing.h"
+#include "sim-hardware.h"
+
+static struct sim_hardware_config config;
+static struct sim_hardware_stats stats;
+
+static uint64_t now_ns = 0;
+static bool in_irq = false;
+static bool irqs_disabled = false;
+static uint32_t rng_state = 1;
+
+static uint32_t next_random() {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+//
+// ADC
+//
+
+static adc_hw_t fake_adc_hw;
+adc_hw_t *adc_hw = &fake_adc_hw;
+
+static bool adc_running = false;
+static uint32_t adc_cycles_per_conversion = SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION;
+static uint64_t adc_start_ns = 0;
+// The number of conversions when the adc was stopped
+static uint64_t adc_stopped_count = 0;
+// The conversions from previous runs (for the stats)
+static uint64_t adc_previous_runs_count = 0;
+// The round robin inputs in the order that they are converted
+static uint8_t adc_inputs[5];
+static int adc_num_inputs = 1;
+// The next conversion that hasn't been taken by a dma channel
+static uint64_t adc_next = 0;
+
+// The number of conversions that have finished by the given time
+static uint64_t adc_count_at(uint64_t t) {
+    if (!adc_running) {
+        return adc_stopped_count;
+    }
+    return (t - adc_start_ns) * (SCOPPY_ADC_CLOCK_HZ / 1000000u) / ((uint64_t)adc_cycles_per_conversion * 1000u);
+}
+
+uint64_t sim_adc_time_ns(uint64_t conversion) {
+    // rounded up so that adc_count_at(sim_adc_time_ns(n)) == n + 1
+    uint64_t cycles_x1000 = (conversion + 1) * adc_cycles_per_conversion * 1000u;
+    uint64_t per_us = SCOPPY_ADC_CLOCK_HZ / 1000000u;
+    return adc_start_ns + (cycles_x1000 + per_us - 1) / per_us;
+}
+
+uint64_t sim_adc_num_conversions() { return adc_count_at(now_ns); }
+
+uint8_t sim_adc_input(uint64_t conversion) { return adc_inputs[conversion % adc_num_inputs]; }
+
+uint8_t sim_adc_value(uint64_t conversion) {
+    if (config.waveform == NULL) {
+        return 0;
+    }
+    return config.waveform(config.waveform_arg, sim_adc_input(conversion), sim_adc_time_ns(conversion));
+}
+
+void adc_init(void) {
+    adc_run(false);
+    fake_adc_hw.cs = ADC_CS_READY_BITS | 1u;
+    fake_adc_hw.div = 0;
+    adc_cycles_per_conversion = SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION;
+}
+
+void adc_gpio_init(uint gpio) {}
+
+void adc_select_input(uint input) { hw_write_masked(&fake_adc_hw.cs, input << ADC_CS_AINSEL_LSB, ADC_CS_AINSEL_BITS); }
+
+void adc_set_round_robin(uint input_mask) { hw_write_masked(&fake_adc_hw.cs, input_mask << ADC_CS_RROBIN_LSB, ADC_CS_RROBIN_BITS); }
+
+void adc_set_clkdiv(float clkdiv) {
+    fake_adc_hw.div = (uint32_t)clkdiv << 8;
+    uint32_t cycles = (uint32_t)clkdiv + 1;
+    adc_cycles_per_conversion = cycles < SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION ? SCOPPY_ADC_MIN_CYCLES_PER_CONVERSION : cycles;
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {
+    // Only 8 bit samples are simulated
+    assert(byte_shift);
+}
+
+void adc_fifo_drain(void) { adc_next = adc_count_at(now_ns); }
+
+void adc_run(bool run) {
+    if (run == adc_running) {
+        return;
+    }
+
+    if (run) {
+        // Round robin starts with the selected input
+        uint32_t mask = (fake_adc_hw.cs & ADC_CS_RROBIN_BITS) >> ADC_CS_RROBIN_LSB;
+        uint32_t input = (fake_adc_hw.cs & ADC_CS_AINSEL_BITS) >> ADC_CS_AINSEL_LSB;
+        adc_num_inputs = 0;
+        if (mask == 0) {
+            adc_inputs[adc_num_inputs++] = input;
+        } else {
+            for (int i = 0; i < 5; i++) {
+                uint8_t candidate = (input + i) % 5;
+                if (mask & (1u << candidate)) {
+                    adc_inputs[adc_num_inputs++] = candidate;
+                }
+            }
+        }
+
+        adc_previous_runs_count += adc_stopped_count;
+        adc_stopped_count = 0;
+        adc_next = 0;
+        adc_start_ns = now_ns;
+        adc_running = true;
+        fake_adc_hw.cs |= 0x8u;
+    } else {
+        adc_stopped_count = adc_count_at(now_ns);
+        adc_running = false;
+        fake_adc_hw.cs &= ~0x8u;
+    }
+}
+
+//
+// Memory written by the dma. Used to work out which conversion is in a byte that's sent to the app.
+//
+
+struct extent {
+    uintptr_t addr;
+    uint32_t len;
+    uint64_t conversion;
+};
+
+#define MAX_EXTENTS 65536
+static struct extent extents[MAX_EXTENTS];
+// The total number of extents added. The newest is extents[(num_extents - 1) % MAX_EXTENTS].
+static uint64_t num_extents = 0;
+
+static void add_extent(uintptr_t addr, uint64_t conversion) {
+    if (num_extents > 0) {
+        // Only the newest extent is extended so that a newer write always shadows an older one
+        struct extent *last = &extents[(num_extents - 1) % MAX_EXTENTS];
+        if (last->addr + last->len == addr && last->conversion + last->len == conversion) {
+            last->len++;
+            return;
+        }
+    }
+
+    struct extent *e = &extents[num_extents++ % MAX_EXTENTS];
+    e->addr = addr;
+    e->len = 1;
+    e->conversion = conversion;
+}
+
+int64_t sim_dma_conversion_at(const uint8_t *addr, uint32_t *len) {
+    uintptr_t a = (uintptr_t)addr;
+    uint64_t oldest = num_extents > MAX_EXTENTS ? num_extents - MAX_EXTENTS : 0;
+    for (uint64_t i = num_extents; i > oldest; i--) {
+        struct extent *e = &extents[(i - 1) % MAX_EXTENTS];
+        if (a >= e->addr && a < e->addr + e->len) {
+            *len = (uint32_t)(e->addr + e->len - a);
+            return (int64_t)(e->conversion + (a - e->addr));
+        }
+    }
+    *len = 0;
+    return -1;
+}
+
+//
+// DMA
+//
+
+#define NUM_DMA_CHANNELS 12
+
+struct fake_dma_channel {
+    bool claimed;
+    dma_channel_config config;
+    dma_channel_hw_t hw;
+    // The value that transfer_count is reloaded with when the channel is triggered
+    uint32_t trans_count_reload;
+    bool busy;
+    bool irq0_enabled;
+    bool irq1_enabled;
+    bool irq_pending;
+    uint64_t irq_raised_ns;
+    uint64_t irq_due_ns;
+    // The channel restarted before its interrupt handler was called. Its writes are thrown away until it's given a
+    // new write address.
+    bool overrunning;
+};
+
+static struct fake_dma_channel dma_channels[NUM_DMA_CHANNELS];
+
+static dma_hw_t fake_dma_hw;
+dma_hw_t *dma_hw = &fake_dma_hw;
+
+static irq_handler_t irq_handlers[32];
+static bool irq_line_enabled[32];
+
+static inline bool reads_adc(struct fake_dma_channel *ch) { return ch->hw.read_addr == (uintptr_t)&fake_adc_hw.fifo; }
+
+static inline uintptr_t next_write_addr(struct fake_dma_channel *ch, uintptr_t addr) {
+    if (!ch->config.write_increment) {
+        return addr;
+    }
+    if (ch->config.ring_sel_write && ch->config.ring_size_bits > 0) {
+        uintptr_t mask = ((uintptr_t)1 << ch->config.ring_size_bits) - 1;
+        return (addr & ~mask) | ((addr + 1) & mask);
+    }
+    return addr + 1;
+}
+
+// Take the conversions that the adc has finished (up to the transfer count)
+static void flush(struct fake_dma_channel *ch) {
+    if (!ch->busy || !reads_adc(ch)) {
+        return;
+    }
+
+    uint64_t available = adc_count_at(now_ns) - adc_next;
+    uint32_t n = available < ch->hw.transfer_count ? (uint32_t)available : ch->hw.transfer_count;
+    if (ch->overrunning) {
+        stats.num_overrun_bytes += n;
+        adc_next += n;
+    } else {
+        uintptr_t addr = ch->hw.write_addr;
+        for (uint32_t i = 0; i < n; i++) {
+            *(volatile uint8_t *)addr = sim_adc_value(adc_next);
+            add_extent(addr, adc_next);
+            adc_next++;
+            addr = next_write_addr(ch, addr);
+        }
+        ch->hw.write_addr = addr;
+    }
+    ch->hw.transfer_count -= n;
+}
+
+static void trigger(uint channel) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    if (ch->busy) {
+        return;
+    }
+
+    if (ch->irq_pending) {
+        // The handler hasn't had a chance to give the channel somewhere else to write to
+        stats.num_overruns++;
+        ch->overrunning = true;
+    }
+
+    if (reads_adc(ch) && adc_running) {
+        // The adc fifo only holds 4 conversions
+        uint64_t count = adc_count_at(now_ns);
+        if (count > adc_next + 4) {
+            stats.num_lost += count - 4 - adc_next;
+            adc_next = count - 4;
+        }
+    }
+
+    ch->hw.transfer_count = ch->trans_count_reload;
+    ch->busy = ch->hw.transfer_count > 0;
+}
+
+// When the busy channel will have taken its last conversion (or UINT64_MAX if it's not being paced by the adc)
+static uint64_t completion_ns(struct fake_dma_channel *ch) {
+    if (!ch->busy || !reads_adc(ch) || !adc_running) {
+        return UINT64_MAX;
+    }
+    return sim_adc_time_ns(adc_next + ch->hw.transfer_count - 1);
+}
+
+static void complete(uint channel) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    flush(ch);
+    assert(ch->hw.transfer_count == 0);
+    ch->busy = false;
+
+    if (ch->irq0_enabled || ch->irq1_enabled) {
+        if (!ch->irq_pending) {
+            ch->irq_pending = true;
+            ch->irq_raised_ns = now_ns;
+            ch->irq_due_ns = now_ns + config.irq_latency_ns + (config.irq_jitter_ns > 0 ? next_random() % (config.irq_jitter_ns + 1) : 0);
+        }
+    }
+
+    if (ch->config.chain_to != channel) {
+        trigger(ch->config.chain_to);
+    }
+}
+
+static void deliver_irq(uint channel) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    ch->irq_pending = false;
+
+    uint64_t latency = now_ns - ch->irq_raised_ns;
+    if (latency > stats.max_irq_latency_ns) {
+        stats.max_irq_latency_ns = (uint32_t)latency;
+    }
+    stats.num_irqs++;
+
+    uint line = ch->irq0_enabled ? DMA_IRQ_0 : DMA_IRQ_1;
+    if (irq_line_enabled[line] && irq_handlers[line] != NULL) {
+        in_irq = true;
+        irq_handlers[line]();
+        in_irq = false;
+    }
+}
+
+// The time of the next completion or deliverable interrupt. Sets channel and is_irq.
+static uint64_t next_event_ns(int *channel, bool *is_irq) {
+    uint64_t next = UINT64_MAX;
+    *channel = -1;
+    *is_irq = false;
+    for (int i = 0; i < NUM_DMA_CHANNELS; i++) {
+        uint64_t t = completion_ns(&dma_channels[i]);
+        if (t < next) {
+            next = t;
+            *channel = i;
+        }
+    }
+
+    if (!in_irq && !irqs_disabled) {
+        for (int i = 0; i < NUM_DMA_CHANNELS; i++) {
+            struct fake_dma_channel *ch = &dma_channels[i];
+            // At the same time as a completion the completion goes first
+            if (ch->irq_pending && ch->irq_due_ns < next) {
+                next = ch->irq_due_ns;
+                *channel = i;
+                *is_irq = true;
+            }
+        }
+    }
+    return next;
+}
+
+static void run_until(uint64_t t) {
+    for (;;) {
+        int channel;
+        bool is_irq;
+        uint64_t next = next_event_ns(&channel, &is_irq);
+        if (next > t) {
+            break;
+        }
+
+        // An interrupt might be overdue if interrupts were disabled
+        if (next > now_ns) {
+            now_ns = next;
+        }
+
+        if (is_irq) {
+            deliver_irq(channel);
+        } else {
+            complete(channel);
+        }
+    }
+
+    if (t > now_ns) {
+        now_ns = t;
+    }
+}
+
+// The cpu is busy. Interrupt handlers don't take any (simulated) time.
+static void charge(uint64_t ns) {
+    if (!in_irq) {
+        run_until(now_ns + ns);
+    }
+}
+
+// The cpu is spinning waiting for something to happen. Nothing can happen until the next dma event.
+static void idle() {
+    if (in_irq) {
+        return;
+    }
+
+    int channel;
+    bool is_irq;
+    uint64_t next = next_event_ns(&channel, &is_irq);
+    run_until(next == UINT64_MAX ? now_ns + 1000u : next);
+}
+
+int dma_claim_unused_channel(bool required) {
+    for (int i = 0; i < NUM_DMA_CHANNELS; i++) {
+        if (!dma_channels[i].claimed) {
+            dma_channels[i].claimed = true;
+            return i;
+        }
+    }
+    assert(!required);
+    return -1;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    assert(channel < NUM_DMA_CHANNELS);
+    flush(&dma_channels[channel]);
+    return &dma_channels[channel].hw;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c;
+    memset(&c, 0, sizeof(c));
+    c.chain_to = channel;
+    c.dreq = DREQ_FORCE;
+    c.read_increment = true;
+    c.write_increment = false;
+    c.transfer_data_size = DMA_SIZE_32;
+    return c;
+}
+
+dma_channel_config dma_get_channel_config(uint channel) { return dma_channels[channel].config; }
+
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) { c->chain_to = chain_to; }
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) { c->dreq = dreq; }
+
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_sel_write = write;
+    c->ring_size_bits = size_bits;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) { c->read_increment = incr; }
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) { c->write_increment = incr; }
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    // Only byte transfers are simulated
+    assert(size == DMA_SIZE_8);
+    c->transfer_data_size = size;
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *c, bool trigger_now) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    flush(ch);
+    ch->config = *c;
+    if (trigger_now) {
+        trigger(channel);
+    }
+    charge(config.ns_per_call);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger_now) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    flush(ch);
+    ch->hw.read_addr = (uintptr_t)read_addr;
+    if (trigger_now) {
+        trigger(channel);
+    }
+    charge(config.ns_per_call);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger_now) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    flush(ch);
+    ch->hw.write_addr = (uintptr_t)write_addr;
+    ch->overrunning = false;
+    if (trigger_now) {
+        trigger(channel);
+    }
+    charge(config.ns_per_call);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger_now) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    flush(ch);
+    ch->trans_count_reload = trans_count;
+    if (!ch->busy) {
+        ch->hw.transfer_count = trans_count;
+    }
+    if (trigger_now) {
+        trigger(channel);
+    }
+    charge(config.ns_per_call);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *c, volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger_now) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_config(channel, c, trigger_now);
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) { dma_channels[channel].irq0_enabled = enabled; }
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) { dma_channels[channel].irq1_enabled = enabled; }
+
+void dma_channel_start(uint channel) {
+    trigger(channel);
+    charge(config.ns_per_call);
+}
+
+void dma_channel_abort(uint channel) {
+    struct fake_dma_channel *ch = &dma_channels[channel];
+    flush(ch);
+    ch->busy = false;
+    ch->irq_pending = false;
+    charge(config.ns_per_call);
+}
+
+bool dma_channel_is_busy(uint channel) {
+    charge(config.ns_per_call);
+    return dma_channels[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    while (dma_channels[channel].busy && completion_ns(&dma_channels[channel]) != UINT64_MAX) {
+        idle();
+    }
+    // A channel that isn't being paced by anything would never finish
+    dma_channels[channel].busy = false;
+}
+
+//
+// IRQ
+//
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) { irq_handlers[num] = handler; }
+
+void irq_set_enabled(uint num, bool enabled) { irq_line_enabled[num] = enabled; }
+
+uint32_t save_and_disable_interrupts(void) {
+    uint32_t status = irqs_disabled ? 0u : 1u;
+    irqs_disabled = true;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) { irqs_disabled = status == 0u; }
+
+//
+// Time
+//
+
+absolute_time_t get_absolute_time(void) {
+    charge(config.ns_per_call);
+    absolute_time_t t = {now_ns / 1000u};
+    return t;
+}
+
+uint32_t time_us_32(void) {
+    charge(config.ns_per_call);
+    return (uint32_t)(now_ns / 1000u);
+}
+
+uint64_t time_us_64(void) {
+    charge(config.ns_per_call);
+    return now_ns / 1000u;
+}
+
+void sleep_ms(uint32_t ms) { charge((uint64_t)ms * 1000000u); }
+
+void sleep_us(uint64_t us) { charge(us * 1000u); }
+
+void busy_wait_us(uint64_t us) { charge(us * 1000u); }
+
+void tight_loop_contents(void) { idle(); }
+
+uint32_t clock_get_hz(enum clock_index clk_index) { return clk_index == clk_adc ? SCOPPY_ADC_CLOCK_HZ : 125000000u; }
+
+//
+// Queue
+//
+
+void queue_init(queue_t *q, uint element_size, uint element_count) {
+    free(q->data);
+    // One spare slot so that a full queue can be told from an empty one
+    q->data = calloc(element_count + 1, element_size);
+    q->wptr = 0;
+    q->rptr = 0;
+    q->element_size = element_size;
+    q->element_count = element_count;
+}
+
+uint queue_get_level(queue_t *q) {
+    int32_t level = (int32_t)q->wptr - (int32_t)q->rptr;
+    if (level < 0) {
+        level += q->element_count + 1;
+    }
+    return (uint)level;
+}
+
+bool queue_is_empty(queue_t *q) { return q->wptr == q->rptr; }
+
+bool queue_try_add(queue_t *q, const void *data) {
+    uint16_t next_wptr = (q->wptr + 1) % (q->element_count + 1);
+    if (next_wptr == q->rptr) {
+        return false;
+    }
+    memcpy(q->data + (q->wptr * q->element_size), data, q->element_size);
+    q->wptr = next_wptr;
+
+    uint level = queue_get_level(q);
+    if (level > stats.max_queue_level) {
+        stats.max_queue_level = level;
+    }
+    return true;
+}
+
+bool queue_try_remove(queue_t *q, void *data) {
+    if (queue_is_empty(q)) {
+        // The caller is polling the queue
+        idle();
+        return false;
+    }
+    memcpy(data, q->data + (q->rptr * q->element_size), q->element_size);
+    q->rptr = (q->rptr + 1) % (q->element_count + 1);
+    charge(config.ns_per_call + config.ns_per_dequeue);
+    return true;
+}
+
+//
+// Control
+//
+
+void sim_hardware_set_config(const struct sim_hardware_config *c) { config = *c; }
+
+void sim_hardware_reset(const struct sim_hardware_config *c) {
+    config = *c;
+    memset(&stats, 0, sizeof(stats));
+    now_ns = 0;
+    in_irq = false;
+    irqs_disabled = false;
+    rng_state = 1;
+
+    adc_running = false;
+    adc_stopped_count = 0;
+    adc_previous_runs_count = 0;
+    adc_next = 0;
+    adc_init();
+
+    memset(dma_channels, 0, sizeof(dma_channels));
+    memset(irq_handlers, 0, sizeof(irq_handlers));
+    memset(irq_line_enabled, 0, sizeof(irq_line_enabled));
+    num_extents = 0;
+}
+
+void sim_hardware_get_stats(struct sim_hardware_stats *s) {
+    *s = stats;
+    s->num_converted = adc_previous_runs_count + adc_count_at(now_ns);
+}
+
+uint64_t sim_time_ns() { return now_ns; }
+
+void sim_advance_ns(uint64_t ns) { charge(ns); }
@@ -0,0 +1,49 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "hardware/address_mapped.h"
+#include "pico/types.h"
+
+#define ADC_CS_READY_BITS 0x00000100u
+#define ADC_CS_AINSEL_LSB 12
+#define ADC_CS_AINSEL_BITS 0x00007000u
+#define ADC_CS_RROBIN_LSB 16
+#define ADC_CS_RROBIN_BITS 0x001f0000u
+
+typedef struct {
+    volatile uint32_t cs;
+    volatile uint32_t result;
+    volatile uint32_t fcs;
+    volatile uint32_t fifo;
+    volatile uint32_t div;
+} adc_hw_t;
+
+extern adc_hw_t *adc_hw;
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+void adc_set_round_robin(uint input_mask);
+void adc_run(bool run);
+void adc_set_clkdiv(float clkdiv);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_fifo_drain(void);
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico/types.h"
+
+#define DREQ_ADC 36
+#define DREQ_FORCE 63
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+    uint chain_to;
+    uint dreq;
+    uint ring_size_bits;
+    bool ring_sel_write;
+    bool read_increment;
+    bool write_increment;
+    enum dma_channel_transfer_size transfer_data_size;
+} dma_channel_config;
+
+// The addresses are pointer sized so that they can hold host addresses
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+
+typedef struct {
+    volatile uint32_t intr;
+    volatile uint32_t inte0;
+    volatile uint32_t intf0;
+    volatile uint32_t ints0;
+    volatile uint32_t inte1;
+    volatile uint32_t intf1;
+    volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t *dma_hw;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+dma_channel_config dma_get_channel_config(uint channel);
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger);
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
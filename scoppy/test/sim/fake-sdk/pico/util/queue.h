@@ -0,0 +1,37 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct {
+    uint8_t *data;
+    uint16_t wptr;
+    uint16_t rptr;
+    uint element_size;
+    uint element_count;
+} queue_t;
+
+void queue_init(queue_t *q, uint element_size, uint element_count);
+uint queue_get_level(queue_t *q);
+bool queue_is_empty(queue_t *q);
+bool queue_try_add(queue_t *q, const void *data);
+bool queue_try_remove(queue_t *q, void *data);
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Simulated RP2040 hardware for running the samplers (pico-scoppy-non-cont-sampling.c and
+// pico-scoppy-cont-sampling.c) on a PC. See fake-sdk/
+//
+// Time is simulated and only moves on when the sampler calls into the fake sdk, so a run is deterministic. Spinning
+// (eg. tight_loop_contents()) skips straight to the next dma event and the other calls cost ns_per_call.
+//
+// The adc converts the round robin inputs one after another at the rate set by adc_set_clkdiv() and takes its values
+// from the waveform. The dma channels take the conversions in order and write them to memory. When a channel finishes
+// its transfer count the channel it is chained to starts and its interrupt handler is called irq_latency_ns later.
+// If the chained channel starts again before its own handler has been called (ie. before it has been given a new
+// write address) that's an overrun. On the pico it would write past the end of its chunk. Here the bytes are thrown
+// away until the handler sets the write address.
+//
+
+// The value of the given adc input at the given time (nanoseconds since the sim was reset)
+typedef uint8_t (*sim_waveform_fn)(void *arg, uint8_t input, uint64_t time_ns);
+
+struct sim_hardware_config {
+    // The dma interrupt handlers are called this long after the transfer finishes plus a pseudo random 0 to
+    // irq_jitter_ns
+    uint32_t irq_latency_ns;
+    uint32_t irq_jitter_ns;
+
+    // The cpu time charged for each call into the fake sdk (outside of an interrupt handler)
+    uint32_t ns_per_call;
+
+    // The extra cpu time charged for each item taken off a queue eg. for scanning a chunk for a trigger
+    uint32_t ns_per_dequeue;
+
+    sim_waveform_fn waveform;
+    void *waveform_arg;
+};
+
+struct sim_hardware_stats {
+    // Conversions by the adc
+    uint64_t num_converted;
+    // Conversions that were lost because no dma channel took them before the adc fifo overflowed
+    uint64_t num_lost;
+    // The number of times that a dma channel restarted before its interrupt handler was called
+    uint32_t num_overruns;
+    // Bytes thrown away because of an overrun
+    uint64_t num_overrun_bytes;
+    uint32_t num_irqs;
+    uint32_t max_irq_latency_ns;
+    uint32_t max_queue_level;
+};
+
+void sim_hardware_reset(const struct sim_hardware_config *config);
+// Change the config without resetting anything
+void sim_hardware_set_config(const struct sim_hardware_config *config);
+void sim_hardware_get_stats(struct sim_hardware_stats *stats);
+
+uint64_t sim_time_ns();
+// Pass the time as if the cpu was busy eg. writing to USB. The interrupt handlers are called as normal.
+void sim_advance_ns(uint64_t ns);
+
+// The adc conversions since it was last started. Conversion n is of input sim_adc_input(n) at sim_adc_time_ns(n).
+uint64_t sim_adc_num_conversions();
+uint8_t sim_adc_input(uint64_t conversion);
+uint64_t sim_adc_time_ns(uint64_t conversion);
+uint8_t sim_adc_value(uint64_t conversion);
+
+// The conversion that the dma wrote to addr (if it hasn't been written to since) or -1 if the dma didn't write it.
+// len is set to the number of bytes from addr that were written by the dma in consecutive conversions.
+int64_t sim_dma_conversion_at(const uint8_t *addr, uint32_t *len);
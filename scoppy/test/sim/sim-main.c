@@ -0,0 +1,203 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+// my stuff
+#include "scoppy.h"
+
+#include "pico-scoppy-samples.h"
+
+#include "sim-sampler.h"
+#include "sim-waveform.h"
+
+//
+// Runs the samplers on the simulated hardware and reports what the app would have seen:
+//
+//   pico-scoppy-sim [recording sample_rate]
+//
+// The optional recording is a file of 8 bit samples that replaces the synthetic waveforms.
+//
+
+static struct sim_sine_waveform sine = {1000, 120};
+static struct sim_pulse_waveform pulses = {3300000, 20000, 30, 220};
+static struct sim_pulse_waveform rare_pulses = {50000000, 20000, 30, 220};
+static struct sim_recorded_waveform recording;
+
+static void print_header() {
+    printf("%-28s %7s %6s %5s %5s %5s %5s %8s %7s %6s %5s %6s %7s %8s %7s\n", "scenario", "frames", "fps", "tmo", "badf", "badt", "disc", "trig", "missed%",
+           "dead%", "maxq", "ovrrun", "lost", "irq_us", "unscan%");
+}
+
+static void print_result(const char *name, const struct sim_result *r) {
+    double seconds = r->duration_ns / 1e9;
+    double missed = r->num_trigger_points > 0 ? 100.0 * (r->num_trigger_points - r->num_trigger_points_sent) / r->num_trigger_points : 0.0;
+    double dead = r->num_conversions > 0 ? 100.0 * (r->num_conversions - r->num_conversions_sent) / r->num_conversions : 0.0;
+    double unscanned = r->num_frames > 0 ? r->sum_unscanned_permille / (10.0 * r->num_frames) : 0.0;
+    uint32_t max_queue = r->telemetry.max_trigger_queue_size > r->hardware.max_queue_level ? r->telemetry.max_trigger_queue_size : r->hardware.max_queue_level;
+    printf("%-28s %7lu %6.1f %5lu %5lu %5lu %5lu %8llu %7.2f %6.2f %5lu %6lu %7llu %8.1f %7.1f\n", name, (unsigned long)r->num_frames,
+           r->num_frames / seconds, (unsigned long)r->num_timeouts, (unsigned long)r->num_bad_frames, (unsigned long)r->num_bad_triggers,
+           (unsigned long)r->num_discontinuities,
+           (unsigned long long)r->num_trigger_points, missed, dead, (unsigned long)max_queue, (unsigned long)r->hardware.num_overruns,
+           (unsigned long long)r->hardware.num_lost, r->hardware.max_irq_latency_ns / 1000.0, unscanned);
+}
+
+static void init_scenario(struct sim_scenario *s, const char *name) {
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->sample_rate_per_channel = 500000;
+    s->enabled_channels = 0x01;
+    s->trigger_mode = TRIGGER_MODE_AUTO;
+    s->trigger_channel = 0;
+    s->trigger_type = TRIGGER_TYPE_RISING_EDGE;
+    s->trigger_level = 128;
+    s->run_mode = RUN_MODE_RUN;
+    s->pre_trigger_percent = 50;
+    s->hardware.irq_latency_ns = 2000;
+    s->hardware.irq_jitter_ns = 1000;
+    s->hardware.ns_per_call = 200;
+    s->hardware.waveform = sim_sine_waveform;
+    s->hardware.waveform_arg = &sine;
+    s->scan_ns_per_byte = 10;
+    s->usb_bytes_per_sec = 1000000;
+    s->duration_ms = 2000;
+}
+
+static void run(struct sim_scenario *s) {
+    if (recording.num_samples > 0) {
+        s->hardware.waveform = sim_recorded_waveform;
+        s->hardware.waveform_arg = &recording;
+    }
+
+    struct sim_result r;
+    sim_run(s, &r);
+    print_result(s->name, &r);
+    fflush(stdout);
+}
+
+static void load_recording(const char *path, uint32_t sample_rate) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *samples = malloc(size > 0 ? size : 1);
+    if (size <= 0 || fread(samples, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "can't read %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+
+    recording.samples = samples;
+    recording.num_samples = size;
+    recording.sample_rate = sample_rate;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3) {
+        load_recording(argv[1], (uint32_t)strtoul(argv[2], NULL, 10));
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [recording sample_rate]\n", argv[0]);
+        return 1;
+    }
+
+    print_header();
+
+    struct sim_scenario s;
+
+    init_scenario(&s, "auto 1ch 500k");
+    run(&s);
+
+    init_scenario(&s, "auto 2ch 250k");
+    s.sample_rate_per_channel = 250000;
+    s.enabled_channels = 0x03;
+    s.trigger_channel = 1;
+    run(&s);
+
+    init_scenario(&s, "auto 1ch 500k hysteresis 8");
+    s.trigger_hysteresis = 8;
+    run(&s);
+
+    init_scenario(&s, "auto 1ch 500k no frame delay");
+    s.min_frame_interval_us = 1;
+    run(&s);
+
+    init_scenario(&s, "normal 1ch 500k pulses");
+    s.trigger_mode = TRIGGER_MODE_NORMAL;
+    s.hardware.waveform = sim_pulse_waveform;
+    s.hardware.waveform_arg = &pulses;
+    run(&s);
+
+    init_scenario(&s, "auto 1ch 500k slow scan");
+    s.scan_ns_per_byte = 2500;
+    run(&s);
+
+    // Slower than the adc so the oldest chunks have to be skipped. NB. the simulated queue charges the scan time for
+    // every chunk taken off it, including the skipped ones, so this is pessimistic.
+    init_scenario(&s, "auto 1ch 500k overloaded scan");
+    s.hardware.waveform = sim_pulse_waveform;
+    s.hardware.waveform_arg = &rare_pulses;
+    s.scan_ns_per_byte = 6000;
+    run(&s);
+
+    init_scenario(&s, "auto 1ch 500k late irqs");
+    s.hardware.irq_latency_ns = 3000000;
+    s.hardware.irq_jitter_ns = 2000000;
+    run(&s);
+
+    init_scenario(&s, "segmented x4 1ch 500k");
+    s.num_segments = 4;
+    s.trigger_mode = TRIGGER_MODE_NORMAL;
+    s.hardware.waveform = sim_pulse_waveform;
+    s.hardware.waveform_arg = &pulses;
+    run(&s);
+
+    init_scenario(&s, "single 1ch 500k");
+    s.run_mode = RUN_MODE_SINGLE;
+    s.frame_samples_per_channel = SINGLE_SHOT_TOTAL_BYTES_TO_SEND;
+    run(&s);
+
+    init_scenario(&s, "roll 2ch 10k");
+    s.sample_rate_per_channel = 10000;
+    s.enabled_channels = 0x03;
+    s.continuous = true;
+    s.trigger_mode = TRIGGER_MODE_NONE;
+    run(&s);
+
+    init_scenario(&s, "stream 1ch 500k 1MB/s");
+    s.run_mode = RUN_MODE_STREAM;
+    s.trigger_mode = TRIGGER_MODE_NONE;
+    run(&s);
+
+    init_scenario(&s, "stream 1ch 500k 400kB/s");
+    s.run_mode = RUN_MODE_STREAM;
+    s.trigger_mode = TRIGGER_MODE_NONE;
+    s.usb_bytes_per_sec = 400000;
+    run(&s);
+
+    return 0;
+}
@@ -0,0 +1,522 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/adc.h"
+#include "pico/stdlib.h"
+
+// my stuff
+#include "scoppy-adc-timing.h"
+#include "scoppy-frame-queue.h"
+#include "scoppy-message.h"
+#include "scoppy-outgoing.h"
+#include "scoppy-util/number.h"
+#include "scoppy.h"
+
+#include "pico-scoppy-cont-sampling.h"
+#include "pico-scoppy-non-cont-sampling.h"
+#include "pico-scoppy-samples.h"
+
+#include "sim-sampler.h"
+
+//
+// The parts of pico-scoppy-samples.c that the samplers use
+//
+
+static struct sampling_params params1, params2;
+struct sampling_params *active_params = &params1;
+struct sampling_params *dormant_params = &params2;
+
+struct scoppy_telemetry pico_scoppy_telemetry;
+
+// When the run ends. The samplers see it as a restart.
+static uint64_t run_end_ns = 0;
+
+bool pico_scoppy_is_sampler_restart_required() { return sim_time_ns() >= run_end_ns; }
+
+//
+// The USB link. Like the firmware, everything that the sampler (core1) writes goes through a frame queue. core0 writes
+// the queued messages in the background and the sampler only waits for it when it queues a message before the
+// previous one has been written (see pico_scoppy_queue_samples_msg()) or when it waits for everything to be written.
+//
+
+static uint32_t usb_bytes_per_sec = 0;
+// When core0 will have written everything queued so far
+static uint64_t usb_idle_ns = 0;
+// When the last samples message will have been written
+static uint64_t last_msg_written_ns = 0;
+static uint64_t num_bytes_written = 0;
+
+static int count_bytes(const struct scoppy_iovec *iov, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].len;
+    }
+    return total;
+}
+
+// The same size as in pico-scoppy-samples.c
+#define FRAME_QUEUE_SIZE 16
+static struct scoppy_frame_desc frame_queue_descs[FRAME_QUEUE_SIZE];
+static struct scoppy_frame_queue frame_queue;
+
+static int queued_bytes = 0;
+
+// core0's write_serial_v
+static int usb_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    int total = count_bytes(iov, count);
+    queued_bytes += total;
+    return total;
+}
+
+static void wait_until(uint64_t t) {
+    uint64_t now = sim_time_ns();
+    if (t > now) {
+        sim_advance_ns(t - now);
+    }
+}
+
+// Returns when the bytes will have been written
+static uint64_t queue_usb_write(uint32_t num_bytes) {
+    num_bytes_written += num_bytes;
+    uint64_t start = usb_idle_ns > sim_time_ns() ? usb_idle_ns : sim_time_ns();
+    uint64_t duration = usb_bytes_per_sec == 0 ? 0 : (uint64_t)num_bytes * 1000000000u / usb_bytes_per_sec;
+    usb_idle_ns = start + duration;
+    return usb_idle_ns;
+}
+
+// Like pico_scoppy_queue_write_serial_v(). core0 takes the message off the queue straight away (the time it takes to
+// write it is accounted for by queue_usb_write()) so the queue is never full. A message that can't be queued at all
+// (eg. its header is too big) would hang the firmware so it stops the sim. Returns when it will have been written.
+static uint64_t queue_frame(const struct scoppy_iovec *iov, int count) {
+    if (!scoppy_frame_queue_push_v(&frame_queue, iov, count)) {
+        fprintf(stderr, "sim: core1 can't queue a message with a %u byte header\n", (unsigned)iov[0].len);
+        abort();
+    }
+
+    queued_bytes = 0;
+    scoppy_frame_queue_write(&frame_queue, usb_write_serial_v, FRAME_QUEUE_SIZE);
+    return queue_usb_write(queued_bytes);
+}
+
+//
+// Checking what's sent against the conversions that the dma wrote
+//
+
+struct interval {
+    uint64_t start;
+    uint64_t end;
+};
+
+static struct interval *sent = NULL;
+static uint32_t num_sent = 0;
+static uint32_t max_sent = 0;
+
+static void add_sent(uint64_t start, uint64_t end) {
+    if (num_sent > 0 && sent[num_sent - 1].end == start) {
+        sent[num_sent - 1].end = end;
+        return;
+    }
+    if (num_sent == max_sent) {
+        max_sent = max_sent == 0 ? 1024 : max_sent * 2;
+        sent = realloc(sent, max_sent * sizeof(*sent));
+    }
+    sent[num_sent].start = start;
+    sent[num_sent].end = end;
+    num_sent++;
+}
+
+static int compare_intervals(const void *a, const void *b) {
+    const struct interval *ia = a, *ib = b;
+    return ia->start < ib->start ? -1 : (ia->start > ib->start ? 1 : 0);
+}
+
+// Sort and merge. Returns the number of conversions covered.
+static uint64_t merge_sent() {
+    qsort(sent, num_sent, sizeof(*sent), compare_intervals);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < num_sent; i++) {
+        if (n > 0 && sent[i].start <= sent[n - 1].end) {
+            if (sent[i].end > sent[n - 1].end) {
+                sent[n - 1].end = sent[i].end;
+            }
+        } else {
+            sent[n++] = sent[i];
+        }
+    }
+    num_sent = n;
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < num_sent; i++) {
+        total += sent[i].end - sent[i].start;
+    }
+    return total;
+}
+
+// The frame being sent
+struct frame {
+    bool started;
+    bool bad;
+    int32_t trigger_idx;
+    // From the samples message info (0 if there wasn't any)
+    uint16_t trigger_fraction;
+    int64_t first_conversion;
+    int64_t next_conversion;
+};
+
+static struct frame frame;
+// Roll and stream mode. The conversion that the next samples message should start with (-1 if we don't know).
+static int64_t stream_next_conversion = -1;
+static struct sim_result *result;
+static const struct sim_scenario *scenario;
+
+static bool is_trigger_point(uint64_t conversion) {
+    uint8_t num_channels = active_params->num_enabled_channels;
+    if (conversion < num_channels || sim_adc_input(conversion) != scenario->trigger_channel) {
+        return false;
+    }
+
+    uint8_t last = sim_adc_value(conversion - num_channels);
+    uint8_t current = sim_adc_value(conversion);
+    uint8_t level = active_params->trigger_level;
+    if (active_params->trigger_type == TRIGGER_TYPE_RISING_EDGE) {
+        return last < level && current >= level;
+    } else {
+        return last > level && current <= level;
+    }
+}
+
+static void end_frame() {
+    if (!frame.started) {
+        return;
+    }
+
+    result->num_frames++;
+    if (frame.bad) {
+        result->num_bad_frames++;
+    }
+
+    if (frame.trigger_idx == -2) {
+        result->num_timeouts++;
+    } else if (frame.trigger_idx >= 0 && frame.first_conversion >= 0) {
+        // The index of the trigger channel within a sample
+        uint8_t num_channels = active_params->num_enabled_channels;
+        uint64_t conversion = frame.first_conversion + (uint64_t)frame.trigger_idx * num_channels;
+        for (int i = 0; i < num_channels && sim_adc_input(conversion) != scenario->trigger_channel; i++) {
+            conversion++;
+        }
+        if (!is_trigger_point(conversion)) {
+            result->num_bad_triggers++;
+        } else {
+            // The crossing should be where the straight line between the samples meets the level
+            double last = sim_adc_value(conversion - num_channels);
+            double current = sim_adc_value(conversion);
+            double expected = (current - active_params->trigger_level) / (current - last);
+            double error = frame.trigger_fraction / 65536.0 - expected;
+            if (error > 1.0 / 65536 || error < -1.0 / 65536) {
+                result->num_bad_triggers++;
+            }
+        }
+    }
+
+    frame.started = false;
+}
+
+// Record the samples in the segments as sent. Bytes that weren't written by the dma are skipped (eg. the headers)
+// unless they're meant to be samples.
+static void track_segments(const struct scoppy_iovec *segments, int num_segments, bool are_samples) {
+    for (int i = 0; i < num_segments; i++) {
+        const uint8_t *p = segments[i].base;
+        uint32_t remaining = segments[i].len;
+        while (remaining > 0) {
+            uint32_t len;
+            int64_t conversion = sim_dma_conversion_at(p, &len);
+            if (conversion < 0) {
+                if (are_samples) {
+                    frame.bad = true;
+                }
+                break;
+            }
+            if (len > remaining) {
+                len = remaining;
+            }
+
+            if (are_samples) {
+                if (frame.first_conversion < 0) {
+                    frame.first_conversion = conversion;
+                } else if (conversion != frame.next_conversion) {
+                    frame.bad = true;
+                }
+                frame.next_conversion = conversion + len;
+            }
+
+            add_sent(conversion, conversion + len);
+            p += len;
+            remaining -= len;
+        }
+    }
+}
+
+// Roll and stream mode write their samples (and logic edges) messages with ctx->write_serial_v rather than
+// pico_scoppy_queue_samples_msg() ie. they wait for each one to be written. Each message is a frame as far as the app is concerned. A message that doesn't follow on from the last one must be
+// flagged as a new record. Returns false if it isn't one of those messages.
+static bool track_stream_msg(const struct scoppy_iovec *iov, int count) {
+    // The header is in the first segment. See prepare_outgoing() in scoppy-outgoing.c.
+    const uint8_t *data = iov[0].base;
+    if (count < 1 || iov[0].len < 7 || data[4] != (uint8_t)(data[3] + 5)) {
+        return false;
+    }
+    uint8_t msg_type = data[3];
+    if (msg_type != SCOPPY_OUTGOING_MSG_TYPE_SAMPLES && msg_type != SCOPPY_OUTGOING_MSG_TYPE_LOGIC_EDGES) {
+        return false;
+    }
+    // The first payload byte has the flags for both messages
+    bool is_new_record = data[6] & 0x01;
+
+    end_frame();
+    frame.started = true;
+    frame.bad = false;
+    frame.trigger_idx = -1;
+    frame.first_conversion = -1;
+    frame.next_conversion = -1;
+    frame.trigger_fraction = 0;
+    if (is_new_record && result->num_frames > 0) {
+        result->num_discontinuities++;
+    }
+
+    track_segments(iov, 1, false);
+    if (msg_type == SCOPPY_OUTGOING_MSG_TYPE_SAMPLES) {
+        track_segments(iov + 1, count - 1, true);
+        if (!is_new_record && stream_next_conversion >= 0 && frame.first_conversion != stream_next_conversion) {
+            frame.bad = true;
+        }
+        stream_next_conversion = frame.next_conversion;
+    } else {
+        // The edges are encoded so we can't tell which conversions they came from
+        track_segments(iov + 1, count - 1, false);
+        stream_next_conversion = -1;
+    }
+    return true;
+}
+
+// Blocking writes (like sampler_write_serial_v() in pico-scoppy-samples.c)
+static int sim_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    if (!track_stream_msg(iov, count)) {
+        track_segments(iov, count, false);
+    }
+    wait_until(queue_frame(iov, count));
+    return count_bytes(iov, count);
+}
+
+// When the last message queued by sim_queue_write_serial_v() will have been written
+static uint64_t queued_msg_written_ns = 0;
+
+// pico_scoppy_queue_write_serial_v() without the wait
+static int sim_queue_write_serial_v(const struct scoppy_iovec *iov, int count) {
+    queued_msg_written_ns = queue_frame(iov, count);
+    return count_bytes(iov, count);
+}
+
+void pico_scoppy_queue_samples_msg(struct scoppy_outgoing *msg, const struct scoppy_samples_msg_info *info, const struct scoppy_iovec *segments,
+                                   int num_segments) {
+    // flags, number of channels, the channel ids, sample rate, trigger index
+    uint8_t flags = msg->payload[0];
+    uint8_t num_channels = msg->payload[1];
+    int32_t trigger_idx = scoppy_int32_from_4_network_bytes(msg->payload + 2 + num_channels + 4);
+
+    if (flags & 0x01) {
+        // new wavepoint record
+        end_frame();
+        frame.started = true;
+        frame.bad = false;
+        frame.trigger_idx = trigger_idx;
+        frame.first_conversion = -1;
+        frame.next_conversion = -1;
+        frame.trigger_fraction = info != NULL ? info->trigger_fraction : 0;
+        if (info != NULL) {
+            result->sum_unscanned_permille += info->unscanned_permille;
+        }
+    }
+    track_segments(segments, num_segments, true);
+
+    scoppy_write_outgoing_samples_msg(sim_queue_write_serial_v, msg, active_params->samples_msg_version, info, segments, num_segments);
+
+    // The previous message has to be written before it can be released
+    wait_until(last_msg_written_ns);
+    last_msg_written_ns = queued_msg_written_ns;
+    scoppy_release_outgoing(msg);
+}
+
+void pico_scoppy_wait_for_queued_writes() { wait_until(usb_idle_ns); }
+
+//
+// Running a scenario
+//
+
+static void init_params(struct sampling_params *params, const struct sim_scenario *s) {
+    memset(params, 0, sizeof(*params));
+    params->pre = SAMPLING_PARAMS_PRE;
+    params->post = SAMPLING_PARAMS_POST;
+
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+        if (s->enabled_channels & (1u << i)) {
+            params->channels[i].enabled = true;
+            params->num_enabled_channels++;
+        }
+    }
+    params->enabled_channels = s->enabled_channels;
+
+    bool is_stream_mode = s->run_mode == RUN_MODE_STREAM;
+    struct scoppy_adc_timing timing;
+    scoppy_adc_timing_calculate(&timing, s->sample_rate_per_channel, params->num_enabled_channels, s->continuous && !is_stream_mode ? UINT32_MAX : 1);
+    params->preferredSampleRatePerChannelHz = s->sample_rate_per_channel;
+    params->realSampleRatePerChannel = timing.real_sample_rate_per_channel;
+    params->clkdivint = timing.clkdivint;
+    params->decimation = timing.decimation;
+
+    uint32_t samples_per_channel = s->frame_samples_per_channel > 0 ? s->frame_samples_per_channel : BYTES_TO_SEND_PER_CHANNEL;
+    params->num_bytes_to_send = samples_per_channel * params->num_enabled_channels;
+    params->min_num_pre_trigger_bytes = params->num_bytes_to_send * s->pre_trigger_percent / 100;
+    params->min_num_pre_trigger_bytes -= params->min_num_pre_trigger_bytes % params->num_enabled_channels;
+    params->min_num_post_trigger_bytes = params->num_bytes_to_send - params->min_num_pre_trigger_bytes;
+
+    params->trigger_mode = s->trigger_mode;
+    params->trigger_channel = s->trigger_channel;
+    params->trigger_type = s->trigger_type;
+    params->trigger_level = s->trigger_level;
+    params->trigger_hysteresis = s->trigger_hysteresis;
+    params->run_mode = s->run_mode;
+    params->is_logic_mode = false;
+    // Version 1 sends the samples as they are so that every byte can be checked
+    params->samples_msg_version = 1;
+    params->num_segments = s->num_segments;
+
+    if (is_stream_mode) {
+        params->get_samples = pico_scoppy_get_streamed_samples;
+    } else if (s->continuous) {
+        params->get_samples = pico_scoppy_get_continuous_samples;
+    } else {
+        params->get_samples = pico_scoppy_get_non_continuous_samples;
+    }
+}
+
+static void count_trigger_points(struct sim_result *r) {
+    uint64_t num_conversions = sim_adc_num_conversions();
+    uint32_t i = 0;
+    for (uint64_t conversion = 0; conversion < num_conversions; conversion++) {
+        if (!is_trigger_point(conversion)) {
+            continue;
+        }
+        r->num_trigger_points++;
+
+        while (i < num_sent && sent[i].end <= conversion) {
+            i++;
+        }
+        if (i < num_sent && sent[i].start <= conversion) {
+            r->num_trigger_points_sent++;
+        }
+    }
+}
+
+void sim_run(const struct sim_scenario *s, struct sim_result *r) {
+    memset(r, 0, sizeof(*r));
+    result = r;
+    scenario = s;
+
+    sim_hardware_reset(&s->hardware);
+    scoppy_init_outgoing();
+    memset(&pico_scoppy_telemetry, 0, sizeof(pico_scoppy_telemetry));
+
+    usb_bytes_per_sec = s->usb_bytes_per_sec;
+    usb_idle_ns = 0;
+    last_msg_written_ns = 0;
+    queued_msg_written_ns = 0;
+    scoppy_frame_queue_init(&frame_queue, frame_queue_descs, FRAME_QUEUE_SIZE);
+    num_bytes_written = 0;
+    num_sent = 0;
+    memset(&frame, 0, sizeof(frame));
+    stream_next_conversion = -1;
+
+    init_params(active_params, s);
+    *dormant_params = *active_params;
+    scoppy.app.trigger_channel = s->trigger_channel;
+    run_end_ns = (uint64_t)s->duration_ms * 1000000u;
+
+    // The same order as pico_scoppy_init_samplers() so that they get the same dma channels
+    pico_scoppy_continuous_sampling_init();
+    pico_scoppy_non_continuous_sampling_init();
+
+    struct scoppy_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.write_serial_v = sim_write_serial_v;
+
+    bool is_non_continuous = active_params->get_samples == pico_scoppy_get_non_continuous_samples;
+    if (is_non_continuous) {
+        pico_scoppy_start_non_continuous_sampling();
+
+        // Now that the chunk size is known
+        struct sim_hardware_config hardware = s->hardware;
+        hardware.ns_per_dequeue = s->scan_ns_per_byte * pico_scoppy_telemetry.chunk_size;
+        sim_hardware_set_config(&hardware);
+    } else {
+        pico_scoppy_start_continuous_sampling();
+    }
+
+    // Like pico_scoppy_sampling_loop()
+    uint64_t min_interval_ns = (uint64_t)(s->min_frame_interval_us > 0 ? s->min_frame_interval_us : 100000u) * 1000u;
+    uint64_t last_get_samples_ns = 0;
+    bool first = true;
+    while (sim_time_ns() < run_end_ns) {
+        if (!first && active_params->run_mode != RUN_MODE_STREAM) {
+            wait_until(last_get_samples_ns + min_interval_ns);
+        }
+        first = false;
+
+        last_get_samples_ns = sim_time_ns();
+        active_params->get_samples(&ctx);
+
+        if (active_params->run_mode == RUN_MODE_SINGLE && !pico_scoppy_non_continuous_segments_pending()) {
+            break;
+        }
+    }
+    end_frame();
+
+    if (is_non_continuous) {
+        pico_scoppy_stop_non_continuous_sampling();
+    } else {
+        pico_scoppy_stop_continuous_sampling();
+    }
+
+    r->num_conversions = sim_adc_num_conversions();
+    r->num_conversions_sent = merge_sent();
+    if (s->trigger_mode != TRIGGER_MODE_NONE) {
+        count_trigger_points(r);
+    }
+    r->duration_ns = sim_time_ns();
+    r->num_bytes_written = num_bytes_written;
+    sim_hardware_get_stats(&r->hardware);
+    r->telemetry = pico_scoppy_telemetry;
+
+    adc_run(false);
+}
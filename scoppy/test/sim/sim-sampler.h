@@ -0,0 +1,96 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// my stuff
+#include "scoppy-telemetry.h"
+#include "sim-hardware.h"
+
+//
+// Runs the samplers against the simulated hardware (see sim-hardware.h) in place of pico-scoppy-samples.c and
+// checks everything that they send against the conversions that the dma actually wrote.
+//
+
+struct sim_scenario {
+    const char *name;
+
+    // The sampling settings as the app would set them (oscilloscope mode only)
+    uint32_t sample_rate_per_channel;
+    uint8_t enabled_channels;
+    uint8_t trigger_mode;
+    uint8_t trigger_channel;
+    uint8_t trigger_type;
+    uint8_t trigger_level;
+    uint8_t trigger_hysteresis;
+    uint8_t run_mode;
+    // Roll mode (pico_scoppy_get_continuous_samples()). Ignored in stream mode.
+    bool continuous;
+    uint8_t num_segments;
+    // The samples per channel in a frame. 0 for the default.
+    uint32_t frame_samples_per_channel;
+    uint8_t pre_trigger_percent;
+
+    struct sim_hardware_config hardware;
+
+    // The cpu time to scan a chunk for a trigger
+    uint32_t scan_ns_per_byte;
+    // The throughput of the USB link. 0 means unlimited.
+    uint32_t usb_bytes_per_sec;
+    // The shortest time between frames. 0 for the default (the same as pico_scoppy_sampling_loop()).
+    uint32_t min_frame_interval_us;
+
+    uint32_t duration_ms;
+};
+
+struct sim_result {
+    uint32_t num_frames;
+    // Frames sent without a trigger (because none was found before the timeout)
+    uint32_t num_timeouts;
+    // Frames whose samples weren't consecutive conversions (eg. part of the frame was overwritten)
+    uint32_t num_bad_frames;
+    // Frames where the sample at the trigger index isn't a trigger point
+    uint32_t num_bad_triggers;
+    // Roll and stream mode. The frames (messages) that started a new record because samples were dropped.
+    uint32_t num_discontinuities;
+
+    // The trigger points in the waveform and how many of them were in a frame sent to the app
+    uint64_t num_trigger_points;
+    uint64_t num_trigger_points_sent;
+
+    // The adc conversions and how many of them were sent to the app. The rest is dead time.
+    uint64_t num_conversions;
+    uint64_t num_conversions_sent;
+
+    // The unscanned_permille reported with each frame (the part of the trigger search that was skipped because the
+    // scan fell behind)
+    uint64_t sum_unscanned_permille;
+
+    uint64_t duration_ns;
+    uint64_t num_bytes_written;
+
+    struct sim_hardware_stats hardware;
+    struct scoppy_telemetry telemetry;
+};
+
+void sim_run(const struct sim_scenario *scenario, struct sim_result *result);
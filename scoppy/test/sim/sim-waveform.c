@@ -0,0 +1,43 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+// my stuff
+#include "sim-waveform.h"
+
+uint8_t sim_sine_waveform(void *arg, uint8_t input, uint64_t time_ns) {
+    struct sim_sine_waveform *wf = arg;
+    uint64_t frequency = (uint64_t)wf->frequency_hz * (input + 1);
+    // the phase in 1e-9 cycles
+    uint64_t phase = (time_ns * frequency) % 1000000000u;
+    return (uint8_t)lrint(128.0 + wf->amplitude * sin(2.0 * M_PI * (double)phase / 1e9));
+}
+
+uint8_t sim_pulse_waveform(void *arg, uint8_t input, uint64_t time_ns) {
+    struct sim_pulse_waveform *wf = arg;
+    return (time_ns % wf->period_ns) < wf->width_ns ? wf->high : wf->low;
+}
+
+uint8_t sim_recorded_waveform(void *arg, uint8_t input, uint64_t time_ns) {
+    struct sim_recorded_waveform *wf = arg;
+    uint64_t idx = time_ns * wf->sample_rate / 1000000000u;
+    return wf->samples[idx % wf->num_samples];
+}
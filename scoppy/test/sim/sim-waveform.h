@@ -0,0 +1,56 @@
+/*
+ * This file is part of the scoppy-pico project.
+ *
+ * Copyright (C) 2021 FHDM Apps <scoppy@fhdm.xyz>
+ * https://github.com/fhdm-dev
+ *
+ * scoppy-pico is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * scoppy-pico is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with scoppy-pico.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Waveforms for the simulated adc. See sim_waveform_fn in sim-hardware.h
+//
+
+// Each input is a sine wave at a different frequency
+struct sim_sine_waveform {
+    // The frequency of input 0. Input n is (n + 1) times this.
+    uint32_t frequency_hz;
+    uint8_t amplitude;
+};
+
+uint8_t sim_sine_waveform(void *arg, uint8_t input, uint64_t time_ns);
+
+// Short pulses on every input eg. to see how many are missed between frames
+struct sim_pulse_waveform {
+    uint32_t period_ns;
+    uint32_t width_ns;
+    uint8_t low;
+    uint8_t high;
+};
+
+uint8_t sim_pulse_waveform(void *arg, uint8_t input, uint64_t time_ns);
+
+// 8 bit samples recorded at sample_rate (eg. by a real scope) played back on every input. It loops at the end.
+struct sim_recorded_waveform {
+    const uint8_t *samples;
+    size_t num_samples;
+    uint32_t sample_rate;
+};
+
+uint8_t sim_recorded_waveform(void *arg, uint8_t input, uint64_t time_ns);
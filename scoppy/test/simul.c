@@ -90,6 +90,7 @@ void run_scoppy_simulation() {
     struct scoppy_context ctx;
     ctx.read_serial = fake_serial_read;
     ctx.write_serial = fake_serial_write;
+    ctx.write_serial_v = fake_serial_write_v;
     ctx.tight_loop = ctx_tight_loop;
     ctx.sleep_ms = ctx_sleep_ms;
     ctx.debugf = ctx_debugf;